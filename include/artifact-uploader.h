@@ -7,6 +7,9 @@
 #include "domain-types.h"
 #include "payload-holder.h"
 #include "public-util.h"
+#include "request-metrics.h"
+#include "boost/function.hpp"
+#include "boost/shared_ptr.hpp"
 
 namespace prism
 {
@@ -22,6 +25,90 @@ class ArtifactUploader
 public:
     typedef void (ClientConfigCallback)(Client& client);
 
+    // Used by "priority" queue. Artifacts of type with greater priority are
+    // uploaded first, artifacts of the same priority are uploaded in order.
+    struct Priorities
+    {
+        Priorities()
+            : event(3)
+            , count(3)
+            , objectStream(2)
+            , background(1)
+            , flipbook(0)
+        {
+        }
+
+        int event;
+        int count;
+        int objectStream;
+        int background;
+        int flipbook;
+    };
+
+    // Types of artifacts, which replace older artifact of the same type
+    // waiting in queue. Object stream replaces one of the same object and
+    // stream type only.
+    struct Supersedable
+    {
+        Supersedable()
+            : background(false)
+            , objectStream(false)
+            , flipbook(false)
+        {
+        }
+
+        bool background;
+        bool objectStream;
+        bool flipbook;
+    };
+
+    // Decides, whether and when failed upload is retried. Methods are called
+    // from upload threads, possibly concurrently.
+    class RetryPolicy
+    {
+    public:
+        virtual ~RetryPolicy()
+        {
+        }
+
+        // Returns true, if upload, which failed with status, may succeed later
+        virtual bool isRetryable(const Status& status) const = 0;
+
+        // Returns false to drop artifact, which failed to upload numFailures
+        // times in a row and was enqueued ageSec seconds ago
+        virtual bool canRetry(int numFailures, int ageSec) const = 0;
+
+        // Delay before next upload, after numFailures uploads of any artifacts
+        // failed in a row. Server may ask for longer delay by Retry-After.
+        virtual int getDelayMs(int numFailures) const = 0;
+    };
+
+    typedef boost::shared_ptr<RetryPolicy> RetryPolicyPtr;
+
+    // Exponential backoff with full jitter: delay is random in range
+    // [0, min(maxDelayMs, baseDelayMs * 2^(numFailures - 1))], so that many
+    // devices don't retry in lockstep. Network errors and HTTP 408, 429, 500,
+    // 502, 503, 504 are retried. maxAttempts and maxAgeSec limit attempts and
+    // time since artifact is enqueued, 0 means no limit.
+    class ExponentialBackoffRetryPolicy : public RetryPolicy
+    {
+    public:
+        ExponentialBackoffRetryPolicy(int baseDelayMs = 3000,
+                                      int maxDelayMs = 300000,
+                                      int maxAttempts = 0,
+                                      int maxAgeSec = 0);
+
+        bool isRetryable(const Status& status) const;
+        bool canRetry(int numFailures, int ageSec) const;
+        int getDelayMs(int numFailures) const;
+
+    private:
+        int baseDelayMs_;
+        int maxDelayMs_;
+        int maxAttempts_;
+        int maxAgeSec_;
+    };
+
     struct Configuration
     {
         Configuration(const std::string& apiRoot,
@@ -30,7 +117,10 @@ public:
                       size_t maxQueueSize,
                       size_t warnQueueSize,
                       const std::string& queueType = "simple",
-                      int timeoutToCompleteUploadSec = 0)
+                      int timeoutToCompleteUploadSec = 0,
+                      size_t numUploadThreads = 1,
+                      const std::string& queueDir = "",
+                      uint64_t maxQueueDiskSize = 0)
             : apiRoot(apiRoot)
             , apiToken(apiToken)
             , cameraName(cameraName)
@@ -38,6 +128,14 @@ public:
             , warnQueueSize(warnQueueSize)
             , queueType(queueType)
             , timeoutToCompleteUploadSec(timeoutToCompleteUploadSec)
+            , numUploadThreads(numUploadThreads)
+            , queueDir(queueDir)
+            , maxQueueDiskSize(maxQueueDiskSize)
+            , maxQueueFileSize(0)
+            , maxPriorityWaitSec(60)
+            , maxTimeSeriesBatchSize(100)
+            , timeSeriesLingerMs(0)
+            , circuitBreakerThreshold(5)
         {
         }
 
@@ -46,16 +144,158 @@ public:
         std::string cameraName;
         size_t maxQueueSize;
         size_t warnQueueSize;
-        std::string queueType; // "simple"
+        std::string queueType; // "simple", "persistent" or "priority"
         int timeoutToCompleteUploadSec; // 0
+
+        // Number of artifacts uploaded concurrently, each thread has its own
+        // connection. Counts for the same label are still uploaded in order.
+        // More threads help on high latency links.
+        size_t numUploadThreads; // 1
+
+        // "persistent" queue only. Tasks are kept in journal in queueDir and
+        // are uploaded after restart, if they weren't uploaded before exit.
+        // maxQueueSize limits memory, while tasks are limited to
+        // maxQueueDiskSize bytes on disk. Artifact larger than that is
+        // rejected. Payload files are hard-linked into queueDir, they're
+        // copied into journal only if it's on another file system.
+        std::string queueDir;
+        uint64_t maxQueueDiskSize;
+
+        // Not set by constructor. Payload files passed by
+        // makePayloadHolderByReferencingFileAutodelete() don't count against
+        // maxQueueSize, while waiting in queue they are limited to
+        // maxQueueFileSize bytes, 0 means no limit.
+        uint64_t maxQueueFileSize; // 0
+
+        // "priority" queue only, not set by constructor. Artifact, which waits
+        // longer than maxPriorityWaitSec, is uploaded next regardless of its
+        // priority, so that low priority artifacts aren't starved. When queue
+        // is full, the oldest artifact of the lowest priority is dropped.
+        Priorities priorities;
+        int maxPriorityWaitSec; // 60
+
+        // Not set by constructor. Only the latest artifact of types set here
+        // is kept in queue, e.g. background, which is refreshed periodically,
+        // so that stale ones don't take memory and delay fresh data, once
+        // uploads resume after outage. Artifacts being uploaded and ones of
+        // "persistent" queue kept on disk only aren't replaced.
+        Supersedable supersedable;
+
+        // Not set by constructor. Counts and events waiting in queue are
+        // merged and uploaded by single request of up to maxTimeSeriesBatchSize
+        // counts or events, 1 disables merging. Counts are merged only if
+        // their update flags are the same. Count or event is held for up to
+        // timeSeriesLingerMs since it was enqueued to let more of them come.
+        size_t maxTimeSeriesBatchSize; // 100
+        int timeSeriesLingerMs; // 0
+
+        // Not set by constructor. Retry policy is shared by all upload
+        // threads, ExponentialBackoffRetryPolicy with default parameters is
+        // used, if it's empty.
+        RetryPolicyPtr retryPolicy;
+
+        // Not set by constructor. Uploads are paused, once that many of them
+        // failed in a row, until single small request to server succeeds.
+        // Then next failure pauses them again. 0 disables.
+        int circuitBreakerThreshold; // 5
+
+        // Not set by constructor. File, where accounts URL, account and camera
+        // IDs are kept between runs, so that uploads start right after init()
+        // without any discovery requests. It's used only, if apiRoot, token
+        // (file keeps its hash) and cameraName match. Cached IDs are trusted,
+        // until upload fails with HTTP 404, then they are discovered again.
+        std::string sessionCacheFile;
     };
 
+    struct Statistics
+    {
+        Statistics()
+            : numTimeSeriesArtifacts(0)
+            , numTimeSeriesUploads(0)
+            , numArtifacts(0)
+            , numArtifactBytes(0)
+            , numFailedUploads(0)
+        {
+        }
+
+        // Counts and events uploaded, each upload*() call is one artifact
+        uint64_t numTimeSeriesArtifacts;
+
+        // Requests they were uploaded by, artifacts/uploads is merge ratio
+        uint64_t numTimeSeriesUploads;
+
+        // Artifacts of all types uploaded and their approximate size in memory
+        uint64_t numArtifacts;
+        uint64_t numArtifactBytes;
+
+        // Upload requests failed, including ones retried later
+        uint64_t numFailedUploads;
+    };
+
+    // Final outcome of artifact passed to upload*()
+    struct UploadResult
+    {
+        UploadResult()
+            : status(Status::FAILURE, true, Status::FACILITY_NONE)
+            , numAttempts(0)
+            , queueWaitMs(0)
+            , transferMs(0)
+        {
+        }
+
+        // Success, or error of the last attempt, once artifact isn't retried
+        // any more. FAILURE, if artifact is dropped to make room in full queue,
+        // is replaced by newer one (see Configuration::supersedable) or is left
+        // in queue, when uploader is destroyed.
+        Status status;
+
+        // Upload requests made, counts or events merged together share them
+        int numAttempts;
+
+        // Time since upload*() call, which wasn't spent by upload requests,
+        // i.e. waiting in queue and before retries
+        int64_t queueWaitMs;
+
+        // Time spent by upload requests of all attempts
+        int64_t transferMs;
+    };
+
+    // Artifacts left behind by flush() or abort()
+    struct Backlog
+    {
+        Backlog()
+            : numQueued(0)
+            , numInProgress(0)
+        {
+        }
+
+        // Waiting in queue, including ones of persistent queue kept on disk
+        size_t numQueued;
+
+        // Being uploaded by upload threads
+        size_t numInProgress;
+    };
+
+    // Called once for each artifact, which upload*() has enqueued, from upload
+    // thread, from thread calling upload*(), if artifact is dropped from full
+    // queue, or from uploader's destructor. Thus it shall return quickly and
+    // must not destroy uploader. It may enqueue more artifacts, unless it's
+    // called once destructor has started, then upload*() fails. Isn't
+    // called for artifacts restored from persistent queue after restart.
+    typedef boost::function<void (const UploadResult& result)> CompletionCallback;
+
     ArtifactUploader();
 
-    // synchronous, may block
+    // Doesn't contact server, so artifacts can be enqueued right away, even if
+    // network is down. Fails only, if configuration is invalid or journal of
+    // persistent queue can't be opened. Account and camera (registered, if
+    // there is none of cfg.cameraName) are resolved in background, retrying
+    // according to retry policy. Uploads start, once they are resolved.
+    // Destructor waits for that as it waits for uploads, no longer than
+    // timeoutToCompleteUploadSec, if it's set.
     // configCallback will be called to let config client to e.g. set connection timeouts,
-    // logging flags and similar. This will happen once and may be called from a thread
-    // different than the one, where init() is called
+    // logging flags and similar. This will happen once per client and may be called from
+    // a thread different than the one, where init() is called
     // configCallback may be NULL, in which case no configuration is performed
     Status init(const Configuration& cfg, ClientConfigCallback configCallback);
 
@@ -72,10 +312,52 @@ public:
     Status uploadEvent(const timestamp_t& timestamp, move_ref<Events> events);
     Status uploadCount(move_ref<Counts> counts, bool update);
 
+    // Same as above, callback is called, once artifact is uploaded or
+    // dropped, unless error is returned
+    Status uploadBackground(const timestamp_t& timestamp, PayloadHolderPtr payload,
+                            const CompletionCallback& callback);
+    Status uploadObjectStream(const ObjectStream& stream, PayloadHolderPtr payload,
+                              const CompletionCallback& callback);
+    Status uploadFlipbook(const Flipbook& flipbook, PayloadHolderPtr payload,
+                          const CompletionCallback& callback);
+    Status uploadEvent(const timestamp_t& timestamp, move_ref<Events> events,
+                       const CompletionCallback& callback);
+    Status uploadCount(move_ref<Counts> counts, bool update,
+                       const CompletionCallback& callback);
+
+    // Thread safe, statistics since init()
+    Statistics getStatistics() const;
+
+    // Thread safe, metrics of requests made by all clients of uploader
+    // since init(), see Client::getMetrics()
+    RequestMetricsMap getMetrics() const;
+
+    // Thread safe. Success, once account and camera are resolved (or are
+    // taken from Configuration::sessionCacheFile), otherwise error of the
+    // latest attempt to resolve them.
+    Status getSessionStatus() const;
+
+    // Waits until all artifacts enqueued so far are uploaded or dropped and
+    // their completion callbacks have returned, but no longer than
+    // timeoutMs. Meanwhile counts and events aren't held for
+    // timeSeriesLingerMs, so that all upload threads are kept busy. Returns
+    // Status::TIMEOUT error, if queue isn't drained in time, then backlog
+    // tells what is left. Queue may not drain, while artifacts are enqueued
+    // concurrently.
+    Status flush(int timeoutMs, Backlog& backlog);
+
     // Stop uploader thread ASAP, enqueued data won't be uploaded
     // Non-blocking, doesn't wait for thread actaully exiting only signals it to exit.
+    // Uploads in progress are aborted without waiting for them to time out,
+    // their artifacts are put back to queue. Persistent queue uploads them
+    // after restart.
     void abort();
 
+    // Same as above, but waits up to timeoutMs for upload threads to exit.
+    // Returns artifacts left in queue, as well as ones still in progress, if
+    // threads didn't exit in time.
+    Backlog abort(int timeoutMs);
+
 private:
     class Impl;
     unique_ptr<Impl>::t pImpl_;
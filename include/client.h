@@ -5,6 +5,8 @@
 #define CONNECT_SDK_CLIENT_H
 
 #include "domain-types.h"
+#include "request-metrics.h"
+#include "boost/function.hpp"
 
 namespace prism
 {
@@ -40,18 +42,44 @@ struct SdkVersion
 
 SdkVersion getSdkVersion();
 
+// Server-side filter and page size of instruments query
+struct InstrumentQuery
+{
+    InstrumentQuery()
+        : pageSize(0)
+    {
+    }
+
+    // exact match, empty matches any
+    std::string name;
+    std::string type;
+
+    // 0 requests whole list in single response
+    int pageSize;
+};
+
 // client interface reflects Prism Connect Device API v1.0
 // see https://github.com/prismskylabs/connect/wiki/Prism-Connect-Device-API-v1.0
 class Client
 {
 public:
 
+    // Called once asynchronous request completes. Called from SDK internal
+    // thread, or from calling thread, if request can't be started, thus it shall
+    // return quickly. It must not destroy the client.
+    typedef boost::function<void (const Status& status)> CompletionCallback;
+
     Client(const std::string& apiRoot = "", const std::string& token = "");
     ~Client();
 
     // init() method is synchronous regardless of other methods
     Status init();
 
+    // Accounts URL is what init() learns from API root. Client, which is
+    // given URL saved from previous run, may skip init().
+    std::string getAccountsUrl() const;
+    void setAccountsUrl(const std::string& accountsUrl);
+
     // default is 300000 (300 sec), pass 0 to reset to default
     void setConnectionTimeoutMs(long timeoutMs);
 
@@ -72,11 +100,57 @@ public:
 
     Status queryInstrumentsList(id_t accountId, Instruments& instruments);
 
+    // Fetches single page of instruments matching query. Pass empty cursor
+    // for the first page and nextCursor of previous page after that,
+    // nextCursor is empty after the last page. Server, which doesn't
+    // paginate, returns whole list as the first page. Filters are applied
+    // here too, in case server ignores them. See InstrumentCursor.
+    Status queryInstrumentsList(id_t accountId, const InstrumentQuery& query, const std::string& cursor,
+                                Instruments& instruments, std::string& nextCursor);
+
     // not sure we can get instrument by ID, as there is no such member for now
 //    Status queryInstrument(id_t accountId, id_t instrumentId, Instrument& instrument);
 
     Status registerInstrument(id_t accountId, const Instrument& instrument);
 
+    // Finds instrument of account by name and type. Queries server for
+    // instruments of that name and type and stops at the first match,
+    // unless it's found in cache (see setInstrumentCacheTtlSec()). Returns
+    // NOT_FOUND error, if there is no such instrument.
+    Status findInstrument(id_t accountId, const std::string& name, const std::string& type,
+                          Instrument& instrument);
+
+    // Time instrument lists are cached for, default is 0, which disables
+    // cache. Instrument list returned by queryInstrumentsList() is cached and
+    // indexed, so that findInstrument() doesn't query server for instrument
+    // in it, until list expires. Cache is updated by registerInstrument() and
+    // by lookups. Instrument, which isn't in cache, is looked up on server,
+    // but cached one may be renamed or deleted meanwhile by other client.
+    void setInstrumentCacheTtlSec(int ttlSec);
+
+    struct HttpCacheStatistics
+    {
+        HttpCacheStatistics()
+            : numHits(0)
+            , numMisses(0)
+        {
+        }
+
+        // 304 Not Modified responses served from cache
+        uint64_t numHits;
+        // full responses
+        uint64_t numMisses;
+    };
+
+    // Results of init(), queryAccountsList(), queryAccount() and
+    // queryInstrumentsList() are cached by URL along with ETag and
+    // Last-Modified of response. URL is then requested with If-None-Match
+    // and If-Modified-Since and, if server replies 304 Not Modified, result
+    // is served from memory. Default is 64 URLs, 0 disables cache.
+    void setHttpCacheMaxEntries(size_t maxEntries);
+
+    HttpCacheStatistics getHttpCacheStatistics() const;
+
     // image uploads
     Status uploadBackground(id_t accountId, id_t instrumentId,
                               const timestamp_t& timestamp, const Payload& payload);
@@ -118,6 +192,36 @@ public:
     Status uploadTag(id_t accountId, id_t instrumentId,
                        const timestamp_t& timestamp, const Tags& data);
 
+    // Asynchronous uploads. Return immediately, status is passed to callback.
+    // Many requests may be in progress at once. Synchronous upload methods
+    // above are thin wrappers over these.
+    // All parameters are copied or serialized before method returns except for
+    // payload data or file, which must stay available until callback is called.
+    // Requests still in progress, when client is destroyed, are aborted.
+    void uploadBackgroundAsync(id_t accountId, id_t instrumentId,
+                               const timestamp_t& timestamp, const Payload& payload,
+                               CompletionCallback callback);
+
+    void uploadObjectStreamAsync(id_t accountId, id_t instrumentId,
+                                 const ObjectStream& stream, const Payload& payload,
+                                 CompletionCallback callback);
+
+    void uploadFlipbookAsync(id_t accountId, id_t instrumentId,
+                             const Flipbook& flipbook, const Payload& payload,
+                             CompletionCallback callback);
+
+    void uploadCountAsync(id_t accountId, id_t instrumentId,
+                          const Counts& data, bool update,
+                          CompletionCallback callback);
+
+    void uploadEventAsync(id_t accountId, id_t instrumentId,
+                          const timestamp_t& timestamp, const Events& data,
+                          CompletionCallback callback);
+
+    void uploadTrackAsync(id_t accountId, id_t instrumentId,
+                          const timestamp_t& timestamp, const Tracks& data,
+                          CompletionCallback callback);
+
     enum
     {
         // log input parameters of client methods
@@ -133,6 +237,20 @@ public:
     // use it to selectively enable or disable (logFlags = 0 disables all) logging
     void setLogFlags(int logFlags);
 
+    enum ContentEncoding
+    {
+        ENCODING_IDENTITY,
+        ENCODING_GZIP,
+        ENCODING_DEFLATE
+    };
+
+    // Enables compression of JSON data of uploadCount(), uploadEvent() and
+    // uploadTrack() (and their async versions) to save traffic on metered
+    // links. JSON of at least minSize bytes is compressed with given zlib
+    // level (1..9, -1 for default) and its form part is sent with
+    // Content-Encoding header, so server must support it. Disabled by default.
+    void setJsonEncoding(ContentEncoding encoding, size_t minSize = 1024, int level = -1);
+
     // Proxy is of format [<scheme>://]<host>[:<port>] e.g. "http://proxy:80"
     // <scheme> is one of http, https, socks4, socks4a, socks5, socks5a
     void setProxy(const std::string& proxy);
@@ -143,9 +261,26 @@ public:
     }
 
     // By default, caBundlePath is set to empty string. Use
-    // to specify path to Certificate Authority (CA) bundle
+    // to specify path to Certificate Authority (CA) bundle. Bundle is read
+    // once and shared by all clients in process, instead of being loaded for
+    // every new connection. It's re-read if file is modified and path is set
+    // again.
     void setCaBundlePath(const std::string& caBundlePath);
 
+    // Thread safe. Timings and sizes of requests made since client is
+    // created, by operation, e.g. "Client::uploadBackground()".
+    RequestMetricsMap getMetrics() const;
+
+    // Seconds left of delay, which server asked for by Retry-After header of
+    // the latest upload rejected with HTTP 429 or 503, 0 if none
+    int getRetryAfterSec() const;
+
+    // Aborts requests in progress, synchronous or asynchronous, they fail
+    // with network error. Requests started later aren't affected. Unlike
+    // other methods, may be called from any thread, e.g. to stop long upload
+    // on shutdown.
+    void abortRequests();
+
 private:
     class Impl;
     unique_ptr<Impl>::t pImpl_;
@@ -154,6 +289,11 @@ private:
     {
         return *pImpl_;
     }
+
+    const Impl& impl() const
+    {
+        return *pImpl_;
+    }
 };
 
 inline void swap(Client& one, Client& two)
@@ -161,6 +301,49 @@ inline void swap(Client& one, Client& two)
     one.swap(two);
 }
 
+// Iterates instruments of account matching query, fetching pages as they
+// are needed:
+//
+//     InstrumentCursor cursor(client, accountId, query);
+//     Instrument instrument;
+//
+//     while (cursor.next(instrument))
+//         ...
+//
+//     if (cursor.getStatus().isError())
+//         ...
+class InstrumentCursor
+{
+public:
+    InstrumentCursor(Client& client, id_t accountId, const InstrumentQuery& query);
+
+    // Returns false after the last instrument or, if page request fails
+    bool next(Instrument& instrument);
+
+    // Error of failed page request, success otherwise
+    Status getStatus() const
+    {
+        return status_;
+    }
+
+    size_t getNumPages() const
+    {
+        return numPages_;
+    }
+
+private:
+    Client& client_;
+    id_t accountId_;
+    InstrumentQuery query_;
+
+    Instruments page_;
+    size_t pos_;
+    // of the next page, empty before the first and after the last one
+    std::string nextCursor_;
+    size_t numPages_;
+    Status status_;
+};
+
 // On success fills cameraInfo.
 Status findCameraByName(Client& client, id_t accountId, const std::string& name,
                         Instrument& cameraInfo);
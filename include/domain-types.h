@@ -34,7 +34,8 @@ public:
         SUCCESS = 0,
         FAILURE = 1, // for any (unknown) reason
         NOT_FOUND = 2,
-        ALREADY_EXISTS = 3
+        ALREADY_EXISTS = 3,
+        TIMEOUT = 4
 
         // extend with more specific codes as necessary
     };
@@ -289,9 +290,12 @@ struct Payload
     }
 
     // Caller owns the data. Data shall be available until function accepting
-    // parameter of type Payload returns.
-    Payload(const void* data, size_t dataSize, const std::string& mimeType)
-        : data(data)
+    // parameter of type Payload returns. fileName, if given, is sent as name
+    // of uploaded file, e.g. when data is mapped from file.
+    Payload(const void* data, size_t dataSize, const std::string& mimeType,
+            const std::string& fileName = std::string())
+        : fileName(fileName)
+        , data(data)
         , dataSize(dataSize)
         , mimeType(mimeType)
     {
@@ -32,13 +32,19 @@ public:
     bool isFile() const;
     std::string getFilePath() const;
     std::string getMimeType() const;
+
+    // File payload is mapped into memory on the first call, mapping is
+    // released on destruction. Returns NULL, if file can't be mapped.
     const uint8_t* getData() const;
+
+    // Size of file is taken, when PayloadHolder is made
     size_t getDataSize() const;
 
 private:
     friend PayloadHolderPtr makePayloadHolderByMovingData(move_ref<ByteBuffer> data, const std::string& mimeType);
     friend PayloadHolderPtr makePayloadHolderByCopyingData(const void* data, size_t dataSize, const std::string& mimeType);
     friend PayloadHolderPtr makePayloadHolderByReferencingFileAutodelete(const std::string& filePath);
+    friend PayloadHolderPtr makePayloadHolderByReferencingFile(const std::string& filePath);
 
     PayloadHolder();
 
@@ -55,9 +61,13 @@ private:
 PayloadHolderPtr makePayloadHolderByMovingData(move_ref<ByteBuffer> data, const std::string& mimeType);
 PayloadHolderPtr makePayloadHolderByCopyingData(const void* data, size_t dataSize, const std::string& mimeType);
 
-// file will be deleted on PayloadHolder destruction
+// file will be deleted on PayloadHolder destruction, it must not be modified
+// before that
 PayloadHolderPtr makePayloadHolderByReferencingFileAutodelete(const std::string& filePath);
 
+// Same as above, but file is left in place on PayloadHolder destruction
+PayloadHolderPtr makePayloadHolderByReferencingFile(const std::string& filePath);
+
 } // namespace connect
 } // namespace prism
 
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#ifndef PRISM_BYTE_STREAM_H_
+#define PRISM_BYTE_STREAM_H_
+
+#include <cstring>
+#include <string>
+
+#include "common-types.h"
+
+namespace prism
+{
+namespace connect
+{
+
+// Minimal binary serialization for upload journal. Integers are stored in
+// host byte order, as journal is never moved between machines.
+class ByteStreamWriter
+{
+public:
+    explicit ByteStreamWriter(ByteBuffer& buf)
+        : buf_(buf)
+    {
+    }
+
+    template <typename T>
+    void write(T value)
+    {
+        writeBytes(&value, sizeof(value));
+    }
+
+    void writeString(const std::string& str)
+    {
+        write<uint32_t>(str.size());
+        writeBytes(str.data(), str.size());
+    }
+
+    void writeBytes(const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        buf_.insert(buf_.end(), bytes, bytes + size);
+    }
+
+    // Appends size bytes to be filled by caller e.g. directly from file.
+    // Pointer is valid until next write.
+    uint8_t* append(size_t size)
+    {
+        const size_t pos = buf_.size();
+        buf_.resize(pos + size);
+        return buf_.data() + pos;
+    }
+
+    // Drops bytes appended after size() returned given value
+    void truncate(size_t size)
+    {
+        buf_.resize(size);
+    }
+
+    size_t size() const
+    {
+        return buf_.size();
+    }
+
+private:
+    ByteBuffer& buf_;
+};
+
+// All read* methods return false, if there is not enough data left, and
+// leave stream in failed state, so it's enough to check the last one.
+class ByteStreamReader
+{
+public:
+    ByteStreamReader(const uint8_t* data, size_t size)
+        : data_(data)
+        , size_(size)
+        , pos_(0)
+        , failed_(false)
+    {
+    }
+
+    template <typename T>
+    bool read(T& value)
+    {
+        return readBytes(&value, sizeof(value));
+    }
+
+    bool readString(std::string& str)
+    {
+        uint32_t size = 0;
+
+        if (!read(size)  ||  !canRead(size))
+            return false;
+
+        str.assign(reinterpret_cast<const char*>(data_ + pos_), size);
+        pos_ += size;
+
+        return true;
+    }
+
+    bool readBytes(void* data, size_t size)
+    {
+        if (!canRead(size))
+            return false;
+
+        memcpy(data, data_ + pos_, size);
+        pos_ += size;
+
+        return true;
+    }
+
+    bool readBuffer(ByteBuffer& buf)
+    {
+        uint32_t size = 0;
+
+        if (!read(size)  ||  !canRead(size))
+            return false;
+
+        buf.assign(data_ + pos_, data_ + pos_ + size);
+        pos_ += size;
+
+        return true;
+    }
+
+    bool isFailed() const
+    {
+        return failed_;
+    }
+
+private:
+    bool canRead(size_t size)
+    {
+        if (failed_  ||  size > size_ - pos_)
+            failed_ = true;
+
+        return !failed_;
+    }
+
+    const uint8_t* data_;
+    size_t size_;
+    size_t pos_;
+    bool failed_;
+};
+
+} // namespace connect
+} // namespace prism
+
+#endif // PRISM_BYTE_STREAM_H_
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#ifndef PRISM_CA_BUNDLE_H
+#define PRISM_CA_BUNDLE_H
+
+#include <ctime>
+#include <string>
+#include "boost/noncopyable.hpp"
+#include "boost/shared_ptr.hpp"
+
+#include "curl/curl.h"
+
+// CA certificates can be passed to libCURL in memory since 7.77.0
+#define PRISM_HAVE_CURL_CAINFO_BLOB (LIBCURL_VERSION_NUM >= 0x074d00)
+
+// OpenSSL X509_STORE, declared regardless of PRISM_HAVE_OPENSSL to keep
+// layout the same for code built without it
+struct x509_store_st;
+
+namespace prism
+{
+namespace connect
+{
+
+class CaBundle;
+typedef boost::shared_ptr<CaBundle> CaBundlePtr;
+
+// CA certificates, which are read from PEM file once and shared by CURL handles
+// of all clients in process. libCURL loads CURLOPT_CAINFO file for every new
+// connection, which is costly with large bundles on slow CPUs. If SDK is built
+// with OpenSSL and libCURL uses it, certificates are parsed once into store,
+// which is installed into each new TLS context. Otherwise bundle is passed
+// to libCURL from memory, or, if libCURL is too old, by path, as before.
+// Thread-safe.
+class CaBundle : boost::noncopyable
+{
+public:
+    // Instance for file at path, shared while someone holds pointer to it,
+    // and re-read once file is modified. Returns empty pointer, if file can't
+    // be read.
+    static CaBundlePtr getInstance(const std::string& path);
+
+    ~CaBundle();
+
+    // Makes handle verify peers against certificates of bundle only. Bundle
+    // must outlive request performed by handle.
+    void attach(CURL* handle);
+
+    const std::string& getPath() const
+    {
+        return path_;
+    }
+
+private:
+    CaBundle(const std::string& path, std::time_t modificationTime);
+
+    bool load();
+
+#if PRISM_HAVE_OPENSSL
+    bool parse();
+
+    static CURLcode sslCtxFunction(CURL* handle, void* sslCtx, void* userptr);
+#endif
+
+    std::string path_;
+    std::time_t modificationTime_;
+    std::string pem_;
+    // parsed pem_, referenced by TLS contexts of connections
+    x509_store_st* store_;
+};
+
+} // namespace connect
+} // namespace prism
+
+#endif // PRISM_CA_BUNDLE_H
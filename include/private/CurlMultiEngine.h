@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#ifndef PRISM_CURL_MULTI_ENGINE_H
+#define PRISM_CURL_MULTI_ENGINE_H
+
+#include <deque>
+#include <map>
+
+#include "boost/function.hpp"
+#include "boost/noncopyable.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/thread.hpp"
+
+#include "private/curl-wrapper.h"
+
+namespace prism
+{
+namespace connect
+{
+
+// Runs many transfers at once on single thread using curl_multi interface.
+// Thread is started on first submit() and stopped in destructor.
+class CurlMultiEngine : boost::noncopyable
+{
+public:
+    typedef boost::function<void (CURLcode)> CompletionHandler;
+
+    CurlMultiEngine();
+
+    // Transfers still in progress are aborted, their handlers are called
+    // with CURLE_ABORTED_BY_CALLBACK.
+    ~CurlMultiEngine();
+
+    // Starts transfer of request prepared by wrapper.prepareHttp*() methods.
+    // Once transfer is over, engine thread calls wrapper.completeRequest() and
+    // then handler. wrapper must stay alive until handler is called, handler
+    // may destroy it. Handler is called before submit() returns, if transfer
+    // can't be started.
+    void submit(CurlWrapper& wrapper, CompletionHandler handler);
+
+    // true, if called from the engine's thread e.g. from completion handler.
+    // Waiting for transfer completion on engine thread would deadlock.
+    bool isEngineThread() const;
+
+    // Makes engine thread drive transfers now instead of at the end of its
+    // wait, e.g. so that abort requested by them is noticed sooner
+    void wakeUp();
+
+private:
+    struct Transfer
+    {
+        Transfer()
+            : wrapper(0)
+        {
+        }
+
+        Transfer(CurlWrapper* wrapper, CompletionHandler handler)
+            : wrapper(wrapper)
+            , handler(handler)
+        {
+        }
+
+        CurlWrapper* wrapper;
+        CompletionHandler handler;
+    };
+
+    void threadFunc();
+    void startPendingTransfers();
+    void processCompletedTransfers();
+    void abortActiveTransfers();
+    void wait();
+
+    static void complete(Transfer& transfer, CURLcode result);
+
+    CURLM* multi_;
+    boost::thread thread_;
+    mutable boost::mutex mutex_;
+
+    // guarded by mutex_
+    std::deque<Transfer> pending_;
+    bool done_;
+
+    // accessed by engine thread only
+    std::map<CURL*, Transfer> active_;
+
+    // wakes up curl_multi_wait() on libCURL versions lacking curl_multi_wakeup()
+    int wakeupPipe_[2];
+};
+
+} // namespace connect
+} // namespace prism
+
+#endif // PRISM_CURL_MULTI_ENGINE_H
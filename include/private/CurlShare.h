@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#ifndef PRISM_CURL_SHARE_H
+#define PRISM_CURL_SHARE_H
+
+#include "boost/noncopyable.hpp"
+#include "boost/shared_ptr.hpp"
+#include "boost/thread/mutex.hpp"
+
+#include "curl/curl.h"
+
+namespace prism
+{
+namespace connect
+{
+
+class CurlShare;
+typedef boost::shared_ptr<CurlShare> CurlSharePtr;
+
+// DNS cache and TLS session IDs shared by CURL handles of all clients and
+// upload threads in process, so that one of them skips DNS lookup and full
+// TLS handshake already done by another. Thread-safe.
+class CurlShare : boost::noncopyable
+{
+public:
+    // Process-wide instance, it lives while someone holds pointer to it.
+    // Returns empty pointer, if libCURL fails to create share.
+    static CurlSharePtr getInstance();
+
+    ~CurlShare();
+
+    // Makes handle use shared data. Handle must be cleaned up before share
+    // is destroyed.
+    void attach(CURL* handle);
+
+private:
+    CurlShare();
+
+    static void lock(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr);
+    static void unlock(CURL* handle, curl_lock_data data, void* userptr);
+
+    CURLSH* share_;
+
+    // one per kind of shared data, so that e.g. DNS lookup doesn't wait for
+    // TLS session
+    boost::mutex mutexes_[CURL_LOCK_DATA_LAST];
+};
+
+} // namespace connect
+} // namespace prism
+
+#endif // PRISM_CURL_SHARE_H
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#ifndef PRISM_HTTP_VALIDATOR_CACHE_H
+#define PRISM_HTTP_VALIDATOR_CACHE_H
+
+#include <list>
+#include <map>
+#include <string>
+#include "boost/any.hpp"
+#include "domain-types.h"
+
+namespace prism
+{
+namespace connect
+{
+
+// Validators (ETag, Last-Modified) of GET responses by URL, along with
+// result parsed from response, so that request can be made conditional and,
+// if server replies 304 Not Modified, result is taken from here instead of
+// downloading and parsing body again. Holds up to maxEntries URLs, least
+// recently used one is evicted. Isn't thread-safe, each client has its own.
+class HttpValidatorCache
+{
+public:
+    struct Validators
+    {
+        std::string etag;
+        std::string lastModified;
+
+        bool isEmpty() const
+        {
+            return etag.empty()  &&  lastModified.empty();
+        }
+    };
+
+    struct Statistics
+    {
+        Statistics()
+            : numHits(0)
+            , numMisses(0)
+        {
+        }
+
+        // 304 responses served from cache
+        uint64_t numHits;
+        // full responses, whether they are cached or not
+        uint64_t numMisses;
+    };
+
+    explicit HttpValidatorCache(size_t maxEntries);
+
+    // 0 disables cache
+    void setMaxEntries(size_t maxEntries);
+
+    // Returns false, if url isn't cached
+    bool getValidators(const std::string& url, Validators& validators) const;
+
+    // Call on 304 response. Returns false, if url isn't cached or its result
+    // isn't of type T.
+    template <typename T>
+    bool get(const std::string& url, T& result)
+    {
+        Entry* entry = find(url);
+        const T* cached = entry ? boost::any_cast<T>(&entry->result) : 0;
+
+        if (!cached)
+            return false;
+
+        result = *cached;
+        ++statistics_.numHits;
+
+        return true;
+    }
+
+    // Call on full response. Response without validators can't be requested
+    // conditionally, it replaces cached one, if any, by nothing.
+    template <typename T>
+    void put(const std::string& url, const Validators& validators, const T& result)
+    {
+        ++statistics_.numMisses;
+
+        if (validators.isEmpty()  ||  maxEntries_ == 0)
+        {
+            erase(url);
+            return;
+        }
+
+        Entry& entry = insert(url);
+        entry.validators = validators;
+        entry.result = result;
+    }
+
+    void erase(const std::string& url);
+
+    Statistics getStatistics() const
+    {
+        return statistics_;
+    }
+
+private:
+    struct Entry
+    {
+        Validators validators;
+        boost::any result;
+        // position in lru_
+        std::list<std::string>::iterator lruPos;
+    };
+
+    // Returns NULL, if url isn't cached, makes it most recently used otherwise
+    Entry* find(const std::string& url);
+
+    // Adds url as most recently used, evicts least recently used one, if
+    // cache is full
+    Entry& insert(const std::string& url);
+
+    size_t maxEntries_;
+    std::map<std::string, Entry> entries_;
+    // URLs, most recently used first
+    std::list<std::string> lru_;
+    Statistics statistics_;
+};
+
+} // namespace connect
+} // namespace prism
+
+#endif // PRISM_HTTP_VALIDATOR_CACHE_H
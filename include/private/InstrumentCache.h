@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#ifndef PRISM_INSTRUMENT_CACHE_H
+#define PRISM_INSTRUMENT_CACHE_H
+
+#include <map>
+#include <string>
+#include "boost/thread/thread_time.hpp"
+#include "boost/unordered_map.hpp"
+#include "domain-types.h"
+
+namespace prism
+{
+namespace connect
+{
+
+// Instrument lists of accounts, as server returned them last time, indexed
+// by name and type, so that lookup of camera by name needs neither request
+// nor scan of whole list. Account's list expires ttl after it's stored.
+// Account may also have partial list of instruments found or registered one
+// by one. Only hits are served, as instrument missing from list may have
+// been added since by other client.
+// Isn't thread-safe, each client has its own.
+class InstrumentCache
+{
+public:
+    explicit InstrumentCache(const boost::posix_time::time_duration& ttl);
+
+    // Zero ttl disables cache
+    void setTtl(const boost::posix_time::time_duration& ttl);
+
+    // Replaces instrument list of account
+    void put(id_t accountId, const Instruments& instruments);
+
+    // Adds instrument to list of account, starts partial list, if account
+    // has none
+    void add(id_t accountId, const Instrument& instrument);
+
+    void invalidate(id_t accountId);
+
+    // Returns false, if list of account isn't cached, has expired or
+    // doesn't have instrument
+    bool find(id_t accountId, const std::string& name, const std::string& type,
+              Instrument& instrument);
+
+private:
+    struct Entry
+    {
+        Instruments instruments;
+
+        // name and type separated by '\0' -> index in instruments
+        boost::unordered_map<std::string, size_t> index;
+
+        boost::system_time expiresAt;
+    };
+
+    static std::string makeKey(const std::string& name, const std::string& type);
+
+    // the first instrument of given name and type wins, as before caching
+    static void addToIndex(Entry& entry, size_t i);
+
+    boost::posix_time::time_duration ttl_;
+    std::map<id_t, Entry> entries_;
+};
+
+} // namespace connect
+} // namespace prism
+
+#endif // PRISM_INSTRUMENT_CACHE_H
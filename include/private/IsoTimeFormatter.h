@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#ifndef PRISM_ISO_TIME_FORMATTER_H_
+#define PRISM_ISO_TIME_FORMATTER_H_
+
+#include <vector>
+
+#include "domain-types.h"
+
+namespace prism
+{
+namespace connect
+{
+
+// Formats timestamps as "2016-02-08T16:15:20.123" (UTC) into caller's buffer
+// without allocations or calls to gmtime(). Date and hour of last formatted
+// timestamp are cached, so consecutive timestamps of time-series data only
+// need minutes, seconds and milliseconds to be formatted.
+// Instance isn't thread safe, use one per thread or per call.
+class IsoTimeFormatter
+{
+public:
+    // Formatted timestamp length, output isn't null-terminated
+    static const size_t LENGTH = 23;
+
+    IsoTimeFormatter();
+
+    // Writes exactly LENGTH characters into buffer
+    void format(timestamp_t timestamp, char* buffer);
+
+    // Formats timestamps of all counts into out, LENGTH characters per count
+    // without separators, so that timestamp of counts[i] starts at i * LENGTH.
+    void format(const Counts& counts, std::vector<char>& out);
+
+private:
+    void updatePrefix(int64_t hour);
+
+    // Hours since epoch of cached prefix
+    int64_t hour_;
+    // "2016-02-08T16:"
+    char prefix_[14];
+};
+
+} // namespace connect
+} // namespace prism
+
+#endif // PRISM_ISO_TIME_FORMATTER_H_
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#ifndef PRISM_JSON_ARRAY_READER_H_
+#define PRISM_JSON_ARRAY_READER_H_
+
+#include <string>
+#include <vector>
+
+#include "boost/function.hpp"
+#include "rapidjson/document.h"
+#include "domain-types.h"
+#include "curl-wrapper.h"
+
+namespace prism
+{
+namespace connect
+{
+
+// Reads JSON array, which arrives in chunks, e.g. list response straight
+// from libcurl, and passes each element to callback as soon as it's
+// complete. Only element being received is buffered, it's parsed in situ,
+// so that neither whole response nor its DOM is ever held in memory.
+// Instance isn't thread safe and reads single array.
+class JsonArrayReader : public ResponseBodySink
+{
+public:
+    // Element is valid during call only. Error returned stops reading.
+    typedef boost::function<Status (const rapidjson::Value& element)> ElementCallback;
+
+    explicit JsonArrayReader(const ElementCallback& callback);
+
+    // Feeds next chunk of JSON text. Errors are reported by finish().
+    void write(const char* data, size_t size);
+
+    // Call after the last chunk. Returns error, if text isn't complete JSON
+    // array, element isn't valid JSON or callback has returned error.
+    Status finish();
+
+    // Tells what and where went wrong, once finish() returned error
+    const std::string& getErrorMessage() const
+    {
+        return errorMessage_;
+    }
+
+    size_t getNumElements() const
+    {
+        return numElements_;
+    }
+
+private:
+    enum State
+    {
+        BEFORE_ARRAY,
+        BEFORE_FIRST_ELEMENT,
+        BEFORE_ELEMENT,
+        IN_ELEMENT,
+        AFTER_ELEMENT,
+        AFTER_ARRAY,
+        FAILED
+    };
+
+    // Consumes element bytes up to its end or end of chunk, returns position
+    // of the first byte not consumed
+    const char* scanElement(const char* p, const char* end);
+
+    void completeElement();
+
+    void fail(const Status& status, const std::string& message);
+
+    ElementCallback callback_;
+    State state_;
+
+    // Scanner state of element being received: nesting of objects and
+    // arrays, whether it's inside string and after backslash there
+    int depth_;
+    bool isInString_;
+    bool isEscaped_;
+
+    std::vector<char> element_;
+    size_t numElements_;
+
+    // bytes consumed so far, for error messages
+    size_t offset_;
+
+    Status status_;
+    std::string errorMessage_;
+};
+
+} // namespace connect
+} // namespace prism
+
+#endif // PRISM_JSON_ARRAY_READER_H_
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#ifndef PRISM_MPSC_RING_H
+#define PRISM_MPSC_RING_H
+
+#include <cstddef>
+#include "boost/atomic.hpp"
+#include "boost/noncopyable.hpp"
+#include "boost/scoped_array.hpp"
+
+namespace prism
+{
+namespace connect
+{
+
+// Bounded lock-free FIFO for many producers and one consumer. Consumers may
+// be several threads, if they are serialized by caller, e.g. by mutex.
+// Based on D. Vyukov's bounded MPMC queue: each cell has sequence number,
+// which tells whether it's free for producer of given position or filled
+// for consumer, so that producers only contend on CAS of enqueue position.
+template <typename T>
+class MpscRing : boost::noncopyable
+{
+public:
+    // capacity is rounded up to power of 2
+    explicit MpscRing(size_t capacity)
+        : enqueuePos_(0)
+        , dequeuePos_(0)
+    {
+        size_t n = 2;
+
+        while (n < capacity)
+            n *= 2;
+
+        mask_ = n - 1;
+        cells_.reset(new Cell[n]);
+
+        for (size_t i = 0; i < n; ++i)
+            cells_[i].sequence.store(i, boost::memory_order_relaxed);
+    }
+
+    // Returns false, if ring is full
+    bool push(const T& value)
+    {
+        size_t pos = enqueuePos_.load(boost::memory_order_relaxed);
+
+        for (;;)
+        {
+            Cell& cell = cells_[pos & mask_];
+            const size_t sequence = cell.sequence.load(boost::memory_order_acquire);
+            const ptrdiff_t diff = static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(pos);
+
+            if (diff == 0)
+            {
+                if (enqueuePos_.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed))
+                {
+                    cell.value = value;
+                    cell.sequence.store(pos + 1, boost::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                // consumer hasn't freed cell of previous lap yet
+                return false;
+            }
+            else
+            {
+                pos = enqueuePos_.load(boost::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns false, if ring is empty or the oldest value is still being
+    // written by producer. Must not be called concurrently.
+    bool pop(T& value)
+    {
+        const size_t pos = dequeuePos_.load(boost::memory_order_relaxed);
+        Cell& cell = cells_[pos & mask_];
+        const size_t sequence = cell.sequence.load(boost::memory_order_acquire);
+
+        if (static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(pos + 1) < 0)
+            return false;
+
+        value = cell.value;
+        cell.value = T();
+        cell.sequence.store(pos + mask_ + 1, boost::memory_order_release);
+        dequeuePos_.store(pos + 1, boost::memory_order_release);
+
+        return true;
+    }
+
+    // Approximate, if called concurrently with push() or pop()
+    size_t size() const
+    {
+        const size_t dequeuePos = dequeuePos_.load(boost::memory_order_acquire);
+        const size_t enqueuePos = enqueuePos_.load(boost::memory_order_acquire);
+
+        return enqueuePos > dequeuePos ? enqueuePos - dequeuePos : 0;
+    }
+
+private:
+    struct Cell
+    {
+        boost::atomic<size_t> sequence;
+        T value;
+    };
+
+    size_t mask_;
+    boost::scoped_array<Cell> cells_;
+
+    // on separate cache lines, so that producers don't slow consumer down
+    char padding0_[64];
+    boost::atomic<size_t> enqueuePos_;
+    char padding1_[64];
+    boost::atomic<size_t> dequeuePos_;
+};
+
+} // namespace connect
+} // namespace prism
+
+#endif // PRISM_MPSC_RING_H
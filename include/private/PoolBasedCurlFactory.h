@@ -5,11 +5,19 @@
 #define PRISM_POOLBASEDCURLFACTORY_H
 
 #include "boost/noncopyable.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/locks.hpp"
 #include "private/curl-wrapper.h"
+#include "private/CurlShare.h"
+#include "easylogging++.h"
 
 namespace prism
 {
 
+// Keeps CURL easy handles alive between requests. Handles are reset, when
+// returned, but libCURL keeps live connections, TLS session IDs and DNS cache
+// across curl_easy_reset(), thus reusing a handle means reusing connection
+// to the same host. Thread-safe.
 class CurlHandlesPool : boost::noncopyable
 {
 public:
@@ -30,6 +38,8 @@ public:
 
     CURL* acquireHandle()
     {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+
         if (maxPoolSize_  &&  numExistingHandles_ >= maxPoolSize_)
         {
             LOG(INFO) << __FUNCTION__ << ": pool is full and has "
@@ -58,6 +68,8 @@ public:
         if (!handle)
             return;
 
+        boost::lock_guard<boost::mutex> lock(mutex_);
+
         if (numExistingHandles_ < 1)
             LOG(INFO) << __FUNCTION__ << ": unexpected handle return";
 
@@ -67,6 +79,8 @@ public:
 
     void clear()
     {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+
         if (availableHandles_.size() != numExistingHandles_)
             LOG(ERROR) << __FUNCTION__ << ": not all handles were returned"
                        << ": " << numExistingHandles_ << " were created "
@@ -85,14 +99,30 @@ private:
     std::vector<CURL*> availableHandles_;
     size_t numExistingHandles_;
     size_t maxPoolSize_;
+    boost::mutex mutex_;
 };
 
+// Handles are attached to share, if any, so that they reuse DNS cache and
+// TLS sessions of handles of other factories.
 class PoolBasedCurlFactory : public prism::connect::CurlFactory, boost::noncopyable
 {
 public:
+    explicit PoolBasedCurlFactory(size_t maxPoolSize = 0,
+                                  prism::connect::CurlSharePtr share = prism::connect::CurlSharePtr())
+        : share_(share)
+        , pool_(maxPoolSize)
+    {
+    }
+
     virtual CURL* create()
     {
-        return pool_.acquireHandle();
+        CURL* rv = pool_.acquireHandle();
+
+        // reset handle may keep share or not depending on libCURL version
+        if (rv  &&  share_)
+            share_->attach(rv);
+
+        return rv;
     }
 
     virtual void destroy(CURL* handle)
@@ -101,6 +131,8 @@ public:
     }
 
 private:
+    // declared first, as it must outlive handles in pool_
+    prism::connect::CurlSharePtr share_;
     CurlHandlesPool pool_;
 };
 
@@ -4,10 +4,15 @@
 #ifndef PRISM_UPLOAD_ARTIFACT_TASK_H_
 #define PRISM_UPLOAD_ARTIFACT_TASK_H_
 
+#include <string>
+#include <vector>
+
 #include "domain-types.h"
 #include "boost/shared_ptr.hpp"
+#include "boost/thread/thread_time.hpp"
 #include "public-util.h"
 #include "payload-holder.h"
+#include "UploadCompletion.h"
 
 namespace prism
 {
@@ -15,20 +20,144 @@ namespace connect
 {
 
 struct ClientSession;
+class ByteStreamWriter;
+class ByteStreamReader;
 
 class UploadArtifactTask
 {
 public:
+    // Values are stored in journal, don't change them
+    enum Type
+    {
+        BACKGROUND = 1,
+        OBJECT_STREAM = 2,
+        FLIPBOOK = 3,
+        EVENT = 4,
+        COUNT = 5
+    };
+
+    UploadArtifactTask()
+        : journalId_(0)
+        , numFailures_(0)
+    {}
+
     virtual ~UploadArtifactTask()
     {}
 
     virtual Status execute(ClientSession& session) const = 0;
     virtual size_t getArtifactSize() const = 0;
+
+    // Part of getArtifactSize() taken by payload file, which is referenced
+    // rather than held in memory
+    virtual uint64_t getFileSize() const
+    {
+        return 0;
+    }
+
+    size_t getMemorySize() const
+    {
+        return getArtifactSize() - static_cast<size_t>(getFileSize());
+    }
+
     virtual std::string toString() const = 0;
+    virtual Type getType() const = 0;
+
+    // Writes task, so that it can be restored by
+    // deserializeUploadArtifactTask() after restart. Payload file is
+    // hard-linked as payloadFilePrefix followed by its name, as original file
+    // is deleted together with the task, and record refers to the link then.
+    // linkPath is set to path of the link, it's left empty, if payload data
+    // is written into record instead.
+    virtual bool serialize(ByteStreamWriter& writer, const std::string& payloadFilePrefix,
+                           std::string& linkPath) const = 0;
+
+    // ID of the task's record in persistent queue journal, 0 if none
+    uint64_t getJournalId() const
+    {
+        return journalId_;
+    }
+
+    void setJournalId(uint64_t journalId)
+    {
+        journalId_ = journalId;
+    }
+
+    // Time, when task was put into queue first time
+    boost::system_time getQueueTime() const
+    {
+        return queueTime_;
+    }
+
+    void setQueueTime(const boost::system_time& queueTime)
+    {
+        queueTime_ = queueTime;
+    }
+
+    // Number of failed upload attempts, isn't kept in journal
+    int getNumFailures() const
+    {
+        return numFailures_;
+    }
+
+    void incrementNumFailures()
+    {
+        ++numFailures_;
+    }
+
+    // Reports final result to caller of ArtifactUploader::upload*(), empty
+    // if none. Isn't kept in journal, nor copied to merged task.
+    UploadCompletionPtr getCompletion() const
+    {
+        return completion_;
+    }
+
+    void setCompletion(UploadCompletionPtr completion)
+    {
+        completion_ = completion;
+    }
+
+    // Tasks sharing any key are uploaded in order they were queued, one at a
+    // time. Tasks without keys may be uploaded concurrently in any order.
+    // Queue checks keys on every pop, so they're made once by constructor.
+    virtual const std::vector<std::string>& getOrderingKeys() const;
+
+    // Time-series tasks may be merged to be uploaded by single request.
+    // Returns true, if data of other task may follow data of this one.
+    virtual bool canMergeWith(const UploadArtifactTask& /*other*/) const
+    {
+        return false;
+    }
+
+    // Number of counts or events, which limits size of merged task
+    virtual size_t getNumItems() const
+    {
+        return 1;
+    }
+
+    // Queued task of supersedable type is replaced by newer task of the same
+    // type and key, see UploadQueue::setSupersedableTypes()
+    virtual std::string getSupersedeKey() const
+    {
+        return std::string();
+    }
+
+private:
+    uint64_t journalId_;
+    boost::system_time queueTime_;
+    int numFailures_;
+    UploadCompletionPtr completion_;
 };
 
 typedef boost::shared_ptr<UploadArtifactTask> UploadArtifactTaskPtr;
 
+// Returns empty pointer, if data is malformed. Payload file links are looked
+// up in payloadDir, restored task refers to them, but doesn't delete them.
+UploadArtifactTaskPtr deserializeUploadArtifactTask(ByteStreamReader& reader, const std::string& payloadDir);
+
+// Returns task, which uploads data of all given tasks in order by single
+// request. Each task must be mergeable with the first one.
+UploadArtifactTaskPtr mergeUploadArtifactTasks(const std::vector<UploadArtifactTaskPtr>& tasks);
+
 
 class UploadBackgroundTask : public UploadArtifactTask
 {
@@ -41,7 +170,14 @@ public:
 
     Status execute(ClientSession& session) const;
     size_t getArtifactSize() const;
+    uint64_t getFileSize() const;
     std::string toString() const;
+    bool serialize(ByteStreamWriter& writer, const std::string& payloadFilePrefix, std::string& linkPath) const;
+
+    Type getType() const
+    {
+        return BACKGROUND;
+    }
 
 private:
     prism::connect::timestamp_t timestamp_;
@@ -62,7 +198,17 @@ public:
 
     Status execute(ClientSession& session) const;
     size_t getArtifactSize() const;
+    uint64_t getFileSize() const;
     std::string toString() const;
+    bool serialize(ByteStreamWriter& writer, const std::string& payloadFilePrefix, std::string& linkPath) const;
+
+    // Only the latest snapshot of each object is needed
+    std::string getSupersedeKey() const;
+
+    Type getType() const
+    {
+        return OBJECT_STREAM;
+    }
 
 private:
     ObjectStream stream_;
@@ -83,7 +229,14 @@ public:
 
     Status execute(ClientSession& session) const;
     size_t getArtifactSize() const;
+    uint64_t getFileSize() const;
     std::string toString() const;
+    bool serialize(ByteStreamWriter& writer, const std::string& payloadFilePrefix, std::string& linkPath) const;
+
+    Type getType() const
+    {
+        return FLIPBOOK;
+    }
 
 private:
     Flipbook flipbook_;
@@ -105,6 +258,32 @@ public:
     Status execute(ClientSession& session) const;
     size_t getArtifactSize() const;
     std::string toString() const;
+    bool serialize(ByteStreamWriter& writer, const std::string& payloadFilePrefix, std::string& linkPath) const;
+
+    Type getType() const
+    {
+        return EVENT;
+    }
+
+    bool canMergeWith(const UploadArtifactTask& other) const
+    {
+        return other.getType() == EVENT;
+    }
+
+    size_t getNumItems() const
+    {
+        return data_.size();
+    }
+
+    const timestamp_t& getTimestamp() const
+    {
+        return timestamp_;
+    }
+
+    const Events& getEvents() const
+    {
+        return data_;
+    }
 
 private:
     timestamp_t timestamp_;
@@ -121,15 +300,53 @@ public:
         : update_(update)
     {
         std::swap(counts.ref, data_);
+        makeOrderingKeys();
     }
 
     Status execute(ClientSession& session) const;
     size_t getArtifactSize() const;
     std::string toString() const;
+    bool serialize(ByteStreamWriter& writer, const std::string& payloadFilePrefix, std::string& linkPath) const;
+
+    Type getType() const
+    {
+        return COUNT;
+    }
+
+    // counts, which update earlier ones, are sent by separate request
+    bool canMergeWith(const UploadArtifactTask& other) const
+    {
+        return other.getType() == COUNT
+                &&  static_cast<const UploadCountTask&>(other).update_ == update_;
+    }
+
+    size_t getNumItems() const
+    {
+        return data_.size();
+    }
+
+    const Counts& getCounts() const
+    {
+        return data_;
+    }
+
+    bool isUpdate() const
+    {
+        return update_;
+    }
+
+    // one key per label, as later counts for label may update earlier ones
+    const std::vector<std::string>& getOrderingKeys() const
+    {
+        return orderingKeys_;
+    }
 
 private:
+    void makeOrderingKeys();
+
     Counts data_;
     bool update_;
+    std::vector<std::string> orderingKeys_;
 };
 
 typedef boost::shared_ptr<UploadCountTask> UploadCountTaskPtr;
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#ifndef PRISM_UPLOAD_COMPLETION_H_
+#define PRISM_UPLOAD_COMPLETION_H_
+
+#include "boost/chrono.hpp"
+#include "boost/noncopyable.hpp"
+#include "boost/shared_ptr.hpp"
+
+#include "artifact-uploader.h"
+
+namespace prism
+{
+namespace connect
+{
+
+// Counts upload attempts of task and reports its final result to callback
+// given to ArtifactUploader::upload*(). It's shared by task and by queue,
+// which keeps it, while task is spilled to journal. Task is owned by one
+// thread at a time, so is its completion.
+class UploadCompletion : boost::noncopyable
+{
+public:
+    explicit UploadCompletion(const ArtifactUploader::CompletionCallback& callback);
+
+    // Reports abandoned task as failed, unless it's completed or cancelled
+    ~UploadCompletion();
+
+    void addAttempt(int64_t transferMs);
+
+    // Calls callback, if it wasn't called yet
+    void complete(const Status& status);
+
+    // Callback won't be called, e.g. as task wasn't enqueued
+    void cancel();
+
+private:
+    ArtifactUploader::CompletionCallback callback_;
+    boost::chrono::steady_clock::time_point startTime_;
+    int numAttempts_;
+    int64_t transferMs_;
+};
+
+typedef boost::shared_ptr<UploadCompletion> UploadCompletionPtr;
+
+} // namespace connect
+} // namespace prism
+
+#endif // PRISM_UPLOAD_COMPLETION_H_
@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#ifndef PRISM_UPLOAD_JOURNAL_H_
+#define PRISM_UPLOAD_JOURNAL_H_
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "boost/noncopyable.hpp"
+#include "boost/thread/condition_variable.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/thread.hpp"
+
+#include "UploadArtifactTask.h"
+
+namespace prism
+{
+namespace connect
+{
+
+// Append-only on-disk log of upload tasks backing "persistent" upload queue.
+// Journal consists of segment files in single directory. Task is recorded on
+// append() and cancelled by removal record on remove(). Records are written
+// and synced to disk by journal's own thread in batches, so single fsync
+// covers all records appended meanwhile. Oldest segments are deleted once
+// none of their tasks is alive. Payload files are kept in the same directory
+// as hard links, which are deleted together with their tasks.
+class UploadJournal : boost::noncopyable
+{
+public:
+    struct RecordInfo
+    {
+        RecordInfo(uint64_t id, size_t size, uint64_t fileSize)
+            : id(id)
+            , size(size)
+            , fileSize(fileSize)
+        {
+        }
+
+        uint64_t id;
+        size_t size;
+
+        // part of size taken by payload file
+        uint64_t fileSize;
+    };
+
+    typedef std::vector<RecordInfo> RecordInfos;
+
+    explicit UploadJournal(const std::string& dirPath);
+
+    // Writes records still pending
+    ~UploadJournal();
+
+    // Scans existing segments and fills records alive in order they were
+    // appended. Must be called once before other methods.
+    Status open(RecordInfos& records);
+
+    // Non-blocking. Assigns journal ID to task, task is written later.
+    void append(UploadArtifactTaskPtr task);
+
+    // Task is uploaded or dropped and won't be restored after restart
+    void remove(uint64_t id);
+
+    // Returns task, which was appended earlier or restored by open(), or
+    // empty pointer if it can't be read
+    UploadArtifactTaskPtr load(uint64_t id);
+
+    // Size of alive records in bytes including their payload files. Size of
+    // records pending write is estimated by their artifact size.
+    uint64_t getAliveSize() const;
+
+    // Estimated size of task's record, as counted by getAliveSize()
+    static uint64_t getRecordSize(const UploadArtifactTask& task);
+
+    // Blocks until all records appended so far are on disk
+    void flush();
+
+private:
+    enum RecordType
+    {
+        RECORD_ADD = 1,
+        RECORD_REMOVE = 2
+    };
+
+    struct Entry
+    {
+        Entry()
+            : segment(0)
+            , offset(0)
+            , size(0)
+            , fileSize(0)
+            , isWritten(false)
+        {
+        }
+
+        // held until written, as it may be evicted from memory queue meanwhile
+        UploadArtifactTaskPtr task;
+        uint32_t segment;
+        uint64_t offset;
+
+        // record's size in segment plus fileSize
+        size_t size;
+
+        // payload file linked by record, if any
+        std::string filePath;
+        uint64_t fileSize;
+        bool isWritten;
+    };
+
+    struct WrittenRecord
+    {
+        WrittenRecord(uint64_t id, size_t offset, size_t size, const std::string& filePath, uint64_t fileSize)
+            : id(id)
+            , offset(offset)
+            , size(size)
+            , filePath(filePath)
+            , fileSize(fileSize)
+        {
+        }
+
+        uint64_t id;
+
+        // in batch
+        size_t offset;
+        size_t size;
+        std::string filePath;
+        uint64_t fileSize;
+    };
+
+    struct Segment
+    {
+        Segment()
+            : size(0)
+            , numAlive(0)
+        {
+        }
+
+        uint64_t size;
+        size_t numAlive;
+    };
+
+    struct Operation
+    {
+        Operation(RecordType type, uint64_t id)
+            : type(type)
+            , id(id)
+        {
+        }
+
+        RecordType type;
+        uint64_t id;
+    };
+
+    void threadFunc();
+    bool writeBatch(const ByteBuffer& batch, uint32_t& segment, uint64_t& offset);
+    bool openActiveSegment(uint32_t segment);
+    void deleteDeadSegments();
+    bool scanSegment(uint32_t segment);
+    void attachPayloadFiles(const std::map<uint64_t, std::string>& files);
+    std::string getSegmentPath(uint32_t segment) const;
+    std::string getPayloadFilePrefix(uint64_t id) const;
+
+    static void finishRecord(ByteBuffer& buf, RecordType type, uint64_t id, size_t offset);
+
+    const std::string dirPath_;
+
+    boost::thread thread_;
+    mutable boost::mutex mutex_;
+    boost::condition_variable cv_;
+
+    // guarded by mutex_
+    std::map<uint64_t, Entry> entries_;
+    std::map<uint32_t, Segment> segments_;
+    std::deque<Operation> pending_;
+    uint64_t nextId_;
+    uint64_t aliveSize_;
+    uint32_t activeSegment_;
+    bool isWriting_;
+    bool done_;
+
+    // accessed by journal thread only, once it's started
+    int fd_;
+};
+
+typedef boost::shared_ptr<UploadJournal> UploadJournalPtr;
+
+} // namespace connect
+} // namespace prism
+
+#endif // PRISM_UPLOAD_JOURNAL_H_
@@ -5,12 +5,19 @@
 #define PRISM_UPLOAD_QUEUE_H_
 
 #include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
 
+#include <boost/atomic.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/locks.hpp>
 
+#include "MpscRing.h"
 #include "UploadArtifactTask.h"
+#include "UploadJournal.h"
 
 namespace prism
 {
@@ -20,43 +27,237 @@ namespace connect
 class UploadQueue
 {
 public:
-    UploadQueue(size_t maxMemorySize, size_t usageWarningSize)
+    // Payload files referenced by tasks don't count against maxMemorySize,
+    // they are limited by maxFileSize instead, 0 means no limit.
+    UploadQueue(size_t maxMemorySize, size_t usageWarningSize, uint64_t maxFileSize = 0)
         : maxMemorySize_(maxMemorySize)
         , usageSizeWarning_(usageWarningSize)
         , size_(0)
+        , maxFileSize_(maxFileSize)
+        , fileSize_(0)
+        , lanes_(1)
+        , intake_(INTAKE_CAPACITY)
+        , numWaiters_(0)
+        , numInProgress_(0)
+        , isInterrupted_(false)
+        , numFlushes_(0)
+        , defaultLane_(0)
+        , maxDiskSize_(0)
+        , isRefilling_(false)
     {}
 
+    typedef std::map<UploadArtifactTask::Type, int> Priorities;
+    typedef std::set<UploadArtifactTask::Type> Types;
+
+    // Enables priority mode: pop_front() prefers tasks of types with greater
+    // priority, tasks of the same priority are popped in order. Task, which
+    // waits longer than maxWait, is popped first regardless of priority.
+    // Once memory is exhausted, the oldest task of the lowest priority is
+    // dropped. Types not in priorities have priority 0. Each priority has
+    // its own lane, so that pop doesn't scan tasks of lower priority.
+    // Can't be combined with openJournal(). Must be called before any other
+    // method.
+    void setPriorities(const Priorities& priorities, const boost::posix_time::time_duration& maxWait);
+
+    // Makes queue persistent: restores tasks left in journal in dirPath by
+    // previous run and records new tasks there. Tasks, which don't fit into
+    // maxMemorySize, are kept in journal only, then oldest tasks are dropped
+    // once journal exceeds maxDiskSize. Task, whose record alone exceeds
+    // maxDiskSize, is rejected by push_back(). Must be called before any
+    // other method.
+    Status openJournal(const std::string& dirPath, uint64_t maxDiskSize);
+
+    // Task of one of types replaces tasks queued earlier, which are of the
+    // same type and have the same supersede key, so that only the latest one
+    // is uploaded. Completions of replaced tasks are reported failed. Tasks
+    // in progress and tasks kept in journal only aren't replaced.
+    // Must be called before any other method.
+    void setSupersedableTypes(const Types& types);
+
+    // Unless queue is persistent, task, which fits into free space, is put
+    // into lock-free intake without taking mutex, it's moved to queue by
+    // consumer. Otherwise, tasks are dropped to make room for it under mutex,
+    // their completions are reported failed by calling thread. Task is
+    // rejected, if room can't be made, e.g. space is reserved by producers,
+    // which haven't put their tasks into intake yet.
     Status push_back(UploadArtifactTaskPtr task);
     Status push_front(UploadArtifactTaskPtr task);
+
+    // Pops first task, which doesn't share ordering keys with tasks in
+    // progress or with tasks ahead of it. Popped task is in progress until
+    // release() is called for it.
     bool pop_front(UploadArtifactTaskPtr& task, const boost::posix_time::time_duration waitTime = boost::posix_time::pos_infin);
 
+    // Doesn't wait. Appends to batch tasks, which can be merged with the
+    // first task of batch (see UploadArtifactTask::canMergeWith()), while
+    // batch holds no more than maxNumItems items. Tasks of batch must be
+    // popped by pop_front() or pop_mergeable() and each of them is in
+    // progress until released. Returns number of items in batch.
+    size_t pop_mergeable(std::vector<UploadArtifactTaskPtr>& batch, size_t maxNumItems);
+
+    // Marks task returned by pop_front() as no longer in progress. Call it
+    // after task is put back by push_front(), if it is to be retried.
+    void release(UploadArtifactTaskPtr task);
+
+    // Same as release() for task, which is uploaded or dropped, also removes
+    // it from journal.
+    void complete(UploadArtifactTaskPtr task);
+
     // Uses queue's mutex and condition variable to wait until given time
     // This is necessary evil to be able to interrupt sleep (wait) by adding item to queue.
     // This allows implicit "sharing" of queue's mutex and cond.variable without explicitly
     // exposing them to implement "interruptible sleep"
     bool timed_wait(boost::system_time waitUntil);
 
-    size_t size() const
-    {
-        return deque_.size();
-    }
+    // Same as timed_wait(), for thread lingering for more tasks to upload
+    // them together: returns false without waiting, while flush is in
+    // progress, and flush wakes it up.
+    bool linger_wait(boost::system_time lingerUntil);
+
+    // Flush is in progress between calls, possibly nested. Threads don't
+    // linger meanwhile.
+    void beginFlush();
+    void endFlush();
+    bool isFlushing() const;
+
+    // Wakes up threads waiting in pop_front(), timed_wait() or linger_wait().
+    // From then on they return false without waiting. Tasks stay in queue.
+    void interrupt();
+
+    // Waits until queue is empty and no task is in progress, or until
+    // deadline. Returns true, if queue is drained.
+    bool wait_drained(boost::system_time deadline);
 
-    bool empty() const
+    // Tasks popped and not released yet
+    size_t numInProgress() const
     {
-        return deque_.empty();
+        return numInProgress_.load(boost::memory_order_relaxed);
     }
 
+    // Detaches completions of all queued tasks, including ones in journal
+    // only, so that owner reports them, while queue is intact. Tasks stay
+    // in queue.
+    void takeCompletions(std::vector<UploadCompletionPtr>& completions);
+
+    // Take mutex_, so they're safe to call from any thread
+    size_t size() const;
+    bool empty() const;
+
 private:
+    typedef std::deque<UploadArtifactTaskPtr> Lane;
+
+    // tasks pushed, while consumer is busy, spill over to locked path
+    static const size_t INTAKE_CAPACITY = 4096;
+
+    // records loaded from journal at once, so that first of them are
+    // uploaded before the rest is read
+    static const size_t REFILL_BATCH_SIZE = 16;
+
     const size_t maxMemorySize_;
     const size_t usageSizeWarning_;
-    size_t size_;
-    std::deque<UploadArtifactTaskPtr> deque_;
+    // Sizes of tasks in lanes_ and intake_. Space is reserved by producers
+    // without lock, so they're only changed atomically.
+    boost::atomic<size_t> size_;
+    const uint64_t maxFileSize_;
+    boost::atomic<uint64_t> fileSize_;
+
+    // Single lane, unless in priority mode. Then lanes are in order of
+    // priority, the greatest first, and the last lane holds only empty
+    // tasks, which stop upload threads. Journal isn't used in priority
+    // mode, so journaled tasks are always in the first lane.
+    std::vector<Lane> lanes_;
+
+    // Tasks pushed without lock, they follow tasks of lanes_. Popped under
+    // mutex_ only.
+    MpscRing<UploadArtifactTaskPtr> intake_;
+
+    // Threads waiting on cv_ or timedCv_. Producers, which don't take
+    // mutex_, take it to notify them only if there are any, so that wakeup
+    // isn't lost.
+    boost::atomic<int> numWaiters_;
+
+    // Changed under mutex_, read without it by numInProgress()
+    boost::atomic<size_t> numInProgress_;
+    bool isInterrupted_;
+
+    // flushes in progress, changed under mutex_, so that lingering thread
+    // doesn't miss it between check and wait
+    int numFlushes_;
+
+    // ordering keys of tasks in progress
+    std::set<std::string> busyKeys_;
+
+    Types supersedableTypes_;
+
+    // empty unless in priority mode
+    Priorities priorities_;
+    boost::posix_time::time_duration maxPriorityWait_;
+    std::map<UploadArtifactTask::Type, size_t> typeLanes_;
+    size_t defaultLane_;
+
+    UploadJournalPtr journal_;
+    uint64_t maxDiskSize_;
+
+    // Tasks, which are in journal only, they follow tasks of the lane
+    std::deque<UploadJournal::RecordInfo> spilled_;
+
+    // Single thread loads tasks from journal without mutex_. Their records
+    // stay in spilled_ meanwhile, so that order is kept. Records dropped
+    // meanwhile are removed from loadingIds_.
+    bool isRefilling_;
+    std::set<uint64_t> loadingIds_;
+
+    // Completions of spilled_ tasks by journal ID, they're given back to
+    // tasks, once they're loaded
+    std::map<uint64_t, UploadCompletionPtr> spilledCompletions_;
+
+    // Completions of tasks dropped under mutex_, they're reported after it's
+    // unlocked, as callbacks may push more tasks
+    std::vector<UploadCompletionPtr> dropped_;
 
     boost::condition_variable cv_;
-    boost::mutex mutex_;
+    mutable boost::mutex mutex_;
+
+    // Separate from cv_, as producers wake up single waiter of cv_, which
+    // must be consumer
+    boost::condition_variable drainedCv_;
+
+    // Waiters of timed_wait() and linger_wait(), separate from cv_ for the same reason. Push
+    // wakes up all of them, as each rechecks its own condition.
+    boost::condition_variable timedCv_;
 
-    bool arrangeFreeSpaceForTask(const size_t taskSize);
-    void addSize(size_t size);
+    bool arrangeFreeSpaceForTask(const UploadArtifactTask& task);
+    bool hasRoomFor(size_t memorySize, uint64_t fileSize) const;
+    bool tryReserve(size_t memorySize, uint64_t fileSize);
+    bool tryPushToIntake(UploadArtifactTaskPtr task);
+    void drainIntake();
+    void notifyWaiter();
+    void notifyPushed();
+    bool waitTimed(boost::unique_lock<boost::mutex>& lock, boost::system_time waitUntil);
+    bool findReadyTask(size_t& lane, Lane::iterator& it);
+    bool findPriorityTask(size_t& lane, Lane::iterator& it);
+    Lane::iterator findReadyTaskInLane(Lane& lane);
+    bool findTaskToDrop(bool withFileOnly, size_t& lane, Lane::iterator& it);
+    size_t getLane(const UploadArtifactTaskPtr& task) const;
+    size_t getTypeLane(UploadArtifactTask::Type type) const;
+    bool hasReadyTask();
+    bool isReadyOrInterrupted();
+    bool isEmpty() const;
+    bool isDrained() const;
+    bool pushBackJournaled(UploadArtifactTaskPtr task);
+    void spillBack();
+    void refill();
+    void pickSpilled(std::vector<UploadJournal::RecordInfo>& records);
+    bool putLoaded(const std::vector<UploadJournal::RecordInfo>& records,
+                   const std::vector<UploadArtifactTaskPtr>& tasks,
+                   std::vector<UploadCompletionPtr>& failed);
+    bool dropForDiskSpace();
+    void addDropped(const UploadArtifactTask& task);
+    void dropSuperseded(const UploadArtifactTask& task);
+    void spill(const UploadArtifactTask& task);
+    void checkUsage(size_t size);
+    void addTaskSize(const UploadArtifactTask& task);
+    void removeTaskSize(const UploadArtifactTask& task);
 };
 typedef boost::shared_ptr<UploadQueue> UploadQueuePtr;
 
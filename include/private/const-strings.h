@@ -45,11 +45,18 @@ extern const char* kStrLabel;
 
 extern const char* kStrErrorMessages;
 extern const char* kStrSimple;
+extern const char* kStrPersistent;
+extern const char* kStrPriority;
 extern const char* kStrCamera;
 extern const char* kStrTrue;
 extern const char* kStrFalse;
 extern const char* kStrUpdate;
 extern const char* kStrPoints;
+extern const char* kStrRetryAfter;
+extern const char* kStrNext;
+extern const char* kStrResults;
+extern const char* kStrETag;
+extern const char* kStrLastModified;
 }
 }
 
@@ -18,7 +18,9 @@ typedef unique_ptr<CurlSession>::t CurlSessionPtr;
 class CurlSession : public CurlWrapper
 {
 public:
-    static CurlSessionPtr create(const std::string& token);
+    // curlFactory is shared between sessions to reuse CURL handles and,
+    // therefore, connections
+    static CurlSessionPtr create(const std::string& token, CurlFactoryPtr curlFactory);
 
     virtual ~CurlSession();
 
@@ -27,10 +29,10 @@ public:
         return errorMessage_;
     }
 
-    CURLcode performRequest(CString url);
+    virtual void completeRequest(CURLcode result);
 
 private:
-    bool init(const std::string& token);
+    bool init(const std::string& token, CurlFactoryPtr curlFactory);
 
     void parseResponseForMessage();
 
@@ -4,9 +4,21 @@
 #ifndef CONNECT_SDK_CURLWRAPPER_H
 #define CONNECT_SDK_CURLWRAPPER_H
 
+#include <list>
+#include "boost/atomic.hpp"
 #include "common-types.h"
+#include "public-util.h"
 #include "curl/curl.h"
 #include "util.h"
+#include "CaBundle.h"
+
+// curl_mime API appeared in libcurl 7.56.0, older libcurl (e.g. one used on
+// iOS) is driven by deprecated curl_formadd()
+#define CONNECT_CURL_HAS_MIME (LIBCURL_VERSION_NUM >= 0x073800)
+
+// CURLOPT_XFERINFOFUNCTION appeared in libcurl 7.32.0, older one has
+// CURLOPT_PROGRESSFUNCTION only
+#define CONNECT_CURL_HAS_XFERINFO (LIBCURL_VERSION_NUM >= 0x072000)
 
 namespace prism
 {
@@ -23,6 +35,57 @@ struct CurlCallbacks
     }
 };
 
+// Receives body of successful response as it arrives, instead of it being
+// collected for getResponseBodyAsString()
+struct ResponseBodySink
+{
+    virtual void write(const char* data, size_t size) = 0;
+
+    virtual ~ResponseBodySink()
+    {
+    }
+};
+
+// What libcurl has measured of the last request. Times are in seconds
+// since request start, as libcurl reports them.
+struct RequestTimings
+{
+    RequestTimings()
+        : nameLookupTime(0)
+        , connectTime(0)
+        , appConnectTime(0)
+        , preTransferTime(0)
+        , startTransferTime(0)
+        , totalTime(0)
+        , redirectTime(0)
+        , downloadSpeed(0)
+        , uploadSpeed(0)
+        , sizeUpload(0)
+        , sizeDownload(0)
+        , numConnects(0)
+    {
+    }
+
+    double nameLookupTime;
+    double connectTime;
+    // TLS handshake is complete, 0 for plain HTTP
+    double appConnectTime;
+    double preTransferTime;
+    // the first byte of response is received
+    double startTransferTime;
+    double totalTime;
+    double redirectTime;
+
+    // bytes per second, bodies only
+    double downloadSpeed;
+    double uploadSpeed;
+    double sizeUpload;
+    double sizeDownload;
+
+    // new connections made for request, 0, if one was reused
+    long numConnects;
+};
+
 struct CurlFactory
 {
     virtual CURL* create() = 0;
@@ -45,8 +108,15 @@ public:
     CurlWrapper()
         : curl_(0)
         , httpHeader_(0)
+#if CONNECT_CURL_HAS_MIME
+        , mime_(0)
+#else
         , post_(0)
         , last_(0)
+#endif
+        , responseBodySink_(0)
+        , abortGeneration_(0)
+        , startGeneration_(0)
     {
     }
 
@@ -55,16 +125,33 @@ public:
 
     virtual ~CurlWrapper();
 
-    CURLcode httpGet(const std::string& url)
+    // Request is either performed synchronously by http*() methods or
+    // prepared by prepareHttp*() and then run by perform() or by CurlMultiEngine.
+    // In both cases completeRequest() is called once transfer is over.
+    void prepareHttpGet(const std::string& url)
     {
         curl_easy_setopt(curl_, CURLOPT_HTTPGET, 1);
-        return performRequest(url);
+        prepareRequest(url);
     }
 
-    CURLcode httpPost(const std::string& url, CString postField)
+    void prepareHttpPost(const std::string& url, CString postField)
     {
         curl_easy_setopt(curl_, CURLOPT_COPYPOSTFIELDS, postField.ptr());
-        return performRequest(url);
+        prepareRequest(url);
+    }
+
+    void prepareHttpPostForm(const std::string& url);
+
+    CURLcode httpGet(const std::string& url)
+    {
+        prepareHttpGet(url);
+        return perform();
+    }
+
+    CURLcode httpPost(const std::string& url, CString postField)
+    {
+        prepareHttpPost(url, postField);
+        return perform();
     }
 
     // overwrites existing headers, if any
@@ -84,55 +171,68 @@ public:
         httpHeader_ = curl_slist_append(httpHeader_, header);
     }
 
-    void addFormField(CString key, CString value)
-    {
-        curl_formadd(&post_, &last_,
-                     CURLFORM_COPYNAME, key.ptr(),
-                     CURLFORM_COPYCONTENTS, value.ptr(),
-                     CURLFORM_END);
-    }
+    // Form parts below are sent by prepareHttpPostForm(). Small values are
+    // copied, larger ones are read by libcurl directly from their buffers.
 
-    void addFormField(CString key, CString value, CString mimeType)
-    {
-        curl_formadd(&post_, &last_,
-                     CURLFORM_COPYNAME, key.ptr(),
-                     CURLFORM_COPYCONTENTS, value.ptr(),
-                     CURLFORM_CONTENTTYPE, mimeType.ptr(),
-                     CURLFORM_END);
-    }
+    void addFormField(CString key, CString value);
+    void addFormField(CString key, CString value, CString mimeType);
 
-    void addFormFile(CString key, CString filePath, CString mimeType)
-    {
-        curl_formadd(&post_, &last_,
-                     CURLFORM_COPYNAME, key.ptr(),
-                     CURLFORM_FILE, filePath.ptr(),
-                     CURLFORM_CONTENTTYPE, mimeType.ptr(),
-                     CURLFORM_END);
-    }
+    // Takes value over without copying, it's kept until request is complete
+    void addFormField(CString key, move_ref<std::string> value, CString mimeType);
+
+    // Same as above for value already encoded by contentEncoding e.g. "gzip",
+    // which is sent in Content-Encoding header of the part
+    void addFormField(CString key, move_ref<std::string> value, CString mimeType,
+                      CString contentEncoding);
+
+    // File is streamed in chunks of libcurl's upload buffer size
+    void addFormFile(CString key, CString filePath, CString mimeType);
+
+    // Data isn't copied, it must stay available until request is complete.
+    // Part is named "dummyname", if fileName is empty.
+    void addFormFile(CString key, const void* data, size_t dataSize, CString mimeType, CString fileName);
 
-    void addFormFile(CString key, const void* data, size_t dataSize, CString mimeType)
+    CURLcode httpPostForm(const std::string& url)
     {
-        curl_formadd(&post_, &last_,
-                     CURLFORM_COPYNAME, key.ptr(),
-                     CURLFORM_BUFFER, "dummyname",
-                     CURLFORM_BUFFERPTR, data,
-                     CURLFORM_BUFFERLENGTH, dataSize,
-                     CURLFORM_CONTENTTYPE, mimeType.ptr(),
-                     CURLFORM_END);
+        prepareHttpPostForm(url);
+        return perform();
     }
 
-    CURLcode httpPostForm(const std::string& url);
+    // performs prepared request synchronously
+    CURLcode perform();
+
+    // Collects response data and releases request data. Called after transfer
+    // of prepared request is over, successfully or not.
+    virtual void completeRequest(CURLcode result);
 
     const std::string& getResponseBodyAsString() const
     {
         return responseBody_;
     }
 
+    // Sink gets body of 200 response of prepared request, while body of
+    // any other response is still collected for error handling. Set after
+    // prepareHttp*(), sink must outlive request.
+    void setResponseBodySink(ResponseBodySink* sink)
+    {
+        responseBodySink_ = sink;
+    }
+
     long getResponseCode() const
     {
         return responseCode_;
     }
 
+    // Collected by completeRequest() for every request
+    const RequestTimings& getTimings() const
+    {
+        return timings_;
+    }
+
+    // Returns value of response header, name is case insensitive. Returns
+    // empty string, if there is no such header.
+    std::string getResponseHeader(CString name) const;
+
     void setConnectionTimeoutMs(long timeoutMs)
     {
         curl_easy_setopt(curl_, CURLOPT_CONNECTTIMEOUT_MS, timeoutMs);
@@ -189,8 +289,20 @@ public:
         curl_easy_setopt(curl_, CURLOPT_CAINFO, caBundlePath.c_str());
     }
 
+    // Keeps bundle until request is complete
+    void setCaBundle(CaBundlePtr caBundle)
+    {
+        caBundle_ = caBundle;
+        caBundle_->attach(curl_);
+    }
+
+    // Request in progress fails with CURLE_ABORTED_BY_CALLBACK, once
+    // generation differs from value it has now. generation must outlive
+    // wrapper.
+    void setAbortGeneration(const boost::atomic<unsigned>& generation);
+
 protected:
-    virtual CURLcode performRequest(CString url);
+    void prepareRequest(CString url);
 
 private:
     static size_t writeFunctionThunk(void* ptr, size_t size, size_t nmemb,
@@ -205,11 +317,7 @@ private:
         return callbacks->headerFunction(ptr, size, nmemb);
     }
 
-    virtual size_t writeFunction(void* ptr, size_t size, size_t nmemb)
-    {
-        responseBody_.append((char*) ptr, size * nmemb);
-        return size * nmemb;
-    }
+    virtual size_t writeFunction(void* ptr, size_t size, size_t nmemb);
 
     virtual size_t headerFunction(void* ptr, size_t size, size_t nmemb)
     {
@@ -217,15 +325,52 @@ private:
         return size * nmemb;
     }
 
+#if CONNECT_CURL_HAS_XFERINFO
+    static int xferInfoThunk(void* wrapper, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
+    {
+        return static_cast<CurlWrapper*>(wrapper)->isAborted() ? 1 : 0;
+    }
+#else
+    static int progressThunk(void* wrapper, double, double, double, double)
+    {
+        return static_cast<CurlWrapper*>(wrapper)->isAborted() ? 1 : 0;
+    }
+#endif
+
+    bool isAborted() const
+    {
+        return abortGeneration_
+                &&  abortGeneration_->load(boost::memory_order_relaxed) != startGeneration_;
+    }
+
+#if CONNECT_CURL_HAS_MIME
+    curl_mimepart* addFormPart(CString key, CString mimeType);
+#endif
+
+    void releaseForm();
+
     CURL* curl_;
     struct curl_slist* httpHeader_;
+#if CONNECT_CURL_HAS_MIME
+    curl_mime* mime_;
+#else
     struct curl_httppost* post_;
     struct curl_httppost* last_;
+    // part headers, libcurl doesn't own them
+    std::list<curl_slist*> formHeaders_;
+#endif
+    // values taken over by addFormField()
+    std::list<std::string> formValues_;
     long responseCode_;
+    RequestTimings timings_;
     std::string responseBody_;
+    ResponseBodySink* responseBodySink_;
     std::string responseHeaders_;
     CurlFactoryPtr curlFactory_;
     std::string proxy_;
+    CaBundlePtr caBundle_;
+    const boost::atomic<unsigned>* abortGeneration_;
+    unsigned startGeneration_;
 };
 
 }
@@ -18,8 +18,19 @@ namespace connect
     std::string toJsonString(const ObjectStream&);
     std::string toJsonString(const Tracks&);
 
+    // Same as above, but write into out, which is cleared first. Reuse the
+    // same string for consecutive calls to avoid reallocating it.
+    void toJsonString(const Counts&, std::string& out);
+    void toJsonString(const Events&, std::string& out);
+    void toJsonString(const Tracks&, std::string& out);
+
     std::string toString(int value);
 
+    // Compresses data by zlib in gzip format or, unless isGzip, in zlib
+    // format used by "deflate" HTTP content coding. level is 1..9 or -1 for
+    // zlib's default. Returns false, if data can't be compressed.
+    bool compressString(const std::string& data, bool isGzip, int level, std::string& out);
+
     std::string mimeTypeFromFilePath(const std::string& fileName);
     std::string toIsoTimeString(const timestamp_t& timestamp);
 
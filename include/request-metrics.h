@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#ifndef CONNECT_SDK_REQUEST_METRICS_H
+#define CONNECT_SDK_REQUEST_METRICS_H
+
+#include <map>
+#include <string>
+#include "boost/array.hpp"
+#include "boost/cstdint.hpp"
+
+namespace prism
+{
+namespace connect
+{
+
+// Distribution of durations, microseconds. As in HdrHistogram, values are
+// counted in log-linear buckets: each power of 2 is split into 16 linear
+// sub-buckets, so that reported values are within 1/16 of recorded ones.
+// Size is fixed, values above 2^32 us (71 min) are counted as that.
+// Histograms are merged by adding bucket counts.
+class DurationHistogram
+{
+public:
+    DurationHistogram();
+
+    void record(uint64_t valueUs);
+
+    void merge(const DurationHistogram& other);
+
+    uint64_t getCount() const
+    {
+        return count_;
+    }
+
+    // 0, if histogram is empty
+    uint64_t getMinUs() const
+    {
+        return count_ ? min_ : 0;
+    }
+
+    uint64_t getMaxUs() const
+    {
+        return max_;
+    }
+
+    double getMeanUs() const
+    {
+        return count_ ? double(sum_) / count_ : 0;
+    }
+
+    // Value, which percent of recorded values don't exceed, e.g. 99 for
+    // 99th percentile. 0, if histogram is empty.
+    uint64_t getPercentileUs(double percent) const;
+
+private:
+    enum
+    {
+        SUB_BUCKET_BITS = 4,
+        SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS,
+        MAX_VALUE_BITS = 32,
+        NUM_BUCKETS = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT
+    };
+
+    static size_t getBucket(uint64_t value);
+
+    // the largest value counted in bucket
+    static uint64_t getBucketValue(size_t bucket);
+
+    boost::array<uint64_t, NUM_BUCKETS> counts_;
+    uint64_t count_;
+    uint64_t min_;
+    uint64_t max_;
+    uint64_t sum_;
+};
+
+// Requests of single operation, e.g. all uploadBackground() ones
+struct RequestMetrics
+{
+    RequestMetrics()
+        : numRequests(0)
+        , numFailed(0)
+        , numNewConnections(0)
+        , numBytesUploaded(0)
+        , numBytesDownloaded(0)
+    {
+    }
+
+    void merge(const RequestMetrics& other);
+
+    uint64_t numRequests;
+
+    // network errors and HTTP 4xx and 5xx responses
+    uint64_t numFailed;
+
+    // requests, which have opened connection instead of reusing one
+    uint64_t numNewConnections;
+
+    // bodies only
+    uint64_t numBytesUploaded;
+    uint64_t numBytesDownloaded;
+
+    // Phases of request as libcurl measures them. The first three are
+    // about 0 for reused connection, time to first byte includes them and
+    // sending of request.
+    DurationHistogram nameLookup;
+    DurationHistogram connect;
+    DurationHistogram tlsHandshake;
+    DurationHistogram timeToFirstByte;
+    DurationHistogram total;
+};
+
+// By operation, named as in log, e.g. "Client::uploadBackground()"
+typedef std::map<std::string, RequestMetrics> RequestMetricsMap;
+
+// Adds metrics of from to those of the same operations in to
+void mergeRequestMetrics(const RequestMetricsMap& from, RequestMetricsMap& to);
+
+} // namespace connect
+} // namespace prism
+
+#endif // CONNECT_SDK_REQUEST_METRICS_H
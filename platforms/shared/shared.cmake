@@ -65,6 +65,11 @@ endmacro()
 
 macro(findCurlCommon)
     find_package(CURL REQUIRED)
+    # used to compress JSON uploads, libcurl depends on it anyway
+    find_package(ZLIB REQUIRED)
+    # optional, CA bundle is parsed once for all connections, if libcurl
+    # uses OpenSSL too
+    find_package(OpenSSL)
 endmacro()
 
 macro(setFlagsCommon)
@@ -95,6 +100,7 @@ function(buildSdk)
     message(STATUS "CURL include dirs: ${CURL_INCLUDE_DIRS}")
     message(STATUS "CURL library dirs: ${CURL_LIBRARY_DIRS}")
     message(STATUS "CURL libraries: ${CURL_LIBRARIES}")
+    message(STATUS "ZLIB libraries: ${ZLIB_LIBRARIES}")
 
     set (CONNECT_INCLUDE_DIRS
         ${CMAKE_SOURCE_DIR}/include
@@ -107,27 +113,47 @@ function(buildSdk)
         ${CMAKE_SOURCE_DIR}/src/client.cpp
         ${CMAKE_SOURCE_DIR}/src/curl-wrapper.cpp
         ${CMAKE_SOURCE_DIR}/src/curl-session.cpp
+        ${CMAKE_SOURCE_DIR}/src/CurlMultiEngine.cpp
+        ${CMAKE_SOURCE_DIR}/src/CurlShare.cpp
+        ${CMAKE_SOURCE_DIR}/src/CaBundle.cpp
+        ${CMAKE_SOURCE_DIR}/src/HttpValidatorCache.cpp
+        ${CMAKE_SOURCE_DIR}/src/InstrumentCache.cpp
+        ${CMAKE_SOURCE_DIR}/src/JsonArrayReader.cpp
         ${CMAKE_SOURCE_DIR}/src/domain-types.cpp
         ${CMAKE_SOURCE_DIR}/src/util.cpp
         ${CMAKE_SOURCE_DIR}/src/const-strings.cpp
         ${CMAKE_SOURCE_DIR}/src/public-util.cpp
+        ${CMAKE_SOURCE_DIR}/src/request-metrics.cpp
         ${CMAKE_SOURCE_DIR}/src/payload-holder.cpp
         ${CMAKE_SOURCE_DIR}/src/artifact-uploader.cpp
         ${CMAKE_SOURCE_DIR}/src/UploadArtifactTask.cpp
         ${CMAKE_SOURCE_DIR}/src/UploadQueue.cpp
+        ${CMAKE_SOURCE_DIR}/src/UploadCompletion.cpp
+        ${CMAKE_SOURCE_DIR}/src/UploadJournal.cpp
+        ${CMAKE_SOURCE_DIR}/src/IsoTimeFormatter.cpp
     )
 
     include_directories(
         ${CONNECT_INCLUDE_DIRS}
         ${Boost_INCLUDE_DIRS}
-        ${CURL_INCLUDE_DIRS})
+        ${CURL_INCLUDE_DIRS}
+        ${ZLIB_INCLUDE_DIRS})
 
     link_directories(
         ${Boost_LIBRARY_DIRS}
         ${CURL_LIBRARY_DIRS})
 
+    set (CONNECT_LIBS ${Boost_LIBRARIES} ${CURL_LIBRARIES} ${ZLIB_LIBRARIES})
+
+    if (OPENSSL_FOUND)
+        message(STATUS "OpenSSL libraries: ${OPENSSL_LIBRARIES}")
+        add_definitions(-DPRISM_HAVE_OPENSSL=1)
+        include_directories(${OPENSSL_INCLUDE_DIR})
+        list(APPEND CONNECT_LIBS ${OPENSSL_LIBRARIES})
+    endif ()
+
     add_library(connect STATIC ${CONNECT_SOURCES})
-    target_link_libraries(connect ${Boost_LIBRARIES} ${CURL_LIBRARIES})
+    target_link_libraries(connect ${CONNECT_LIBS})
 
     add_custom_target(
         install_wrapper
@@ -145,6 +171,7 @@ function(buildSdk)
         ${CMAKE_SOURCE_DIR}/include/domain-types.h
         ${CMAKE_SOURCE_DIR}/include/payload-holder.h
         ${CMAKE_SOURCE_DIR}/include/public-util.h
+        ${CMAKE_SOURCE_DIR}/include/request-metrics.h
         # util.h is internal header and shall not be exposed
         )
 
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include <iostream>
+#include <sstream>
+#include "boost/bind.hpp"
+#include "benchmarks.h"
+
+namespace prc = prism::connect;
+
+namespace prism
+{
+namespace bench
+{
+
+static prc::Counts makeCounts(int i)
+{
+    prc::Counts counts;
+    counts.push_back(prc::Count(prc::timestamp_t(1500000000000LL + i), i, "bench"));
+    return counts;
+}
+
+static double runSequential(const BenchOptions& options, prc::Client& client,
+                            prc::id_t accountId, prc::id_t instrumentId, BenchReport& report)
+{
+    Stopwatch total;
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        Stopwatch sw;
+        prc::Status status = client.uploadCount(accountId, instrumentId, makeCounts(i), false);
+        report.addRequest(sw.elapsedMs(), status.isSuccess());
+    }
+
+    return total.elapsedMs();
+}
+
+static double runConcurrent(const BenchOptions& options, prc::Client& client,
+                            prc::id_t accountId, prc::id_t instrumentId,
+                            int maxInFlight, BenchReport& report)
+{
+    InFlightTracker tracker(report, maxInFlight);
+    Stopwatch total;
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        steady_clock::time_point start = tracker.acquire();
+
+        client.uploadCountAsync(accountId, instrumentId, makeCounts(i), false,
+                                boost::bind(&InFlightTracker::onComplete, &tracker, start, _1));
+    }
+
+    tracker.waitAll();
+
+    return total.elapsedMs();
+}
+
+int benchAsyncUploads(const BenchOptions& options)
+{
+    prc::Client client(options.apiRoot, options.apiToken);
+    configureClient(client, options);
+
+    prc::Status status = client.init();
+    prc::id_t accountId = 0;
+    prc::id_t instrumentId = 0;
+
+    if (status.isSuccess())
+        status = findTargetInstrument(client, accountId, instrumentId);
+
+    if (status.isError())
+    {
+        std::cout << "async-uploads: can't find instrument to upload to: " << status << std::endl;
+        return -1;
+    }
+
+    BenchReport sequential("async-uploads: sequential");
+    double sequentialMs = runSequential(options, client, accountId, instrumentId, sequential);
+    sequential.print(sequentialMs);
+
+    const int inFlight[] = {4, 16};
+
+    for (size_t i = 0; i < sizeof(inFlight)/sizeof(inFlight[0]); ++i)
+    {
+        std::ostringstream name;
+        name << "async-uploads: " << inFlight[i] << " in flight";
+
+        BenchReport concurrent(name.str());
+        double concurrentMs = runConcurrent(options, client, accountId, instrumentId,
+                                            inFlight[i], concurrent);
+        concurrent.print(concurrentMs);
+    }
+
+    return 0;
+}
+
+} // namespace bench
+} // namespace prism
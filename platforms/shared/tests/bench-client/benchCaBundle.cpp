@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include <sys/resource.h>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include "boost/filesystem.hpp"
+#include "boost/make_shared.hpp"
+#include "private/CaBundle.h"
+#include "private/curl-session.h"
+#include "private/PoolBasedCurlFactory.h"
+#include "benchmarks.h"
+#include "MockServer.h"
+
+#if PRISM_HAVE_OPENSSL
+#include "openssl/evp.h"
+#include "openssl/pem.h"
+#include "openssl/x509v3.h"
+#endif
+
+namespace prc = prism::connect;
+
+namespace prism
+{
+namespace bench
+{
+
+#if PRISM_HAVE_OPENSSL
+
+// Bundles of Linux distributions, which server certificate is appended to,
+// so that bundle is of realistic size
+static const char* const systemBundles[] =
+{
+    "/etc/ssl/certs/ca-certificates.crt",
+    "/etc/pki/tls/certs/ca-bundle.crt",
+    "/etc/ssl/cert.pem"
+};
+
+// CPU time consumed by calling thread so far, ms. Mock server runs in other
+// threads, so its part of TLS handshakes isn't counted.
+static double threadCpuMs()
+{
+    rusage usage;
+#ifdef RUSAGE_THREAD
+    getrusage(RUSAGE_THREAD, &usage);
+#else
+    getrusage(RUSAGE_SELF, &usage);
+#endif
+
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0
+            + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+}
+
+// Self-signed certificate of 127.0.0.1, which is also its own CA
+static bool makeCertificate(const std::string& certPath, const std::string& keyPath)
+{
+    EVP_PKEY* key = 0;
+    EVP_PKEY_CTX* keyCtx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, 0);
+
+    if (!keyCtx  ||  EVP_PKEY_keygen_init(keyCtx) <= 0
+            ||  EVP_PKEY_CTX_set_rsa_keygen_bits(keyCtx, 2048) <= 0
+            ||  EVP_PKEY_keygen(keyCtx, &key) <= 0)
+    {
+        EVP_PKEY_CTX_free(keyCtx);
+        return false;
+    }
+
+    EVP_PKEY_CTX_free(keyCtx);
+
+    X509* cert = X509_new();
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_get_notBefore(cert), 0);
+    X509_gmtime_adj(X509_get_notAfter(cert), 24 * 3600);
+    X509_set_pubkey(cert, key);
+
+    X509_NAME* name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                               reinterpret_cast<const unsigned char*>("127.0.0.1"), -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+
+    X509V3_CTX extCtx;
+    X509V3_set_ctx_nodb(&extCtx);
+    X509V3_set_ctx(&extCtx, cert, cert, 0, 0, 0);
+
+    static const char* const exts[][2] =
+    {
+        {"basicConstraints", "critical,CA:TRUE"},
+        {"subjectAltName", "IP:127.0.0.1"}
+    };
+
+    bool isOk = true;
+
+    for (size_t i = 0; isOk  &&  i < sizeof(exts)/sizeof(exts[0]); ++i)
+    {
+        X509_EXTENSION* ext = X509V3_EXT_conf(0, &extCtx, const_cast<char*>(exts[i][0]),
+                                              const_cast<char*>(exts[i][1]));
+        isOk = ext  &&  X509_add_ext(cert, ext, -1);
+        X509_EXTENSION_free(ext);
+    }
+
+    isOk = isOk  &&  X509_sign(cert, key, EVP_sha256());
+
+    FILE* certFile = isOk ? fopen(certPath.c_str(), "w") : 0;
+    isOk = certFile  &&  PEM_write_X509(certFile, cert);
+
+    if (certFile)
+        fclose(certFile);
+
+    FILE* keyFile = isOk ? fopen(keyPath.c_str(), "w") : 0;
+    isOk = keyFile  &&  PEM_write_PrivateKey(keyFile, key, 0, 0, 0, 0, 0);
+
+    if (keyFile)
+        fclose(keyFile);
+
+    X509_free(cert);
+    EVP_PKEY_free(key);
+
+    return isOk;
+}
+
+// System bundle, if any, followed by server certificate
+static bool makeBundle(const std::string& bundlePath, const std::string& certPath)
+{
+    std::ofstream bundle(bundlePath.c_str(), std::ios::binary);
+
+    for (size_t i = 0; i < sizeof(systemBundles)/sizeof(systemBundles[0]); ++i)
+    {
+        std::ifstream systemBundle(systemBundles[i], std::ios::binary);
+
+        if (systemBundle)
+        {
+            bundle << systemBundle.rdbuf() << '\n';
+            break;
+        }
+    }
+
+    std::ifstream cert(certPath.c_str(), std::ios::binary);
+    bundle << cert.rdbuf();
+
+    return bundle.good();
+}
+
+// CPU time to read and parse bundle, as done once per process now
+static void runLoad(const BenchOptions& options, const std::string& bundlePath)
+{
+    const double cpuStartMs = threadCpuMs();
+    Stopwatch total;
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        // previous instance is released, so that file is loaded again
+        if (!prc::CaBundle::getInstance(bundlePath))
+        {
+            std::cout << "ca-bundle: can't load " << bundlePath << std::endl;
+            return;
+        }
+    }
+
+    std::cout << "ca-bundle: load once, CPU ms: " << (threadCpuMs() - cpuStartMs) / options.iterations
+              << ", wall ms: " << total.elapsedMs() / options.iterations << std::endl;
+}
+
+// Requests over new TLS connection each, which is what first request of
+// new Client or upload thread does
+static bool runRequests(const BenchOptions& options, const char* name, const std::string& apiRoot,
+                        const std::string& bundlePath, prc::CaBundlePtr bundle)
+{
+    BenchReport report(std::string("ca-bundle: ") + name);
+    const double cpuStartMs = threadCpuMs();
+    Stopwatch total;
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        prc::CurlFactoryPtr factory = boost::make_shared<PoolBasedCurlFactory>();
+        prc::CurlSessionPtr session = prc::CurlSession::create("mock", factory);
+
+        if (!session)
+        {
+            report.addRequest(0, false);
+            continue;
+        }
+
+        if (bundle)
+            session->setCaBundle(bundle);
+        else
+            session->setCaBundlePath(bundlePath);
+
+        Stopwatch sw;
+        const CURLcode res = session->httpGet(apiRoot);
+        report.addRequest(sw.elapsedMs(), res == CURLE_OK  &&  session->getResponseCode() == 200);
+
+        if (res != CURLE_OK  &&  i == 0)
+            std::cout << "ca-bundle: " << name << ": " << curl_easy_strerror(res) << std::endl;
+    }
+
+    report.print(total.elapsedMs());
+    std::cout << "ca-bundle: " << name << ": client CPU ms per request: "
+              << (threadCpuMs() - cpuStartMs) / options.iterations << std::endl;
+
+    return report.getNumErrors() == 0;
+}
+
+int benchCaBundle(const BenchOptions& options)
+{
+    if (!prism::mock::MockServer::isTlsSupported())
+    {
+        std::cout << "ca-bundle: skipped, mock server is built without TLS" << std::endl;
+        return 0;
+    }
+
+    namespace fs = boost::filesystem;
+    const fs::path dir = fs::temp_directory_path() / fs::unique_path("ca-bundle-%%%%-%%%%");
+    fs::create_directories(dir);
+
+    prism::mock::MockServer::Configuration cfg;
+    cfg.certificateFile = (dir / "cert.pem").string();
+    cfg.privateKeyFile = (dir / "key.pem").string();
+    const std::string bundlePath = (dir / "bundle.pem").string();
+
+    prism::mock::MockServer server;
+    bool isOk = makeCertificate(cfg.certificateFile, cfg.privateKeyFile)
+            &&  makeBundle(bundlePath, cfg.certificateFile)
+            &&  server.start(cfg);
+
+    if (isOk)
+    {
+        std::cout << "ca-bundle: bundle bytes: " << fs::file_size(bundlePath) << std::endl;
+
+        runLoad(options, bundlePath);
+
+        prc::CaBundlePtr bundle = prc::CaBundle::getInstance(bundlePath);
+
+        isOk = bundle
+                &&  runRequests(options, "CURLOPT_CAINFO", server.getApiRoot(), bundlePath, prc::CaBundlePtr())
+                &&  runRequests(options, "shared bundle", server.getApiRoot(), bundlePath, bundle);
+    }
+    else
+    {
+        std::cout << "ca-bundle: can't set up TLS server" << std::endl;
+    }
+
+    server.stop();
+
+    boost::system::error_code ec;
+    fs::remove_all(dir, ec);
+
+    return isOk ? 0 : -1;
+}
+
+#else
+
+int benchCaBundle(const BenchOptions& /*options*/)
+{
+    std::cout << "ca-bundle: skipped, SDK is built without OpenSSL" << std::endl;
+    return 0;
+}
+
+#endif
+
+} // namespace bench
+} // namespace prism
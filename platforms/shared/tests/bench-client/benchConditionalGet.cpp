@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include <iostream>
+#include <sstream>
+#include "benchmarks.h"
+#include "MockServer.h"
+
+namespace prc = prism::connect;
+
+namespace prism
+{
+namespace bench
+{
+
+static const int NUM_INSTRUMENTS = 10000;
+
+// Mock server has one camera already
+static bool populateInstruments(prc::Client& client)
+{
+    for (int i = 2; i <= NUM_INSTRUMENTS; ++i)
+    {
+        std::ostringstream name;
+        name << "camera-" << i;
+
+        prc::Instrument instrument;
+        instrument.name = name.str();
+        instrument.type = "camera";
+
+        if (client.registerInstrument(1, instrument).isError())
+            return false;
+    }
+
+    return true;
+}
+
+// What client re-reads on restart or periodic refresh: API root, accounts,
+// account and its instruments
+static bool queryAll(prc::Client& client, size_t& numInstruments)
+{
+    prc::Accounts accounts;
+    prc::Account account;
+    prc::Instruments instruments;
+
+    const bool isOk = client.init().isSuccess()
+            &&  client.queryAccountsList(accounts).isSuccess()
+            &&  client.queryAccount(1, account).isSuccess()
+            &&  client.queryInstrumentsList(1, instruments).isSuccess();
+
+    numInstruments = instruments.size();
+
+    return isOk;
+}
+
+static bool runQueries(const BenchOptions& options, const prism::mock::MockServer& server, size_t maxEntries)
+{
+    prc::Client client(server.getApiRoot(), "mock");
+    configureClient(client, options);
+    client.setHttpCacheMaxEntries(maxEntries);
+
+    const prism::mock::MockServer::Statistics initial = server.getStatistics();
+    size_t numInstruments = 0;
+    Stopwatch sw;
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        if (!queryAll(client, numInstruments)  ||  numInstruments != size_t(NUM_INSTRUMENTS))
+            return false;
+    }
+
+    const prism::mock::MockServer::Statistics stats = server.getStatistics();
+    const prc::Client::HttpCacheStatistics cacheStats = client.getHttpCacheStatistics();
+
+    std::cout << "conditional-get: " << (maxEntries ? "validator cache" : "no cache") << ": "
+              << sw.elapsedMs() / options.iterations << " ms, response KB: "
+              << double(stats.numBytesSent - initial.numBytesSent) / 1024 / options.iterations
+              << " per round of 4 GETs; hits: " << cacheStats.numHits << ", misses: " << cacheStats.numMisses
+              << ", 304 sent: " << stats.numNotModified - initial.numNotModified << std::endl;
+
+    return true;
+}
+
+// Instrument registered by someone else changes list, so that it's
+// downloaded again, while the rest is still not modified
+static bool runChanged(const BenchOptions& options, const prism::mock::MockServer& server)
+{
+    prc::Client client(server.getApiRoot(), "mock");
+    configureClient(client, options);
+
+    prc::Client other(server.getApiRoot(), "mock");
+    configureClient(other, options);
+
+    size_t numInstruments = 0;
+
+    if (!queryAll(client, numInstruments)  ||  other.init().isError())
+        return false;
+
+    prc::Instrument instrument;
+    instrument.name = "camera-new";
+    instrument.type = "camera";
+
+    if (other.registerInstrument(1, instrument).isError()  ||  !queryAll(client, numInstruments))
+        return false;
+
+    const prc::Client::HttpCacheStatistics cacheStats = client.getHttpCacheStatistics();
+
+    std::cout << "conditional-get: list changed between rounds: hits: " << cacheStats.numHits
+              << ", misses: " << cacheStats.numMisses << ", instruments: " << numInstruments << std::endl;
+
+    return cacheStats.numHits == 3  &&  numInstruments == size_t(NUM_INSTRUMENTS + 1);
+}
+
+int benchConditionalGet(const BenchOptions& options)
+{
+    prism::mock::MockServer server;
+
+    if (!server.start(prism::mock::MockServer::Configuration()))
+        return -1;
+
+    prc::Client client(server.getApiRoot(), "mock");
+    configureClient(client, options);
+
+    if (client.init().isError()  ||  !populateInstruments(client))
+    {
+        std::cout << "conditional-get: unable to register instruments" << std::endl;
+        server.stop();
+        return -1;
+    }
+
+    std::cout << "conditional-get: " << NUM_INSTRUMENTS << " instruments in account" << std::endl;
+
+    const bool isOk = runQueries(options, server, 0)
+            &&  runQueries(options, server, 64)
+            &&  runChanged(options, server);
+
+    server.stop();
+
+    return isOk ? 0 : -1;
+}
+
+} // namespace bench
+} // namespace prism
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include <iostream>
+#include <sstream>
+#include "benchmarks.h"
+#include "MockServer.h"
+
+namespace prc = prism::connect;
+
+namespace prism
+{
+namespace bench
+{
+
+static const int NUM_INSTRUMENTS = 10000;
+static const int PAGE_SIZE = 1000;
+static const char* const CAMERA_NAME = "bench-lookup";
+
+// Account of mock server gets many instruments, camera looked up by
+// benchmarks is the last one, so that scan of list finds it at the end.
+// Mock server has one camera already.
+static bool populateInstruments(prc::Client& client)
+{
+    for (int i = 2; i < NUM_INSTRUMENTS; ++i)
+    {
+        std::ostringstream name;
+        name << "camera-" << i;
+
+        prc::Instrument instrument;
+        instrument.name = name.str();
+        instrument.type = "camera";
+
+        if (client.registerInstrument(1, instrument).isError())
+            return false;
+    }
+
+    prc::Instrument camera;
+
+    return prc::registerNewCamera(client, 1, CAMERA_NAME, camera).isSuccess();
+}
+
+static void printResult(const char* name, const BenchOptions& options, const Stopwatch& sw,
+                        const prism::mock::MockServer& server,
+                        const prism::mock::MockServer::Statistics& initial)
+{
+    const prism::mock::MockServer::Statistics stats = server.getStatistics();
+
+    std::cout << "instrument-lookup: " << name << ": " << sw.elapsedMs() / options.iterations
+              << " ms, requests: " << double(stats.numRequests - initial.numRequests) / options.iterations
+              << ", response KB: " << double(stats.numBytesSent - initial.numBytesSent) / 1024 / options.iterations
+              << " per lookup" << std::endl;
+}
+
+// Whole list in single response, scanned for camera, as before filters
+static bool runWholeList(const BenchOptions& options, prc::Client& client,
+                         const prism::mock::MockServer& server)
+{
+    const prism::mock::MockServer::Statistics initial = server.getStatistics();
+    Stopwatch sw;
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        prc::Instruments instruments;
+
+        if (client.queryInstrumentsList(1, instruments).isError())
+            return false;
+
+        bool isFound = false;
+
+        for (size_t j = 0; j < instruments.size()  &&  !isFound; ++j)
+            isFound = instruments[j].name == CAMERA_NAME  &&  instruments[j].type == "camera";
+
+        if (!isFound)
+            return false;
+    }
+
+    printResult("whole list", options, sw, server, initial);
+
+    return true;
+}
+
+// findCameraByName() asking server for instruments of that name only
+static bool runFiltered(const BenchOptions& options, prc::Client& client,
+                        const prism::mock::MockServer& server)
+{
+    const prism::mock::MockServer::Statistics initial = server.getStatistics();
+    Stopwatch sw;
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        prc::Instrument camera;
+
+        if (prc::findCameraByName(client, 1, CAMERA_NAME, camera).isError())
+            return false;
+    }
+
+    printResult("filtered findCameraByName()", options, sw, server, initial);
+
+    return true;
+}
+
+// InstrumentCursor over whole list, PAGE_SIZE instruments per request
+static bool runPaged(const BenchOptions& options, prc::Client& client,
+                     const prism::mock::MockServer& server)
+{
+    const prism::mock::MockServer::Statistics initial = server.getStatistics();
+    Stopwatch sw;
+
+    prc::InstrumentQuery query;
+    query.pageSize = PAGE_SIZE;
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        prc::InstrumentCursor cursor(client, 1, query);
+        prc::Instrument instrument;
+        int numInstruments = 0;
+
+        while (cursor.next(instrument))
+            ++numInstruments;
+
+        if (cursor.getStatus().isError()  ||  numInstruments != NUM_INSTRUMENTS)
+            return false;
+    }
+
+    printResult("paged cursor over whole list", options, sw, server, initial);
+
+    return true;
+}
+
+int benchInstrumentLookup(const BenchOptions& options)
+{
+    prism::mock::MockServer server;
+
+    if (!server.start(prism::mock::MockServer::Configuration()))
+        return -1;
+
+    prc::Client client(server.getApiRoot(), "mock");
+    configureClient(client, options);
+
+    // every lookup goes to server and downloads its response
+    client.setHttpCacheMaxEntries(0);
+
+    if (client.init().isError()  ||  !populateInstruments(client))
+    {
+        std::cout << "instrument-lookup: unable to register instruments" << std::endl;
+        server.stop();
+        return -1;
+    }
+
+    std::cout << "instrument-lookup: " << NUM_INSTRUMENTS << " instruments in account" << std::endl;
+
+    const bool isOk = runWholeList(options, client, server)
+            &&  runFiltered(options, client, server)
+            &&  runPaged(options, client, server);
+
+    server.stop();
+
+    return isOk ? 0 : -1;
+}
+
+} // namespace bench
+} // namespace prism
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <vector>
+#include "private/IsoTimeFormatter.h"
+#include "benchmarks.h"
+
+namespace prc = prism::connect;
+
+namespace prism
+{
+namespace bench
+{
+
+static const int NUM_TIMESTAMPS = 100000;
+
+// One count per second, as typical time-series batch
+static prc::Counts makeCounts()
+{
+    prc::Counts counts;
+    counts.reserve(NUM_TIMESTAMPS);
+
+    for (int i = 0; i < NUM_TIMESTAMPS; ++i)
+        counts.push_back(prc::Count(prc::timestamp_t(1500000000000LL + i * 1000LL + i % 1000), i, "bench"));
+
+    return counts;
+}
+
+// gmtime_r() and snprintf() based formatting, as toIsoTimeString() did before
+static std::string formatSnprintf(prc::timestamp_t timestamp)
+{
+    const time_t time = timestamp / 1000;
+    tm utcTime;
+    gmtime_r(&time, &utcTime);
+
+    // 7 ints of up to 11 chars each, 6 separators and terminator, so that
+    // output is never truncated
+    char buffer[84];
+    snprintf(buffer, sizeof(buffer), "%04d-%02d-%02dT%02d:%02d:%02d.%03d",
+             utcTime.tm_year + 1900, utcTime.tm_mon + 1, utcTime.tm_mday,
+             utcTime.tm_hour, utcTime.tm_min, utcTime.tm_sec, (int)(timestamp % 1000));
+
+    return buffer;
+}
+
+static void printResult(const char* name, double elapsedMs, int numTimestamps)
+{
+    std::cout << "iso-time-formatting: " << name << ": "
+              << elapsedMs * 1000000.0 / numTimestamps << " ns/timestamp" << std::endl;
+}
+
+int benchIsoTimeFormatting(const BenchOptions& options)
+{
+    const prc::Counts counts = makeCounts();
+    const int numTimestamps = NUM_TIMESTAMPS * options.iterations;
+    size_t checksum = 0;
+
+    Stopwatch sw;
+
+    for (int i = 0; i < options.iterations; ++i)
+        for (size_t j = 0; j < counts.size(); ++j)
+            checksum += formatSnprintf(counts[j].timestamp).size();
+
+    printResult("gmtime_r + snprintf", sw.elapsedMs(), numTimestamps);
+
+    char buffer[prc::IsoTimeFormatter::LENGTH];
+    sw.restart();
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        prc::IsoTimeFormatter formatter;
+
+        for (size_t j = 0; j < counts.size(); ++j)
+        {
+            formatter.format(counts[j].timestamp, buffer);
+            checksum += buffer[prc::IsoTimeFormatter::LENGTH - 1];
+        }
+    }
+
+    printResult("IsoTimeFormatter", sw.elapsedMs(), numTimestamps);
+
+    std::vector<char> batch;
+    sw.restart();
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        prc::IsoTimeFormatter().format(counts, batch);
+        checksum += batch.back();
+    }
+
+    printResult("IsoTimeFormatter, batch", sw.elapsedMs(), numTimestamps);
+
+    // Compare outputs, also keeps compiler from dropping loops above
+    for (size_t j = 0; j < counts.size(); ++j)
+    {
+        if (formatSnprintf(counts[j].timestamp).compare(
+                0, std::string::npos, &batch[j * prc::IsoTimeFormatter::LENGTH],
+                prc::IsoTimeFormatter::LENGTH) != 0)
+        {
+            std::cout << "iso-time-formatting: output differs, checksum " << checksum << std::endl;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+} // namespace bench
+} // namespace prism
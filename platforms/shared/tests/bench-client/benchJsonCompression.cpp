@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include <iostream>
+#include "boost/bind.hpp"
+#include "private/util.h"
+#include "benchmarks.h"
+#include "MockServer.h"
+
+namespace prc = prism::connect;
+
+namespace prism
+{
+namespace bench
+{
+
+static const int NUM_COUNTS = 300;
+static const int NUM_EVENTS = 300;
+static const int NUM_TRACKS = 20;
+static const int NUM_POINTS_PER_TRACK = 200;
+static const int MAX_IN_FLIGHT = 8;
+
+// Counts of a few labels every 10 seconds for an hour and a bit, as
+// ArtifactUploader merges them
+static prc::Counts makeCounts()
+{
+    static const char* const labels[] = {"entrance", "exit", "zone-1", "zone-2"};
+    prc::Counts counts;
+
+    for (int i = 0; i < NUM_COUNTS; ++i)
+        counts.push_back(prc::Count(prc::timestamp_t(1500000000000LL + (i / 4) * 10000LL),
+                                    (i * 7) % 23, labels[i % 4]));
+
+    return counts;
+}
+
+// Events at irregular intervals, with millisecond parts
+static prc::Events makeEvents()
+{
+    prc::Events events;
+
+    for (int i = 0; i < NUM_EVENTS; ++i)
+        events.push_back(prc::Event(prc::timestamp_t(1500000000000LL + i * 1733LL + (i * 37) % 1000)));
+
+    return events;
+}
+
+// People walking across 1080p frame sampled at 25 fps
+static prc::Tracks makeTracks()
+{
+    prc::Tracks tracks;
+
+    for (int i = 0; i < NUM_TRACKS; ++i)
+    {
+        tracks.push_back(prc::Track(1000000000000LL + i, prc::timestamp_t(1500000000000LL + i * 4000LL)));
+
+        for (int j = 0; j < NUM_POINTS_PER_TRACK; ++j)
+            tracks.back().points.push_back(prc::TrackPoint(100 + j * 8 + (i * j) % 5,
+                                                           300 + j * 2 + (j * 13) % 7, j * 40));
+    }
+
+    return tracks;
+}
+
+struct Level
+{
+    const char* name;
+    bool isGzip;
+    int level;
+};
+
+static const Level levels[] =
+{
+    {"gzip 1", true, 1},
+    {"gzip 6", true, 6},
+    {"gzip 9", true, 9},
+    {"deflate 6", false, 6}
+};
+
+static const size_t numLevels = sizeof(levels)/sizeof(levels[0]);
+
+// Compression ratio and CPU time of compressing JSON at each level
+static bool runCompression(const BenchOptions& options, const char* name, const std::string& json)
+{
+    std::cout << "json-compression: " << name << " JSON, bytes: " << json.size() << std::endl;
+
+    for (size_t i = 0; i < numLevels; ++i)
+    {
+        std::string compressed;
+        Stopwatch total;
+
+        for (int j = 0; j < options.iterations; ++j)
+        {
+            if (!prc::compressString(json, levels[i].isGzip, levels[i].level, compressed))
+            {
+                std::cout << "json-compression: " << levels[i].name << " failed" << std::endl;
+                return false;
+            }
+        }
+
+        const double usPerJson = total.elapsedMs() * 1000 / options.iterations;
+
+        std::cout << "json-compression: " << name << ", " << levels[i].name
+                  << ": bytes: " << compressed.size()
+                  << ", ratio: " << static_cast<double>(json.size()) / compressed.size()
+                  << ", us/JSON: " << usPerJson
+                  << ", input MB/s: " << json.size() / usPerJson << std::endl;
+    }
+
+    return true;
+}
+
+// Concurrent track uploads to local server, which decodes and checks them
+static bool runUploads(const BenchOptions& options, prc::Client::ContentEncoding encoding, const char* name)
+{
+    prism::mock::MockServer::Configuration cfg;
+    cfg.checkTimeSeries = true;
+
+    prism::mock::MockServer server;
+
+    if (!server.start(cfg))
+        return false;
+
+    prc::Client client(server.getApiRoot(), "mock");
+    configureClient(client, options);
+    client.setJsonEncoding(encoding);
+
+    prc::Status status = client.init();
+    prc::id_t accountId = 0;
+    prc::id_t instrumentId = 0;
+
+    if (status.isSuccess())
+        status = findTargetInstrument(client, accountId, instrumentId);
+
+    if (status.isError())
+    {
+        std::cout << "json-compression: can't find instrument to upload to: " << status << std::endl;
+        return false;
+    }
+
+    const prc::Tracks tracks = makeTracks();
+    BenchReport report(std::string("json-compression: tracks upload, ") + name);
+    InFlightTracker tracker(report, MAX_IN_FLIGHT, prc::toJsonString(tracks).size());
+    const uint64_t initialBytesReceived = server.getStatistics().numBytesReceived;
+    Stopwatch total;
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        steady_clock::time_point start = tracker.acquire();
+
+        client.uploadTrackAsync(accountId, instrumentId, 1500000000000LL + i, tracks,
+                                boost::bind(&InFlightTracker::onComplete, &tracker, start, _1));
+    }
+
+    tracker.waitAll();
+    report.print(total.elapsedMs());
+
+    const prism::mock::MockServer::Statistics stats = server.getStatistics();
+
+    std::cout << "json-compression: tracks upload, " << name
+              << ": bytes sent: " << stats.numBytesReceived - initialBytesReceived
+              << ", encoded parts: " << stats.numEncodedParts << std::endl;
+
+    return report.getNumErrors() == 0;
+}
+
+int benchJsonCompression(const BenchOptions& options)
+{
+    bool isOk = runCompression(options, "counts", prc::toJsonString(makeCounts()))
+            &&  runCompression(options, "events", prc::toJsonString(makeEvents()))
+            &&  runCompression(options, "tracks", prc::toJsonString(makeTracks()));
+
+    isOk = isOk
+            &&  runUploads(options, prc::Client::ENCODING_IDENTITY, "identity")
+            &&  runUploads(options, prc::Client::ENCODING_GZIP, "gzip")
+            &&  runUploads(options, prc::Client::ENCODING_DEFLATE, "deflate");
+
+    return isOk ? 0 : -1;
+}
+
+} // namespace bench
+} // namespace prism
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include <iostream>
+#include "rapidjson/document.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#include "private/util.h"
+#include "benchmarks.h"
+
+namespace prc = prism::connect;
+
+namespace prism
+{
+namespace bench
+{
+
+static const int NUM_TRACKS = 100;
+static const int NUM_POINTS_PER_TRACK = 100;
+
+static prc::Tracks makeTracks()
+{
+    prc::Tracks tracks;
+
+    for (int i = 0; i < NUM_TRACKS; ++i)
+    {
+        prc::Track track(1000000000000LL + i, prc::timestamp_t(1500000000000LL + i * 1000));
+
+        for (int j = 0; j < NUM_POINTS_PER_TRACK; ++j)
+            track.points.push_back(prc::TrackPoint(j * 3 % 1920, j * 7 % 1080, j * 40));
+
+        tracks.push_back(track);
+    }
+
+    return tracks;
+}
+
+// DOM based serialization, as toJsonString(const Tracks&) did before
+static std::string toJsonStringDom(const prc::Tracks& tracks)
+{
+    rapidjson::Document doc;
+    rapidjson::Document::AllocatorType& allocator = doc.GetAllocator();
+
+    doc.SetArray();
+    doc.Reserve(tracks.size(), allocator);
+
+    for (size_t i = 0; i < tracks.size(); ++i)
+    {
+        const prc::Track& track = tracks[i];
+        rapidjson::Value jsonTrack(rapidjson::kObjectType);
+        rapidjson::Value value;
+
+        value.SetString(std::to_string(track.objectId).c_str(), allocator);
+        jsonTrack.AddMember("object_id", value, allocator);
+        value.SetString(prc::toIsoTimeString(track.timestamp).c_str(), allocator);
+        jsonTrack.AddMember("timestamp", value, allocator);
+
+        rapidjson::Value jsonPoints(rapidjson::kArrayType);
+
+        for (size_t j = 0; j < track.points.size(); ++j)
+        {
+            const prc::TrackPoint& tp = track.points[j];
+            rapidjson::Value jsonPoint(rapidjson::kArrayType);
+
+            jsonPoint.PushBack(tp.x, allocator);
+            jsonPoint.PushBack(tp.y, allocator);
+            jsonPoint.PushBack(tp.relativeTimeMs, allocator);
+            jsonPoints.PushBack(jsonPoint, allocator);
+        }
+
+        jsonTrack.AddMember("points", jsonPoints, allocator);
+        doc.PushBack(jsonTrack, allocator);
+    }
+
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    doc.Accept(writer);
+
+    return buffer.GetString();
+}
+
+int benchJsonSerialization(const BenchOptions& options)
+{
+    const prc::Tracks tracks = makeTracks();
+    const std::string expected = toJsonStringDom(tracks);
+
+    BenchReport dom("json-serialization: DOM");
+    Stopwatch total;
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        Stopwatch sw;
+        const std::string json = toJsonStringDom(tracks);
+        dom.addRequest(sw.elapsedMs(), json.size() == expected.size(), json.size());
+    }
+
+    dom.print(total.elapsedMs());
+
+    BenchReport writer("json-serialization: writer");
+    std::string json;
+    total.restart();
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        Stopwatch sw;
+        prc::toJsonString(tracks, json);
+        writer.addRequest(sw.elapsedMs(), json.size() == expected.size(), json.size());
+    }
+
+    writer.print(total.elapsedMs());
+
+    if (json != expected)
+    {
+        std::cout << "json-serialization: writer output differs from DOM output" << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+
+} // namespace bench
+} // namespace prism
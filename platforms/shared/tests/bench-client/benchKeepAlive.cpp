@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include <iostream>
+#include "benchmarks.h"
+
+namespace prc = prism::connect;
+
+namespace prism
+{
+namespace bench
+{
+
+// Client::init() does single GET of API root, which makes it the cheapest
+// request to measure connection setup overhead.
+static double runColdConnections(const BenchOptions& options, BenchReport& report)
+{
+    Stopwatch total;
+
+    // Each client owns its CURL handles pool, thus new client means new
+    // connection. This is how every request behaved before handles were
+    // kept by client.
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        prc::Client client(options.apiRoot, options.apiToken);
+        configureClient(client, options);
+
+        Stopwatch sw;
+        prc::Status status = client.init();
+        report.addRequest(sw.elapsedMs(), status.isSuccess());
+    }
+
+    return total.elapsedMs();
+}
+
+static double runReusedConnection(const BenchOptions& options, BenchReport& report)
+{
+    prc::Client client(options.apiRoot, options.apiToken);
+    configureClient(client, options);
+
+    Stopwatch total;
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        Stopwatch sw;
+        prc::Status status = client.init();
+        report.addRequest(sw.elapsedMs(), status.isSuccess());
+    }
+
+    return total.elapsedMs();
+}
+
+int benchKeepAlive(const BenchOptions& options)
+{
+    BenchReport cold("keep-alive: new connection");
+    double coldMs = runColdConnections(options, cold);
+    cold.print(coldMs);
+
+    BenchReport warm("keep-alive: reused connection");
+    double warmMs = runReusedConnection(options, warm);
+    warm.print(warmMs);
+
+    if (cold.requestsPerSec(coldMs) > 0)
+        std::cout << "keep-alive speedup: "
+                  << warm.requestsPerSec(warmMs) / cold.requestsPerSec(coldMs) << "x"
+                  << std::endl;
+
+    return 0;
+}
+
+} // namespace bench
+} // namespace prism
@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include <sys/resource.h>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include "boost/bind.hpp"
+#include "rapidjson/document.h"
+#include "private/JsonArrayReader.h"
+#include "private/util.h"
+#include "benchmarks.h"
+#include "MockServer.h"
+
+namespace prc = prism::connect;
+
+namespace prism
+{
+namespace bench
+{
+
+static const int NUM_INSTRUMENTS = 10000;
+
+// libcurl passes response in chunks of up to CURL_MAX_WRITE_SIZE
+static const size_t CHUNK_SIZE = 16 * 1024;
+
+// Peak resident set size of the process so far, KB
+static long peakRssKb()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+// Instruments list as server returns it
+static std::string makeInstrumentsJson()
+{
+    std::ostringstream os;
+    os << '[';
+
+    for (int i = 1; i <= NUM_INSTRUMENTS; ++i)
+    {
+        if (i > 1)
+            os << ',';
+
+        os << "{\"id\":" << i << ",\"name\":\"camera-" << i << "\",\"instrument_type\":\"camera\","
+           << "\"url\":\"https://api.example.com/accounts/1/instruments/" << i << "/\"}";
+    }
+
+    os << ']';
+
+    return os.str();
+}
+
+static prc::Status addInstrument(const rapidjson::Value& itemJson, prc::Instruments& instruments)
+{
+    if (!itemJson.IsObject()  ||  !itemJson.HasMember("id")  ||  !itemJson.HasMember("name"))
+        return prc::makeError();
+
+    instruments.push_back(prc::Instrument());
+    instruments.back().id = itemJson["id"].GetInt();
+    instruments.back().name = itemJson["name"].GetString();
+    instruments.back().type = itemJson["instrument_type"].GetString();
+
+    return prc::makeSuccess();
+}
+
+// Whole response is parsed into DOM, then copied to instruments
+static bool runDom(const BenchOptions& options, const std::string& json, long initialRssKb)
+{
+    Stopwatch sw;
+    size_t numInstruments = 0;
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        // as collected by CurlWrapper
+        const std::string responseBody(json);
+
+        rapidjson::Document document;
+        document.Parse(responseBody.c_str());
+
+        prc::Instruments instruments;
+
+        for (rapidjson::SizeType j = 0; j < document.Size(); ++j)
+            addInstrument(document[j], instruments);
+
+        numInstruments = instruments.size();
+    }
+
+    std::cout << "list-parsing: DOM: " << sw.elapsedMs() / options.iterations
+              << " ms per list, peak RSS above baseline, KB: " << peakRssKb() - initialRssKb << std::endl;
+
+    return numInstruments == size_t(NUM_INSTRUMENTS);
+}
+
+// Response is fed to JsonArrayReader in chunks, as libcurl delivers it
+static bool runStreamed(const BenchOptions& options, const std::string& json, long initialRssKb)
+{
+    Stopwatch sw;
+    size_t numInstruments = 0;
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        prc::Instruments instruments;
+        prc::JsonArrayReader reader(boost::bind(addInstrument, _1, boost::ref(instruments)));
+
+        for (size_t pos = 0; pos < json.size(); pos += CHUNK_SIZE)
+            reader.write(json.data() + pos, std::min(CHUNK_SIZE, json.size() - pos));
+
+        if (reader.finish().isError())
+        {
+            std::cout << "list-parsing: " << reader.getErrorMessage() << std::endl;
+            return false;
+        }
+
+        numInstruments = instruments.size();
+    }
+
+    std::cout << "list-parsing: streamed: " << sw.elapsedMs() / options.iterations
+              << " ms per list, peak RSS above baseline, KB: " << peakRssKb() - initialRssKb << std::endl;
+
+    return numInstruments == size_t(NUM_INSTRUMENTS);
+}
+
+// queryInstrumentsList() of local mock server account
+static bool runQuery(const BenchOptions& options)
+{
+    prism::mock::MockServer server;
+
+    if (!server.start(prism::mock::MockServer::Configuration()))
+        return false;
+
+    prc::Client client(server.getApiRoot(), "mock");
+    configureClient(client, options);
+
+    // list is downloaded and parsed each time, not revalidated
+    client.setHttpCacheMaxEntries(0);
+
+    bool isOk = client.init().isSuccess();
+
+    // mock server has one camera already
+    for (int i = 1; i < NUM_INSTRUMENTS  &&  isOk; ++i)
+    {
+        std::ostringstream name;
+        name << "camera-" << i;
+
+        prc::Instrument instrument;
+        instrument.name = name.str();
+        instrument.type = "camera";
+
+        isOk = client.registerInstrument(1, instrument).isSuccess();
+    }
+
+    prc::Instruments instruments;
+    Stopwatch sw;
+
+    for (int i = 0; i < options.iterations  &&  isOk; ++i)
+        isOk = client.queryInstrumentsList(1, instruments).isSuccess();
+
+    std::cout << "list-parsing: queryInstrumentsList() from mock server: "
+              << sw.elapsedMs() / options.iterations << " ms per list of " << instruments.size() << std::endl;
+
+    server.stop();
+
+    return isOk  &&  instruments.size() == size_t(NUM_INSTRUMENTS);
+}
+
+int benchListParsing(const BenchOptions& options)
+{
+    const std::string json = makeInstrumentsJson();
+
+    std::cout << "list-parsing: " << NUM_INSTRUMENTS << " instruments, response " << json.size() / 1024
+              << " KB" << std::endl;
+
+    // Peak RSS only grows, so the one using less memory goes first and both
+    // are measured from the same baseline
+    const long initialRssKb = peakRssKb();
+
+    const bool isOk = runStreamed(options, json, initialRssKb)
+            &&  runDom(options, json, initialRssKb)
+            &&  runQuery(options);
+
+    return isOk ? 0 : -1;
+}
+
+} // namespace bench
+} // namespace prism
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include <sys/resource.h>
+#include <fstream>
+#include <iostream>
+#include "boost/bind.hpp"
+#include "boost/filesystem.hpp"
+#include "private/util.h"
+#include "benchmarks.h"
+
+namespace prc = prism::connect;
+
+namespace prism
+{
+namespace bench
+{
+
+static const size_t FILE_PAYLOAD_SIZE = 32 * 1024 * 1024;
+static const int NUM_TRACKS = 10;
+static const int NUM_POINTS_PER_TRACK = 10000;
+static const int MAX_IN_FLIGHT = 16;
+
+// Peak resident set size of the process so far, KB
+static long peakRssKb()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+static prc::Tracks makeTracks()
+{
+    prc::Tracks tracks;
+
+    for (int i = 0; i < NUM_TRACKS; ++i)
+    {
+        tracks.push_back(prc::Track(i, prc::timestamp_t(1500000000000LL + i * 1000)));
+
+        for (int j = 0; j < NUM_POINTS_PER_TRACK; ++j)
+            tracks.back().points.push_back(prc::TrackPoint(j % 1920, j % 1080, j * 40));
+    }
+
+    return tracks;
+}
+
+static bool makeFile(const std::string& path, size_t size)
+{
+    std::ofstream file(path.c_str(), std::ios::binary);
+    const std::vector<char> chunk(1024 * 1024, 'x');
+
+    for (size_t written = 0; written < size && file; written += chunk.size())
+        file.write(chunk.data(), std::min(chunk.size(), size - written));
+
+    return file.good();
+}
+
+// Sequential uploads of large file, it should be streamed rather than read into memory
+static void runFileUploads(const BenchOptions& options, prc::Client& client,
+                           prc::id_t accountId, prc::id_t instrumentId)
+{
+    const std::string path = (boost::filesystem::temp_directory_path()
+                              / boost::filesystem::unique_path("bench-%%%%%%%%.mp4")).string();
+
+    if (!makeFile(path, FILE_PAYLOAD_SIZE))
+    {
+        std::cout << "multipart: can't create " << path << std::endl;
+        return;
+    }
+
+    const int numUploads = std::max(options.iterations / 10, 1);
+    const long initialRssKb = peakRssKb();
+    BenchReport report("multipart: 32 MB file");
+    Stopwatch total;
+
+    for (int i = 0; i < numUploads; ++i)
+    {
+        prc::Flipbook flipbook(1500000000000LL + i, 1500000060000LL + i, 320, 240, 60);
+        Stopwatch sw;
+        prc::Status status = client.uploadFlipbook(accountId, instrumentId, flipbook, prc::Payload(path));
+        report.addRequest(sw.elapsedMs(), status.isSuccess(), status.isSuccess() ? FILE_PAYLOAD_SIZE : 0);
+    }
+
+    report.print(total.elapsedMs());
+    std::cout << "multipart: 32 MB file: peak RSS growth, KB: " << peakRssKb() - initialRssKb << std::endl;
+
+    boost::system::error_code ec;
+    boost::filesystem::remove(path, ec);
+}
+
+// Concurrent uploads of large JSON, each of them is held in memory until request is complete
+static void runJsonUploads(const BenchOptions& options, prc::Client& client,
+                           prc::id_t accountId, prc::id_t instrumentId)
+{
+    const prc::Tracks tracks = makeTracks();
+    const long initialRssKb = peakRssKb();
+    BenchReport report("multipart: tracks JSON");
+    InFlightTracker tracker(report, MAX_IN_FLIGHT, prc::toJsonString(tracks).size());
+    Stopwatch total;
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        steady_clock::time_point start = tracker.acquire();
+
+        client.uploadTrackAsync(accountId, instrumentId, 1500000000000LL + i, tracks,
+                                boost::bind(&InFlightTracker::onComplete, &tracker, start, _1));
+    }
+
+    tracker.waitAll();
+
+    report.print(total.elapsedMs());
+    std::cout << "multipart: tracks JSON: peak RSS growth, KB: " << peakRssKb() - initialRssKb << std::endl;
+}
+
+int benchMultipart(const BenchOptions& options)
+{
+    prc::Client client(options.apiRoot, options.apiToken);
+    configureClient(client, options);
+
+    prc::Status status = client.init();
+    prc::id_t accountId = 0;
+    prc::id_t instrumentId = 0;
+
+    if (status.isSuccess())
+        status = findTargetInstrument(client, accountId, instrumentId);
+
+    if (status.isError())
+    {
+        std::cout << "multipart: can't find instrument to upload to: " << status << std::endl;
+        return -1;
+    }
+
+    // peak RSS only grows, so start with the one using more memory
+    runJsonUploads(options, client, accountId, instrumentId);
+    runFileUploads(options, client, accountId, instrumentId);
+
+    return 0;
+}
+
+} // namespace bench
+} // namespace prism
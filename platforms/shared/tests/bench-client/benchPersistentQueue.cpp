@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include <fstream>
+#include <iostream>
+#include "boost/filesystem.hpp"
+#include "boost/make_shared.hpp"
+#include "private/UploadQueue.h"
+#include "private/util.h"
+#include "benchmarks.h"
+
+namespace prc = prism::connect;
+namespace fs = boost::filesystem;
+
+namespace prism
+{
+namespace bench
+{
+
+static const size_t PAYLOAD_SIZE = 64 * 1024;
+
+// Smaller than total payload, so that replay also exercises loading tasks,
+// which were kept on disk only
+static const size_t MAX_MEMORY_SIZE = 16 * 1024 * 1024;
+static const uint64_t MAX_DISK_SIZE = 4ULL * 1024 * 1024 * 1024;
+
+// Payload files are made by "camera" in advance, next to journal
+static prc::PayloadHolderPtr makePayload(const fs::path& dir, const std::vector<uint8_t>& payload,
+                                         bool isFile, int i)
+{
+    if (!isFile)
+        return prc::makePayloadHolderByCopyingData(payload.data(), payload.size(), "image/jpeg");
+
+    const fs::path path = dir / (prc::toString(i) + ".jpg");
+    std::ofstream file(path.string().c_str(), std::ios::binary);
+    file.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+    file.close();
+
+    return prc::makePayloadHolderByReferencingFileAutodelete(path.string());
+}
+
+// Bytes of journal segments and of payload files linked by journal
+static void getJournalSize(const fs::path& dir, uint64_t& segmentsSize, uint64_t& filesSize)
+{
+    segmentsSize = 0;
+    filesSize = 0;
+
+    for (fs::directory_iterator it(dir); it != fs::directory_iterator(); ++it)
+    {
+        const std::string name = it->path().filename().string();
+
+        if (name.compare(0, 8, "journal-") == 0)
+            segmentsSize += fs::file_size(it->path());
+        else if (name.compare(0, 8, "payload-") == 0)
+            filesSize += fs::file_size(it->path());
+    }
+}
+
+static double runEnqueue(const fs::path& dir, int numTasks, bool isFile, BenchReport& report)
+{
+    const std::vector<uint8_t> payload(PAYLOAD_SIZE, 0x5a);
+    const fs::path filesDir = dir / "files";
+    fs::create_directories(filesDir);
+    Stopwatch total;
+
+    {
+        prc::UploadQueue queue(MAX_MEMORY_SIZE, MAX_MEMORY_SIZE, MAX_DISK_SIZE);
+
+        if (queue.openJournal((dir / "journal").string(), MAX_DISK_SIZE).isError())
+            return -1;
+
+        for (int i = 0; i < numTasks; ++i)
+        {
+            prc::PayloadHolderPtr holder = makePayload(filesDir, payload, isFile, i);
+
+            Stopwatch sw;
+            prc::Status status = queue.push_back(
+                        boost::make_shared<prc::UploadBackgroundTask>(prc::timestamp_t(i), holder));
+            report.addRequest(sw.elapsedMs(), status.isSuccess(), PAYLOAD_SIZE);
+        }
+
+        // destructor waits for journal to be written and synced
+    }
+
+    return total.elapsedMs();
+}
+
+static double runReplay(const fs::path& dir, int numTasks, bool isFile, BenchReport& report)
+{
+    Stopwatch total;
+    prc::UploadQueue queue(MAX_MEMORY_SIZE, MAX_MEMORY_SIZE, MAX_DISK_SIZE);
+
+    if (queue.openJournal((dir / "journal").string(), MAX_DISK_SIZE).isError())
+        return -1;
+
+    std::cout << "persistent-queue: journal opened in " << total.elapsedMs() << " ms, "
+              << queue.size() << " tasks restored" << std::endl;
+
+    for (int i = 0; i < numTasks; ++i)
+    {
+        Stopwatch sw;
+        prc::UploadArtifactTaskPtr task;
+
+        if (!queue.pop_front(task, boost::posix_time::seconds(0))  ||  !task)
+        {
+            report.addRequest(sw.elapsedMs(), false);
+            continue;
+        }
+
+        // file payload is restored as file rather than read into memory
+        const bool isOk = task->getArtifactSize() >= PAYLOAD_SIZE
+                &&  task->getFileSize() == (isFile ? PAYLOAD_SIZE : 0);
+
+        report.addRequest(sw.elapsedMs(), isOk, PAYLOAD_SIZE);
+        queue.complete(task);
+    }
+
+    return total.elapsedMs();
+}
+
+static int runPayloads(int numTasks, bool isFile)
+{
+    const fs::path dir = fs::temp_directory_path() / fs::unique_path("bench-journal-%%%%-%%%%");
+    const std::string name = isFile ? "persistent-queue: file payloads" : "persistent-queue: data payloads";
+    int rv = 0;
+
+    BenchReport enqueue(name + ": enqueue");
+    double enqueueMs = runEnqueue(dir, numTasks, isFile, enqueue);
+
+    if (enqueueMs < 0)
+        rv = -1;
+    else
+    {
+        enqueue.print(enqueueMs);
+
+        uint64_t segmentsSize = 0;
+        uint64_t filesSize = 0;
+        getJournalSize(dir / "journal", segmentsSize, filesSize);
+
+        std::cout << name << ": journal segments: " << segmentsSize / 1024 << " KB, linked files: "
+                  << filesSize / 1024 << " KB" << std::endl;
+    }
+
+    BenchReport replay(name + ": replay");
+    double replayMs = rv ? -1 : runReplay(dir, numTasks, isFile, replay);
+
+    if (replayMs < 0)
+        rv = -1;
+    else
+        replay.print(replayMs);
+
+    // links are deleted together with completed tasks
+    uint64_t segmentsSize = 0;
+    uint64_t filesSize = 0;
+
+    if (!rv)
+        getJournalSize(dir / "journal", segmentsSize, filesSize);
+
+    if (filesSize)
+    {
+        std::cout << name << ": " << filesSize << " bytes of payload files left" << std::endl;
+        rv = -1;
+    }
+
+    boost::system::error_code ec;
+    fs::remove_all(dir, ec);
+
+    return rv;
+}
+
+int benchPersistentQueue(const BenchOptions& options)
+{
+    const int numTasks = options.iterations * 10;
+
+    return runPayloads(numTasks, false) == 0  &&  runPayloads(numTasks, true) == 0 ? 0 : -1;
+}
+
+} // namespace bench
+} // namespace prism
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include <iostream>
+#include "boost/make_shared.hpp"
+#include "private/UploadQueue.h"
+#include "private/util.h"
+#include "benchmarks.h"
+
+namespace prc = prism::connect;
+
+namespace prism
+{
+namespace bench
+{
+
+static const size_t MAX_MEMORY_SIZE = 1024 * 1024 * 1024;
+static const size_t IMAGE_SIZE = 1024;
+static const int TASKS_PER_ITERATION = 100;
+static const int NUM_LABELS = 10;
+
+// Backlog left by network outage: backgrounds, each followed by counts,
+// which are popped first, while backgrounds wait
+static void fillBacklog(prc::UploadQueue& queue, int numTasks)
+{
+    const std::vector<uint8_t> image(IMAGE_SIZE, 0x5a);
+
+    for (int i = 0; i < numTasks; ++i)
+    {
+        if (i % 2 == 0)
+        {
+            queue.push_back(boost::make_shared<prc::UploadBackgroundTask>(prc::timestamp_t(i),
+                    prc::makePayloadHolderByCopyingData(image.data(), image.size(), "image/jpeg")));
+            continue;
+        }
+
+        prc::Counts counts;
+        counts.push_back(prc::Count(prc::timestamp_t(i), i, "line-" + prc::toString(i % NUM_LABELS)));
+        queue.push_back(boost::make_shared<prc::UploadCountTask>(prc::move_ref<prc::Counts>(counts), false));
+    }
+}
+
+int benchPriorityQueue(const BenchOptions& options)
+{
+    const int numTasks = options.iterations * TASKS_PER_ITERATION;
+
+    prc::UploadQueue::Priorities priorities;
+    priorities[prc::UploadArtifactTask::COUNT] = 2;
+    priorities[prc::UploadArtifactTask::BACKGROUND] = 0;
+
+    prc::UploadQueue queue(MAX_MEMORY_SIZE, MAX_MEMORY_SIZE);
+    queue.setPriorities(priorities, boost::posix_time::hours(1));
+    fillBacklog(queue, numTasks);
+
+    BenchReport report("priority-queue: pop");
+    bool isBackgroundPopped = false;
+    bool isOrderKept = true;
+    Stopwatch total;
+
+    // popped the way upload thread does, one at a time
+    for (int i = 0; i < numTasks; ++i)
+    {
+        prc::UploadArtifactTaskPtr task;
+        Stopwatch sw;
+
+        if (!queue.pop_front(task, boost::posix_time::seconds(0))  ||  !task)
+        {
+            report.addRequest(sw.elapsedMs(), false);
+            continue;
+        }
+
+        queue.complete(task);
+        report.addRequest(sw.elapsedMs(), true);
+
+        const bool isBackground = task->getType() == prc::UploadArtifactTask::BACKGROUND;
+        isOrderKept = isOrderKept  &&  (isBackground  ||  !isBackgroundPopped);
+        isBackgroundPopped = isBackgroundPopped  ||  isBackground;
+    }
+
+    std::cout << "priority-queue: " << numTasks << " tasks, every other one is count" << std::endl;
+    report.print(total.elapsedMs());
+
+    if (!isOrderKept)
+        std::cout << "priority-queue: count is popped after background" << std::endl;
+
+    return isOrderKept  &&  report.getNumErrors() == 0 ? 0 : -1;
+}
+
+} // namespace bench
+} // namespace prism
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include <iostream>
+#include <sstream>
+#include "boost/bind.hpp"
+#include "boost/make_shared.hpp"
+#include "boost/thread/thread.hpp"
+#include "private/UploadQueue.h"
+#include "benchmarks.h"
+
+namespace prc = prism::connect;
+
+namespace prism
+{
+namespace bench
+{
+
+static const size_t MAX_MEMORY_SIZE = 64 * 1024 * 1024;
+static const int TASKS_PER_ITERATION = 100;
+static const size_t MAX_BATCH_SIZE = 50;
+static const int numProducers[] = {1, 2, 4, 8, 16};
+
+// Pushes single event tasks as fast as it can, like pipeline thread of
+// each camera does at frame rate
+static void produce(prc::UploadQueue& queue, int producerId, int numTasks, std::vector<double>& latenciesMs)
+{
+    latenciesMs.reserve(numTasks);
+
+    for (int i = 0; i < numTasks; ++i)
+    {
+        prc::Events events(1, prc::Event(prc::timestamp_t(1500000000000LL + i)));
+        prc::UploadArtifactTaskPtr task = boost::make_shared<prc::UploadEventTask>(
+                    prc::timestamp_t(producerId), prc::move_ref<prc::Events>(events));
+
+        Stopwatch sw;
+        queue.push_back(task);
+        latenciesMs.push_back(sw.elapsedMs());
+    }
+}
+
+// Pops and merges tasks the way upload thread does, until empty task comes
+static void consume(prc::UploadQueue& queue, size_t& numTasks)
+{
+    for (;;)
+    {
+        prc::UploadArtifactTaskPtr task;
+
+        if (!queue.pop_front(task))
+            continue;
+
+        if (!task)
+            return;
+
+        std::vector<prc::UploadArtifactTaskPtr> batch(1, task);
+        queue.pop_mergeable(batch, MAX_BATCH_SIZE);
+
+        for (size_t i = 0; i < batch.size(); ++i)
+            queue.complete(batch[i]);
+
+        numTasks += batch.size();
+    }
+}
+
+static bool runProducers(const BenchOptions& options, int n)
+{
+    const int numTasks = options.iterations * TASKS_PER_ITERATION;
+    prc::UploadQueue queue(MAX_MEMORY_SIZE, MAX_MEMORY_SIZE);
+    std::vector<std::vector<double> > latenciesMs(n);
+    size_t numConsumed = 0;
+    Stopwatch total;
+
+    boost::thread consumer(consume, boost::ref(queue), boost::ref(numConsumed));
+    boost::thread_group producers;
+
+    for (int i = 0; i < n; ++i)
+        producers.create_thread(boost::bind(produce, boost::ref(queue), i, numTasks, boost::ref(latenciesMs[i])));
+
+    producers.join_all();
+    const double pushMs = total.elapsedMs();
+
+    queue.push_back(prc::UploadArtifactTaskPtr());
+    consumer.join();
+
+    std::ostringstream name;
+    name << "queue-contention: " << n << " producers";
+    BenchReport report(name.str());
+
+    for (int i = 0; i < n; ++i)
+    {
+        for (size_t j = 0; j < latenciesMs[i].size(); ++j)
+            report.addRequest(latenciesMs[i][j], true);
+    }
+
+    report.print(pushMs);
+    std::cout << name.str() << ": push max, ms: " << report.percentileMs(100)
+              << ", p99.9, ms: " << report.percentileMs(99.9)
+              << ", consumed: " << numConsumed << " in " << total.elapsedMs() << " ms" << std::endl;
+
+    return numConsumed == static_cast<size_t>(n) * numTasks;
+}
+
+int benchQueueContention(const BenchOptions& options)
+{
+    bool isOk = true;
+
+    for (size_t i = 0; i < sizeof(numProducers)/sizeof(numProducers[0]); ++i)
+        isOk = runProducers(options, numProducers[i])  &&  isOk;
+
+    return isOk ? 0 : -1;
+}
+
+} // namespace bench
+} // namespace prism
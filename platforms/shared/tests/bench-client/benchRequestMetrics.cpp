@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include <cmath>
+#include <iostream>
+#include "artifact-uploader.h"
+#include "benchmarks.h"
+#include "MockServer.h"
+
+namespace prc = prism::connect;
+
+namespace prism
+{
+namespace bench
+{
+
+static const size_t MAX_QUEUE_SIZE = 64 * 1024 * 1024;
+static const size_t IMAGE_SIZE = 64 * 1024;
+static const int DRAIN_TIMEOUT_MS = 600000;
+static const int UPLOAD_DELAY_MS = 5;
+static const int NUM_RECORDS = 10000000;
+
+// Cost of recording and worst relative error of percentiles for values
+// spread over 1 us .. 10 s
+static bool runHistogram()
+{
+    prc::DurationHistogram histogram;
+    Stopwatch sw;
+
+    // golden ratio steps cover range evenly in log scale
+    double value = 1;
+
+    for (int i = 0; i < NUM_RECORDS; ++i)
+    {
+        histogram.record(uint64_t(value));
+        value = value * 1.618 > 1e7 ? 1 + i % 7 : value * 1.618;
+    }
+
+    const double recordNs = sw.elapsedMs() * 1e6 / NUM_RECORDS;
+    double maxError = 0;
+
+    for (uint64_t us = 1; us < 10000000; us = us * 3 / 2 + 1)
+    {
+        // larger value keeps max from clamping the one checked
+        prc::DurationHistogram pair;
+        pair.record(us);
+        pair.record(uint64_t(1) << 31);
+
+        const double error = std::fabs(double(pair.getPercentileUs(50)) - us) / us;
+        maxError = std::max(maxError, error);
+    }
+
+    std::cout << "request-metrics: DurationHistogram: " << sizeof(prc::DurationHistogram)
+              << " bytes, record(): " << recordNs << " ns, max relative error: " << maxError
+              << ", p50 of " << histogram.getCount() << " values: " << histogram.getPercentileUs(50)
+              << " us" << std::endl;
+
+    return maxError <= 1.0 / 16;
+}
+
+static void printMetrics(const prc::RequestMetricsMap& metrics)
+{
+    for (prc::RequestMetricsMap::const_iterator it = metrics.begin(); it != metrics.end(); ++it)
+    {
+        const prc::RequestMetrics& m = it->second;
+
+        std::cout << "request-metrics: " << it->first << ": requests: " << m.numRequests
+                  << ", failed: " << m.numFailed << ", new connections: " << m.numNewConnections
+                  << ", uploaded KB: " << m.numBytesUploaded / 1024
+                  << ", TTFB p50/p99 us: " << m.timeToFirstByte.getPercentileUs(50)
+                  << "/" << m.timeToFirstByte.getPercentileUs(99)
+                  << ", total p50/p99 us: " << m.total.getPercentileUs(50)
+                  << "/" << m.total.getPercentileUs(99) << std::endl;
+    }
+}
+
+// Metrics ArtifactUploader has collected uploading backgrounds and counts
+static bool runUploader(const BenchOptions& options)
+{
+    prc::ArtifactUploader::Configuration cfg(options.apiRoot, options.apiToken, "bench-client",
+                                             MAX_QUEUE_SIZE, MAX_QUEUE_SIZE);
+    prc::ArtifactUploader uploader;
+
+    if (uploader.init(cfg, configureUploaderClient).isError())
+    {
+        std::cout << "request-metrics: uploader init failed" << std::endl;
+        return false;
+    }
+
+    const prc::ByteBuffer image(IMAGE_SIZE);
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        const prc::timestamp_t timestamp(1500000000000LL + i * 1000LL);
+
+        uploader.uploadBackground(timestamp,
+                                  prc::makePayloadHolderByCopyingData(image.data(), image.size(), "image/jpeg"));
+
+        prc::Counts counts;
+        counts.push_back(prc::Count(timestamp, i, "bench"));
+        uploader.uploadCount(prc::move_ref<prc::Counts>(counts), false);
+    }
+
+    prc::ArtifactUploader::Backlog backlog;
+
+    if (uploader.flush(DRAIN_TIMEOUT_MS, backlog).isError())
+        return false;
+
+    const prc::RequestMetricsMap metrics = uploader.getMetrics();
+    printMetrics(metrics);
+
+    const prc::RequestMetricsMap::const_iterator it = metrics.find("Client::uploadBackground()");
+
+    return it != metrics.end()  &&  it->second.numRequests >= uint64_t(options.iterations)
+            &&  it->second.total.getPercentileUs(50) >= uint64_t(UPLOAD_DELAY_MS) * 1000;
+}
+
+int benchRequestMetrics(const BenchOptions& options)
+{
+    if (!runHistogram())
+        return -1;
+
+    prism::mock::MockServer::Configuration serverCfg;
+    serverCfg.responseDelayMs = UPLOAD_DELAY_MS;
+
+    prism::mock::MockServer server;
+
+    if (!server.start(serverCfg))
+        return -1;
+
+    BenchOptions mockOptions = options;
+    mockOptions.apiRoot = server.getApiRoot();
+    mockOptions.apiToken = "mock";
+    setUploaderClientOptions(mockOptions);
+
+    std::cout << "request-metrics: " << options.iterations << " backgrounds and counts, upload takes "
+              << UPLOAD_DELAY_MS << " ms" << std::endl;
+
+    const bool isOk = runUploader(mockOptions);
+
+    server.stop();
+
+    return isOk ? 0 : -1;
+}
+
+} // namespace bench
+} // namespace prism
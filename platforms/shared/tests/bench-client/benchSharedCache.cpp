@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include <iostream>
+#include "boost/make_shared.hpp"
+#include "private/curl-session.h"
+#include "private/CurlShare.h"
+#include "private/PoolBasedCurlFactory.h"
+#include "benchmarks.h"
+
+namespace prc = prism::connect;
+
+namespace prism
+{
+namespace bench
+{
+
+// Latency of the first request of each new CURL factory, i.e. of new Client
+// or upload thread, while share, if any, is kept alive by others
+static bool runFirstRequests(const BenchOptions& options, const char* name, prc::CurlSharePtr share)
+{
+    BenchReport report(std::string("shared-cache: ") + name);
+    long numConnects = 0;
+    Stopwatch total;
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        prc::CurlFactoryPtr factory = boost::make_shared<PoolBasedCurlFactory>(0, share);
+        prc::CurlSessionPtr session = prc::CurlSession::create(options.apiToken, factory);
+
+        if (!session)
+        {
+            report.addRequest(0, false);
+            continue;
+        }
+
+        if (options.insecure)
+            session->setSslVerifyPeer(false);
+
+        Stopwatch sw;
+        const CURLcode res = session->httpGet(options.apiRoot);
+        report.addRequest(sw.elapsedMs(), res == CURLE_OK  &&  session->getResponseCode() == 200);
+
+        long n = 0;
+        curl_easy_getinfo(static_cast<CURL*>(*session), CURLINFO_NUM_CONNECTS, &n);
+        numConnects += n;
+    }
+
+    report.print(total.elapsedMs());
+    std::cout << "shared-cache: " << name << ": new connections: " << numConnects << std::endl;
+
+    return true;
+}
+
+int benchSharedCache(const BenchOptions& options)
+{
+    runFirstRequests(options, "no share", prc::CurlSharePtr());
+
+    prc::CurlSharePtr share = prc::CurlShare::getInstance();
+
+    if (!share)
+    {
+        std::cout << "shared-cache: can't create share" << std::endl;
+        return -1;
+    }
+
+    // the first request fills cache for following ones
+    runFirstRequests(options, "share", share);
+
+    return 0;
+}
+
+} // namespace bench
+} // namespace prism
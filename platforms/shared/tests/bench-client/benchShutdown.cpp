@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include <iostream>
+#include "boost/atomic.hpp"
+#include "boost/bind.hpp"
+#include "boost/thread/thread.hpp"
+#include "artifact-uploader.h"
+#include "benchmarks.h"
+#include "MockServer.h"
+
+namespace prc = prism::connect;
+
+namespace prism
+{
+namespace bench
+{
+
+static const size_t MAX_QUEUE_SIZE = 64 * 1024 * 1024;
+static const size_t IMAGE_SIZE = 128 * 1024;
+static const int LINGER_MS = 2000;
+
+// large enough for counts not to fill batch, so that they linger
+static const size_t MAX_BATCH_SIZE = 1000000;
+static const int FLUSH_TIMEOUT_MS = 600000;
+
+// Server holds each upload that long, as if it were sent over slow link
+static const int SLOW_UPLOAD_MS = 5000;
+static const int ABORT_TIMEOUT_MS = 1000;
+
+static prc::ArtifactUploader::Configuration makeConfiguration(const BenchOptions& options)
+{
+    prc::ArtifactUploader::Configuration cfg(options.apiRoot, options.apiToken, "bench-client",
+                                             MAX_QUEUE_SIZE, MAX_QUEUE_SIZE);
+    cfg.numUploadThreads = 4;
+    cfg.maxTimeSeriesBatchSize = MAX_BATCH_SIZE;
+    cfg.timeSeriesLingerMs = LINGER_MS;
+
+    return cfg;
+}
+
+static void enqueueArtifacts(const BenchOptions& options, prc::ArtifactUploader& uploader,
+                             boost::atomic<int>& numUploaded)
+{
+    const prc::ByteBuffer image(IMAGE_SIZE);
+    const prc::ArtifactUploader::CompletionCallback callback
+            = boost::bind(countUploaded, boost::ref(numUploaded), _1);
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        const prc::timestamp_t timestamp(1500000000000LL + i * 1000LL);
+
+        uploader.uploadBackground(timestamp,
+                                  prc::makePayloadHolderByCopyingData(image.data(), image.size(), "image/jpeg"),
+                                  callback);
+
+        prc::Counts counts;
+        counts.push_back(prc::Count(timestamp, i, "bench"));
+        uploader.uploadCount(prc::move_ref<prc::Counts>(counts), false, callback);
+    }
+}
+
+// Time from the last upload*() call until everything is uploaded, either
+// by flush() or by destructor, which waits for upload threads to take
+// their exit sentinels
+static bool runDrain(const BenchOptions& options, bool useFlush)
+{
+    const char* name = useFlush ? "flush()" : "destructor";
+    boost::atomic<int> numUploaded(0);
+    Stopwatch total;
+    bool isOk = true;
+
+    {
+        prc::ArtifactUploader uploader;
+
+        if (uploader.init(makeConfiguration(options), configureUploaderClient).isError())
+        {
+            std::cout << "shutdown: uploader init failed" << std::endl;
+            return false;
+        }
+
+        enqueueArtifacts(options, uploader, numUploaded);
+        total.restart();
+
+        if (useFlush)
+        {
+            prc::ArtifactUploader::Backlog backlog;
+            isOk = uploader.flush(FLUSH_TIMEOUT_MS, backlog).isSuccess();
+
+            std::cout << "shutdown: " << name << " returned in " << total.elapsedMs() << " ms, left queued: "
+                      << backlog.numQueued << ", in progress: " << backlog.numInProgress << std::endl;
+        }
+    }
+
+    const int numExpected = 2 * options.iterations;
+
+    std::cout << "shutdown: drained by " << name << " in " << total.elapsedMs() << " ms, uploaded "
+              << numUploaded << " of " << numExpected << std::endl;
+
+    return isOk  &&  numUploaded == numExpected;
+}
+
+// Time to stop uploader, while upload is in progress on slow link
+static bool runAbort(const BenchOptions& options)
+{
+    prism::mock::MockServer::Configuration serverCfg;
+    serverCfg.responseDelayMs = SLOW_UPLOAD_MS;
+
+    prism::mock::MockServer server;
+
+    if (!server.start(serverCfg))
+        return false;
+
+    BenchOptions slowOptions = options;
+    slowOptions.apiRoot = server.getApiRoot();
+    slowOptions.apiToken = "mock";
+    setUploaderClientOptions(slowOptions);
+
+    prc::ArtifactUploader uploader;
+
+    if (uploader.init(makeConfiguration(slowOptions), configureUploaderClient).isError())
+    {
+        std::cout << "shutdown: uploader init failed" << std::endl;
+        server.stop();
+        return false;
+    }
+
+    const prc::ByteBuffer image(IMAGE_SIZE);
+    uploader.uploadBackground(prc::timestamp_t(1500000000000LL),
+                              prc::makePayloadHolderByCopyingData(image.data(), image.size(), "image/jpeg"));
+
+    // upload is on its way, once server has got request
+    Stopwatch wait;
+
+    while (server.getStatistics().numUploads == 0  &&  wait.elapsedMs() < SLOW_UPLOAD_MS)
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+
+    Stopwatch sw;
+    const prc::ArtifactUploader::Backlog backlog = uploader.abort(ABORT_TIMEOUT_MS);
+    const double abortMs = sw.elapsedMs();
+
+    std::cout << "shutdown: abort() during " << SLOW_UPLOAD_MS << " ms upload returned in " << abortMs
+              << " ms, left queued: " << backlog.numQueued << ", in progress: " << backlog.numInProgress
+              << std::endl;
+
+    server.stop();
+
+    return abortMs < ABORT_TIMEOUT_MS  &&  backlog.numQueued == 1  &&  backlog.numInProgress == 0;
+}
+
+int benchShutdown(const BenchOptions& options)
+{
+    setUploaderClientOptions(options);
+
+    std::cout << "shutdown: " << options.iterations << " backgrounds and counts, linger "
+              << LINGER_MS << " ms" << std::endl;
+
+    const bool isOk = runDrain(options, false)
+            &&  runDrain(options, true)
+            &&  runAbort(options);
+
+    return isOk ? 0 : -1;
+}
+
+} // namespace bench
+} // namespace prism
@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include "boost/atomic.hpp"
+#include "boost/bind.hpp"
+#include "boost/filesystem.hpp"
+#include "boost/thread/thread.hpp"
+#include "artifact-uploader.h"
+#include "benchmarks.h"
+#include "MockServer.h"
+
+namespace prc = prism::connect;
+namespace fs = boost::filesystem;
+
+namespace prism
+{
+namespace bench
+{
+
+static const size_t MAX_QUEUE_SIZE = 16 * 1024 * 1024;
+static const size_t IMAGE_SIZE = 16 * 1024;
+static const int NUM_INSTRUMENTS = 2000;
+static const char* const CAMERA_NAME = "bench-startup";
+static const int FIRST_UPLOAD_TIMEOUT_MS = 30000;
+static const int ABORT_TIMEOUT_MS = 1000;
+
+// Account of mock server gets as many instruments as large deployment has,
+// camera looked up by benchmarks is the last one
+static bool populateInstruments(prc::Client& client)
+{
+    for (int i = 1; i < NUM_INSTRUMENTS; ++i)
+    {
+        std::ostringstream name;
+        name << "camera-" << i;
+
+        prc::Instrument instrument;
+        instrument.name = name.str();
+        instrument.type = "camera";
+
+        if (client.registerInstrument(1, instrument).isError())
+            return false;
+    }
+
+    prc::Instrument camera;
+
+    return prc::registerNewCamera(client, 1, CAMERA_NAME, camera).isSuccess();
+}
+
+// findCameraByName() querying server for camera each time vs. looking it up
+// in cache
+static bool runLookups(const BenchOptions& options, int ttlSec)
+{
+    prc::Client client(options.apiRoot, options.apiToken);
+    configureClient(client, options);
+    client.setInstrumentCacheTtlSec(ttlSec);
+
+    if (client.init().isError())
+        return false;
+
+    Stopwatch sw;
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        prc::Instrument camera;
+
+        if (prc::findCameraByName(client, 1, CAMERA_NAME, camera).isError())
+            return false;
+    }
+
+    std::cout << "startup: findCameraByName() " << (ttlSec ? "cached" : "uncached") << ": "
+              << sw.elapsedMs() / options.iterations << " ms per lookup" << std::endl;
+
+    return true;
+}
+
+// Time init() takes, time until the first artifact is uploaded and requests
+// it has taken
+static bool runFirstUpload(const BenchOptions& options, const prism::mock::MockServer& server,
+                           const std::string& sessionCacheFile, const char* name)
+{
+    const uint64_t numRequests = server.getStatistics().numRequests;
+
+    prc::ArtifactUploader::Configuration cfg(options.apiRoot, options.apiToken, CAMERA_NAME,
+                                             MAX_QUEUE_SIZE, MAX_QUEUE_SIZE);
+    cfg.sessionCacheFile = sessionCacheFile;
+
+    prc::ArtifactUploader uploader;
+    boost::atomic<int> numUploaded(0);
+    const prc::ByteBuffer image(IMAGE_SIZE);
+    Stopwatch sw;
+
+    if (uploader.init(cfg, configureUploaderClient).isError())
+    {
+        std::cout << "startup: uploader init failed" << std::endl;
+        return false;
+    }
+
+    const double initMs = sw.elapsedMs();
+
+    uploader.uploadBackground(prc::timestamp_t(1500000000000LL),
+                              prc::makePayloadHolderByCopyingData(image.data(), image.size(), "image/jpeg"),
+                              boost::bind(countUploaded, boost::ref(numUploaded), _1));
+
+    while (numUploaded == 0  &&  sw.elapsedMs() < FIRST_UPLOAD_TIMEOUT_MS)
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+
+    std::cout << "startup: " << name << ": init() returned in " << initMs << " ms, first upload done in "
+              << sw.elapsedMs() << " ms, requests: " << server.getStatistics().numRequests - numRequests
+              << std::endl;
+
+    return numUploaded == 1;
+}
+
+// Camera ID in session cache (the last line) is replaced by one server
+// doesn't know, as if camera were deleted since previous run
+static bool makeSessionCacheStale(const std::string& sessionCacheFile)
+{
+    std::vector<std::string> lines;
+
+    {
+        std::ifstream file(sessionCacheFile.c_str());
+        std::string line;
+
+        while (std::getline(file, line))
+            lines.push_back(line);
+    }
+
+    if (lines.empty())
+        return false;
+
+    lines.back() = "999999";
+
+    std::ofstream file(sessionCacheFile.c_str(), std::ios::trunc);
+
+    for (size_t i = 0; i < lines.size(); ++i)
+        file << lines[i] << '\n';
+
+    return file.good();
+}
+
+// init() and enqueueing, while server can't be reached at all
+static bool runServerDown(const BenchOptions& options)
+{
+    prc::ArtifactUploader::Configuration cfg(options.apiRoot, options.apiToken, CAMERA_NAME,
+                                             MAX_QUEUE_SIZE, MAX_QUEUE_SIZE);
+    prc::ArtifactUploader uploader;
+    const prc::ByteBuffer image(IMAGE_SIZE);
+    Stopwatch sw;
+
+    if (uploader.init(cfg, configureUploaderClient).isError())
+    {
+        std::cout << "startup: uploader init failed with server down" << std::endl;
+        return false;
+    }
+
+    const double initMs = sw.elapsedMs();
+
+    const prc::Status status = uploader.uploadBackground(
+                prc::timestamp_t(1500000000000LL),
+                prc::makePayloadHolderByCopyingData(image.data(), image.size(), "image/jpeg"));
+
+    const prc::ArtifactUploader::Backlog backlog = uploader.abort(ABORT_TIMEOUT_MS);
+
+    std::cout << "startup: server down: init() returned in " << initMs << " ms, upload enqueued: "
+              << (status.isSuccess() ? "yes" : "no") << ", left queued after abort(): "
+              << backlog.numQueued << std::endl;
+
+    return status.isSuccess()  &&  backlog.numQueued == 1;
+}
+
+int benchStartup(const BenchOptions& options)
+{
+    prism::mock::MockServer server;
+
+    if (!server.start(prism::mock::MockServer::Configuration()))
+        return -1;
+
+    BenchOptions mockOptions = options;
+    mockOptions.apiRoot = server.getApiRoot();
+    mockOptions.apiToken = "mock";
+    setUploaderClientOptions(mockOptions);
+
+    prc::Client client(mockOptions.apiRoot, mockOptions.apiToken);
+    configureClient(client, mockOptions);
+
+    if (client.init().isError()  ||  !populateInstruments(client))
+    {
+        std::cout << "startup: unable to register instruments" << std::endl;
+        server.stop();
+        return -1;
+    }
+
+    std::cout << "startup: " << NUM_INSTRUMENTS << " instruments in account" << std::endl;
+
+    const std::string sessionCacheFile
+            = (fs::temp_directory_path() / fs::unique_path("bench-session-%%%%-%%%%")).string();
+
+    bool isOk = runLookups(mockOptions, 0)
+            &&  runLookups(mockOptions, 300)
+            &&  runFirstUpload(mockOptions, server, sessionCacheFile, "cold start")
+            &&  runFirstUpload(mockOptions, server, sessionCacheFile, "warm start")
+            &&  makeSessionCacheStale(sessionCacheFile)
+            &&  runFirstUpload(mockOptions, server, sessionCacheFile, "stale session cache");
+
+    fs::remove(sessionCacheFile);
+
+    // nothing listens on port of stopped server
+    server.stop();
+
+    isOk = isOk  &&  runServerDown(mockOptions);
+
+    return isOk ? 0 : -1;
+}
+
+} // namespace bench
+} // namespace prism
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include <iostream>
+#include "boost/atomic.hpp"
+#include "boost/bind.hpp"
+#include "artifact-uploader.h"
+#include "benchmarks.h"
+#include "MockServer.h"
+
+namespace prc = prism::connect;
+
+namespace prism
+{
+namespace bench
+{
+
+static const size_t MAX_QUEUE_SIZE = 256 * 1024 * 1024;
+static const size_t IMAGE_SIZE = 128 * 1024;
+static const int DRAIN_TIMEOUT_MS = 600000;
+
+// Server holds each upload that long, so that backlog builds up, as it
+// does during outage
+static const int SLOW_UPLOAD_MS = 20;
+
+// Backlog of backgrounds and counts, time to upload all of it
+static bool runBacklog(const BenchOptions& options, bool isSupersedable)
+{
+    prc::ArtifactUploader::Configuration cfg(options.apiRoot, options.apiToken, "bench-client",
+                                             MAX_QUEUE_SIZE, MAX_QUEUE_SIZE);
+    cfg.supersedable.background = isSupersedable;
+
+    prc::ArtifactUploader uploader;
+
+    if (uploader.init(cfg, configureUploaderClient).isError())
+    {
+        std::cout << "supersede: uploader init failed" << std::endl;
+        return false;
+    }
+
+    boost::atomic<int> numBackgrounds(0);
+    boost::atomic<int> numCounts(0);
+    const prc::ByteBuffer image(IMAGE_SIZE);
+    Stopwatch total;
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        const prc::timestamp_t timestamp(1500000000000LL + i * 1000LL);
+
+        uploader.uploadBackground(timestamp,
+                                  prc::makePayloadHolderByCopyingData(image.data(), image.size(), "image/jpeg"),
+                                  boost::bind(countUploaded, boost::ref(numBackgrounds), _1));
+
+        prc::Counts counts;
+        counts.push_back(prc::Count(timestamp, i, "bench"));
+        uploader.uploadCount(prc::move_ref<prc::Counts>(counts), false,
+                             boost::bind(countUploaded, boost::ref(numCounts), _1));
+    }
+
+    prc::ArtifactUploader::Backlog backlog;
+    const bool isOk = uploader.flush(DRAIN_TIMEOUT_MS, backlog).isSuccess();
+    const prc::ArtifactUploader::Statistics stats = uploader.getStatistics();
+
+    std::cout << "supersede: " << (isSupersedable ? "latest background only" : "all backgrounds")
+              << ": drained in " << total.elapsedMs() << " ms, backgrounds uploaded: " << numBackgrounds
+              << ", counts uploaded: " << numCounts << ", bytes: " << stats.numArtifactBytes << std::endl;
+
+    return isOk  &&  numCounts == options.iterations
+            &&  numBackgrounds >= 1  &&  (isSupersedable  ||  numBackgrounds == options.iterations);
+}
+
+int benchSupersede(const BenchOptions& options)
+{
+    prism::mock::MockServer::Configuration serverCfg;
+    serverCfg.responseDelayMs = SLOW_UPLOAD_MS;
+
+    prism::mock::MockServer server;
+
+    if (!server.start(serverCfg))
+        return -1;
+
+    BenchOptions slowOptions = options;
+    slowOptions.apiRoot = server.getApiRoot();
+    slowOptions.apiToken = "mock";
+    setUploaderClientOptions(slowOptions);
+
+    std::cout << "supersede: " << options.iterations << " backgrounds and counts, upload takes "
+              << SLOW_UPLOAD_MS << " ms" << std::endl;
+
+    const bool isOk = runBacklog(slowOptions, false)
+            &&  runBacklog(slowOptions, true);
+
+    server.stop();
+
+    return isOk ? 0 : -1;
+}
+
+} // namespace bench
+} // namespace prism
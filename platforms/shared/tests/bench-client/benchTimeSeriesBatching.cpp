@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include <iostream>
+#include "boost/thread/thread.hpp"
+#include "artifact-uploader.h"
+#include "benchmarks.h"
+
+namespace prc = prism::connect;
+
+namespace prism
+{
+namespace bench
+{
+
+static const size_t MAX_QUEUE_SIZE = 64 * 1024 * 1024;
+static const int UPLOAD_TIMEOUT_SEC = 600;
+
+static int runUploader(const BenchOptions& options, size_t maxBatchSize, int lingerMs)
+{
+    prc::ArtifactUploader::Configuration cfg(options.apiRoot, options.apiToken, "bench-client",
+                                             MAX_QUEUE_SIZE, MAX_QUEUE_SIZE);
+    cfg.maxTimeSeriesBatchSize = maxBatchSize;
+    cfg.timeSeriesLingerMs = lingerMs;
+
+    setUploaderClientOptions(options);
+
+    prc::ArtifactUploader uploader;
+    prc::Status status = uploader.init(cfg, configureUploaderClient);
+
+    if (status.isError())
+    {
+        std::cout << "time-series-batching: uploader init failed: " << status << std::endl;
+        return -1;
+    }
+
+    Stopwatch total;
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        prc::Counts counts;
+        counts.push_back(prc::Count(prc::timestamp_t(1500000000000LL + i), i, "bench"));
+        uploader.uploadCount(prc::move_ref<prc::Counts>(counts), false);
+    }
+
+    prc::ArtifactUploader::Statistics stats;
+
+    while (stats.numTimeSeriesArtifacts < (uint64_t)options.iterations
+           && total.elapsedMs() < UPLOAD_TIMEOUT_SEC * 1000)
+    {
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+        stats = uploader.getStatistics();
+    }
+
+    const double elapsedMs = total.elapsedMs();
+
+    std::cout << "time-series-batching: batch " << maxBatchSize << ", linger " << lingerMs << " ms: "
+              << stats.numTimeSeriesArtifacts << " counts by " << stats.numTimeSeriesUploads
+              << " requests in " << elapsedMs << " ms, "
+              << stats.numTimeSeriesArtifacts * 1000.0 / elapsedMs << " counts/s, merge ratio "
+              << (stats.numTimeSeriesUploads ? (double)stats.numTimeSeriesArtifacts / stats.numTimeSeriesUploads : 0)
+              << std::endl;
+
+    return stats.numTimeSeriesArtifacts == (uint64_t)options.iterations ? 0 : -1;
+}
+
+int benchTimeSeriesBatching(const BenchOptions& options)
+{
+    int rv = runUploader(options, 1, 0);
+
+    if (runUploader(options, 100, 0) != 0)
+        rv = -1;
+
+    if (runUploader(options, 100, 200) != 0)
+        rv = -1;
+
+    return rv;
+}
+
+} // namespace bench
+} // namespace prism
@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include <fstream>
+#include <iostream>
+#include "boost/bind.hpp"
+#include "boost/filesystem.hpp"
+#include "boost/function.hpp"
+#include "boost/thread/locks.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/thread.hpp"
+#include "artifact-uploader.h"
+#include "private/util.h"
+#include "benchmarks.h"
+
+namespace prc = prism::connect;
+
+namespace prism
+{
+namespace bench
+{
+
+static const size_t IMAGE_SIZE = 128 * 1024;
+static const size_t OBJECT_STREAM_SIZE = 16 * 1024;
+static const size_t FLIPBOOK_SIZE = 1024 * 1024;
+static const int NUM_TRACK_POINTS = 100;
+static const size_t FLIPBOOK_FILE_SIZE = 8 * 1024 * 1024;
+static const size_t MAX_QUEUE_SIZE = 256 * 1024 * 1024;
+static const int UPLOAD_TIMEOUT_SEC = 600;
+
+// Synthetic payload, content doesn't matter to server
+static prc::ByteBuffer makeData(size_t size)
+{
+    prc::ByteBuffer data(size);
+    uint32_t x = 2463534242u;
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        // xorshift
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        data[i] = static_cast<uint8_t>(x);
+    }
+
+    return data;
+}
+
+static prc::timestamp_t makeTimestamp(int i)
+{
+    return prc::timestamp_t(1500000000000LL + i * 1000LL);
+}
+
+// Single upload of i-th artifact, returns number of bytes sent in request
+// body (excluding multipart overhead) or 0 on error
+typedef boost::function<size_t (int i)> UploadFunc;
+
+static void runUploads(const BenchOptions& options, const char* name, const UploadFunc& upload)
+{
+    BenchReport report(std::string("uploads: ") + name);
+    Stopwatch total;
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        Stopwatch sw;
+        const size_t numBytes = upload(i);
+        report.addRequest(sw.elapsedMs(), numBytes > 0, numBytes);
+    }
+
+    report.print(total.elapsedMs());
+}
+
+class ClientUploads
+{
+public:
+    ClientUploads(prc::Client& client, prc::id_t accountId, prc::id_t instrumentId)
+        : client_(client)
+        , accountId_(accountId)
+        , instrumentId_(instrumentId)
+        , image_(makeData(IMAGE_SIZE))
+        , objectStream_(makeData(OBJECT_STREAM_SIZE))
+        , flipbook_(makeData(FLIPBOOK_SIZE))
+    {
+    }
+
+    size_t uploadBackground(int i)
+    {
+        prc::Status status = client_.uploadBackground(accountId_, instrumentId_, makeTimestamp(i),
+                                                      makePayload(image_, "image/jpeg"));
+        return status.isSuccess() ? image_.size() : 0;
+    }
+
+    size_t uploadObjectStream(int i)
+    {
+        prc::ObjectStream stream(makeTimestamp(i), 100, 100, 64, 128, 1920, 1080, i, "FOREGROUND");
+        prc::Status status = client_.uploadObjectStream(accountId_, instrumentId_, stream,
+                                                        makePayload(objectStream_, "image/jpeg"));
+        return status.isSuccess() ? objectStream_.size() : 0;
+    }
+
+    size_t uploadFlipbook(int i)
+    {
+        prc::Flipbook flipbook(makeTimestamp(i), makeTimestamp(i + 60), 320, 240, 60);
+        prc::Status status = client_.uploadFlipbook(accountId_, instrumentId_, flipbook,
+                                                    makePayload(flipbook_, "video/mp4"));
+        return status.isSuccess() ? flipbook_.size() : 0;
+    }
+
+    size_t uploadCount(int i)
+    {
+        prc::Counts counts;
+        counts.push_back(prc::Count(makeTimestamp(i), i, "bench"));
+
+        prc::Status status = client_.uploadCount(accountId_, instrumentId_, counts, false);
+        return status.isSuccess() ? prc::toJsonString(counts).size() : 0;
+    }
+
+    size_t uploadEvent(int i)
+    {
+        prc::Events events;
+        events.push_back(prc::Event(makeTimestamp(i)));
+
+        prc::Status status = client_.uploadEvent(accountId_, instrumentId_, makeTimestamp(i), events);
+        return status.isSuccess() ? prc::toJsonString(events).size() : 0;
+    }
+
+    size_t uploadTrack(int i)
+    {
+        prc::Tracks tracks;
+        tracks.push_back(prc::Track(i, makeTimestamp(i)));
+
+        for (int j = 0; j < NUM_TRACK_POINTS; ++j)
+            tracks.back().points.push_back(prc::TrackPoint(j, j, j * 40));
+
+        prc::Status status = client_.uploadTrack(accountId_, instrumentId_, makeTimestamp(i), tracks);
+        return status.isSuccess() ? prc::toJsonString(tracks).size() : 0;
+    }
+
+private:
+    static prc::Payload makePayload(const prc::ByteBuffer& data, const char* mimeType)
+    {
+        return prc::Payload(data.data(), data.size(), mimeType);
+    }
+
+    prc::Client& client_;
+    prc::id_t accountId_;
+    prc::id_t instrumentId_;
+    prc::ByteBuffer image_;
+    prc::ByteBuffer objectStream_;
+    prc::ByteBuffer flipbook_;
+};
+
+static int runClientUploads(const BenchOptions& options)
+{
+    prc::Client client(options.apiRoot, options.apiToken);
+    configureClient(client, options);
+
+    prc::Status status = client.init();
+    prc::id_t accountId = 0;
+    prc::id_t instrumentId = 0;
+
+    if (status.isSuccess())
+        status = findTargetInstrument(client, accountId, instrumentId);
+
+    if (status.isError())
+    {
+        std::cout << "uploads: can't find instrument to upload to: " << status << std::endl;
+        return -1;
+    }
+
+    ClientUploads uploads(client, accountId, instrumentId);
+
+    runUploads(options, "Client background", boost::bind(&ClientUploads::uploadBackground, &uploads, _1));
+    runUploads(options, "Client object stream", boost::bind(&ClientUploads::uploadObjectStream, &uploads, _1));
+    runUploads(options, "Client flipbook", boost::bind(&ClientUploads::uploadFlipbook, &uploads, _1));
+    runUploads(options, "Client count", boost::bind(&ClientUploads::uploadCount, &uploads, _1));
+    runUploads(options, "Client event", boost::bind(&ClientUploads::uploadEvent, &uploads, _1));
+    runUploads(options, "Client track", boost::bind(&ClientUploads::uploadTrack, &uploads, _1));
+
+    return 0;
+}
+
+// Waits for uploader to process numArtifacts and prints its throughput
+static bool reportUploaderStatistics(const char* name, prc::ArtifactUploader& uploader,
+                                     uint64_t numArtifacts, const Stopwatch& total)
+{
+    prc::ArtifactUploader::Statistics stats;
+
+    while (stats.numArtifacts < numArtifacts  &&  total.elapsedMs() < UPLOAD_TIMEOUT_SEC * 1000)
+    {
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+        stats = uploader.getStatistics();
+    }
+
+    const double elapsedMs = total.elapsedMs();
+    const uint64_t numRequests = stats.numArtifacts - stats.numTimeSeriesArtifacts
+            + stats.numTimeSeriesUploads + stats.numFailedUploads;
+
+    std::cout << "uploads: " << name << ": " << stats.numArtifacts << " artifacts by "
+              << numRequests << " requests, failed: " << stats.numFailedUploads
+              << ", in " << elapsedMs << " ms, req/s: " << numRequests * 1000.0 / elapsedMs
+              << ", artifacts/s: " << stats.numArtifacts * 1000.0 / elapsedMs
+              << ", bytes/s: " << static_cast<uint64_t>(stats.numArtifactBytes * 1000.0 / elapsedMs) << std::endl;
+
+    return stats.numArtifacts == numArtifacts;
+}
+
+// Collects results reported by uploader's completion callbacks
+class UploaderResults
+{
+public:
+    explicit UploaderResults(const std::string& name)
+        : queueWait_(name + " queue wait")
+        , transfer_(name + " transfer")
+        , numAttempts_(0)
+    {
+    }
+
+    void onComplete(const prc::ArtifactUploader::UploadResult& result)
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        queueWait_.addRequest(static_cast<double>(result.queueWaitMs), result.status.isSuccess());
+        transfer_.addRequest(static_cast<double>(result.transferMs), result.status.isSuccess());
+        numAttempts_ += result.numAttempts;
+    }
+
+    void print(double elapsedMs) const
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        queueWait_.print(elapsedMs);
+        transfer_.print(elapsedMs);
+        std::cout << "uploads: attempts reported by callbacks: " << numAttempts_ << std::endl;
+    }
+
+private:
+    mutable boost::mutex mutex_;
+    BenchReport queueWait_;
+    BenchReport transfer_;
+    int numAttempts_;
+};
+
+// Per-artifact queue wait and transfer time come from completion callbacks
+static int runUploaderUploads(const BenchOptions& options)
+{
+    prc::ArtifactUploader::Configuration cfg(options.apiRoot, options.apiToken, "bench-client",
+                                             MAX_QUEUE_SIZE, MAX_QUEUE_SIZE);
+    cfg.numUploadThreads = 4;
+
+    setUploaderClientOptions(options);
+
+    // outlives uploader, which reports artifacts left in queue on destruction
+    UploaderResults results("uploads: ArtifactUploader");
+    const prc::ArtifactUploader::CompletionCallback callback
+            = boost::bind(&UploaderResults::onComplete, &results, _1);
+
+    prc::ArtifactUploader uploader;
+    prc::Status status = uploader.init(cfg, configureUploaderClient);
+
+    if (status.isError())
+    {
+        std::cout << "uploads: uploader init failed: " << status << std::endl;
+        return -1;
+    }
+
+    const prc::ByteBuffer image = makeData(IMAGE_SIZE);
+    Stopwatch total;
+
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        uploader.uploadBackground(makeTimestamp(i),
+                                  prc::makePayloadHolderByCopyingData(image.data(), image.size(), "image/jpeg"),
+                                  callback);
+
+        prc::Counts counts;
+        counts.push_back(prc::Count(makeTimestamp(i), i, "bench"));
+        uploader.uploadCount(prc::move_ref<prc::Counts>(counts), false, callback);
+    }
+
+    const bool isOk = reportUploaderStatistics("ArtifactUploader", uploader, 2 * options.iterations, total);
+    results.print(total.elapsedMs());
+
+    return isOk ? 0 : -1;
+}
+
+// Flipbook files are queued by reference and uploaded from memory mapping,
+// they are limited by maxQueueFileSize rather than by memory queue size
+static int runUploaderFileUploads(const BenchOptions& options)
+{
+    const int numFiles = std::max(options.iterations / 10, 1);
+
+    prc::ArtifactUploader::Configuration cfg(options.apiRoot, options.apiToken, "bench-client",
+                                             FLIPBOOK_SIZE, FLIPBOOK_SIZE);
+    cfg.numUploadThreads = 4;
+    cfg.maxQueueFileSize = static_cast<uint64_t>(numFiles) * FLIPBOOK_FILE_SIZE;
+
+    setUploaderClientOptions(options);
+
+    prc::ArtifactUploader uploader;
+    prc::Status status = uploader.init(cfg, configureUploaderClient);
+
+    if (status.isError())
+    {
+        std::cout << "uploads: uploader init failed: " << status << std::endl;
+        return -1;
+    }
+
+    // files are written in advance, so that only uploads are timed
+    const prc::ByteBuffer data = makeData(FLIPBOOK_FILE_SIZE);
+    std::vector<std::string> paths;
+
+    for (int i = 0; i < numFiles; ++i)
+    {
+        paths.push_back((boost::filesystem::temp_directory_path()
+                         / boost::filesystem::unique_path("bench-%%%%%%%%.mp4")).string());
+
+        std::ofstream file(paths.back().c_str(), std::ios::binary);
+
+        if (!file.write(reinterpret_cast<const char*>(data.data()), data.size()))
+        {
+            std::cout << "uploads: can't create " << paths.back() << std::endl;
+            return -1;
+        }
+    }
+
+    Stopwatch total;
+
+    for (int i = 0; i < numFiles; ++i)
+    {
+        prc::Flipbook flipbook(makeTimestamp(i), makeTimestamp(i + 60), 320, 240, 60);
+        uploader.uploadFlipbook(flipbook, prc::makePayloadHolderByReferencingFileAutodelete(paths[i]));
+    }
+
+    return reportUploaderStatistics("ArtifactUploader flipbook files", uploader, numFiles, total) ? 0 : -1;
+}
+
+int benchUploads(const BenchOptions& options)
+{
+    int rv = runClientUploads(options);
+
+    if (runUploaderUploads(options) != 0)
+        rv = -1;
+
+    if (runUploaderFileUploads(options) != 0)
+        rv = -1;
+
+    return rv;
+}
+
+} // namespace bench
+} // namespace prism
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include "benchUtils.h"
+#include <algorithm>
+#include <iostream>
+#include "boost/format.hpp"
+
+namespace prc = prism::connect;
+
+namespace prism
+{
+namespace bench
+{
+
+// set by setUploaderClientOptions()
+static const BenchOptions* uploaderClientOptions = NULL;
+
+void configureClient(prc::Client& client, const BenchOptions& options)
+{
+    client.setLogFlags(0);
+    client.setConnectionTimeoutMs(5000);
+
+    if (options.insecure)
+        client.setSslVerifyPeer(false);
+}
+
+void setUploaderClientOptions(const BenchOptions& options)
+{
+    uploaderClientOptions = &options;
+}
+
+void configureUploaderClient(prc::Client& client)
+{
+    configureClient(client, *uploaderClientOptions);
+}
+
+void countUploaded(boost::atomic<int>& numUploaded, const prc::ArtifactUploader::UploadResult& result)
+{
+    if (result.status.isSuccess())
+        ++numUploaded;
+}
+
+prc::Status findTargetInstrument(prc::Client& client, prc::id_t& accountId, prc::id_t& instrumentId)
+{
+    prc::Accounts accounts;
+    prc::Status status = client.queryAccountsList(accounts);
+
+    if (status.isError())
+        return status;
+
+    if (accounts.empty())
+    {
+        std::cout << "No accounts available for API_TOKEN" << std::endl;
+        return prc::Status(prc::Status::NOT_FOUND, true, prc::Status::FACILITY_NONE);
+    }
+
+    prc::Instruments instruments;
+    status = client.queryInstrumentsList(accounts[0].id, instruments);
+
+    if (status.isError())
+        return status;
+
+    if (instruments.empty())
+    {
+        std::cout << "No instruments in account " << accounts[0].id << std::endl;
+        return prc::Status(prc::Status::NOT_FOUND, true, prc::Status::FACILITY_NONE);
+    }
+
+    accountId = accounts[0].id;
+    instrumentId = instruments[0].id;
+
+    return status;
+}
+
+void BenchReport::addRequest(double latencyMs, bool isSuccess, size_t numBytes)
+{
+    latenciesMs_.push_back(latencyMs);
+
+    if (!isSuccess)
+        ++numErrors_;
+
+    numBytes_ += numBytes;
+}
+
+double BenchReport::requestsPerSec(double elapsedMs) const
+{
+    return elapsedMs > 0 ? latenciesMs_.size() * 1000.0 / elapsedMs : 0;
+}
+
+double BenchReport::percentileMs(double p) const
+{
+    if (latenciesMs_.empty())
+        return 0;
+
+    std::vector<double> sorted(latenciesMs_);
+    std::sort(sorted.begin(), sorted.end());
+    size_t index = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+void BenchReport::print(double elapsedMs) const
+{
+    const double bytesPerSec = elapsedMs > 0 ? numBytes_ * 1000.0 / elapsedMs : 0;
+
+    std::cout << boost::format("%-32s requests: %6d, errors: %5d, req/s: %9.1f, "
+                               "bytes/s: %11.0f, p50, ms: %8.3f, p99, ms: %8.3f")
+                 % name_ % latenciesMs_.size() % numErrors_ % requestsPerSec(elapsedMs)
+                 % bytesPerSec % percentileMs(50) % percentileMs(99)
+              << std::endl;
+}
+
+} // namespace bench
+} // namespace prism
@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#ifndef PRISM_BENCH_UTILS_H
+#define PRISM_BENCH_UTILS_H
+
+#include <string>
+#include <vector>
+#include "boost/atomic.hpp"
+#include "boost/chrono/chrono.hpp"
+#include "boost/thread/condition_variable.hpp"
+#include "boost/thread/locks.hpp"
+#include "boost/thread/mutex.hpp"
+#include "artifact-uploader.h"
+#include "client.h"
+
+// Helper classes for internal use i.e. their interface may change in any time
+namespace prism
+{
+namespace bench
+{
+
+typedef boost::chrono::steady_clock steady_clock;
+
+struct BenchOptions
+{
+    BenchOptions()
+        : iterations(100)
+        , insecure(false)
+        , mockServer(false)
+    {
+    }
+
+    std::string apiRoot;
+    std::string apiToken;
+    int iterations;
+
+    // disables SSL peer verification, useful for local server with self-signed certificate
+    bool insecure;
+
+    // runs benchmarks against in-process mock server instead of API_ROOT
+    bool mockServer;
+};
+
+// Applies options common for all benchmarks to client
+void configureClient(prism::connect::Client& client, const BenchOptions& options);
+
+// ArtifactUploader takes plain function as config callback, so options it
+// applies are set beforehand. They must outlive uploader.
+void setUploaderClientOptions(const BenchOptions& options);
+void configureUploaderClient(prism::connect::Client& client);
+
+// Completion callback, which counts successful uploads
+void countUploaded(boost::atomic<int>& numUploaded, const prism::connect::ArtifactUploader::UploadResult& result);
+
+// Picks first instrument of first account to upload artifacts to
+prism::connect::Status findTargetInstrument(prism::connect::Client& client,
+                                            prism::connect::id_t& accountId,
+                                            prism::connect::id_t& instrumentId);
+
+class Stopwatch
+{
+public:
+    Stopwatch()
+        : start_(steady_clock::now())
+    {
+    }
+
+    void restart()
+    {
+        start_ = steady_clock::now();
+    }
+
+    double elapsedMs() const
+    {
+        return boost::chrono::duration<double, boost::milli>(steady_clock::now() - start_).count();
+    }
+
+private:
+    steady_clock::time_point start_;
+};
+
+// Accumulates per-request results and prints summary
+class BenchReport
+{
+public:
+    explicit BenchReport(const std::string& name)
+        : name_(name)
+        , numErrors_(0)
+        , numBytes_(0)
+    {
+    }
+
+    void addRequest(double latencyMs, bool isSuccess, size_t numBytes = 0);
+
+    // elapsedMs is wall time of the whole run, it differs from sum of
+    // latencies, if requests are concurrent
+    void print(double elapsedMs) const;
+
+    double requestsPerSec(double elapsedMs) const;
+
+    // p is in range [0, 100]
+    double percentileMs(double p) const;
+
+    size_t getNumErrors() const
+    {
+        return numErrors_;
+    }
+
+private:
+    std::string name_;
+    std::vector<double> latenciesMs_;
+    size_t numErrors_;
+    size_t numBytes_;
+};
+
+// Limits number of uploads in flight and collects their results
+class InFlightTracker
+{
+public:
+    // bytesPerRequest is reported for each successful upload
+    InFlightTracker(BenchReport& report, int maxInFlight, size_t bytesPerRequest = 0)
+        : report_(report)
+        , maxInFlight_(maxInFlight)
+        , bytesPerRequest_(bytesPerRequest)
+        , numInFlight_(0)
+    {
+    }
+
+    // Blocks while maxInFlight uploads are running, returns start time of new one
+    steady_clock::time_point acquire()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+
+        while (numInFlight_ >= maxInFlight_)
+            cv_.wait(lock);
+
+        ++numInFlight_;
+
+        return steady_clock::now();
+    }
+
+    void onComplete(steady_clock::time_point start, const prism::connect::Status& status)
+    {
+        double latencyMs = boost::chrono::duration<double, boost::milli>(
+                    steady_clock::now() - start).count();
+
+        {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            report_.addRequest(latencyMs, status.isSuccess(),
+                               status.isSuccess() ? bytesPerRequest_ : 0);
+            --numInFlight_;
+        }
+
+        cv_.notify_all();
+    }
+
+    void waitAll()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+
+        while (numInFlight_ > 0)
+            cv_.wait(lock);
+    }
+
+private:
+    BenchReport& report_;
+    const int maxInFlight_;
+    const size_t bytesPerRequest_;
+    int numInFlight_;
+    boost::mutex mutex_;
+    boost::condition_variable cv_;
+};
+
+} // namespace bench
+} // namespace prism
+
+#endif // PRISM_BENCH_UTILS_H
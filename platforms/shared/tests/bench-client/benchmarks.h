@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#ifndef PRISM_BENCHMARKS_H
+#define PRISM_BENCHMARKS_H
+
+#include "benchUtils.h"
+
+namespace prism
+{
+namespace bench
+{
+
+// Each benchmark returns 0 on success
+
+// Requests/s of GET API root with new connection per request vs. reused one
+int benchKeepAlive(const BenchOptions& options);
+
+// Requests/s of sequential uploadCount() vs. concurrent uploadCountAsync()
+int benchAsyncUploads(const BenchOptions& options);
+
+// Throughput of enqueueing tasks to persistent upload queue and of restoring
+// them, with payloads in memory and in files, and size of journal
+int benchPersistentQueue(const BenchOptions& options);
+
+// Counts/s uploaded by ArtifactUploader with and without merging counts
+int benchTimeSeriesBatching(const BenchOptions& options);
+
+// Time to serialize 10k track points to JSON through DOM vs. rapidjson::Writer
+int benchJsonSerialization(const BenchOptions& options);
+
+// Nanoseconds per timestamp formatted by gmtime_r() + snprintf() vs. IsoTimeFormatter
+int benchIsoTimeFormatting(const BenchOptions& options);
+
+// Requests/s, bytes/s and latency of Client uploads of each artifact type,
+// then throughput of ArtifactUploader
+int benchUploads(const BenchOptions& options);
+
+// Throughput and peak RSS growth of uploading large file and large JSON form parts
+int benchMultipart(const BenchOptions& options);
+
+// Compression ratio and CPU cost of gzip/deflate for counts, events and
+// tracks JSON, then track uploads with each encoding to local server
+int benchJsonCompression(const BenchOptions& options);
+
+// Latency of the first request made by new CURL handle factory, i.e. by new
+// Client or upload thread, with and without process-wide curl_share
+int benchSharedCache(const BenchOptions& options);
+
+// CPU time of loading CA bundle, then of requests over new TLS connections
+// verified against bundle file given by CURLOPT_CAINFO vs. shared CaBundle
+int benchCaBundle(const BenchOptions& options);
+
+// Latency of UploadQueue::push_back() from 1 to 16 producer threads, while
+// upload thread pops and merges tasks
+int benchQueueContention(const BenchOptions& options);
+
+// Time to drain upload queue by ArtifactUploader::flush() vs. destructor,
+// while counts linger for more, and time of abort() during slow upload to
+// local mock server
+int benchShutdown(const BenchOptions& options);
+
+// Time to upload backlog of backgrounds and counts built up by slow local
+// mock server, while every background is kept in queue vs. the latest one
+int benchSupersede(const BenchOptions& options);
+
+// findCameraByName() among 2000 instruments with and without instrument
+// cache, time and requests from ArtifactUploader::init() to the first upload
+// on cold, warm and stale session cache start, and init() while server is down
+int benchStartup(const BenchOptions& options);
+
+// Time and peak RSS growth of parsing 10k instruments list into DOM vs.
+// streaming it through JsonArrayReader in chunks, then queryInstrumentsList()
+// of such list from local mock server
+int benchListParsing(const BenchOptions& options);
+
+// Camera lookup among 10k instruments of local mock server: whole list
+// scanned vs. filtered findCameraByName(), then InstrumentCursor over whole
+// list in pages; time, requests and response size per lookup
+int benchInstrumentLookup(const BenchOptions& options);
+
+// Rounds of API root, accounts, account and 10k instruments GETs from local
+// mock server without and with HTTP validator cache: time, response size,
+// cache hits and misses, then round after list has changed
+int benchConditionalGet(const BenchOptions& options);
+
+// DurationHistogram size, cost of record() and accuracy, then metrics
+// ArtifactUploader has collected uploading to local mock server
+int benchRequestMetrics(const BenchOptions& options);
+
+// Cost of each pop from "priority" upload queue, while it holds backlog of
+// backgrounds and counts of higher priority left by network outage
+int benchPriorityQueue(const BenchOptions& options);
+
+} // namespace bench
+} // namespace prism
+
+#endif // PRISM_BENCHMARKS_H
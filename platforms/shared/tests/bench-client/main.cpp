@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "curl/curl.h"
+#include "easylogging++.h"
+#include "benchmarks.h"
+#include "MockServer.h"
+
+_INITIALIZE_EASYLOGGINGPP
+
+namespace pb = prism::bench;
+
+struct CurlGlobal
+{
+    CurlGlobal()
+    {
+        curl_global_init(CURL_GLOBAL_ALL);
+    }
+
+    ~CurlGlobal()
+    {
+        curl_global_cleanup();
+    }
+};
+
+struct Benchmark
+{
+    const char* name;
+    int (*func)(const pb::BenchOptions&);
+    bool needsServer;
+};
+
+static const Benchmark benchmarks[] =
+{
+    {"keep-alive", pb::benchKeepAlive, true},
+    {"async-uploads", pb::benchAsyncUploads, true},
+    {"persistent-queue", pb::benchPersistentQueue, false},
+    {"time-series-batching", pb::benchTimeSeriesBatching, true},
+    {"json-serialization", pb::benchJsonSerialization, false},
+    {"iso-time-formatting", pb::benchIsoTimeFormatting, false},
+    {"uploads", pb::benchUploads, true},
+    {"multipart", pb::benchMultipart, true},
+    {"json-compression", pb::benchJsonCompression, false},
+    {"shared-cache", pb::benchSharedCache, true},
+    {"ca-bundle", pb::benchCaBundle, false},
+    {"queue-contention", pb::benchQueueContention, false},
+    {"shutdown", pb::benchShutdown, true},
+    {"supersede", pb::benchSupersede, false},
+    {"startup", pb::benchStartup, false},
+    {"list-parsing", pb::benchListParsing, false},
+    {"instrument-lookup", pb::benchInstrumentLookup, false},
+    {"conditional-get", pb::benchConditionalGet, false},
+    {"request-metrics", pb::benchRequestMetrics, false},
+    {"priority-queue", pb::benchPriorityQueue, false}
+};
+
+static const size_t numBenchmarks = sizeof(benchmarks)/sizeof(benchmarks[0]);
+
+static void printUsage()
+{
+    std::cout << "Usage:\n\tbench-client <benchmark>|all [--iterations=N] [--insecure] [--mock-server]\n"
+              << "Environment:\n\tAPI_ROOT, API_TOKEN - server to run network benchmarks against\n"
+              << "\t--mock-server runs them against local mock server instead\n"
+              << "Benchmarks:\n";
+
+    for (size_t i = 0; i < numBenchmarks; ++i)
+        std::cout << "\t" << benchmarks[i].name << std::endl;
+}
+
+// Benchmarks report to stdout, keep SDK log for errors only
+static void initLogger()
+{
+    namespace el = easyloggingpp;
+
+    el::Configurations conf;
+
+    conf.set(el::Level::All, el::ConfigurationType::Format, "%datetime | %level | %log");
+    conf.set(el::Level::All, el::ConfigurationType::ToFile, "false");
+    conf.set(el::Level::All, el::ConfigurationType::Enabled, "false");
+    conf.set(el::Level::Error, el::ConfigurationType::Enabled, "true");
+
+    el::Loggers::reconfigureAllLoggers(conf);
+}
+
+static bool parseOptions(int argc, char** argv, pb::BenchOptions& options)
+{
+    for (int i = 2; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        const char* kIterations = "--iterations=";
+
+        if (!strncmp(arg, kIterations, strlen(kIterations)))
+            options.iterations = atoi(arg + strlen(kIterations));
+        else if (!strcmp(arg, "--insecure"))
+            options.insecure = true;
+        else if (!strcmp(arg, "--mock-server"))
+            options.mockServer = true;
+        else
+        {
+            std::cout << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+
+    const char* envBuf = std::getenv("API_ROOT");
+
+    if (envBuf)
+        options.apiRoot = envBuf;
+
+    envBuf = std::getenv("API_TOKEN");
+
+    if (envBuf)
+        options.apiToken = envBuf;
+
+    return options.iterations > 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        printUsage();
+        return -1;
+    }
+
+    pb::BenchOptions options;
+
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage();
+        return -1;
+    }
+
+    initLogger();
+
+    CurlGlobal cg;
+
+    prism::mock::MockServer mockServer;
+
+    if (options.mockServer)
+    {
+        if (!mockServer.start(prism::mock::MockServer::Configuration()))
+            return -1;
+
+        options.apiRoot = mockServer.getApiRoot();
+        options.apiToken = "mock";
+    }
+
+    const std::string name(argv[1]);
+    int rv = 0;
+    bool found = false;
+
+    for (size_t i = 0; i < numBenchmarks; ++i)
+    {
+        if (name != "all"  &&  name != benchmarks[i].name)
+            continue;
+
+        found = true;
+
+        if (benchmarks[i].needsServer  &&  options.apiRoot.empty())
+        {
+            std::cout << "Skipping " << benchmarks[i].name
+                      << ": API_ROOT environment variable is undefined" << std::endl;
+            continue;
+        }
+
+        std::cout << "=== " << benchmarks[i].name << " ===" << std::endl;
+
+        if (benchmarks[i].func(options) != 0)
+            rv = -1;
+    }
+
+    if (!found)
+    {
+        printUsage();
+        return -1;
+    }
+
+    return rv;
+}
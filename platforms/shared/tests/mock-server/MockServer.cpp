@@ -0,0 +1,1030 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include "MockServer.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <vector>
+#include "boost/asio.hpp"
+#include "boost/bind.hpp"
+#include "boost/thread/condition_variable.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/thread.hpp"
+#include "rapidjson/document.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#include "zlib.h"
+
+#ifdef PRISM_MOCK_SERVER_TLS
+#include "boost/asio/ssl.hpp"
+#endif
+
+namespace prism
+{
+namespace mock
+{
+
+using boost::asio::ip::tcp;
+
+typedef rapidjson::Writer<rapidjson::StringBuffer> JsonWriter;
+
+static const int ACCOUNT_ID = 1;
+
+// larger page_size is reduced to it, as real server does
+static const int MAX_PAGE_SIZE = 1000;
+
+struct Instrument
+{
+    Instrument(int id, const std::string& name, const std::string& type)
+        : id(id)
+        , name(name)
+        , type(type)
+    {
+    }
+
+    int id;
+    std::string name;
+    std::string type;
+};
+
+struct Request
+{
+    std::string method;
+    std::string path;
+    // case is kept, as multipart boundary is case sensitive
+    std::string contentType;
+    std::string contentEncoding;
+    std::string ifNoneMatch;
+    // empty for uploads, see readRequest()
+    std::string body;
+    size_t bodySize;
+};
+
+struct Response
+{
+    Response()
+        : code(200)
+        , body("{}")
+    {
+    }
+
+    Response(int code, const std::string& body)
+        : code(code)
+        , body(body)
+    {
+    }
+
+    int code;
+    std::string body;
+    // sent, if not empty
+    std::string etag;
+};
+
+static const char* reasonPhrase(int code)
+{
+    switch (code)
+    {
+    case 100: return "Continue";
+    case 200: return "OK";
+    case 201: return "Created";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 411: return "Length Required";
+    case 415: return "Unsupported Media Type";
+    default:  return "Unknown";
+    }
+}
+
+static std::string toLower(std::string str)
+{
+    std::transform(str.begin(), str.end(), str.begin(), ::tolower);
+    return str;
+}
+
+static std::string trim(const std::string& str)
+{
+    const size_t begin = str.find_first_not_of(" \t\r");
+
+    if (begin == std::string::npos)
+        return std::string();
+
+    return str.substr(begin, str.find_last_not_of(" \t\r") - begin + 1);
+}
+
+// "/accounts/1/instruments/?page=1" -> {"accounts", "1", "instruments"}
+static std::vector<std::string> splitPath(const std::string& path)
+{
+    std::vector<std::string> segments;
+    std::istringstream ss(path.substr(0, path.find('?')));
+    std::string segment;
+
+    while (std::getline(ss, segment, '/'))
+        if (!segment.empty())
+            segments.push_back(segment);
+
+    return segments;
+}
+
+// "a%20b+c" -> "a b c"
+static std::string urlDecode(const std::string& str)
+{
+    std::string decoded;
+    decoded.reserve(str.size());
+
+    for (size_t i = 0; i < str.size(); ++i)
+    {
+        if (str[i] == '+')
+            decoded.push_back(' ');
+        else if (str[i] == '%'  &&  i + 2 < str.size()
+                 &&  isxdigit(str[i + 1])  &&  isxdigit(str[i + 2]))
+        {
+            decoded.push_back(char(strtol(str.substr(i + 1, 2).c_str(), NULL, 16)));
+            i += 2;
+        }
+        else
+            decoded.push_back(str[i]);
+    }
+
+    return decoded;
+}
+
+// "/accounts/1/instruments/?name=a%20b&page_size=2" -> {"name": "a b", "page_size": "2"}
+static std::map<std::string, std::string> parseQuery(const std::string& path)
+{
+    std::map<std::string, std::string> params;
+    const size_t question = path.find('?');
+
+    if (question == std::string::npos)
+        return params;
+
+    std::istringstream ss(path.substr(question + 1));
+    std::string param;
+
+    while (std::getline(ss, param, '&'))
+    {
+        const size_t equals = param.find('=');
+
+        if (equals != std::string::npos)
+            params[urlDecode(param.substr(0, equals))] = urlDecode(param.substr(equals + 1));
+    }
+
+    return params;
+}
+
+// Query string of path with cursor parameter set to given one, others are
+// kept as client has encoded them
+static std::string replaceCursor(const std::string& path, size_t cursor)
+{
+    const size_t question = path.find('?');
+    std::ostringstream query;
+
+    if (question != std::string::npos)
+    {
+        std::istringstream ss(path.substr(question + 1));
+        std::string param;
+
+        while (std::getline(ss, param, '&'))
+            if (!param.empty()  &&  param.compare(0, 7, "cursor=") != 0)
+                query << param << '&';
+    }
+
+    query << "cursor=" << cursor;
+
+    return query.str();
+}
+
+// Quoted FNV-1a hash of body, changes whenever body does
+static std::string makeEtag(const std::string& body)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < body.size(); ++i)
+    {
+        hash ^= (unsigned char) body[i];
+        hash *= 1099511628211ULL;
+    }
+
+    std::ostringstream ss;
+    ss << '"' << std::hex << hash << '"';
+
+    return ss.str();
+}
+
+static Response notFound()
+{
+    return Response(404, "{\"detail\":\"Not found.\"}");
+}
+
+static Response badRequest(const char* detail)
+{
+    return Response(400, std::string("{\"detail\":\"") + detail + "\"}");
+}
+
+static Response unsupportedEncoding()
+{
+    return Response(415, "{\"detail\":\"Unsupported content encoding.\"}");
+}
+
+// Decodes gzip or zlib ("deflate" content coding) data, format is detected
+// by header
+static bool inflateString(const std::string& data, std::string& out)
+{
+    // windowBits beyond 31 enable automatic header detection
+    static const int kWindowBits = 15 + 32;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+
+    if (inflateInit2(&zs, kWindowBits) != Z_OK)
+        return false;
+
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    zs.avail_in = data.size();
+
+    char chunk[64 * 1024];
+    int rv = Z_OK;
+    out.clear();
+
+    while (rv == Z_OK)
+    {
+        zs.next_out = reinterpret_cast<Bytef*>(chunk);
+        zs.avail_out = sizeof(chunk);
+        rv = inflate(&zs, Z_NO_FLUSH);
+        out.append(chunk, sizeof(chunk) - zs.avail_out);
+    }
+
+    inflateEnd(&zs);
+
+    return rv == Z_STREAM_END;
+}
+
+static bool isEncoding(const std::string& contentEncoding)
+{
+    return contentEncoding == "gzip"  ||  contentEncoding == "deflate";
+}
+
+// Form part of multipart/form-data body
+struct FormPart
+{
+    std::string contentType;
+    std::string contentEncoding;
+    std::string data;
+};
+
+// Returns false, if body isn't well-formed multipart/form-data
+static bool parseForm(const std::string& contentType, const std::string& body,
+                      std::vector<FormPart>& parts)
+{
+    const size_t boundaryPos = contentType.find("boundary=");
+
+    if (toLower(contentType).find("multipart/form-data") != 0  ||  boundaryPos == std::string::npos)
+        return false;
+
+    const std::string delimiter = "--" + contentType.substr(boundaryPos + strlen("boundary="));
+    size_t pos = body.find(delimiter);
+
+    while (pos != std::string::npos)
+    {
+        pos += delimiter.size();
+
+        // closing delimiter
+        if (body.compare(pos, 2, "--") == 0)
+            return true;
+
+        const size_t headerEnd = body.find("\r\n\r\n", pos);
+        const size_t next = body.find("\r\n" + delimiter, pos);
+
+        if (headerEnd == std::string::npos  ||  next == std::string::npos  ||  headerEnd > next)
+            return false;
+
+        FormPart part;
+        std::istringstream ss(body.substr(pos, headerEnd - pos));
+        std::string line;
+
+        while (std::getline(ss, line))
+        {
+            const size_t colon = line.find(':');
+
+            if (colon == std::string::npos)
+                continue;
+
+            const std::string name = toLower(trim(line.substr(0, colon)));
+
+            if (name == "content-type")
+                part.contentType = toLower(trim(line.substr(colon + 1)));
+            else if (name == "content-encoding")
+                part.contentEncoding = toLower(trim(line.substr(colon + 1)));
+        }
+
+        part.data = body.substr(headerEnd + 4, next - headerEnd - 4);
+        parts.push_back(part);
+        pos = next + 2;
+    }
+
+    return false;
+}
+
+class MockServer::Impl
+{
+public:
+    Impl()
+        : acceptor_(io_)
+        , isTls_(false)
+        , responseDelayMs_(0)
+        , checkTimeSeries_(false)
+        , isStarted_(false)
+        , isStopped_(false)
+        , numConnections_(0)
+        , nextInstrumentId_(1)
+    {
+    }
+
+    bool start(const Configuration& cfg);
+    void stop();
+
+    std::string getApiRoot() const
+    {
+        return apiRoot_;
+    }
+
+    Statistics getStatistics() const
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        return statistics_;
+    }
+
+private:
+    void acceptFunc();
+    void connectionFunc(tcp::socket* socket);
+
+    template <typename Stream>
+    void serve(Stream& stream);
+
+    template <typename Stream>
+    bool readRequest(Stream& stream, boost::asio::streambuf& buf, Request& request, bool& keepAlive);
+
+    template <typename Stream>
+    void writeResponse(Stream& stream, const Response& response, bool keepAlive);
+
+    Response handle(const Request& request);
+    Response route(const Request& request);
+    Response handleInstruments(const Request& request);
+    Response handleUpload(const Request& request, int instrumentId);
+    Response checkTimeSeries(const Request& request);
+
+    void writeAccount(JsonWriter& writer) const;
+    static void writeInstrument(JsonWriter& writer, const Instrument& instrument);
+
+    boost::asio::io_service io_;
+    tcp::acceptor acceptor_;
+#ifdef PRISM_MOCK_SERVER_TLS
+    boost::scoped_ptr<boost::asio::ssl::context> sslContext_;
+#endif
+    bool isTls_;
+    std::string apiRoot_;
+    int responseDelayMs_;
+    bool checkTimeSeries_;
+    boost::thread acceptThread_;
+
+    // guards everything below
+    mutable boost::mutex mutex_;
+    boost::condition_variable connectionsCv_;
+    std::set<tcp::socket*> connections_;
+    bool isStarted_;
+    bool isStopped_;
+    // connection threads, they outlive their sockets in connections_
+    int numConnections_;
+    std::vector<Instrument> instruments_;
+    int nextInstrumentId_;
+    Statistics statistics_;
+};
+
+MockServer::MockServer()
+    : pImpl_(new Impl())
+{
+}
+
+MockServer::~MockServer()
+{
+    stop();
+}
+
+bool MockServer::isTlsSupported()
+{
+#ifdef PRISM_MOCK_SERVER_TLS
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool MockServer::start(const Configuration& cfg)
+{
+    return pImpl_->start(cfg);
+}
+
+void MockServer::stop()
+{
+    pImpl_->stop();
+}
+
+std::string MockServer::getApiRoot() const
+{
+    return pImpl_->getApiRoot();
+}
+
+MockServer::Statistics MockServer::getStatistics() const
+{
+    return pImpl_->getStatistics();
+}
+
+bool MockServer::Impl::start(const Configuration& cfg)
+{
+    isTls_ = !cfg.certificateFile.empty()  &&  !cfg.privateKeyFile.empty();
+    responseDelayMs_ = cfg.responseDelayMs;
+    checkTimeSeries_ = cfg.checkTimeSeries;
+
+    try
+    {
+        if (isTls_)
+        {
+#ifdef PRISM_MOCK_SERVER_TLS
+            namespace ssl = boost::asio::ssl;
+
+            sslContext_.reset(new ssl::context(ssl::context::sslv23_server));
+            sslContext_->set_options(ssl::context::default_workarounds | ssl::context::no_sslv2);
+            sslContext_->use_certificate_chain_file(cfg.certificateFile);
+            sslContext_->use_private_key_file(cfg.privateKeyFile, ssl::context::pem);
+#else
+            std::cout << "Mock server is built without TLS support" << std::endl;
+            return false;
+#endif
+        }
+
+        const tcp::endpoint endpoint(boost::asio::ip::address::from_string(cfg.address), cfg.port);
+
+        acceptor_.open(endpoint.protocol());
+        acceptor_.set_option(tcp::acceptor::reuse_address(true));
+        acceptor_.bind(endpoint);
+        acceptor_.listen();
+    }
+    catch (const std::exception& e)
+    {
+        std::cout << "Mock server failed to start on " << cfg.address << ":" << cfg.port
+                  << ": " << e.what() << std::endl;
+        return false;
+    }
+
+    std::ostringstream ss;
+    ss << (isTls_ ? "https://" : "http://") << cfg.address << ":"
+       << acceptor_.local_endpoint().port() << "/";
+    apiRoot_ = ss.str();
+
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        instruments_.push_back(Instrument(nextInstrumentId_++, "camera", "camera"));
+        isStarted_ = true;
+    }
+
+    acceptThread_ = boost::thread(boost::bind(&Impl::acceptFunc, this));
+
+    return true;
+}
+
+void MockServer::Impl::stop()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+
+        if (!isStarted_  ||  isStopped_)
+            return;
+
+        isStopped_ = true;
+
+        for (std::set<tcp::socket*>::const_iterator it = connections_.begin(); it != connections_.end(); ++it)
+        {
+            boost::system::error_code ec;
+            (*it)->shutdown(tcp::socket::shutdown_both, ec);
+        }
+    }
+
+    // closing acceptor doesn't interrupt blocking accept() on all platforms,
+    // so wake it up by connecting
+    {
+        boost::system::error_code ec;
+        tcp::socket socket(io_);
+        socket.connect(acceptor_.local_endpoint(), ec);
+    }
+
+    acceptThread_.join();
+
+    boost::system::error_code ec;
+    acceptor_.close(ec);
+
+    boost::unique_lock<boost::mutex> lock(mutex_);
+
+    while (numConnections_ > 0)
+        connectionsCv_.wait(lock);
+}
+
+void MockServer::Impl::acceptFunc()
+{
+    for (;;)
+    {
+        // connection thread takes ownership of socket
+        tcp::socket* socket = new tcp::socket(io_);
+        boost::system::error_code ec;
+        acceptor_.accept(*socket, ec);
+
+        boost::lock_guard<boost::mutex> lock(mutex_);
+
+        if (isStopped_  ||  ec)
+        {
+            delete socket;
+
+            if (isStopped_)
+                break;
+
+            continue;
+        }
+
+        socket->set_option(tcp::no_delay(true), ec);
+        connections_.insert(socket);
+        ++numConnections_;
+
+        boost::thread(boost::bind(&Impl::connectionFunc, this, socket)).detach();
+    }
+}
+
+void MockServer::Impl::connectionFunc(tcp::socket* rawSocket)
+{
+    boost::scoped_ptr<tcp::socket> socket(rawSocket);
+
+    try
+    {
+        if (isTls_)
+        {
+#ifdef PRISM_MOCK_SERVER_TLS
+            boost::asio::ssl::stream<tcp::socket&> stream(*socket, *sslContext_);
+            stream.handshake(boost::asio::ssl::stream_base::server);
+            serve(stream);
+
+            boost::system::error_code ec;
+            stream.shutdown(ec);
+#endif
+        }
+        else
+        {
+            serve(*socket);
+        }
+    }
+    catch (const std::exception&)
+    {
+        // client has closed connection or server is stopped
+    }
+
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        connections_.erase(rawSocket);
+    }
+
+    // socket refers to io_, so it must be destroyed before stop() returns
+    socket.reset();
+
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    --numConnections_;
+    connectionsCv_.notify_all();
+}
+
+template <typename Stream>
+void MockServer::Impl::serve(Stream& stream)
+{
+    boost::asio::streambuf buf;
+    Request request;
+    bool keepAlive = true;
+
+    while (keepAlive  &&  readRequest(stream, buf, request, keepAlive))
+        writeResponse(stream, handle(request), keepAlive);
+}
+
+// Returns false, if connection should be closed without response
+template <typename Stream>
+bool MockServer::Impl::readRequest(Stream& stream, boost::asio::streambuf& buf,
+                                   Request& request, bool& keepAlive)
+{
+    boost::system::error_code ec;
+    const size_t headerSize = boost::asio::read_until(stream, buf, "\r\n\r\n", ec);
+
+    if (ec)
+        return false;
+
+    std::string header(boost::asio::buffers_begin(buf.data()),
+                       boost::asio::buffers_begin(buf.data()) + headerSize);
+    buf.consume(headerSize);
+
+    std::istringstream ss(header);
+    std::string version;
+    ss >> request.method >> request.path >> version;
+
+    keepAlive = version == "HTTP/1.1";
+    size_t contentLength = 0;
+    bool expectContinue = false;
+    std::string line;
+
+    request.contentType.clear();
+    request.contentEncoding.clear();
+    request.ifNoneMatch.clear();
+
+    std::getline(ss, line);
+
+    while (std::getline(ss, line))
+    {
+        const size_t colon = line.find(':');
+
+        if (colon == std::string::npos)
+            continue;
+
+        const std::string name = toLower(trim(line.substr(0, colon)));
+        const std::string value = toLower(trim(line.substr(colon + 1)));
+
+        if (name == "content-length")
+            contentLength = strtoul(value.c_str(), NULL, 10);
+        else if (name == "connection")
+            keepAlive = value != "close";
+        else if (name == "expect")
+            expectContinue = value == "100-continue";
+        else if (name == "content-type")
+            request.contentType = trim(line.substr(colon + 1));
+        else if (name == "if-none-match")
+            request.ifNoneMatch = trim(line.substr(colon + 1));
+        else if (name == "content-encoding")
+            request.contentEncoding = value;
+        else if (name == "transfer-encoding"  &&  value != "identity")
+        {
+            writeResponse(stream, Response(411, "{}"), false);
+            return false;
+        }
+    }
+
+    if (expectContinue)
+    {
+        static const char kContinue[] = "HTTP/1.1 100 Continue\r\n\r\n";
+        boost::asio::write(stream, boost::asio::buffer(kContinue, sizeof(kContinue) - 1));
+    }
+
+    request.bodySize = contentLength;
+    request.body.clear();
+
+    // Upload bodies are discarded while read, so that mock server running
+    // in-process doesn't distort memory usage measured by benchmarks
+    const bool isTimeSeries = request.path.find("/time-series") != std::string::npos;
+
+    if (request.path.find("/data/") != std::string::npos  &&  !(checkTimeSeries_  &&  isTimeSeries))
+    {
+        size_t numLeft = contentLength - std::min(contentLength, buf.size());
+        buf.consume(contentLength);
+
+        char chunk[64 * 1024];
+
+        while (numLeft > 0)
+            numLeft -= boost::asio::read(stream, boost::asio::buffer(chunk, std::min(numLeft, sizeof(chunk))));
+
+        return true;
+    }
+
+    if (buf.size() < contentLength)
+        boost::asio::read(stream, buf, boost::asio::transfer_exactly(contentLength - buf.size()));
+
+    request.body.assign(boost::asio::buffers_begin(buf.data()),
+                        boost::asio::buffers_begin(buf.data()) + contentLength);
+    buf.consume(contentLength);
+
+    return true;
+}
+
+template <typename Stream>
+void MockServer::Impl::writeResponse(Stream& stream, const Response& response, bool keepAlive)
+{
+    std::ostringstream ss;
+    ss << "HTTP/1.1 " << response.code << " " << reasonPhrase(response.code) << "\r\n"
+       << "Content-Type: application/json\r\n"
+       << "Content-Length: " << response.body.size() << "\r\n";
+
+    if (!response.etag.empty())
+        ss << "ETag: " << response.etag << "\r\n";
+
+    if (!keepAlive)
+        ss << "Connection: close\r\n";
+
+    ss << "\r\n" << response.body;
+
+    const std::string data = ss.str();
+    boost::asio::write(stream, boost::asio::buffer(data));
+
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    statistics_.numBytesSent += response.body.size();
+}
+
+Response MockServer::Impl::handle(const Request& request)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        ++statistics_.numRequests;
+        statistics_.numBytesReceived += request.bodySize;
+    }
+
+    Response response = route(request);
+
+    // GET responses are tagged, so that client may request them again
+    // conditionally
+    if (request.method != "GET"  ||  response.code != 200)
+        return response;
+
+    response.etag = makeEtag(response.body);
+
+    if (request.ifNoneMatch != response.etag)
+        return response;
+
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    ++statistics_.numNotModified;
+
+    response.code = 304;
+    response.body.clear();
+
+    return response;
+}
+
+Response MockServer::Impl::route(const Request& request)
+{
+    const std::vector<std::string> path = splitPath(request.path);
+    const bool isGet = request.method == "GET";
+    const bool isPost = request.method == "POST";
+
+    rapidjson::StringBuffer buffer;
+    JsonWriter writer(buffer);
+
+    if (path.empty())
+    {
+        if (!isGet)
+            return notFound();
+
+        writer.StartObject();
+        writer.Key("version");
+        writer.String("1");
+        writer.Key("url");
+        writer.String(apiRoot_.c_str());
+        writer.Key("accounts_url");
+        writer.String((apiRoot_ + "accounts/").c_str());
+        writer.EndObject();
+
+        return Response(200, buffer.GetString());
+    }
+
+    if (path[0] != "accounts")
+        return notFound();
+
+    if (path.size() == 1  &&  isGet)
+    {
+        writer.StartArray();
+        writeAccount(writer);
+        writer.EndArray();
+
+        return Response(200, buffer.GetString());
+    }
+
+    if (path.size() == 1  ||  atoi(path[1].c_str()) != ACCOUNT_ID)
+        return notFound();
+
+    if (path.size() == 2  &&  isGet)
+    {
+        writeAccount(writer);
+        return Response(200, buffer.GetString());
+    }
+
+    if (path.size() == 2  ||  path[2] != "instruments")
+        return notFound();
+
+    if (path.size() == 3)
+        return handleInstruments(request);
+
+    // .../instruments/<id>/data/{images,videos,time-series}/
+    if (path.size() == 6  &&  isPost  &&  path[4] == "data"
+            &&  (path[5] == "images"  ||  path[5] == "videos"  ||  path[5] == "time-series"))
+        return handleUpload(request, atoi(path[3].c_str()));
+
+    return notFound();
+}
+
+Response MockServer::Impl::handleInstruments(const Request& request)
+{
+    rapidjson::StringBuffer buffer;
+    JsonWriter writer(buffer);
+
+    if (request.method == "GET")
+    {
+        // Filters match exactly. Cursor is offset in filtered list, client
+        // treats it as opaque and follows "next" URL.
+        std::map<std::string, std::string> params = parseQuery(request.path);
+        const std::string& name = params["name"];
+        const std::string& type = params["instrument_type"];
+        const int pageSize = std::min(atoi(params["page_size"].c_str()), MAX_PAGE_SIZE);
+        const size_t cursor = strtoul(params["cursor"].c_str(), NULL, 10);
+
+        boost::lock_guard<boost::mutex> lock(mutex_);
+
+        std::vector<const Instrument*> matching;
+
+        for (size_t i = 0; i < instruments_.size(); ++i)
+        {
+            if ((name.empty()  ||  instruments_[i].name == name)
+                    &&  (type.empty()  ||  instruments_[i].type == type))
+                matching.push_back(&instruments_[i]);
+        }
+
+        // whole list, as before pagination
+        if (pageSize <= 0)
+        {
+            writer.StartArray();
+
+            for (size_t i = 0; i < matching.size(); ++i)
+                writeInstrument(writer, *matching[i]);
+
+            writer.EndArray();
+
+            return Response(200, buffer.GetString());
+        }
+
+        const size_t begin = std::min(cursor, matching.size());
+        const size_t end = std::min(begin + pageSize, matching.size());
+
+        writer.StartObject();
+        writer.Key("next");
+
+        if (end < matching.size())
+        {
+            std::ostringstream url;
+            url << apiRoot_ << "accounts/" << ACCOUNT_ID << "/instruments/?"
+                << replaceCursor(request.path, end);
+
+            writer.String(url.str().c_str());
+        }
+        else
+            writer.Null();
+
+        writer.Key("results");
+        writer.StartArray();
+
+        for (size_t i = begin; i < end; ++i)
+            writeInstrument(writer, *matching[i]);
+
+        writer.EndArray();
+        writer.EndObject();
+
+        return Response(200, buffer.GetString());
+    }
+
+    if (request.method != "POST")
+        return notFound();
+
+    rapidjson::Document doc;
+
+    if (doc.Parse(request.body.c_str()).HasParseError()  ||  !doc.IsObject()
+            ||  !doc.HasMember("name")  ||  !doc["name"].IsString())
+        return Response(400, "{\"name\":[\"This field is required.\"]}");
+
+    const std::string type = doc.HasMember("instrument_type")  &&  doc["instrument_type"].IsString()
+            ? doc["instrument_type"].GetString()
+            : "camera";
+
+    boost::lock_guard<boost::mutex> lock(mutex_);
+
+    instruments_.push_back(Instrument(nextInstrumentId_++, doc["name"].GetString(), type));
+    writeInstrument(writer, instruments_.back());
+
+    return Response(201, buffer.GetString());
+}
+
+Response MockServer::Impl::handleUpload(const Request& request, int instrumentId)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        bool isFound = false;
+
+        for (size_t i = 0; i < instruments_.size()  &&  !isFound; ++i)
+            isFound = instruments_[i].id == instrumentId;
+
+        if (!isFound)
+            return notFound();
+
+        ++statistics_.numUploads;
+    }
+
+    if (checkTimeSeries_  &&  request.path.find("/time-series") != std::string::npos)
+    {
+        const Response response = checkTimeSeries(request);
+
+        if (response.code != 201)
+            return response;
+    }
+
+    if (responseDelayMs_ > 0)
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(responseDelayMs_));
+
+    return Response(201, "{}");
+}
+
+// Returns 201, if body is a form with well-formed JSON in each of its JSON
+// parts, 400 otherwise
+Response MockServer::Impl::checkTimeSeries(const Request& request)
+{
+    uint64_t numEncodedParts = 0;
+    uint64_t numDecodedBytes = 0;
+    std::string decodedBody;
+    const std::string* body = &request.body;
+
+    if (isEncoding(request.contentEncoding))
+    {
+        if (!inflateString(request.body, decodedBody))
+            return badRequest("Malformed request body encoding.");
+
+        body = &decodedBody;
+        ++numEncodedParts;
+        numDecodedBytes += decodedBody.size();
+    }
+    else if (!request.contentEncoding.empty()  &&  request.contentEncoding != "identity")
+        return unsupportedEncoding();
+
+    std::vector<FormPart> parts;
+
+    if (!parseForm(request.contentType, *body, parts))
+        return badRequest("Malformed form.");
+
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+        FormPart& part = parts[i];
+
+        if (isEncoding(part.contentEncoding))
+        {
+            std::string data;
+
+            if (!inflateString(part.data, data))
+                return badRequest("Malformed part encoding.");
+
+            part.data.swap(data);
+            ++numEncodedParts;
+            numDecodedBytes += part.data.size();
+        }
+        else if (!part.contentEncoding.empty())
+            return unsupportedEncoding();
+
+        rapidjson::Document doc;
+
+        if (part.contentType == "application/json"  &&  doc.Parse(part.data.c_str()).HasParseError())
+            return badRequest("Malformed JSON.");
+    }
+
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    statistics_.numEncodedParts += numEncodedParts;
+    statistics_.numDecodedBytes += numDecodedBytes;
+
+    return Response(201, "{}");
+}
+
+void MockServer::Impl::writeAccount(JsonWriter& writer) const
+{
+    std::ostringstream url;
+    url << apiRoot_ << "accounts/" << ACCOUNT_ID << "/";
+
+    writer.StartObject();
+    writer.Key("id");
+    writer.Int(ACCOUNT_ID);
+    writer.Key("name");
+    writer.String("mock");
+    writer.Key("url");
+    writer.String(url.str().c_str());
+    writer.Key("instruments_url");
+    writer.String((url.str() + "instruments/").c_str());
+    writer.EndObject();
+}
+
+void MockServer::Impl::writeInstrument(JsonWriter& writer, const Instrument& instrument)
+{
+    writer.StartObject();
+    writer.Key("id");
+    writer.Int(instrument.id);
+    writer.Key("name");
+    writer.String(instrument.name.c_str());
+    writer.Key("instrument_type");
+    writer.String(instrument.type.c_str());
+    writer.EndObject();
+}
+
+} // namespace mock
+} // namespace prism
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#ifndef PRISM_MOCK_SERVER_H
+#define PRISM_MOCK_SERVER_H
+
+#include <string>
+#include "boost/cstdint.hpp"
+#include "boost/noncopyable.hpp"
+#include "boost/scoped_ptr.hpp"
+
+namespace prism
+{
+namespace mock
+{
+
+// Local stand-in for Device API endpoints used by Client: API root, accounts,
+// instruments and image, video and time-series uploads. Serves single account
+// with id 1, any token is accepted. Instrument list is filtered by name and
+// instrument_type query parameters and is paginated, if page_size is given.
+// GET responses have ETag and are replied 304 to If-None-Match of it.
+// Uploads are acknowledged without storing them, so that SDK throughput can
+// be measured without live server.
+// Each connection is served by its own thread.
+class MockServer : boost::noncopyable
+{
+public:
+    struct Configuration
+    {
+        Configuration()
+            : address("127.0.0.1")
+            , port(0)
+            , responseDelayMs(0)
+            , checkTimeSeries(false)
+        {
+        }
+
+        std::string address;
+
+        // 0 picks any free port, see getApiRoot()
+        unsigned short port;
+
+        // Delay before replying to upload, simulates server processing time
+        int responseDelayMs;
+
+        // Parses bodies of time-series uploads: JSON form parts are decoded,
+        // if they have Content-Encoding gzip or deflate, as well as bodies
+        // with such Content-Encoding, and malformed ones are rejected with
+        // 400. Off by default, as these bodies are held in memory then.
+        bool checkTimeSeries;
+
+        // PEM files, TLS is enabled if both are set. TLS is only available if
+        // mock server is built with OpenSSL, see isTlsSupported().
+        std::string certificateFile;
+        std::string privateKeyFile;
+    };
+
+    struct Statistics
+    {
+        Statistics()
+            : numRequests(0)
+            , numUploads(0)
+            , numNotModified(0)
+            , numBytesReceived(0)
+            , numBytesSent(0)
+            , numEncodedParts(0)
+            , numDecodedBytes(0)
+        {
+        }
+
+        uint64_t numRequests;
+        // POST requests to data/ endpoints
+        uint64_t numUploads;
+        // 304 replies to GET requests with If-None-Match of current ETag
+        uint64_t numNotModified;
+        // Request bodies only, headers aren't counted
+        uint64_t numBytesReceived;
+        // Response bodies only
+        uint64_t numBytesSent;
+        // Encoded time-series parts or bodies and their size once decoded,
+        // see Configuration::checkTimeSeries
+        uint64_t numEncodedParts;
+        uint64_t numDecodedBytes;
+    };
+
+    MockServer();
+    ~MockServer();
+
+    static bool isTlsSupported();
+
+    // Starts accepting connections in background thread, returns false and
+    // prints reason on error
+    bool start(const Configuration& cfg);
+
+    // Closes all connections and waits for their threads to exit
+    void stop();
+
+    // e.g. http://127.0.0.1:36123/ for port chosen by start()
+    std::string getApiRoot() const;
+
+    Statistics getStatistics() const;
+
+private:
+    class Impl;
+    boost::scoped_ptr<Impl> pImpl_;
+};
+
+} // namespace mock
+} // namespace prism
+
+#endif // PRISM_MOCK_SERVER_H
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "boost/asio/io_service.hpp"
+#include "boost/asio/signal_set.hpp"
+#include "boost/bind.hpp"
+#include "MockServer.h"
+
+namespace pm = prism::mock;
+
+static void printUsage()
+{
+    std::cout << "Usage:\n\tmock-server [--address=ADDRESS] [--port=N] [--delay-ms=N]"
+              << " [--check-time-series] [--cert=FILE --key=FILE]\n"
+              << "Options:\n"
+              << "\t--address   address to listen on, 127.0.0.1 by default\n"
+              << "\t--port      port to listen on, any free one by default\n"
+              << "\t--delay-ms  delay before replying to upload\n"
+              << "\t--check-time-series  decode and validate time-series uploads\n"
+              << "\t--cert, --key  PEM certificate chain and private key to serve HTTPS"
+              << (pm::MockServer::isTlsSupported() ? "" : " (not supported by this build)")
+              << std::endl;
+}
+
+// Returns value of "--name=value" argument or NULL, if arg is another option
+static const char* optionValue(const char* arg, const char* name)
+{
+    const size_t len = strlen(name);
+
+    if (strncmp(arg, name, len)  ||  arg[len] != '=')
+        return NULL;
+
+    return arg + len + 1;
+}
+
+static bool parseOptions(int argc, char** argv, pm::MockServer::Configuration& cfg)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        const char* value = NULL;
+
+        if ((value = optionValue(arg, "--address")))
+            cfg.address = value;
+        else if ((value = optionValue(arg, "--port")))
+            cfg.port = static_cast<unsigned short>(atoi(value));
+        else if ((value = optionValue(arg, "--delay-ms")))
+            cfg.responseDelayMs = atoi(value);
+        else if (!strcmp(arg, "--check-time-series"))
+            cfg.checkTimeSeries = true;
+        else if ((value = optionValue(arg, "--cert")))
+            cfg.certificateFile = value;
+        else if ((value = optionValue(arg, "--key")))
+            cfg.privateKeyFile = value;
+        else
+        {
+            std::cout << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+
+    if (cfg.certificateFile.empty() != cfg.privateKeyFile.empty())
+    {
+        std::cout << "Both --cert and --key are required for HTTPS" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    pm::MockServer::Configuration cfg;
+
+    if (!parseOptions(argc, argv, cfg))
+    {
+        printUsage();
+        return -1;
+    }
+
+    pm::MockServer server;
+
+    if (!server.start(cfg))
+        return -1;
+
+    std::cout << "Serving API_ROOT=" << server.getApiRoot() << ", press Ctrl+C to stop" << std::endl;
+
+    boost::asio::io_service io;
+    boost::asio::signal_set signals(io, SIGINT, SIGTERM);
+    signals.async_wait(boost::bind(&boost::asio::io_service::stop, &io));
+    io.run();
+
+    server.stop();
+
+    const pm::MockServer::Statistics stats = server.getStatistics();
+    std::cout << "Requests: " << stats.numRequests << ", uploads: " << stats.numUploads
+              << ", bytes received: " << stats.numBytesReceived
+              << ", encoded parts: " << stats.numEncodedParts
+              << ", decoded bytes: " << stats.numDecodedBytes << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include "private/CaBundle.h"
+#include <fstream>
+#include <map>
+#include <sstream>
+#include "easylogging++.h"
+#include "boost/filesystem.hpp"
+#include "boost/thread/locks.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/weak_ptr.hpp"
+
+#if PRISM_HAVE_OPENSSL
+#include "openssl/pem.h"
+#include "openssl/ssl.h"
+#include "openssl/x509.h"
+#include "openssl/x509_vfy.h"
+#endif
+
+namespace prism
+{
+namespace connect
+{
+
+namespace
+{
+    boost::mutex instancesMutex;
+    std::map<std::string, boost::weak_ptr<CaBundle> > instances;
+
+#if PRISM_HAVE_OPENSSL
+    void addStoreRef(X509_STORE* store)
+    {
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+        X509_STORE_up_ref(store);
+#else
+        CRYPTO_add(&store->references, 1, CRYPTO_LOCK_X509_STORE);
+#endif
+    }
+
+    bool isCurlUsingOpenSsl()
+    {
+        const curl_version_info_data* info = curl_version_info(CURLVERSION_NOW);
+
+        return info->ssl_version
+                &&  std::string(info->ssl_version).compare(0, 7, "OpenSSL") == 0;
+    }
+#endif
+}
+
+CaBundlePtr CaBundle::getInstance(const std::string& path)
+{
+    boost::system::error_code ec;
+    const std::time_t modificationTime = boost::filesystem::last_write_time(path, ec);
+
+    if (ec)
+    {
+        LOG(ERROR) << "CaBundle: can't access " << path << ": " << ec.message();
+        return CaBundlePtr();
+    }
+
+    boost::lock_guard<boost::mutex> lock(instancesMutex);
+
+    CaBundlePtr rv = instances[path].lock();
+
+    if (rv  &&  rv->modificationTime_ == modificationTime)
+        return rv;
+
+    rv.reset(new CaBundle(path, modificationTime));
+
+    if (!rv->load())
+    {
+        instances.erase(path);
+        return CaBundlePtr();
+    }
+
+    instances[path] = rv;
+
+    return rv;
+}
+
+CaBundle::CaBundle(const std::string& path, std::time_t modificationTime)
+    : path_(path)
+    , modificationTime_(modificationTime)
+    , store_(0)
+{
+}
+
+CaBundle::~CaBundle()
+{
+#if PRISM_HAVE_OPENSSL
+    // TLS contexts of live connections keep their references
+    if (store_)
+        X509_STORE_free(store_);
+#endif
+}
+
+bool CaBundle::load()
+{
+    std::ifstream file(path_.c_str(), std::ios::binary);
+    std::ostringstream pem;
+
+    if (!file  ||  !(pem << file.rdbuf()))
+    {
+        LOG(ERROR) << "CaBundle: error reading " << path_;
+        return false;
+    }
+
+    pem_ = pem.str();
+
+#if PRISM_HAVE_OPENSSL
+    // other TLS backends can't use the store, they get PEM instead
+    if (isCurlUsingOpenSsl()  &&  !parse())
+        LOG(WARNING) << "CaBundle: can't parse " << path_ << ", it'll be passed to libCURL as is";
+#endif
+
+    return true;
+}
+
+#if PRISM_HAVE_OPENSSL
+bool CaBundle::parse()
+{
+    BIO* bio = BIO_new_mem_buf(const_cast<char*>(pem_.data()), static_cast<int>(pem_.size()));
+
+    if (!bio)
+        return false;
+
+    STACK_OF(X509_INFO)* infos = PEM_X509_INFO_read_bio(bio, 0, 0, 0);
+    BIO_free(bio);
+
+    if (!infos)
+        return false;
+
+    X509_STORE* store = X509_STORE_new();
+    int numCerts = 0;
+
+    for (int i = 0; store  &&  i < sk_X509_INFO_num(infos); ++i)
+    {
+        X509_INFO* info = sk_X509_INFO_value(infos, i);
+
+        if (info->x509  &&  X509_STORE_add_cert(store, info->x509))
+            ++numCerts;
+
+        if (info->crl)
+            X509_STORE_add_crl(store, info->crl);
+    }
+
+    sk_X509_INFO_pop_free(infos, X509_INFO_free);
+
+    if (!numCerts)
+    {
+        X509_STORE_free(store);
+        return false;
+    }
+
+#ifdef X509_V_FLAG_PARTIAL_CHAIN
+    // as libCURL does by default, intermediate CA in bundle is trusted
+    X509_STORE_set_flags(store, X509_V_FLAG_PARTIAL_CHAIN);
+#endif
+
+    store_ = store;
+
+    return true;
+}
+
+CURLcode CaBundle::sslCtxFunction(CURL* /*handle*/, void* sslCtx, void* userptr)
+{
+    X509_STORE* store = static_cast<CaBundle*>(userptr)->store_;
+
+    // context takes reference over and frees store libCURL has made for it
+    addStoreRef(store);
+    SSL_CTX_set_cert_store(static_cast<SSL_CTX*>(sslCtx), store);
+
+    return CURLE_OK;
+}
+#endif
+
+void CaBundle::attach(CURL* handle)
+{
+    // neither default bundle nor directory is loaded by libCURL, they're
+    // replaced by this one
+#if PRISM_HAVE_OPENSSL
+    if (store_
+            &&  curl_easy_setopt(handle, CURLOPT_SSL_CTX_FUNCTION, sslCtxFunction) == CURLE_OK)
+    {
+        curl_easy_setopt(handle, CURLOPT_SSL_CTX_DATA, this);
+        curl_easy_setopt(handle, CURLOPT_CAINFO, static_cast<char*>(0));
+        curl_easy_setopt(handle, CURLOPT_CAPATH, static_cast<char*>(0));
+        return;
+    }
+#endif
+
+#if PRISM_HAVE_CURL_CAINFO_BLOB
+    // libCURL copies blob into connection, no need for it to copy it here
+    struct curl_blob blob;
+    blob.data = const_cast<char*>(pem_.data());
+    blob.len = pem_.size();
+    blob.flags = CURL_BLOB_NOCOPY;
+
+    if (curl_easy_setopt(handle, CURLOPT_CAINFO_BLOB, &blob) == CURLE_OK)
+    {
+        curl_easy_setopt(handle, CURLOPT_CAINFO, static_cast<char*>(0));
+        curl_easy_setopt(handle, CURLOPT_CAPATH, static_cast<char*>(0));
+        return;
+    }
+#endif
+
+    curl_easy_setopt(handle, CURLOPT_CAINFO, path_.c_str());
+}
+
+} // namespace connect
+} // namespace prism
@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include "private/CurlMultiEngine.h"
+#include "easylogging++.h"
+#include "boost/thread/locks.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// curl_multi_poll() and curl_multi_wakeup() appeared in libCURL 7.68.0
+#define PRISM_HAVE_CURL_MULTI_WAKEUP (LIBCURL_VERSION_NUM >= 0x074400)
+
+namespace
+{
+    // upper bound for single wait, libCURL may ask for shorter one
+    const int MAX_WAIT_MS = 1000;
+}
+
+namespace prism
+{
+namespace connect
+{
+
+CurlMultiEngine::CurlMultiEngine()
+    : multi_(curl_multi_init())
+    , done_(false)
+{
+    wakeupPipe_[0] = wakeupPipe_[1] = -1;
+
+    if (!multi_)
+        LOG(ERROR) << "CurlMultiEngine: curl_multi_init() failed";
+
+#if !PRISM_HAVE_CURL_MULTI_WAKEUP
+    if (pipe(wakeupPipe_) == 0)
+    {
+        fcntl(wakeupPipe_[0], F_SETFL, fcntl(wakeupPipe_[0], F_GETFL) | O_NONBLOCK);
+        fcntl(wakeupPipe_[1], F_SETFL, fcntl(wakeupPipe_[1], F_GETFL) | O_NONBLOCK);
+    }
+    else
+    {
+        LOG(ERROR) << "CurlMultiEngine: failed to create wake-up pipe";
+        wakeupPipe_[0] = wakeupPipe_[1] = -1;
+    }
+#endif
+}
+
+CurlMultiEngine::~CurlMultiEngine()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        done_ = true;
+    }
+
+    wakeUp();
+
+    if (thread_.joinable())
+        thread_.join();
+
+    if (multi_)
+        curl_multi_cleanup(multi_);
+
+    for (int i = 0; i < 2; ++i)
+        if (wakeupPipe_[i] >= 0)
+            close(wakeupPipe_[i]);
+}
+
+void CurlMultiEngine::submit(CurlWrapper& wrapper, CompletionHandler handler)
+{
+    Transfer transfer(&wrapper, handler);
+    bool canStart = false;
+
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        canStart = multi_  &&  !done_;
+
+        if (canStart)
+        {
+            if (!thread_.joinable())
+            {
+                boost::thread t(&CurlMultiEngine::threadFunc, this);
+                thread_.swap(t);
+            }
+
+            pending_.push_back(transfer);
+        }
+    }
+
+    if (!canStart)
+    {
+        LOG(ERROR) << "CurlMultiEngine::submit(): engine isn't running";
+        complete(transfer, CURLE_FAILED_INIT);
+        return;
+    }
+
+    wakeUp();
+}
+
+bool CurlMultiEngine::isEngineThread() const
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    return thread_.get_id() == boost::this_thread::get_id();
+}
+
+void CurlMultiEngine::threadFunc()
+{
+    // defining const as __FUNCTIONS__ gives too little, __func__ gives too much
+    const char* FNAME = "CurlMultiEngine::threadFunc()";
+    LOG(DEBUG) << "Entered " << FNAME;
+
+    try
+    {
+        while (true)
+        {
+            {
+                boost::lock_guard<boost::mutex> lock(mutex_);
+
+                if (done_)
+                    break;
+            }
+
+            startPendingTransfers();
+
+            int numRunning = 0;
+            CURLMcode rc = curl_multi_perform(multi_, &numRunning);
+
+            if (rc != CURLM_OK)
+                LOG(ERROR) << FNAME << ": curl_multi_perform() failed: " << curl_multi_strerror(rc);
+
+            processCompletedTransfers();
+            wait();
+        }
+    }
+    catch (const std::exception& e)
+    {
+        LOG(ERROR) << FNAME << ": " << e.what();
+    }
+    catch (...)
+    {
+        LOG(ERROR) << FNAME << ": Unknown exception";
+    }
+
+    abortActiveTransfers();
+
+    LOG(DEBUG) << "Exiting " << FNAME;
+}
+
+void CurlMultiEngine::startPendingTransfers()
+{
+    std::deque<Transfer> pending;
+
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        pending.swap(pending_);
+    }
+
+    for (size_t i = 0; i < pending.size(); ++i)
+    {
+        Transfer& transfer = pending[i];
+        CURL* easy = *transfer.wrapper;
+        CURLMcode rc = curl_multi_add_handle(multi_, easy);
+
+        if (rc != CURLM_OK)
+        {
+            LOG(ERROR) << "CurlMultiEngine: curl_multi_add_handle() failed: "
+                       << curl_multi_strerror(rc);
+            complete(transfer, CURLE_FAILED_INIT);
+            continue;
+        }
+
+        active_[easy] = transfer;
+    }
+}
+
+void CurlMultiEngine::processCompletedTransfers()
+{
+    int numMessagesLeft = 0;
+
+    while (CURLMsg* msg = curl_multi_info_read(multi_, &numMessagesLeft))
+    {
+        if (msg->msg != CURLMSG_DONE)
+            continue;
+
+        // msg is invalidated by curl_multi_remove_handle()
+        CURL* easy = msg->easy_handle;
+        CURLcode result = msg->data.result;
+
+        curl_multi_remove_handle(multi_, easy);
+
+        std::map<CURL*, Transfer>::iterator it = active_.find(easy);
+
+        if (it == active_.end())
+        {
+            LOG(ERROR) << "CurlMultiEngine: completed transfer is unknown";
+            continue;
+        }
+
+        Transfer transfer = it->second;
+        active_.erase(it);
+        complete(transfer, result);
+    }
+}
+
+void CurlMultiEngine::abortActiveTransfers()
+{
+    for (std::map<CURL*, Transfer>::iterator it = active_.begin(); it != active_.end(); ++it)
+    {
+        curl_multi_remove_handle(multi_, it->first);
+        complete(it->second, CURLE_ABORTED_BY_CALLBACK);
+    }
+
+    active_.clear();
+
+    std::deque<Transfer> pending;
+
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        pending.swap(pending_);
+    }
+
+    for (size_t i = 0; i < pending.size(); ++i)
+        complete(pending[i], CURLE_ABORTED_BY_CALLBACK);
+}
+
+void CurlMultiEngine::wait()
+{
+#if PRISM_HAVE_CURL_MULTI_WAKEUP
+    curl_multi_poll(multi_, NULL, 0, MAX_WAIT_MS, NULL);
+#else
+    if (wakeupPipe_[0] < 0)
+    {
+        curl_multi_wait(multi_, NULL, 0, MAX_WAIT_MS, NULL);
+        return;
+    }
+
+    curl_waitfd waitFd;
+    waitFd.fd = wakeupPipe_[0];
+    waitFd.events = CURL_WAIT_POLLIN;
+    waitFd.revents = 0;
+
+    curl_multi_wait(multi_, &waitFd, 1, MAX_WAIT_MS, NULL);
+
+    char buf[64];
+
+    while (read(wakeupPipe_[0], buf, sizeof(buf)) > 0)
+        ;
+#endif
+}
+
+void CurlMultiEngine::wakeUp()
+{
+#if PRISM_HAVE_CURL_MULTI_WAKEUP
+    if (multi_)
+        curl_multi_wakeup(multi_);
+#else
+    if (wakeupPipe_[1] >= 0)
+    {
+        const char c = 0;
+
+        // pipe full means wake-up is already pending
+        if (write(wakeupPipe_[1], &c, 1) < 0)
+            return;
+    }
+#endif
+}
+
+void CurlMultiEngine::complete(Transfer& transfer, CURLcode result)
+{
+    try
+    {
+        transfer.wrapper->completeRequest(result);
+
+        if (transfer.handler)
+            transfer.handler(result);
+    }
+    catch (const std::exception& e)
+    {
+        LOG(ERROR) << "CurlMultiEngine: completion handler failed: " << e.what();
+    }
+    catch (...)
+    {
+        LOG(ERROR) << "CurlMultiEngine: completion handler failed: unknown exception";
+    }
+}
+
+} // namespace connect
+} // namespace prism
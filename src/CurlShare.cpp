@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include "private/CurlShare.h"
+#include "easylogging++.h"
+#include "boost/thread/locks.hpp"
+#include "boost/weak_ptr.hpp"
+
+namespace prism
+{
+namespace connect
+{
+
+namespace
+{
+    boost::mutex instanceMutex;
+    boost::weak_ptr<CurlShare> instance;
+}
+
+CurlSharePtr CurlShare::getInstance()
+{
+    boost::lock_guard<boost::mutex> lock(instanceMutex);
+
+    CurlSharePtr rv = instance.lock();
+
+    if (rv)
+        return rv;
+
+    rv.reset(new CurlShare());
+
+    if (!rv->share_)
+        return CurlSharePtr();
+
+    instance = rv;
+
+    return rv;
+}
+
+CurlShare::CurlShare()
+    : share_(curl_share_init())
+{
+    if (!share_)
+    {
+        LOG(ERROR) << "CurlShare: curl_share_init() failed";
+        return;
+    }
+
+    curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, lock);
+    curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, unlock);
+    curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+
+    // Connection cache isn't shared: handles of different clients run
+    // transfers in their own threads concurrently, which libCURL doesn't
+    // support for shared connections even with lock callbacks. Each client
+    // reuses connections of its own handles pool instead.
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+}
+
+CurlShare::~CurlShare()
+{
+    if (!share_)
+        return;
+
+    const CURLSHcode rv = curl_share_cleanup(share_);
+
+    if (rv != CURLSHE_OK)
+        LOG(ERROR) << "CurlShare: curl_share_cleanup() failed: " << curl_share_strerror(rv);
+}
+
+void CurlShare::attach(CURL* handle)
+{
+    curl_easy_setopt(handle, CURLOPT_SHARE, share_);
+}
+
+void CurlShare::lock(CURL* /*handle*/, curl_lock_data data, curl_lock_access /*access*/, void* userptr)
+{
+    if (data >= 0  &&  data < CURL_LOCK_DATA_LAST)
+        static_cast<CurlShare*>(userptr)->mutexes_[data].lock();
+}
+
+void CurlShare::unlock(CURL* /*handle*/, curl_lock_data data, void* userptr)
+{
+    if (data >= 0  &&  data < CURL_LOCK_DATA_LAST)
+        static_cast<CurlShare*>(userptr)->mutexes_[data].unlock();
+}
+
+} // namespace connect
+} // namespace prism
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include "private/HttpValidatorCache.h"
+
+namespace prism
+{
+namespace connect
+{
+
+HttpValidatorCache::HttpValidatorCache(size_t maxEntries)
+    : maxEntries_(maxEntries)
+{
+}
+
+void HttpValidatorCache::setMaxEntries(size_t maxEntries)
+{
+    maxEntries_ = maxEntries;
+
+    while (entries_.size() > maxEntries_)
+    {
+        const std::string oldest = lru_.back();
+        erase(oldest);
+    }
+}
+
+bool HttpValidatorCache::getValidators(const std::string& url, Validators& validators) const
+{
+    const std::map<std::string, Entry>::const_iterator it = entries_.find(url);
+
+    if (it == entries_.end())
+        return false;
+
+    validators = it->second.validators;
+
+    return true;
+}
+
+void HttpValidatorCache::erase(const std::string& url)
+{
+    const std::map<std::string, Entry>::iterator it = entries_.find(url);
+
+    if (it == entries_.end())
+        return;
+
+    lru_.erase(it->second.lruPos);
+    entries_.erase(it);
+}
+
+HttpValidatorCache::Entry* HttpValidatorCache::find(const std::string& url)
+{
+    const std::map<std::string, Entry>::iterator it = entries_.find(url);
+
+    if (it == entries_.end())
+        return 0;
+
+    lru_.splice(lru_.begin(), lru_, it->second.lruPos);
+
+    return &it->second;
+}
+
+HttpValidatorCache::Entry& HttpValidatorCache::insert(const std::string& url)
+{
+    Entry* entry = find(url);
+
+    if (entry)
+        return *entry;
+
+    if (entries_.size() >= maxEntries_  &&  !lru_.empty())
+    {
+        const std::string oldest = lru_.back();
+        erase(oldest);
+    }
+
+    lru_.push_front(url);
+
+    Entry& inserted = entries_[url];
+    inserted.lruPos = lru_.begin();
+
+    return inserted;
+}
+
+} // namespace connect
+} // namespace prism
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include "private/InstrumentCache.h"
+
+namespace prism
+{
+namespace connect
+{
+
+InstrumentCache::InstrumentCache(const boost::posix_time::time_duration& ttl)
+    : ttl_(ttl)
+{
+}
+
+void InstrumentCache::setTtl(const boost::posix_time::time_duration& ttl)
+{
+    ttl_ = ttl;
+
+    if (ttl_ <= boost::posix_time::time_duration())
+        entries_.clear();
+}
+
+void InstrumentCache::put(id_t accountId, const Instruments& instruments)
+{
+    if (ttl_ <= boost::posix_time::time_duration())
+        return;
+
+    Entry& entry = entries_[accountId];
+    entry.instruments = instruments;
+    entry.index.clear();
+    entry.expiresAt = boost::get_system_time() + ttl_;
+
+    for (size_t i = 0; i < entry.instruments.size(); ++i)
+        addToIndex(entry, i);
+}
+
+void InstrumentCache::add(id_t accountId, const Instrument& instrument)
+{
+    if (ttl_ <= boost::posix_time::time_duration())
+        return;
+
+    std::map<id_t, Entry>::iterator it = entries_.find(accountId);
+
+    // expired list isn't extended, partial one is started instead
+    if (it != entries_.end()  &&  boost::get_system_time() >= it->second.expiresAt)
+    {
+        entries_.erase(it);
+        it = entries_.end();
+    }
+
+    if (it == entries_.end())
+    {
+        it = entries_.insert(std::make_pair(accountId, Entry())).first;
+        it->second.expiresAt = boost::get_system_time() + ttl_;
+    }
+
+    Entry& entry = it->second;
+    entry.instruments.push_back(instrument);
+    addToIndex(entry, entry.instruments.size() - 1);
+}
+
+void InstrumentCache::invalidate(id_t accountId)
+{
+    entries_.erase(accountId);
+}
+
+bool InstrumentCache::find(id_t accountId, const std::string& name, const std::string& type,
+                           Instrument& instrument)
+{
+    const std::map<id_t, Entry>::iterator it = entries_.find(accountId);
+
+    if (it == entries_.end())
+        return false;
+
+    const Entry& entry = it->second;
+
+    if (boost::get_system_time() >= entry.expiresAt)
+    {
+        entries_.erase(it);
+        return false;
+    }
+
+    const boost::unordered_map<std::string, size_t>::const_iterator found
+            = entry.index.find(makeKey(name, type));
+
+    if (found == entry.index.end())
+        return false;
+
+    instrument = entry.instruments[found->second];
+
+    return true;
+}
+
+std::string InstrumentCache::makeKey(const std::string& name, const std::string& type)
+{
+    std::string key;
+    key.reserve(name.size() + type.size() + 1);
+    key.append(name).push_back('\0');
+    key.append(type);
+
+    return key;
+}
+
+void InstrumentCache::addToIndex(Entry& entry, size_t i)
+{
+    const Instrument& instrument = entry.instruments[i];
+    entry.index.insert(std::make_pair(makeKey(instrument.name, instrument.type), i));
+}
+
+} // namespace connect
+} // namespace prism
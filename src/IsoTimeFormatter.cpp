@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include "private/IsoTimeFormatter.h"
+#include <cstring>
+#include <limits>
+
+namespace prism
+{
+namespace connect
+{
+
+static const int64_t kMsPerSecond = 1000;
+static const int64_t kMsPerMinute = 60 * kMsPerSecond;
+static const int64_t kMsPerHour = 60 * kMsPerMinute;
+static const int64_t kHoursPerDay = 24;
+
+// Hour which is never formatted, so that first timestamp fills prefix
+static const int64_t kNoHour = std::numeric_limits<int64_t>::min();
+
+// Division rounding towards negative infinity, so that timestamps before
+// epoch get positive minutes, seconds and milliseconds
+static inline int64_t floorDiv(int64_t value, int64_t divisor)
+{
+    return value >= 0 ? value / divisor : (value - divisor + 1) / divisor;
+}
+
+static inline void write2(char* buffer, int value)
+{
+    buffer[0] = '0' + value / 10;
+    buffer[1] = '0' + value % 10;
+}
+
+static inline void write3(char* buffer, int value)
+{
+    buffer[0] = '0' + value / 100;
+    write2(buffer + 1, value % 100);
+}
+
+static inline void write4(char* buffer, int value)
+{
+    write2(buffer, value / 100);
+    write2(buffer + 2, value % 100);
+}
+
+// Converts days since epoch into proleptic Gregorian date, see
+// http://howardhinnant.github.io/date_algorithms.html#civil_from_days
+static void civilFromDays(int64_t days, int& year, int& month, int& day)
+{
+    days += 719468;
+    const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const int dayOfEra = static_cast<int>(days - era * 146097);
+    const int yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    const int dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    const int monthFromMarch = (5 * dayOfYear + 2) / 153;
+
+    day = dayOfYear - (153 * monthFromMarch + 2) / 5 + 1;
+    month = monthFromMarch < 10 ? monthFromMarch + 3 : monthFromMarch - 9;
+    year = static_cast<int>(yearOfEra + era * 400) + (month <= 2 ? 1 : 0);
+}
+
+IsoTimeFormatter::IsoTimeFormatter()
+    : hour_(kNoHour)
+{
+    memset(prefix_, 0, sizeof(prefix_));
+}
+
+void IsoTimeFormatter::updatePrefix(int64_t hour)
+{
+    int year = 0;
+    int month = 0;
+    int day = 0;
+    civilFromDays(floorDiv(hour, kHoursPerDay), year, month, day);
+
+    // years past 9999 aren't representable in 4 digits, API doesn't accept them anyway
+    write4(prefix_, year % 10000);
+    prefix_[4] = '-';
+    write2(prefix_ + 5, month);
+    prefix_[7] = '-';
+    write2(prefix_ + 8, day);
+    prefix_[10] = 'T';
+    write2(prefix_ + 11, static_cast<int>(hour - floorDiv(hour, kHoursPerDay) * kHoursPerDay));
+    prefix_[13] = ':';
+
+    hour_ = hour;
+}
+
+void IsoTimeFormatter::format(timestamp_t timestamp, char* buffer)
+{
+    const int64_t hour = floorDiv(timestamp, kMsPerHour);
+
+    if (hour != hour_)
+        updatePrefix(hour);
+
+    const int msOfHour = static_cast<int>(timestamp - hour * kMsPerHour);
+
+    memcpy(buffer, prefix_, sizeof(prefix_));
+    write2(buffer + 14, msOfHour / kMsPerMinute);
+    buffer[16] = ':';
+    write2(buffer + 17, msOfHour % kMsPerMinute / kMsPerSecond);
+    buffer[19] = '.';
+    write3(buffer + 20, msOfHour % kMsPerSecond);
+}
+
+void IsoTimeFormatter::format(const Counts& counts, std::vector<char>& out)
+{
+    out.resize(counts.size() * LENGTH);
+
+    for (size_t i = 0; i < counts.size(); ++i)
+        format(counts[i].timestamp, &out[i * LENGTH]);
+}
+
+} // namespace connect
+} // namespace prism
@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include "private/JsonArrayReader.h"
+#include "private/util.h"
+#include "rapidjson/error/en.h"
+
+#include <sstream>
+
+namespace prism
+{
+namespace connect
+{
+
+// Element of list response is object of few members, it's parsed without
+// heap allocations, larger ones take more from heap
+static const size_t VALUE_BUFFER_SIZE = 8 * 1024;
+static const size_t PARSE_BUFFER_SIZE = 1024;
+
+typedef rapidjson::GenericDocument<rapidjson::UTF8<>, rapidjson::MemoryPoolAllocator<>,
+                                   rapidjson::MemoryPoolAllocator<> > ElementDocument;
+
+static bool isJsonSpace(char c)
+{
+    return c == ' '  ||  c == '\n'  ||  c == '\r'  ||  c == '\t';
+}
+
+JsonArrayReader::JsonArrayReader(const ElementCallback& callback)
+    : callback_(callback)
+    , state_(BEFORE_ARRAY)
+    , depth_(0)
+    , isInString_(false)
+    , isEscaped_(false)
+    , numElements_(0)
+    , offset_(0)
+    , status_(makeSuccess())
+{
+}
+
+void JsonArrayReader::write(const char* data, size_t size)
+{
+    const char* const end = data + size;
+    const char* p = data;
+
+    while (p < end  &&  state_ != FAILED)
+    {
+        if (state_ == IN_ELEMENT)
+        {
+            p = scanElement(p, end);
+            continue;
+        }
+
+        const char c = *p;
+
+        if (isJsonSpace(c))
+        {
+            ++p;
+            ++offset_;
+            continue;
+        }
+
+        switch (state_)
+        {
+        case BEFORE_ARRAY:
+            if (c != '[')
+            {
+                fail(makeError(), "JSON array expected");
+                continue;
+            }
+
+            state_ = BEFORE_FIRST_ELEMENT;
+            break;
+
+        case BEFORE_FIRST_ELEMENT:
+        case BEFORE_ELEMENT:
+            if (c == ']'  &&  state_ == BEFORE_FIRST_ELEMENT)
+            {
+                state_ = AFTER_ARRAY;
+                break;
+            }
+
+            if (c == ','  ||  c == ']')
+            {
+                fail(makeError(), "array element expected");
+                continue;
+            }
+
+            // c is the first byte of element, it's consumed by scanElement()
+            state_ = IN_ELEMENT;
+            depth_ = 0;
+            isInString_ = false;
+            isEscaped_ = false;
+            element_.clear();
+            continue;
+
+        case AFTER_ELEMENT:
+            if (c == ',')
+            {
+                state_ = BEFORE_ELEMENT;
+            }
+            else if (c == ']')
+            {
+                state_ = AFTER_ARRAY;
+            }
+            else
+            {
+                fail(makeError(), "',' or ']' expected after array element");
+                continue;
+            }
+
+            break;
+
+        default:
+            fail(makeError(), "unexpected data after JSON array");
+            continue;
+        }
+
+        ++p;
+        ++offset_;
+    }
+}
+
+const char* JsonArrayReader::scanElement(const char* p, const char* end)
+{
+    const char* const start = p;
+    bool isComplete = false;
+
+    while (p < end  &&  !isComplete)
+    {
+        if (isInString_)
+        {
+            if (isEscaped_)
+            {
+                isEscaped_ = false;
+                ++p;
+                continue;
+            }
+
+            // most of list is string contents, nothing to track there
+            while (p < end  &&  *p != '"'  &&  *p != '\\')
+                ++p;
+
+            if (p == end)
+                break;
+
+            if (*p++ == '\\')
+            {
+                isEscaped_ = true;
+                continue;
+            }
+
+            isInString_ = false;
+            isComplete = depth_ == 0;
+            continue;
+        }
+
+        const char c = *p;
+
+        if (c == '"')
+        {
+            isInString_ = true;
+        }
+        else if (c == '{'  ||  c == '[')
+        {
+            ++depth_;
+        }
+        else if (depth_ > 0  &&  (c == '}'  ||  c == ']'))
+        {
+            --depth_;
+            isComplete = depth_ == 0;
+        }
+        else if (depth_ == 0  &&  (c == ','  ||  c == ']'  ||  c == '}'  ||  isJsonSpace(c)))
+        {
+            // end of number or literal, separator is left for caller
+            break;
+        }
+
+        ++p;
+    }
+
+    element_.insert(element_.end(), start, p);
+    offset_ += p - start;
+
+    if (isComplete  ||  p < end)
+        completeElement();
+
+    return p;
+}
+
+void JsonArrayReader::completeElement()
+{
+    element_.push_back('\0');
+
+    char valueBuffer[VALUE_BUFFER_SIZE];
+    char parseBuffer[PARSE_BUFFER_SIZE];
+    rapidjson::MemoryPoolAllocator<> valueAllocator(valueBuffer, sizeof(valueBuffer));
+    rapidjson::MemoryPoolAllocator<> parseAllocator(parseBuffer, sizeof(parseBuffer));
+    ElementDocument document(&valueAllocator, sizeof(parseBuffer), &parseAllocator);
+
+    // strings of document point into element_
+    if (document.ParseInsitu(&element_[0]).HasParseError())
+    {
+        std::ostringstream os;
+        os << "array element " << numElements_ << ": "
+           << rapidjson::GetParseError_En(document.GetParseError());
+
+        fail(makeError(), os.str());
+        return;
+    }
+
+    const Status status = callback_(document);
+
+    if (status.isError())
+    {
+        std::ostringstream os;
+        os << "array element " << numElements_ << " is rejected";
+
+        fail(status, os.str());
+        return;
+    }
+
+    ++numElements_;
+    state_ = AFTER_ELEMENT;
+}
+
+Status JsonArrayReader::finish()
+{
+    if (state_ != AFTER_ARRAY  &&  state_ != FAILED)
+        fail(makeError(), "JSON array is incomplete");
+
+    return status_;
+}
+
+void JsonArrayReader::fail(const Status& status, const std::string& message)
+{
+    std::ostringstream os;
+    os << message << " (offset " << offset_ << ")";
+
+    status_ = status;
+    errorMessage_ = os.str();
+    state_ = FAILED;
+}
+
+} // namespace connect
+} // namespace prism
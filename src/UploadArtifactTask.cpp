@@ -1,9 +1,18 @@
 /*
  * Copyright (C) 2017 Prism Skylabs
  */
+#include <set>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
 #include "easylogging++.h"
 #include "private/UploadArtifactTask.h"
+#include "private/ByteStream.h"
+#include "private/util.h"
+#include "boost/filesystem.hpp"
 #include "boost/format.hpp"
+#include "boost/make_shared.hpp"
 #include "public-util.h"
 #include "artifact-uploader.h"
 #include "client.h"
@@ -15,11 +24,282 @@ namespace connect
 
 namespace prc = prism::connect;
 
+// Mapped payload file is uploaded directly from mapping, file is sent by
+// path only if it can't be mapped.
 static inline Payload makePayload(const PayloadHolder& holder)
 {
-    return holder.isFile()
-            ? Payload(holder.getFilePath())
-            : Payload(holder.getData(), holder.getDataSize(), holder.getMimeType());
+    const uint8_t* data = holder.getData();
+
+    if (!holder.isFile())
+        return Payload(data, holder.getDataSize(), holder.getMimeType());
+
+    // mapped file is sent under its own name, as if it was sent by path
+    return data
+            ? Payload(data, holder.getDataSize(), holder.getMimeType(),
+                      boost::filesystem::path(holder.getFilePath()).filename().string())
+            : Payload(holder.getFilePath());
+}
+
+static inline uint64_t getPayloadFileSize(const PayloadHolder& holder)
+{
+    return holder.isFile() ? holder.getDataSize() : 0;
+}
+
+enum PayloadKind
+{
+    PAYLOAD_DATA = 0,
+    PAYLOAD_FILE_LINK = 1
+};
+
+// Link shares data with payload file, so that it's neither written again
+// nor read into memory. Data, which payload file's owner may have left
+// unsynced, is synced, as record refers to it.
+static bool linkPayloadFile(const std::string& filePath, const std::string& linkPath)
+{
+    if (link(filePath.c_str(), linkPath.c_str()) != 0)
+    {
+        LOG(WARNING) << "Unable to link payload file " << filePath << " as " << linkPath
+                     << ": " << strerror(errno) << ", copying it into journal";
+        return false;
+    }
+
+    const int fd = open(linkPath.c_str(), O_RDONLY);
+
+    if (fd < 0  ||  fsync(fd) != 0)
+    {
+        LOG(ERROR) << "Unable to sync payload file " << linkPath << ": " << strerror(errno);
+
+        if (fd >= 0)
+            close(fd);
+
+        removeFile(linkPath);
+        return false;
+    }
+
+    close(fd);
+    return true;
+}
+
+// File payload is kept by link, if possible. Otherwise, it's read into
+// journal as data, as file is deleted once PayloadHolder is destroyed.
+static bool serializePayload(ByteStreamWriter& writer, const PayloadHolder& holder,
+                             const std::string& payloadFilePrefix, std::string& linkPath)
+{
+    if (holder.isFile())
+    {
+        const std::string fileName = boost::filesystem::path(holder.getFilePath()).filename().string();
+
+        if (linkPayloadFile(holder.getFilePath(), payloadFilePrefix + fileName))
+        {
+            linkPath = payloadFilePrefix + fileName;
+            writer.write<uint8_t>(PAYLOAD_FILE_LINK);
+            writer.writeString(boost::filesystem::path(linkPath).filename().string());
+            return true;
+        }
+    }
+
+    const uint8_t* data = holder.getData();
+
+    if (holder.isFile()  &&  !data  &&  holder.getDataSize() > 0)
+    {
+        LOG(ERROR) << "Error reading payload file " << holder.getFilePath();
+        return false;
+    }
+
+    writer.write<uint8_t>(PAYLOAD_DATA);
+    writer.writeString(holder.getMimeType());
+    writer.write<uint32_t>(holder.getDataSize());
+    writer.writeBytes(data, holder.getDataSize());
+    return true;
+}
+
+static PayloadHolderPtr deserializePayload(ByteStreamReader& reader, const std::string& payloadDir)
+{
+    uint8_t kind = 0;
+
+    if (!reader.read(kind))
+        return PayloadHolderPtr();
+
+    if (kind == PAYLOAD_FILE_LINK)
+    {
+        std::string linkName;
+
+        if (!reader.readString(linkName))
+            return PayloadHolderPtr();
+
+        const std::string linkPath = payloadDir + "/" + linkName;
+
+        if (!boost::filesystem::exists(linkPath))
+        {
+            LOG(ERROR) << "Payload file " << linkPath << " is missing";
+            return PayloadHolderPtr();
+        }
+
+        return makePayloadHolderByReferencingFile(linkPath);
+    }
+
+    std::string mimeType;
+    ByteBuffer data;
+
+    if (kind != PAYLOAD_DATA  ||  !reader.readString(mimeType)  ||  !reader.readBuffer(data))
+        return PayloadHolderPtr();
+
+    return makePayloadHolderByMovingData(move_ref<ByteBuffer>(data), mimeType);
+}
+
+const std::vector<std::string>& UploadArtifactTask::getOrderingKeys() const
+{
+    static const std::vector<std::string> noKeys;
+
+    return noKeys;
+}
+
+UploadArtifactTaskPtr deserializeUploadArtifactTask(ByteStreamReader& reader, const std::string& payloadDir)
+{
+    uint8_t type = 0;
+
+    if (!reader.read(type))
+        return UploadArtifactTaskPtr();
+
+    switch (type)
+    {
+    case UploadArtifactTask::BACKGROUND:
+    {
+        timestamp_t timestamp = 0;
+        reader.read(timestamp);
+        PayloadHolderPtr payload = deserializePayload(reader, payloadDir);
+
+        if (!payload)
+            break;
+
+        return boost::make_shared<UploadBackgroundTask>(timestamp, payload);
+    }
+
+    case UploadArtifactTask::OBJECT_STREAM:
+    {
+        ObjectStream stream;
+        reader.read(stream.collected);
+        reader.read(stream.locationX);
+        reader.read(stream.locationY);
+        reader.read(stream.width);
+        reader.read(stream.height);
+        reader.read(stream.origImageWidth);
+        reader.read(stream.origImageHeight);
+        reader.read(stream.objectId);
+        reader.readString(stream.streamType);
+        PayloadHolderPtr payload = deserializePayload(reader, payloadDir);
+
+        if (!payload)
+            break;
+
+        return boost::make_shared<UploadObjectStreamTask>(stream, payload);
+    }
+
+    case UploadArtifactTask::FLIPBOOK:
+    {
+        Flipbook flipbook;
+        reader.read(flipbook.startTimestamp);
+        reader.read(flipbook.stopTimestamp);
+        reader.read(flipbook.width);
+        reader.read(flipbook.height);
+        reader.read(flipbook.numberOfFrames);
+        PayloadHolderPtr payload = deserializePayload(reader, payloadDir);
+
+        if (!payload)
+            break;
+
+        return boost::make_shared<UploadFlipbookTask>(flipbook, payload);
+    }
+
+    case UploadArtifactTask::EVENT:
+    {
+        timestamp_t timestamp = 0;
+        uint32_t numEvents = 0;
+        reader.read(timestamp);
+        reader.read(numEvents);
+
+        Events events;
+
+        for (uint32_t i = 0; i < numEvents && !reader.isFailed(); ++i)
+        {
+            timestamp_t eventTimestamp = 0;
+            reader.read(eventTimestamp);
+            events.push_back(Event(eventTimestamp));
+        }
+
+        if (reader.isFailed())
+            break;
+
+        return boost::make_shared<UploadEventTask>(timestamp, move_ref<Events>(events));
+    }
+
+    case UploadArtifactTask::COUNT:
+    {
+        uint8_t update = 0;
+        uint32_t numCounts = 0;
+        reader.read(update);
+        reader.read(numCounts);
+
+        Counts counts;
+
+        for (uint32_t i = 0; i < numCounts && !reader.isFailed(); ++i)
+        {
+            timestamp_t timestamp = 0;
+            int32_t value = 0;
+            std::string label;
+            reader.read(timestamp);
+            reader.read(value);
+            reader.readString(label);
+            counts.push_back(Count(timestamp, value, label));
+        }
+
+        if (reader.isFailed())
+            break;
+
+        return boost::make_shared<UploadCountTask>(move_ref<Counts>(counts), update != 0);
+    }
+
+    default:
+        LOG(ERROR) << "Unknown upload task type: " << (int)type;
+        return UploadArtifactTaskPtr();
+    }
+
+    LOG(ERROR) << "Malformed upload task of type " << (int)type;
+    return UploadArtifactTaskPtr();
+}
+
+UploadArtifactTaskPtr mergeUploadArtifactTasks(const std::vector<UploadArtifactTaskPtr>& tasks)
+{
+    if (tasks.size() == 1)
+        return tasks.front();
+
+    // merged event takes timestamp of the oldest one
+    if (tasks.front()->getType() == UploadArtifactTask::EVENT)
+    {
+        Events events;
+
+        for (size_t i = 0; i < tasks.size(); ++i)
+        {
+            const Events& data = static_cast<const UploadEventTask&>(*tasks[i]).getEvents();
+            events.insert(events.end(), data.begin(), data.end());
+        }
+
+        return boost::make_shared<UploadEventTask>(
+                    static_cast<const UploadEventTask&>(*tasks.front()).getTimestamp(),
+                    move_ref<Events>(events));
+    }
+
+    Counts counts;
+
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {
+        const Counts& data = static_cast<const UploadCountTask&>(*tasks[i]).getCounts();
+        counts.insert(counts.end(), data.begin(), data.end());
+    }
+
+    return boost::make_shared<UploadCountTask>(
+                move_ref<Counts>(counts),
+                static_cast<const UploadCountTask&>(*tasks.front()).isUpdate());
 }
 
 Status UploadBackgroundTask::execute(ClientSession& session) const
@@ -33,12 +313,25 @@ size_t UploadBackgroundTask::getArtifactSize() const
     return sizeof(timestamp_) +  sizeof(image_) + image_->getDataSize();
 }
 
+uint64_t UploadBackgroundTask::getFileSize() const
+{
+    return getPayloadFileSize(*image_);
+}
+
 std::string UploadBackgroundTask::toString() const
 {
     return (boost::format("Background: (timestamp: %s)")
         % prc::toString(timestamp_)).str();
 }
 
+bool UploadBackgroundTask::serialize(ByteStreamWriter& writer, const std::string& payloadFilePrefix,
+                                     std::string& linkPath) const
+{
+    writer.write<uint8_t>(getType());
+    writer.write(timestamp_);
+    return serializePayload(writer, *image_, payloadFilePrefix, linkPath);
+}
+
 Status UploadObjectStreamTask::execute(ClientSession& session) const
 {
     return session.client.uploadObjectStream(
@@ -50,6 +343,11 @@ size_t UploadObjectStreamTask::getArtifactSize() const
     return sizeof(stream_) + sizeof(image_) + image_->getDataSize();
 }
 
+uint64_t UploadObjectStreamTask::getFileSize() const
+{
+    return getPayloadFileSize(*image_);
+}
+
 std::string UploadObjectStreamTask::toString() const
 {
     return (boost::format("ObjectStream: (collected: %s, object_id: %d)")
@@ -57,6 +355,27 @@ std::string UploadObjectStreamTask::toString() const
         % stream_.objectId).str();
 }
 
+std::string UploadObjectStreamTask::getSupersedeKey() const
+{
+    return (boost::format("%d:%s") % stream_.objectId % stream_.streamType).str();
+}
+
+bool UploadObjectStreamTask::serialize(ByteStreamWriter& writer, const std::string& payloadFilePrefix,
+                                       std::string& linkPath) const
+{
+    writer.write<uint8_t>(getType());
+    writer.write(stream_.collected);
+    writer.write(stream_.locationX);
+    writer.write(stream_.locationY);
+    writer.write(stream_.width);
+    writer.write(stream_.height);
+    writer.write(stream_.origImageWidth);
+    writer.write(stream_.origImageHeight);
+    writer.write(stream_.objectId);
+    writer.writeString(stream_.streamType);
+    return serializePayload(writer, *image_, payloadFilePrefix, linkPath);
+}
+
 Status UploadFlipbookTask::execute(ClientSession& session) const
 {
     return session.client.uploadFlipbook(
@@ -68,6 +387,11 @@ size_t UploadFlipbookTask::getArtifactSize() const
     return sizeof(flipbook_) + sizeof(data_) + data_->getDataSize();
 }
 
+uint64_t UploadFlipbookTask::getFileSize() const
+{
+    return getPayloadFileSize(*data_);
+}
+
 std::string UploadFlipbookTask::toString() const
 {
     return (boost::format("Flipbook: (start_timestamp: %s, stop_timestamp: %s, file_name: %s)")
@@ -76,6 +400,18 @@ std::string UploadFlipbookTask::toString() const
         % data_->getFilePath()).str();
 }
 
+bool UploadFlipbookTask::serialize(ByteStreamWriter& writer, const std::string& payloadFilePrefix,
+                                   std::string& linkPath) const
+{
+    writer.write<uint8_t>(getType());
+    writer.write(flipbook_.startTimestamp);
+    writer.write(flipbook_.stopTimestamp);
+    writer.write(flipbook_.width);
+    writer.write(flipbook_.height);
+    writer.write(flipbook_.numberOfFrames);
+    return serializePayload(writer, *data_, payloadFilePrefix, linkPath);
+}
+
 size_t UploadEventTask::getArtifactSize() const
 {
     return sizeof(timestamp_t) * (data_.size() + 1);
@@ -91,6 +427,19 @@ std::string UploadEventTask::toString() const
     return (boost::format("Event: (timestamp: %s)") % prc::toString(timestamp_)).str();
 }
 
+bool UploadEventTask::serialize(ByteStreamWriter& writer, const std::string& /*payloadFilePrefix*/,
+                                std::string& /*linkPath*/) const
+{
+    writer.write<uint8_t>(getType());
+    writer.write(timestamp_);
+    writer.write<uint32_t>(data_.size());
+
+    for (Events::const_iterator it = data_.begin(); it != data_.end(); ++it)
+        writer.write(it->timestamp);
+
+    return true;
+}
+
 Status UploadCountTask::execute(ClientSession& session) const
 {
     return session.client.uploadCount(session.accountId, session.cameraId, data_, update_);
@@ -106,5 +455,35 @@ std::string UploadCountTask::toString() const
     return "Counts";
 }
 
+bool UploadCountTask::serialize(ByteStreamWriter& writer, const std::string& /*payloadFilePrefix*/,
+                                std::string& /*linkPath*/) const
+{
+    writer.write<uint8_t>(getType());
+    writer.write<uint8_t>(update_ ? 1 : 0);
+    writer.write<uint32_t>(data_.size());
+
+    for (Counts::const_iterator it = data_.begin(); it != data_.end(); ++it)
+    {
+        writer.write(it->timestamp);
+        writer.write(it->value);
+        writer.writeString(it->label);
+    }
+
+    return true;
+}
+
+void UploadCountTask::makeOrderingKeys()
+{
+    std::set<std::string> labels;
+
+    for (Counts::const_iterator it = data_.begin(); it != data_.end(); ++it)
+        labels.insert(it->label);
+
+    orderingKeys_.reserve(labels.size());
+
+    for (std::set<std::string>::const_iterator it = labels.begin(); it != labels.end(); ++it)
+        orderingKeys_.push_back("count:" + *it);
+}
+
 } // namespace connect
 } // namespace prism
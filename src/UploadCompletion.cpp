@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include "private/UploadCompletion.h"
+#include "private/util.h"
+#include "easylogging++.h"
+
+namespace prism
+{
+namespace connect
+{
+
+UploadCompletion::UploadCompletion(const ArtifactUploader::CompletionCallback& callback)
+    : callback_(callback)
+    , startTime_(boost::chrono::steady_clock::now())
+    , numAttempts_(0)
+    , transferMs_(0)
+{
+}
+
+UploadCompletion::~UploadCompletion()
+{
+    complete(makeError());
+}
+
+void UploadCompletion::addAttempt(int64_t transferMs)
+{
+    ++numAttempts_;
+    transferMs_ += transferMs;
+}
+
+void UploadCompletion::complete(const Status& status)
+{
+    if (!callback_)
+        return;
+
+    ArtifactUploader::CompletionCallback callback;
+    callback.swap(callback_);
+
+    ArtifactUploader::UploadResult result;
+    result.status = status;
+    result.numAttempts = numAttempts_;
+    result.transferMs = transferMs_;
+    result.queueWaitMs = boost::chrono::duration_cast<boost::chrono::milliseconds>(
+                boost::chrono::steady_clock::now() - startTime_).count() - transferMs_;
+
+    try
+    {
+        callback(result);
+    }
+    catch (const std::exception& e)
+    {
+        LOG(ERROR) << "Upload completion callback failed: " << e.what();
+    }
+    catch (...)
+    {
+        LOG(ERROR) << "Upload completion callback failed: unknown exception";
+    }
+}
+
+void UploadCompletion::cancel()
+{
+    callback_.clear();
+}
+
+} // namespace connect
+} // namespace prism
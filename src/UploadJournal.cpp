@@ -0,0 +1,722 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include "private/UploadJournal.h"
+#include "private/ByteStream.h"
+#include "private/util.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "boost/crc.hpp"
+#include "boost/filesystem.hpp"
+#include "boost/format.hpp"
+#include "boost/thread/locks.hpp"
+#include "easylogging++.h"
+
+namespace
+{
+    const uint32_t RECORD_MAGIC = 0x4C4E524A; // "JRNL"
+
+    // magic, type, id, body size, body checksum
+    const size_t RECORD_HEADER_SIZE = 4 + 1 + 8 + 4 + 4;
+
+    // New segment is started once active one exceeds this size. Smaller
+    // segments are deleted sooner, bigger ones mean fewer files.
+    const uint64_t MAX_SEGMENT_SIZE = 16 * 1024 * 1024;
+
+    const char* SEGMENT_FILE_PREFIX = "journal-";
+    const char* SEGMENT_FILE_SUFFIX = ".log";
+
+    // followed by task's ID, "-" and name of original file
+    const char* PAYLOAD_FILE_PREFIX = "payload-";
+
+    uint32_t calcChecksum(uint8_t type, uint64_t id, const uint8_t* body, size_t bodySize)
+    {
+        boost::crc_32_type crc;
+        crc.process_bytes(&type, sizeof(type));
+        crc.process_bytes(&id, sizeof(id));
+        crc.process_bytes(body, bodySize);
+
+        return crc.checksum();
+    }
+
+    struct RecordHeader
+    {
+        RecordHeader()
+            : magic(0)
+            , type(0)
+            , id(0)
+            , bodySize(0)
+            , checksum(0)
+        {
+        }
+
+        bool read(prism::connect::ByteStreamReader& reader)
+        {
+            reader.read(magic);
+            reader.read(type);
+            reader.read(id);
+            reader.read(bodySize);
+            reader.read(checksum);
+
+            return !reader.isFailed()  &&  magic == RECORD_MAGIC;
+        }
+
+        uint32_t magic;
+        uint8_t type;
+        uint64_t id;
+        uint32_t bodySize;
+        uint32_t checksum;
+    };
+
+    int syncFile(int fd)
+    {
+#ifdef __APPLE__
+        return fsync(fd);
+#else
+        return fdatasync(fd);
+#endif
+    }
+
+    // New file isn't durable until its directory entry is synced
+    void syncDir(const std::string& dirPath)
+    {
+        int fd = ::open(dirPath.c_str(), O_RDONLY);
+
+        if (fd < 0)
+            return;
+
+        fsync(fd);
+        close(fd);
+    }
+}
+
+namespace prism
+{
+namespace connect
+{
+
+UploadJournal::UploadJournal(const std::string& dirPath)
+    : dirPath_(dirPath)
+    , nextId_(1)
+    , aliveSize_(0)
+    , activeSegment_(0)
+    , isWriting_(false)
+    , done_(false)
+    , fd_(-1)
+{
+}
+
+UploadJournal::~UploadJournal()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        done_ = true;
+    }
+
+    cv_.notify_all();
+
+    if (thread_.joinable())
+        thread_.join();
+
+    if (fd_ >= 0)
+    {
+        close(fd_);
+
+        // nothing was written during this run
+        if (segments_[activeSegment_].size == 0)
+        {
+            removeFile(getSegmentPath(activeSegment_));
+            segments_.erase(activeSegment_);
+        }
+
+        // no segment is active anymore, all tasks may be uploaded already
+        activeSegment_ = 0;
+        deleteDeadSegments();
+    }
+}
+
+Status UploadJournal::open(RecordInfos& records)
+{
+    namespace fs = boost::filesystem;
+
+    std::vector<uint32_t> segments;
+    std::map<uint64_t, std::string> payloadFiles;
+
+    try
+    {
+        fs::create_directories(dirPath_);
+
+        const std::string prefix(SEGMENT_FILE_PREFIX);
+        const std::string suffix(SEGMENT_FILE_SUFFIX);
+        const std::string payloadPrefix(PAYLOAD_FILE_PREFIX);
+
+        for (fs::directory_iterator it(dirPath_); it != fs::directory_iterator(); ++it)
+        {
+            const std::string name = it->path().filename().string();
+            unsigned int segment = 0;
+            unsigned long long id = 0;
+
+            if (name.size() > prefix.size() + suffix.size()
+                    &&  !name.compare(0, prefix.size(), prefix)
+                    &&  !name.compare(name.size() - suffix.size(), suffix.size(), suffix)
+                    &&  sscanf(name.c_str() + prefix.size(), "%u", &segment) == 1)
+                segments.push_back(segment);
+            else if (!name.compare(0, payloadPrefix.size(), payloadPrefix)
+                    &&  sscanf(name.c_str() + payloadPrefix.size(), "%llu", &id) == 1)
+                payloadFiles[id] = it->path().string();
+        }
+    }
+    catch (const std::exception& e)
+    {
+        LOG(ERROR) << "Unable to open upload journal in " << dirPath_ << ": " << e.what();
+        return makeError();
+    }
+
+    std::sort(segments.begin(), segments.end());
+
+    boost::lock_guard<boost::mutex> lock(mutex_);
+
+    for (size_t i = 0; i < segments.size(); ++i)
+        if (!scanSegment(segments[i]))
+            return makeError();
+
+    attachPayloadFiles(payloadFiles);
+
+    activeSegment_ = segments.empty() ? 1 : segments.back() + 1;
+    segments_[activeSegment_] = Segment();
+
+    if (!openActiveSegment(activeSegment_))
+        return makeError();
+
+    deleteDeadSegments();
+
+    records.clear();
+
+    for (std::map<uint64_t, Entry>::const_iterator it = entries_.begin(); it != entries_.end(); ++it)
+        records.push_back(RecordInfo(it->first, it->second.size, it->second.fileSize));
+
+    LOG(INFO) << "Upload journal " << dirPath_ << " has " << records.size()
+              << " tasks to restore, " << aliveSize_ << " bytes";
+
+    boost::thread t(&UploadJournal::threadFunc, this);
+    thread_.swap(t);
+
+    return makeSuccess();
+}
+
+void UploadJournal::append(UploadArtifactTaskPtr task)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+
+        const uint64_t id = nextId_++;
+        task->setJournalId(id);
+
+        Entry& entry = entries_[id];
+        entry.task = task;
+        entry.size = getRecordSize(*task);
+        aliveSize_ += entry.size;
+
+        pending_.push_back(Operation(RECORD_ADD, id));
+    }
+
+    cv_.notify_all();
+}
+
+void UploadJournal::remove(uint64_t id)
+{
+    std::string filePath;
+
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+
+        std::map<uint64_t, Entry>::iterator it = entries_.find(id);
+
+        if (it == entries_.end())
+            return;
+
+        const Entry& entry = it->second;
+        aliveSize_ -= entry.size;
+        filePath = entry.filePath;
+
+        // Record not written yet needs no removal record. If it is being
+        // written now, journal thread adds removal record afterwards.
+        if (entry.isWritten)
+        {
+            --segments_[entry.segment].numAlive;
+            pending_.push_back(Operation(RECORD_REMOVE, id));
+        }
+
+        entries_.erase(it);
+    }
+
+    cv_.notify_all();
+
+    // If removal record doesn't reach disk, task without its payload file
+    // is dropped on restart anyway
+    if (!filePath.empty())
+        removeFile(filePath);
+}
+
+UploadArtifactTaskPtr UploadJournal::load(uint64_t id)
+{
+    uint32_t segment = 0;
+    uint64_t offset = 0;
+    size_t size = 0;
+
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+
+        std::map<uint64_t, Entry>::const_iterator it = entries_.find(id);
+
+        if (it == entries_.end())
+            return UploadArtifactTaskPtr();
+
+        if (!it->second.isWritten)
+            return it->second.task;
+
+        segment = it->second.segment;
+        offset = it->second.offset;
+        size = it->second.size - it->second.fileSize;
+    }
+
+    const std::string path = getSegmentPath(segment);
+    ByteBuffer buf(size);
+    std::ifstream file(path.c_str(), std::ios::binary);
+
+    if (!file.seekg(offset)  ||  !file.read(reinterpret_cast<char*>(buf.data()), size))
+    {
+        LOG(ERROR) << "Error reading task " << id << " from " << path;
+        return UploadArtifactTaskPtr();
+    }
+
+    ByteStreamReader reader(buf.data(), buf.size());
+    RecordHeader header;
+
+    if (!header.read(reader)  ||  header.id != id
+            ||  header.bodySize + RECORD_HEADER_SIZE != size
+            ||  header.checksum != calcChecksum(header.type, header.id,
+                                                buf.data() + RECORD_HEADER_SIZE, header.bodySize))
+    {
+        LOG(ERROR) << "Corrupted record of task " << id << " in " << path;
+        return UploadArtifactTaskPtr();
+    }
+
+    UploadArtifactTaskPtr task = deserializeUploadArtifactTask(reader, dirPath_);
+
+    if (task)
+        task->setJournalId(id);
+
+    return task;
+}
+
+uint64_t UploadJournal::getAliveSize() const
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    return aliveSize_;
+}
+
+uint64_t UploadJournal::getRecordSize(const UploadArtifactTask& task)
+{
+    return RECORD_HEADER_SIZE + task.getArtifactSize();
+}
+
+void UploadJournal::flush()
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+
+    if (!thread_.joinable())
+        return;
+
+    while (!pending_.empty()  ||  isWriting_)
+        cv_.wait(lock);
+}
+
+void UploadJournal::threadFunc()
+{
+    // defining const as __FUNCTIONS__ gives too little, __func__ gives too much
+    const char* FNAME = "UploadJournal::threadFunc()";
+    LOG(DEBUG) << "Entered " << FNAME;
+
+    try
+    {
+        while (true)
+        {
+            std::deque<Operation> operations;
+            std::vector<UploadArtifactTaskPtr> tasks;
+
+            {
+                boost::unique_lock<boost::mutex> lock(mutex_);
+
+                while (pending_.empty()  &&  !done_)
+                    cv_.wait(lock);
+
+                if (pending_.empty())
+                    break;
+
+                operations.swap(pending_);
+                isWriting_ = true;
+
+                // tasks removed before being written are skipped
+                for (size_t i = 0; i < operations.size(); ++i)
+                {
+                    std::map<uint64_t, Entry>::const_iterator it = entries_.find(operations[i].id);
+
+                    tasks.push_back(operations[i].type == RECORD_ADD  &&  it != entries_.end()
+                                    ? it->second.task
+                                    : UploadArtifactTaskPtr());
+                }
+            }
+
+            // Serializing outside of lock, as it may involve linking or
+            // reading payload files
+            ByteBuffer batch;
+            std::vector<WrittenRecord> added;
+            bool hasLinks = false;
+
+            for (size_t i = 0; i < operations.size(); ++i)
+            {
+                const size_t offset = batch.size();
+
+                if (operations[i].type == RECORD_REMOVE)
+                {
+                    batch.resize(offset + RECORD_HEADER_SIZE);
+                    finishRecord(batch, RECORD_REMOVE, operations[i].id, offset);
+                    continue;
+                }
+
+                if (!tasks[i])
+                    continue;
+
+                batch.resize(offset + RECORD_HEADER_SIZE);
+                ByteStreamWriter writer(batch);
+                std::string linkPath;
+
+                if (!tasks[i]->serialize(writer, getPayloadFilePrefix(operations[i].id), linkPath))
+                {
+                    LOG(ERROR) << FNAME << ": unable to serialize " << tasks[i]->toString()
+                               << ", it won't survive restart";
+                    batch.resize(offset);
+                    continue;
+                }
+
+                finishRecord(batch, RECORD_ADD, operations[i].id, offset);
+                added.push_back(WrittenRecord(operations[i].id, offset, batch.size() - offset, linkPath,
+                                              linkPath.empty() ? 0 : tasks[i]->getFileSize()));
+                hasLinks = hasLinks  ||  !linkPath.empty();
+            }
+
+            // links must be on disk before records referring to them
+            if (hasLinks)
+                syncDir(dirPath_);
+
+            uint32_t segment = 0;
+            uint64_t segmentOffset = 0;
+            const bool isWritten = batch.empty()  ||  writeBatch(batch, segment, segmentOffset);
+
+            {
+                boost::lock_guard<boost::mutex> lock(mutex_);
+
+                if (isWritten  &&  !batch.empty())
+                {
+                    segments_[segment].size += batch.size();
+
+                    for (size_t i = 0; i < added.size(); ++i)
+                    {
+                        const WrittenRecord& record = added[i];
+                        std::map<uint64_t, Entry>::iterator it = entries_.find(record.id);
+
+                        if (it == entries_.end())
+                        {
+                            // removed while being written
+                            pending_.push_back(Operation(RECORD_REMOVE, record.id));
+
+                            if (!record.filePath.empty())
+                                removeFile(record.filePath);
+
+                            continue;
+                        }
+
+                        Entry& entry = it->second;
+                        const size_t size = record.size + record.fileSize;
+
+                        aliveSize_ = aliveSize_ - entry.size + size;
+                        entry.task.reset();
+                        entry.segment = segment;
+                        entry.offset = segmentOffset + record.offset;
+                        entry.size = size;
+                        entry.filePath = record.filePath;
+                        entry.fileSize = record.fileSize;
+                        entry.isWritten = true;
+                        ++segments_[segment].numAlive;
+                    }
+                }
+                else if (!isWritten)
+                {
+                    LOG(ERROR) << FNAME << ": " << added.size()
+                               << " tasks are kept in memory only";
+
+                    // nothing refers to links made for them
+                    for (size_t i = 0; i < added.size(); ++i)
+                        if (!added[i].filePath.empty())
+                            removeFile(added[i].filePath);
+                }
+
+                isWriting_ = false;
+                deleteDeadSegments();
+            }
+
+            cv_.notify_all();
+        }
+    }
+    catch (const std::exception& e)
+    {
+        LOG(ERROR) << FNAME << ": " << e.what();
+    }
+    catch (...)
+    {
+        LOG(ERROR) << FNAME << ": Unknown exception";
+    }
+
+    LOG(DEBUG) << "Exiting " << FNAME;
+}
+
+bool UploadJournal::writeBatch(const ByteBuffer& batch, uint32_t& segment, uint64_t& offset)
+{
+    bool needNewSegment = false;
+
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+
+        segment = activeSegment_;
+        offset = segments_[segment].size;
+        needNewSegment = offset > 0  &&  offset + batch.size() > MAX_SEGMENT_SIZE;
+    }
+
+    if (needNewSegment)
+    {
+        if (!openActiveSegment(segment + 1))
+            return false;
+
+        boost::lock_guard<boost::mutex> lock(mutex_);
+
+        segment = ++activeSegment_;
+        segments_[segment] = Segment();
+        offset = 0;
+    }
+
+    if (fd_ < 0)
+        return false;
+
+    const uint8_t* data = batch.data();
+    size_t bytesLeft = batch.size();
+
+    while (bytesLeft > 0)
+    {
+        const ssize_t rv = write(fd_, data, bytesLeft);
+
+        if (rv < 0)
+        {
+            LOG(ERROR) << "Error writing upload journal " << getSegmentPath(segment);
+
+            // drop partially written batch, segment must end with whole record
+            if (ftruncate(fd_, offset) != 0)
+            {
+                LOG(ERROR) << "Unable to truncate " << getSegmentPath(segment);
+                close(fd_);
+                fd_ = -1;
+            }
+
+            return false;
+        }
+
+        data += rv;
+        bytesLeft -= rv;
+    }
+
+    // group commit: single sync for the whole batch
+    if (syncFile(fd_) != 0)
+        LOG(WARNING) << "Error syncing upload journal " << getSegmentPath(segment);
+
+    return true;
+}
+
+// Called by open() before journal thread is started or by journal thread.
+bool UploadJournal::openActiveSegment(uint32_t segment)
+{
+    if (fd_ >= 0)
+        close(fd_);
+
+    const std::string path = getSegmentPath(segment);
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+
+    if (fd_ < 0)
+    {
+        LOG(ERROR) << "Unable to create upload journal segment " << path;
+        return false;
+    }
+
+    syncDir(dirPath_);
+
+    return true;
+}
+
+// Segments are deleted from the oldest one, because removal record may be
+// in later segment than task's record. Deleting segment with removal record
+// first would bring removed task back on restart.
+// Caller must lock mutex_ before calling.
+void UploadJournal::deleteDeadSegments()
+{
+    while (!segments_.empty())
+    {
+        std::map<uint32_t, Segment>::iterator it = segments_.begin();
+
+        if (it->first == activeSegment_  ||  it->second.numAlive > 0)
+            break;
+
+        removeFile(getSegmentPath(it->first));
+        segments_.erase(it);
+    }
+}
+
+// Reads records of segment into entries_. Stops at first malformed record,
+// which is expected at the end of segment, if process was interrupted while
+// writing.
+// Caller must lock mutex_ before calling.
+bool UploadJournal::scanSegment(uint32_t segment)
+{
+    const std::string path = getSegmentPath(segment);
+    std::ifstream file(path.c_str(), std::ios::binary);
+
+    if (!file)
+    {
+        LOG(ERROR) << "Unable to open upload journal segment " << path;
+        return false;
+    }
+
+    file.seekg(0, std::ios::end);
+    const uint64_t fileSize = file.tellg();
+    file.seekg(0);
+
+    Segment& info = segments_[segment];
+    info.size = fileSize;
+
+    uint64_t offset = 0;
+    uint8_t headerBuf[RECORD_HEADER_SIZE];
+
+    while (offset + RECORD_HEADER_SIZE <= fileSize)
+    {
+        ByteStreamReader reader(headerBuf, sizeof(headerBuf));
+        RecordHeader header;
+
+        if (!file.seekg(offset)
+                ||  !file.read(reinterpret_cast<char*>(headerBuf), sizeof(headerBuf))
+                ||  !header.read(reader)
+                ||  header.bodySize > fileSize - offset - RECORD_HEADER_SIZE)
+        {
+            LOG(WARNING) << "Upload journal segment " << path << " is truncated at "
+                         << offset << " of " << fileSize << " bytes";
+            break;
+        }
+
+        const size_t size = RECORD_HEADER_SIZE + header.bodySize;
+        nextId_ = std::max(nextId_, header.id + 1);
+
+        if (header.type == RECORD_ADD)
+        {
+            // checksum of body is verified by load()
+            Entry& entry = entries_[header.id];
+            entry.segment = segment;
+            entry.offset = offset;
+            entry.size = size;
+            entry.isWritten = true;
+            aliveSize_ += size;
+            ++info.numAlive;
+        }
+        else if (header.type == RECORD_REMOVE
+                 &&  header.checksum == calcChecksum(header.type, header.id, 0, 0))
+        {
+            std::map<uint64_t, Entry>::iterator it = entries_.find(header.id);
+
+            if (it != entries_.end())
+            {
+                aliveSize_ -= it->second.size;
+                --segments_[it->second.segment].numAlive;
+                entries_.erase(it);
+            }
+        }
+        else
+        {
+            LOG(WARNING) << "Upload journal segment " << path << " has malformed record at "
+                         << offset;
+            break;
+        }
+
+        offset += size;
+    }
+
+    return true;
+}
+
+// Counts payload files in sizes of records linking them. Files of removed
+// tasks or of records, which didn't reach disk, are deleted.
+// Caller must lock mutex_ before calling.
+void UploadJournal::attachPayloadFiles(const std::map<uint64_t, std::string>& files)
+{
+    for (std::map<uint64_t, std::string>::const_iterator it = files.begin(); it != files.end(); ++it)
+    {
+        const std::map<uint64_t, Entry>::iterator entryIt = entries_.find(it->first);
+        boost::system::error_code ec;
+        const boost::uintmax_t fileSize = boost::filesystem::file_size(it->second, ec);
+
+        if (entryIt == entries_.end()  ||  ec)
+        {
+            removeFile(it->second);
+            continue;
+        }
+
+        Entry& entry = entryIt->second;
+        entry.filePath = it->second;
+        entry.fileSize = fileSize;
+        entry.size += fileSize;
+        aliveSize_ += fileSize;
+    }
+}
+
+std::string UploadJournal::getSegmentPath(uint32_t segment) const
+{
+    return (boost::format("%s/%s%08u%s")
+            % dirPath_ % SEGMENT_FILE_PREFIX % segment % SEGMENT_FILE_SUFFIX).str();
+}
+
+std::string UploadJournal::getPayloadFilePrefix(uint64_t id) const
+{
+    return (boost::format("%s/%s%u-") % dirPath_ % PAYLOAD_FILE_PREFIX % id).str();
+}
+
+// Fills header of record, which starts at offset and lasts till the end of buf
+void UploadJournal::finishRecord(ByteBuffer& buf, RecordType type, uint64_t id, size_t offset)
+{
+    const uint8_t* body = buf.data() + offset + RECORD_HEADER_SIZE;
+    const uint32_t bodySize = buf.size() - offset - RECORD_HEADER_SIZE;
+    const uint8_t typeByte = type;
+
+    ByteBuffer header;
+    ByteStreamWriter writer(header);
+    writer.write(RECORD_MAGIC);
+    writer.write(typeByte);
+    writer.write(id);
+    writer.write(bodySize);
+    writer.write(calcChecksum(typeByte, id, body, bodySize));
+
+    std::copy(header.begin(), header.end(), buf.begin() + offset);
+}
+
+} // namespace connect
+} // namespace prism
@@ -2,68 +2,273 @@
  * Copyright (C) 2017 Prism Skylabs
  */
 #include "private/UploadQueue.h"
+#include <algorithm>
+#include <functional>
+#include <iterator>
 #include "boost/thread/locks.hpp"
+#include "boost/bind.hpp"
+#include "boost/make_shared.hpp"
 #include "boost/format.hpp"
 #include "easylogging++.h"
 #include "private/util.h"
 
-namespace
+namespace prism
+{
+namespace connect
 {
-struct NotEmpty
+
+// Used internally by push_back. Space taken by task is accounted, once
+// it's arranged. Fails, if there's nothing left to drop, queue is never
+// overcommitted. Caller must lock mutex_ before calling.
+bool UploadQueue::arrangeFreeSpaceForTask(const UploadArtifactTask& task)
 {
-    NotEmpty(const std::deque<prism::connect::UploadArtifactTaskPtr>& d)
-        : deque(d)
-    {}
+    const size_t memorySize = task.getMemorySize();
+    const uint64_t fileSize = task.getFileSize();
 
-    bool operator()() const { return !deque.empty(); }
+    if(memorySize > maxMemorySize_ || (maxFileSize_ && fileSize > maxFileSize_))
+        return false;
+
+    while(!tryReserve(memorySize, fileSize))
+    {
+        // Producers reserve space without lock, their tasks can be dropped
+        // only once they're moved from intake.
+        drainIntake();
 
-    const std::deque<prism::connect::UploadArtifactTaskPtr>& deque;
-};
+        // only tasks with files free file space
+        const bool needsFileSpace = memorySize + size_ <= maxMemorySize_;
+        size_t lane = 0;
+        Lane::iterator it;
+
+        if(!findTaskToDrop(needsFileSpace, lane, it))
+            return false;
+
+        const UploadArtifactTaskPtr t = *it;
+        lanes_[lane].erase(it);
+        removeTaskSize(*t);
+        addDropped(*t);
+        LOG(WARNING) << "Upload queue is full. Preemptively removed " << t->toString();
+    }
+    return true;
 }
 
-namespace prism
+bool UploadQueue::hasRoomFor(size_t memorySize, uint64_t fileSize) const
 {
-namespace connect
+    return memorySize + size_ <= maxMemorySize_
+            && (maxFileSize_ == 0 || fileSize + fileSize_ <= maxFileSize_);
+}
+
+// Accounts space for task, if it fits into free space. Doesn't need mutex_.
+bool UploadQueue::tryReserve(size_t memorySize, uint64_t fileSize)
 {
+    size_t size = size_.load(boost::memory_order_relaxed);
+
+    do
+    {
+        if(memorySize + size > maxMemorySize_)
+            return false;
+    }
+    while(!size_.compare_exchange_weak(size, size + memorySize, boost::memory_order_relaxed));
+
+    uint64_t totalFileSize = fileSize_.load(boost::memory_order_relaxed);
+
+    do
+    {
+        if(maxFileSize_ && fileSize + totalFileSize > maxFileSize_)
+        {
+            size_.fetch_sub(memorySize, boost::memory_order_relaxed);
+            return false;
+        }
+    }
+    while(!fileSize_.compare_exchange_weak(totalFileSize, totalFileSize + fileSize, boost::memory_order_relaxed));
+
+    checkUsage(size + memorySize);
 
-// Used internally by push_back. Caller must lock mutex_ before calling.
-bool UploadQueue::arrangeFreeSpaceForTask(const size_t taskSize)
+    return true;
+}
+
+// Lock-free part of push_back(). Fails, if task doesn't fit into free space
+// or intake is full, then it's up to caller to arrange space under mutex_.
+bool UploadQueue::tryPushToIntake(UploadArtifactTaskPtr task)
 {
-    if(taskSize > maxMemorySize_)
+    const size_t memorySize = task ? task->getMemorySize() : 0;
+    const uint64_t fileSize = task ? task->getFileSize() : 0;
+
+    if(!tryReserve(memorySize, fileSize))
         return false;
 
-    while(taskSize + size_ > maxMemorySize_)
+    if(!intake_.push(task))
     {
-        const UploadArtifactTaskPtr t = deque_.front();
-        deque_.pop_front();
-        addSize(-(int)t->getArtifactSize());
-        LOG(WARNING) << "Upload queue is full. Preemptively removed " << t->toString();
+        size_.fetch_sub(memorySize, boost::memory_order_relaxed);
+        fileSize_.fetch_sub(fileSize, boost::memory_order_relaxed);
+        return false;
     }
+
     return true;
 }
 
+// Moves tasks from intake to their lanes, their space is already accounted.
+// Caller must lock mutex_ before calling.
+void UploadQueue::drainIntake()
+{
+    UploadArtifactTaskPtr task;
+
+    while(intake_.pop(task))
+        lanes_[getLane(task)].push_back(task);
+}
+
+// Wakes up thread waiting on cv_ after task is pushed without mutex_.
+// Waiter either already waits or still holds mutex_, while it checks for
+// tasks, so mutex_ is taken to notify it after that.
+void UploadQueue::notifyWaiter()
+{
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+
+    if(numWaiters_.load(boost::memory_order_relaxed) == 0)
+        return;
+
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+    }
+
+    notifyPushed();
+}
+
+// Wakes up single consumer, and all threads in timed_wait(), as pushed task
+// may be what they wait for
+void UploadQueue::notifyPushed()
+{
+    cv_.notify_one();
+    timedCv_.notify_all();
+}
+
+void UploadQueue::setPriorities(const Priorities& priorities, const boost::posix_time::time_duration& maxWait)
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+
+    priorities_ = priorities;
+    maxPriorityWait_ = maxWait;
+    typeLanes_.clear();
+
+    if(priorities_.empty())
+        return;
+
+    // types without priority have 0, so there's always lane for it
+    std::set<int, std::greater<int> > levels;
+    levels.insert(0);
+
+    for(Priorities::const_iterator it = priorities_.begin(); it != priorities_.end(); ++it)
+        levels.insert(it->second);
+
+    for(Priorities::const_iterator it = priorities_.begin(); it != priorities_.end(); ++it)
+        typeLanes_[it->first] = std::distance(levels.begin(), levels.find(it->second));
+
+    defaultLane_ = std::distance(levels.begin(), levels.find(0));
+
+    // the last one is for empty tasks
+    lanes_.assign(levels.size() + 1, Lane());
+}
+
+void UploadQueue::setSupersedableTypes(const Types& types)
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+
+    supersedableTypes_ = types;
+}
+
+Status UploadQueue::openJournal(const std::string& dirPath, uint64_t maxDiskSize)
+{
+    UploadJournalPtr journal = boost::make_shared<UploadJournal>(dirPath);
+    UploadJournal::RecordInfos records;
+
+    Status status = journal->open(records);
+
+    if (status.isError())
+        return status;
+
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+
+        journal_ = journal;
+        maxDiskSize_ = maxDiskSize;
+        spilled_.assign(records.begin(), records.end());
+
+        dropForDiskSpace();
+    }
+
+    refill();
+
+    return makeSuccess();
+}
+
 Status UploadQueue::push_back(UploadArtifactTaskPtr task)
 {
-    const size_t artifactSize = task ? task->getArtifactSize() : 0;
     bool canPush = false;
+    bool needsRefill = false;
+    std::vector<UploadCompletionPtr> dropped;
+
+    if (task  &&  task->getQueueTime().is_not_a_date_time())
+        task->setQueueTime(boost::get_system_time());
+
+    // tasks to be superseded may be anywhere in queue, so it takes mutex
+    const bool supersedes = task  &&  supersedableTypes_.count(task->getType());
+
+    // journal is set before any push, journaled tasks take mutex anyway
+    if (!journal_  &&  !supersedes  &&  tryPushToIntake(task))
+    {
+        notifyWaiter();
+        return makeSuccess();
+    }
 
     {
         boost::lock_guard<boost::mutex> lock(mutex_);
-        canPush = arrangeFreeSpaceForTask(artifactSize);
 
-        if (canPush)
+        // tasks pushed earlier go first
+        drainIntake();
+
+        // frees space before it's arranged for task
+        if (supersedes)
+            dropSuperseded(*task);
+
+        if (journal_  &&  task)
         {
-            deque_.push_back(task);
-            addSize(artifactSize);
+            // otherwise it would drop every task ahead of it, then itself
+            canPush = UploadJournal::getRecordSize(*task) <= maxDiskSize_;
+
+            if (canPush)
+                needsRefill = pushBackJournaled(task);
         }
+        else
+        {
+            canPush = !task  ||  arrangeFreeSpaceForTask(*task);
+
+            if (canPush)
+                lanes_[getLane(task)].push_back(task);
+        }
+
+        dropped.swap(dropped_);
     }
 
-    cv_.notify_one();
+    notifyPushed();
+
+    if (needsRefill)
+        refill();
+
+    for (size_t i = 0; i < dropped.size(); ++i)
+        dropped[i]->complete(makeError());
+
+    if (!canPush  &&  journal_)
+    {
+        LOG(ERROR) << boost::format("Artifact %s is too large (%d bytes) to put into upload queue journal. "
+                "Journal max size is: %d bytes") % task->toString() % task->getArtifactSize() % maxDiskSize_;
+        return makeError();
+    }
 
     if (!canPush)
     {
-        const std::string message = (boost::format("Artifact %s is too large (%d) to put into upload queue. "
-                "Queue max size is: %d bytes") % task->toString() % artifactSize % maxMemorySize_).str();
+        const std::string message = (boost::format("Artifact %s (%d bytes in memory, %d bytes in file) "
+                "doesn't fit into upload queue. Queue max size is: %d bytes in memory, %d bytes in files")
+                % task->toString() % task->getMemorySize() % task->getFileSize()
+                % maxMemorySize_ % maxFileSize_).str();
         LOG(ERROR) << message;
         return makeError();
     }
@@ -73,21 +278,31 @@ Status UploadQueue::push_back(UploadArtifactTaskPtr task)
 
 Status UploadQueue::push_front(UploadArtifactTaskPtr task)
 {
-    const size_t artifactSize = task ? task->getArtifactSize() : 0;
+    const size_t memorySize = task ? task->getMemorySize() : 0;
+    const uint64_t fileSize = task ? task->getFileSize() : 0;
     bool queueIsFull = false;
 
     {
         boost::lock_guard<boost::mutex> lock(mutex_);
-        queueIsFull = (artifactSize + size_ > maxMemorySize_);
 
-        if (!queueIsFull)
+        // journaled task is never dropped, memory is freed by moving last
+        // tasks back to journal
+        if (journal_  &&  task)
         {
-            deque_.push_front(task);
-            addSize(artifactSize);
+            while (!lanes_.front().empty()  &&  lanes_.front().back()  &&  !hasRoomFor(memorySize, fileSize))
+                spillBack();
         }
+
+        if (journal_  &&  task)
+            addTaskSize(*task);
+        else
+            queueIsFull = !tryReserve(memorySize, fileSize);
+
+        if (!queueIsFull)
+            lanes_[getLane(task)].push_front(task);
     }
 
-    cv_.notify_one();
+    notifyPushed();
 
     if (queueIsFull)
     {
@@ -101,34 +316,708 @@ Status UploadQueue::push_front(UploadArtifactTaskPtr task)
 bool UploadQueue::pop_front(UploadArtifactTaskPtr& task, const boost::posix_time::time_duration waitTime)
 {
     boost::unique_lock<boost::mutex> lock(mutex_);
-    const NotEmpty nePred(deque_);
 
-    if(cv_.timed_wait(lock, waitTime, nePred))
+    ++numWaiters_;
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+
+    const bool hasTask = cv_.timed_wait(lock, waitTime, boost::bind(&UploadQueue::isReadyOrInterrupted, this));
+
+    --numWaiters_;
+
+    if(hasTask && !isInterrupted_)
     {
-        task = deque_.front();
-        addSize(task ? -(int)task->getArtifactSize() : 0);
-        deque_.pop_front();
+        size_t lane = 0;
+        Lane::iterator it;
+
+        findReadyTask(lane, it);
+        task = *it;
+        lanes_[lane].erase(it);
+
+        if(task)
+        {
+            removeTaskSize(*task);
+            ++numInProgress_;
+
+            const std::vector<std::string>& keys = task->getOrderingKeys();
+            busyKeys_.insert(keys.begin(), keys.end());
+        }
+
+        lock.unlock();
+        refill();
         return true;
     }
     return false;
 }
 
+size_t UploadQueue::pop_mergeable(std::vector<UploadArtifactTaskPtr>& batch, size_t maxNumItems)
+{
+    size_t numItems = 0;
+    std::set<std::string> batchKeys;
+
+    for(size_t i = 0; i < batch.size(); ++i)
+    {
+        const std::vector<std::string>& keys = batch[i]->getOrderingKeys();
+        batchKeys.insert(keys.begin(), keys.end());
+        numItems += batch[i]->getNumItems();
+    }
+
+    if(batch.empty() || numItems >= maxNumItems)
+        return numItems;
+
+    const UploadArtifactTask& first = *batch.front();
+    size_t numPopped = 0;
+
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+
+        drainIntake();
+
+        // Keys held by batch itself don't block tasks following it. Keys of
+        // skipped tasks are blocked, so that no task overtakes them.
+        std::set<std::string> blockedKeys;
+        std::set_difference(busyKeys_.begin(), busyKeys_.end(),
+                            batchKeys.begin(), batchKeys.end(),
+                            std::inserter(blockedKeys, blockedKeys.end()));
+
+        // mergeable tasks are of the same type, so they're in the same lane
+        Lane& lane = lanes_[getLane(batch.front())];
+        Lane::iterator it = lane.begin();
+
+        while(it != lane.end() && numItems < maxNumItems)
+        {
+            if(!*it)
+            {
+                ++it;
+                continue;
+            }
+
+            const UploadArtifactTaskPtr task = *it;
+            const std::vector<std::string>& keys = task->getOrderingKeys();
+            bool isBlocked = false;
+
+            for(size_t i = 0; i < keys.size() && !isBlocked; ++i)
+                isBlocked = blockedKeys.count(keys[i]) != 0;
+
+            if(isBlocked || !first.canMergeWith(*task) || numItems + task->getNumItems() > maxNumItems)
+            {
+                blockedKeys.insert(keys.begin(), keys.end());
+                ++it;
+                continue;
+            }
+
+            it = lane.erase(it);
+            removeTaskSize(*task);
+            busyKeys_.insert(keys.begin(), keys.end());
+            batch.push_back(task);
+            numItems += task->getNumItems();
+            ++numPopped;
+        }
+
+        numInProgress_ += numPopped;
+    }
+
+    if(numPopped)
+        refill();
+
+    return numItems;
+}
+
+void UploadQueue::release(UploadArtifactTaskPtr task)
+{
+    if(!task)
+        return;
+
+    const std::vector<std::string>& keys = task->getOrderingKeys();
+    bool isLast = false;
+
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+
+        for(size_t i = 0; i < keys.size(); ++i)
+            busyKeys_.erase(keys[i]);
+
+        isLast = --numInProgress_ == 0 && isEmpty();
+    }
+
+    // more than one task may become ready
+    if(!keys.empty())
+        cv_.notify_all();
+
+    if(isLast)
+        drainedCv_.notify_all();
+}
+
+void UploadQueue::complete(UploadArtifactTaskPtr task)
+{
+    if(!task)
+        return;
+
+    if(journal_ && task->getJournalId())
+        journal_->remove(task->getJournalId());
+
+    release(task);
+}
+
 bool UploadQueue::timed_wait(boost::system_time waitUntil)
 {
     boost::unique_lock<boost::mutex> lock(mutex_);
-    return cv_.timed_wait(lock, waitUntil);
+
+    if(isInterrupted_)
+        return false;
+
+    return waitTimed(lock, waitUntil);
+}
+
+bool UploadQueue::linger_wait(boost::system_time lingerUntil)
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+
+    // flush is checked under mutex_, so its wakeup isn't missed
+    if(isInterrupted_ || numFlushes_ > 0)
+        return false;
+
+    return waitTimed(lock, lingerUntil) && numFlushes_ == 0;
+}
+
+bool UploadQueue::waitTimed(boost::unique_lock<boost::mutex>& lock, boost::system_time waitUntil)
+{
+    // intake isn't checked, waiter is woken up by push anyway
+    ++numWaiters_;
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+
+    const bool rv = timedCv_.timed_wait(lock, waitUntil);
+
+    --numWaiters_;
+
+    return rv;
+}
+
+void UploadQueue::beginFlush()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        ++numFlushes_;
+    }
+
+    timedCv_.notify_all();
+}
+
+void UploadQueue::endFlush()
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    --numFlushes_;
+}
+
+bool UploadQueue::isFlushing() const
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    return numFlushes_ > 0;
+}
+
+void UploadQueue::interrupt()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        isInterrupted_ = true;
+    }
+
+    cv_.notify_all();
+    timedCv_.notify_all();
+}
+
+bool UploadQueue::wait_drained(boost::system_time deadline)
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+
+    return drainedCv_.timed_wait(lock, deadline, boost::bind(&UploadQueue::isDrained, this));
+}
+
+void UploadQueue::takeCompletions(std::vector<UploadCompletionPtr>& completions)
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+
+    drainIntake();
+    completions.insert(completions.end(), dropped_.begin(), dropped_.end());
+    dropped_.clear();
+
+    for(size_t i = 0; i < lanes_.size(); ++i)
+    {
+        for(Lane::iterator it = lanes_[i].begin(); it != lanes_[i].end(); ++it)
+        {
+            if(!*it || !(*it)->getCompletion())
+                continue;
+
+            completions.push_back((*it)->getCompletion());
+            (*it)->setCompletion(UploadCompletionPtr());
+        }
+    }
+
+    for(std::map<uint64_t, UploadCompletionPtr>::iterator it = spilledCompletions_.begin();
+        it != spilledCompletions_.end(); ++it)
+        completions.push_back(it->second);
+
+    spilledCompletions_.clear();
 }
 
 // Caller must lock mutex_ before calling.
-void UploadQueue::addSize(size_t size)
+bool UploadQueue::findReadyTask(size_t& lane, Lane::iterator& it)
 {
-    size_ += size;
+    if(!priorities_.empty())
+        return findPriorityTask(lane, it);
+
+    lane = 0;
+    it = findReadyTaskInLane(lanes_.front());
+
+    return it != lanes_.front().end();
+}
+
+// Same as findReadyTask(), but picks task with the greatest priority.
+// Empty task, which stops upload thread, goes last. Ordering keys of
+// different types never match, so lanes don't block each other.
+// Caller must lock mutex_ before calling.
+bool UploadQueue::findPriorityTask(size_t& lane, Lane::iterator& it)
+{
+    const boost::system_time starvedBefore = boost::get_system_time() - maxPriorityWait_;
+    const size_t stopLane = lanes_.size() - 1;
+    bool isFound = false;
+
+    for(size_t i = 0; i < stopLane; ++i)
+    {
+        const Lane::iterator candidate = findReadyTaskInLane(lanes_[i]);
+
+        if(candidate == lanes_[i].end())
+            continue;
+
+        // Tasks of lane are roughly in order of queue time, so its first
+        // ready task is the oldest one. Task of lower priority overtakes
+        // the picked one only if it's starving and older.
+        const boost::system_time queueTime = (*candidate)->getQueueTime();
+
+        if(!isFound || (queueTime < starvedBefore && queueTime < (*it)->getQueueTime()))
+        {
+            lane = i;
+            it = candidate;
+            isFound = true;
+        }
+    }
 
+    if(isFound)
+        return true;
+
+    lane = stopLane;
+    it = lanes_[stopLane].begin();
+
+    return it != lanes_[stopLane].end();
+}
+
+// Returns the first task of lane, which isn't blocked by task in progress.
+// Caller must lock mutex_ before calling.
+UploadQueue::Lane::iterator UploadQueue::findReadyTaskInLane(Lane& lane)
+{
+    if(busyKeys_.empty())
+        return lane.begin();
+
+    // Keys of skipped tasks are blocked too, otherwise task could overtake
+    // preceding one with the same key.
+    std::set<std::string> blockedKeys(busyKeys_);
+    Lane::iterator it = lane.begin();
+
+    for(; it != lane.end(); ++it)
+    {
+        if(!*it)
+            break;
+
+        const std::vector<std::string>& keys = (*it)->getOrderingKeys();
+        bool isBlocked = false;
+
+        for(size_t i = 0; i < keys.size() && !isBlocked; ++i)
+            isBlocked = blockedKeys.count(keys[i]) != 0;
+
+        if(!isBlocked)
+            break;
+
+        blockedKeys.insert(keys.begin(), keys.end());
+    }
+
+    return it;
+}
+
+// Finds the oldest task of the lowest priority in priority mode, the
+// oldest task otherwise. Tasks without payload files are skipped, if
+// withFileOnly is set.
+// Caller must lock mutex_ before calling.
+bool UploadQueue::findTaskToDrop(bool withFileOnly, size_t& lane, Lane::iterator& it)
+{
+    for(size_t i = lanes_.size(); i-- > 0;)
+    {
+        for(it = lanes_[i].begin(); it != lanes_[i].end(); ++it)
+        {
+            if(*it && (!withFileOnly || (*it)->getFileSize() != 0))
+            {
+                lane = i;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// Empty task goes to the last lane in priority mode.
+size_t UploadQueue::getLane(const UploadArtifactTaskPtr& task) const
+{
+    if(!task)
+        return priorities_.empty() ? 0 : lanes_.size() - 1;
+
+    return getTypeLane(task->getType());
+}
+
+size_t UploadQueue::getTypeLane(UploadArtifactTask::Type type) const
+{
+    const std::map<UploadArtifactTask::Type, size_t>::const_iterator it = typeLanes_.find(type);
+
+    return it != typeLanes_.end() ? it->second : defaultLane_;
+}
+
+// Caller must lock mutex_ before calling.
+bool UploadQueue::hasReadyTask()
+{
+    drainIntake();
+
+    size_t lane = 0;
+    Lane::iterator it;
+
+    return findReadyTask(lane, it);
+}
+
+size_t UploadQueue::size() const
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    size_t size = spilled_.size() + intake_.size();
+
+    for(size_t i = 0; i < lanes_.size(); ++i)
+        size += lanes_[i].size();
+
+    return size;
+}
+
+bool UploadQueue::empty() const
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+
+    return isEmpty();
+}
+
+// Caller must lock mutex_ before calling.
+bool UploadQueue::isEmpty() const
+{
+    for(size_t i = 0; i < lanes_.size(); ++i)
+    {
+        if(!lanes_[i].empty())
+            return false;
+    }
+
+    return spilled_.empty() && intake_.size() == 0;
+}
+
+// Caller must lock mutex_ before calling.
+bool UploadQueue::isReadyOrInterrupted()
+{
+    return isInterrupted_ || hasReadyTask();
+}
+
+// Caller must lock mutex_ before calling.
+bool UploadQueue::isDrained() const
+{
+    return numInProgress_ == 0 && isEmpty();
+}
+
+// Journaled task is never rejected. It goes to memory only if all tasks
+// ahead of it are there, otherwise order would break. Returns true, if
+// refill() may load more.
+// Caller must lock mutex_ before calling.
+bool UploadQueue::pushBackJournaled(UploadArtifactTaskPtr task)
+{
+    journal_->append(task);
+
+    if(spilled_.empty() && (lanes_.front().empty() || hasRoomFor(task->getMemorySize(), task->getFileSize())))
+    {
+        lanes_.front().push_back(task);
+        addTaskSize(*task);
+    }
+    else
+    {
+        spill(*task);
+        spilled_.push_back(UploadJournal::RecordInfo(task->getJournalId(), task->getArtifactSize(),
+                                                     task->getFileSize()));
+    }
+
+    return dropForDiskSpace();
+}
+
+// Moves last task in memory to journal only tasks.
+// Caller must lock mutex_ before calling.
+void UploadQueue::spillBack()
+{
+    const UploadArtifactTaskPtr t = lanes_.front().back();
+    lanes_.front().pop_back();
+    removeTaskSize(*t);
+    spill(*t);
+    spilled_.push_front(UploadJournal::RecordInfo(t->getJournalId(), t->getArtifactSize(), t->getFileSize()));
+}
+
+// Loads tasks from journal, while they fit into memory. Records are picked
+// and tasks are put into lane under mutex_, they're read from disk without
+// it. Thread, which finds refill in progress, leaves it to that thread,
+// which picks records again after each batch.
+// Caller must not lock mutex_.
+void UploadQueue::refill()
+{
+    if(!journal_)
+        return;
+
+    std::vector<UploadCompletionPtr> failed;
+    bool isRefilled = false;
+
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+
+        if(isRefilling_)
+            return;
+
+        isRefilling_ = true;
+
+        while(true)
+        {
+            std::vector<UploadJournal::RecordInfo> records;
+            pickSpilled(records);
+
+            if(records.empty())
+                break;
+
+            lock.unlock();
+
+            std::vector<UploadArtifactTaskPtr> tasks(records.size());
+
+            for(size_t i = 0; i < records.size(); ++i)
+                tasks[i] = journal_->load(records[i].id);
+
+            lock.lock();
+
+            if(putLoaded(records, tasks, failed))
+                isRefilled = true;
+        }
+
+        isRefilling_ = false;
+    }
+
+    // more than one task may become ready
+    if(isRefilled)
+    {
+        cv_.notify_all();
+        timedCv_.notify_all();
+    }
+
+    for(size_t i = 0; i < failed.size(); ++i)
+        failed[i]->complete(makeError());
+}
+
+// Picks first spilled records, which fit into memory.
+// Caller must lock mutex_ before calling.
+void UploadQueue::pickSpilled(std::vector<UploadJournal::RecordInfo>& records)
+{
+    size_t memorySize = 0;
+    uint64_t fileSize = 0;
+
+    for(size_t i = 0; i < spilled_.size() && records.size() < REFILL_BATCH_SIZE; ++i)
+    {
+        const UploadJournal::RecordInfo& record = spilled_[i];
+
+        memorySize += record.size - record.fileSize;
+        fileSize += record.fileSize;
+
+        // at least one task is loaded, even if it's too large
+        if((i > 0 || !lanes_.front().empty()) && !hasRoomFor(memorySize, fileSize))
+            break;
+
+        records.push_back(record);
+        loadingIds_.insert(record.id);
+    }
+}
+
+// Puts loaded tasks into lane, while their records are still first in
+// spilled_ and they fit into memory. Task, which is moved back to journal
+// by push_front() meanwhile, goes ahead of them, rest are picked again.
+// Returns true, if any task is put.
+// Caller must lock mutex_ before calling.
+bool UploadQueue::putLoaded(const std::vector<UploadJournal::RecordInfo>& records,
+                            const std::vector<UploadArtifactTaskPtr>& tasks,
+                            std::vector<UploadCompletionPtr>& failed)
+{
+    bool isInOrder = true;
+    bool isPut = false;
+
+    for(size_t i = 0; i < records.size(); ++i)
+    {
+        const uint64_t id = records[i].id;
+        const UploadArtifactTaskPtr& t = tasks[i];
+
+        // dropped for disk space meanwhile
+        if(!loadingIds_.erase(id))
+            continue;
+
+        isInOrder = isInOrder
+                && !spilled_.empty() && spilled_.front().id == id
+                && (!t || lanes_.front().empty() || hasRoomFor(t->getMemorySize(), t->getFileSize()));
+
+        if(!isInOrder)
+            continue;
+
+        spilled_.pop_front();
+
+        const std::map<uint64_t, UploadCompletionPtr>::iterator it = spilledCompletions_.find(id);
+        UploadCompletionPtr completion;
+
+        if(it != spilledCompletions_.end())
+        {
+            completion = it->second;
+            spilledCompletions_.erase(it);
+        }
+
+        if(!t)
+        {
+            LOG(ERROR) << "Unable to restore task " << id << " from upload queue journal, dropping it";
+            journal_->remove(id);
+
+            if(completion)
+                failed.push_back(completion);
+
+            continue;
+        }
+
+        t->setCompletion(completion);
+
+        // restored task counts its queue time since restore
+        if(t->getQueueTime().is_not_a_date_time())
+            t->setQueueTime(boost::get_system_time());
+
+        lanes_.front().push_back(t);
+        addTaskSize(*t);
+        isPut = true;
+    }
+
+    return isPut;
+}
+
+// Drops oldest tasks, until journal fits into maxDiskSize_. Returns true,
+// if task in memory is dropped, so that refill() may load more.
+// Caller must lock mutex_ before calling.
+bool UploadQueue::dropForDiskSpace()
+{
+    bool isMemoryFreed = false;
+
+    while(journal_->getAliveSize() > maxDiskSize_)
+    {
+        if(!lanes_.front().empty() && lanes_.front().front())
+        {
+            const UploadArtifactTaskPtr t = lanes_.front().front();
+            lanes_.front().pop_front();
+            removeTaskSize(*t);
+            addDropped(*t);
+            journal_->remove(t->getJournalId());
+            isMemoryFreed = true;
+            LOG(WARNING) << "Upload queue journal is full. Preemptively removed " << t->toString();
+        }
+        else if(!spilled_.empty())
+        {
+            const uint64_t id = spilled_.front().id;
+            spilled_.pop_front();
+            loadingIds_.erase(id);
+            journal_->remove(id);
+
+            const std::map<uint64_t, UploadCompletionPtr>::iterator it = spilledCompletions_.find(id);
+
+            if(it != spilledCompletions_.end())
+            {
+                dropped_.push_back(it->second);
+                spilledCompletions_.erase(it);
+            }
+
+            LOG(WARNING) << "Upload queue journal is full. Preemptively removed task " << id;
+        }
+        else
+            break;
+    }
+
+    return isMemoryFreed;
+}
+
+// Caller must lock mutex_ before calling.
+void UploadQueue::addDropped(const UploadArtifactTask& task)
+{
+    if(task.getCompletion())
+        dropped_.push_back(task.getCompletion());
+}
+
+// Drops queued tasks, which task replaces. They're removed from journal
+// too, if they're there.
+// Caller must lock mutex_ before calling.
+void UploadQueue::dropSuperseded(const UploadArtifactTask& task)
+{
+    const std::string key = task.getSupersedeKey();
+    Lane& lane = lanes_[getTypeLane(task.getType())];
+    Lane::iterator it = lane.begin();
+
+    while(it != lane.end())
+    {
+        if(!*it || (*it)->getType() != task.getType() || (*it)->getSupersedeKey() != key)
+        {
+            ++it;
+            continue;
+        }
+
+        const UploadArtifactTaskPtr t = *it;
+        it = lane.erase(it);
+        removeTaskSize(*t);
+        addDropped(*t);
+
+        if(journal_ && t->getJournalId())
+            journal_->remove(t->getJournalId());
+
+        LOG(INFO) << "Artifact " << t->toString() << " is superseded by " << task.toString();
+    }
+}
+
+// Keeps completion of task, which is about to be in journal only.
+// Caller must lock mutex_ before calling.
+void UploadQueue::spill(const UploadArtifactTask& task)
+{
+    if(task.getCompletion())
+        spilledCompletions_[task.getJournalId()] = task.getCompletion();
+}
+
+// size is memory used after task is added
+void UploadQueue::checkUsage(size_t size)
+{
     if(size >= usageSizeWarning_)
         LOG_EVERY_N(5, WARNING) << boost::format("Upload queue is using %.2f MB out of %.2f MB")
-                                   % ((float)size_ / 10e6) % ((float)maxMemorySize_/10e6);
+                                   % ((float)size / 10e6) % ((float)maxMemorySize_/10e6);
+}
+
+// Accounts task regardless of free space
+void UploadQueue::addTaskSize(const UploadArtifactTask& task)
+{
+    const size_t memorySize = task.getMemorySize();
+
+    checkUsage(size_.fetch_add(memorySize, boost::memory_order_relaxed) + memorySize);
+    fileSize_.fetch_add(task.getFileSize(), boost::memory_order_relaxed);
+}
+
+void UploadQueue::removeTaskSize(const UploadArtifactTask& task)
+{
+    size_.fetch_sub(task.getMemorySize(), boost::memory_order_relaxed);
+    fileSize_.fetch_sub(task.getFileSize(), boost::memory_order_relaxed);
 }
 
 } // namespace connect
 } // namespace prism
-
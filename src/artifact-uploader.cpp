@@ -10,13 +10,33 @@
 
 #include "easylogging++.h"
 
+#include "boost/bind.hpp"
 #include "boost/filesystem.hpp"
 #include "boost/make_shared.hpp"
+#include "boost/random/mersenne_twister.hpp"
+#include "boost/random/uniform_int_distribution.hpp"
+#include "boost/thread/condition_variable.hpp"
+#include "boost/thread/locks.hpp"
+#include "boost/thread/mutex.hpp"
 #include "boost/thread/thread.hpp"
+#include "boost/thread/tss.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
 
 namespace
 {
-    static const boost::posix_time::time_duration NETWORK_ERROR_WAIT_PERIOD_SEC = boost::posix_time::seconds(3);
+    // how often upload threads check, if other thread's probe has succeeded
+    static const boost::posix_time::time_duration PROBE_WAIT_PERIOD = boost::posix_time::seconds(1);
+
+    // how often abort(timeoutMs) aborts requests again, in case thread has
+    // started one right after abort
+    static const boost::chrono::milliseconds ABORT_REPEAT_PERIOD(100);
+
+    // one per thread to avoid locking
+    static boost::thread_specific_ptr<boost::random::mt19937> jitterGenerator;
 }
 
 namespace prism
@@ -29,7 +49,20 @@ class ArtifactUploader::Impl
 public:
     Impl()
         : done_(false)
+        , isDestroying_(false)
         , timeoutToCompleteUploadSec_(0)
+        , maxTimeSeriesBatchSize_(1)
+        , circuitBreakerThreshold_(0)
+        , retryAfter_(boost::get_system_time())
+        , numFailures_(0)
+        , isCircuitOpen_(false)
+        , isProbing_(false)
+        , accountId_(-1)
+        , cameraId_(-1)
+        , isSessionResolved_(false)
+        , isSessionCached_(false)
+        , sessionStatus_(makeError())
+        , isResolverStopped_(false)
     {
     }
 
@@ -40,27 +73,174 @@ public:
 
     Status enqueueTask(UploadArtifactTaskPtr task)
     {
+        if (isDestroying_)
+            return rejectOnDestruction(*task);
+
         return queue_->push_back(task);
     }
 
-    void abort()
+    Status enqueueTask(UploadArtifactTaskPtr task, const ArtifactUploader::CompletionCallback& callback)
+    {
+        if (isDestroying_)
+            return rejectOnDestruction(*task);
+
+        const UploadCompletionPtr completion = boost::make_shared<UploadCompletion>(callback);
+        task->setCompletion(completion);
+
+        const Status status = queue_->push_back(task);
+
+        // caller learns about rejected task from status
+        if (status.isError())
+            completion->cancel();
+
+        return status;
+    }
+
+    Status flush(int timeoutMs, ArtifactUploader::Backlog& backlog);
+
+    void abort();
+    ArtifactUploader::Backlog abort(int timeoutMs);
+
+    ArtifactUploader::Backlog getBacklog() const
+    {
+        ArtifactUploader::Backlog backlog;
+
+        if (queue_)
+        {
+            backlog.numQueued = queue_->size();
+            backlog.numInProgress = queue_->numInProgress();
+        }
+
+        return backlog;
+    }
+
+    ArtifactUploader::Statistics getStatistics() const
+    {
+        boost::lock_guard<boost::mutex> lock(statisticsMutex_);
+        return statistics_;
+    }
+
+    RequestMetricsMap getMetrics() const
     {
-        done_ = true;
+        RequestMetricsMap metrics;
+
+        for (size_t i = 0; i < sessions_.size(); ++i)
+            mergeRequestMetrics(sessions_[i]->client.getMetrics(), metrics);
+
+        mergeRequestMetrics(resolverClient_.getMetrics(), metrics);
+
+        return metrics;
+    }
+
+    Status getSessionStatus() const
+    {
+        boost::lock_guard<boost::mutex> lock(sessionMutex_);
+        return sessionStatus_;
     }
 
 private:
-    void threadFunc();
+    typedef boost::shared_ptr<ClientSession> ClientSessionPtr;
+    typedef boost::shared_ptr<boost::thread> ThreadPtr;
+
+    Status rejectOnDestruction(const UploadArtifactTask& task);
+    void threadFunc(ClientSession& session);
+
+    // Discovers accounts URL, account and camera, whenever session isn't
+    // resolved, i.e. after start without session cache or once cached
+    // session is found stale
+    void resolverThreadFunc();
+    bool waitUntilDiscoveryNeeded();
+    void discoverSession();
+    Status resolveSession(id_t& accountId, id_t& cameraId);
+    void stopResolver();
+
+    // Retries Client::init() until it succeeds, returns false, if uploader
+    // or resolver is stopped
+    bool initClient(Client& client);
+
+    // Waits for account and camera to be resolved and copies their IDs and
+    // accounts URL to session, returns false, if aborted
+    bool waitUntilSessionResolved(ClientSession& session);
+
+    // Cached session is validated lazily by the first upload. Upload, which
+    // failed with 404, makes cached session stale and triggers discovery.
+    void confirmCachedSession();
+    bool invalidateCachedSession(const ClientSession& session, const Status& status);
+
+    // Sleeps for retry delay after numFailures attempts to reach server
+    // failed in a row, returns earlier, if uploader is stopped
+    void waitBeforeRetry(int numFailures, const Client& client);
+
+    // Network and server errors affect all threads, so they all wait before
+    // next attempt. Delay grows with number of failures in a row.
+    void postponeUploads(const Client& client);
+    void resetFailures();
+
+    // Waits for retry delay to pass. If circuit breaker is open, one of
+    // threads probes server, while others keep waiting.
+    void waitUntilUploadsAllowed(ClientSession& session);
+    void probeServer(ClientSession& session);
+
+    // Adds counts or events, which can be uploaded together with the first
+    // task of batch, waiting for them until linger time is over
+    void collectTimeSeriesBatch(std::vector<UploadArtifactTaskPtr>& batch);
+
+    // one per thread
+    std::vector<ClientSessionPtr> sessions_;
+    std::vector<ThreadPtr> threads_;
 
-    ClientSession session_;
     UploadQueuePtr queue_;
-    boost::thread thread_;
 
     // We don't care about race condition or atomicity as we need to signal
     // value changed from false to true.
     // volatile is to prevent optimizing while(!done) into while(true)
     volatile bool done_;
 
+    // Set once destructor starts, upload*() fails from then on, e.g. when
+    // called by completion callback
+    boost::atomic<bool> isDestroying_;
+
     int timeoutToCompleteUploadSec_;
+
+    size_t maxTimeSeriesBatchSize_;
+    boost::posix_time::time_duration timeSeriesLinger_;
+
+    ArtifactUploader::RetryPolicyPtr retryPolicy_;
+    int circuitBreakerThreshold_;
+
+    // guarded by retryMutex_
+    boost::mutex retryMutex_;
+    boost::system_time retryAfter_;
+    int numFailures_; // uploads failed in a row
+    bool isCircuitOpen_;
+    bool isProbing_;
+
+    std::string apiRoot_;
+    std::string tokenHash_;
+    std::string cameraName_;
+    std::string sessionCacheFile_;
+
+    // Set up by init() before resolverThread_ starts, then used by it only.
+    // Other threads call its thread safe getMetrics() and abortRequests().
+    Client resolverClient_;
+    ThreadPtr resolverThread_;
+
+    // guarded by sessionMutex_, sessionCv_ is notified, once session is
+    // resolved or uploader is stopped
+    mutable boost::mutex sessionMutex_;
+    boost::condition_variable sessionCv_;
+    std::string accountsUrl_;
+    id_t accountId_;
+    id_t cameraId_;
+    bool isSessionResolved_;
+    bool isSessionCached_; // taken from session cache, no upload succeeded yet
+    Status sessionStatus_;
+
+    // set after upload threads exit, volatile for the same reason as done_
+    volatile bool isResolverStopped_;
+
+    mutable boost::mutex statisticsMutex_;
+    ArtifactUploader::Statistics statistics_; // guarded by statisticsMutex_
 };
 
 ArtifactUploader::ArtifactUploader()
@@ -103,11 +283,66 @@ Status ArtifactUploader::uploadCount(move_ref<Counts> counts, bool update)
     return impl().enqueueTask(boost::make_shared<UploadCountTask>(counts, update));
 }
 
+Status ArtifactUploader::uploadBackground(const timestamp_t& timestamp, PayloadHolderPtr payload,
+                                          const CompletionCallback& callback)
+{
+    return impl().enqueueTask(boost::make_shared<UploadBackgroundTask>(timestamp, payload), callback);
+}
+
+Status ArtifactUploader::uploadObjectStream(const ObjectStream& stream, PayloadHolderPtr payload,
+                                            const CompletionCallback& callback)
+{
+    return impl().enqueueTask(boost::make_shared<UploadObjectStreamTask>(stream, payload), callback);
+}
+
+Status ArtifactUploader::uploadFlipbook(const Flipbook& flipbook, PayloadHolderPtr payload,
+                                        const CompletionCallback& callback)
+{
+    return impl().enqueueTask(boost::make_shared<UploadFlipbookTask>(flipbook, payload), callback);
+}
+
+Status ArtifactUploader::uploadEvent(const timestamp_t& timestamp, move_ref<Events> events,
+                                     const CompletionCallback& callback)
+{
+    return impl().enqueueTask(boost::make_shared<UploadEventTask>(timestamp, events), callback);
+}
+
+Status ArtifactUploader::uploadCount(move_ref<Counts> counts, bool update,
+                                     const CompletionCallback& callback)
+{
+    return impl().enqueueTask(boost::make_shared<UploadCountTask>(counts, update), callback);
+}
+
+Status ArtifactUploader::flush(int timeoutMs, Backlog& backlog)
+{
+    return impl().flush(timeoutMs, backlog);
+}
+
 void ArtifactUploader::abort()
 {
     impl().abort();
 }
 
+ArtifactUploader::Backlog ArtifactUploader::abort(int timeoutMs)
+{
+    return impl().abort(timeoutMs);
+}
+
+ArtifactUploader::Statistics ArtifactUploader::getStatistics() const
+{
+    return impl().getStatistics();
+}
+
+RequestMetricsMap ArtifactUploader::getMetrics() const
+{
+    return impl().getMetrics();
+}
+
+Status ArtifactUploader::getSessionStatus() const
+{
+    return impl().getSessionStatus();
+}
+
 ArtifactUploader::Impl::~Impl()
 {
     const char* FNAME = "ArtifactUploader::Impl::~Impl()";
@@ -115,30 +350,236 @@ ArtifactUploader::Impl::~Impl()
     LOG(DEBUG) << "Entered " << FNAME
                << ", timeout to complete upload, sec: " << timeoutToCompleteUploadSec_;
 
+    isDestroying_ = true;
+
     // This will interrupt wait on queue_'s conditional variable.
-    queue_->push_back(UploadArtifactTaskPtr());
+    // Each thread exits after popping single empty task. Threads may have
+    // exited already after abort().
+    for (size_t i = 0; i < threads_.size(); ++i)
+        if (threads_[i]->joinable())
+            queue_->push_back(UploadArtifactTaskPtr());
 
     if (timeoutToCompleteUploadSec_)
     {
-        if (!thread_.try_join_for(boost::chrono::seconds(timeoutToCompleteUploadSec_)))
+        const boost::chrono::steady_clock::time_point deadline
+                = boost::chrono::steady_clock::now()
+                + boost::chrono::seconds(timeoutToCompleteUploadSec_);
+
+        bool isJoined = true;
+
+        for (size_t i = 0; i < threads_.size() && isJoined; ++i)
+            if (threads_[i]->joinable())
+                isJoined = threads_[i]->try_join_until(deadline);
+
+        if (!isJoined)
         {
             LOG(ERROR) << "Thread didn't finish for timeout period. Need to increase "
                           "timeout (output_controller.timeout_to_complete_upload_sec)?"
                           "May be there is some other bug? Deadlock?";
 
             abort();
-            thread_.join();
         }
     }
-    else
-        thread_.join();
+
+    for (size_t i = 0; i < threads_.size(); ++i)
+        if (threads_[i]->joinable())
+            threads_[i]->join();
+
+    stopResolver();
 
     if (!queue_->empty())
         LOG(WARNING) << "Tasks still in queue: " << queue_->size();
 
+    // Left tasks are reported failed, while queue is intact, rather than by
+    // their completions' destructors, once queue is being destroyed
+    std::vector<UploadCompletionPtr> completions;
+    queue_->takeCompletions(completions);
+
+    for (size_t i = 0; i < completions.size(); ++i)
+        completions[i]->complete(makeError());
+
+    LOG(INFO) << "Artifacts uploaded: " << statistics_.numArtifacts
+              << ", failed uploads: " << statistics_.numFailedUploads;
+    LOG(INFO) << "Time-series artifacts uploaded: " << statistics_.numTimeSeriesArtifacts
+              << ", by requests: " << statistics_.numTimeSeriesUploads;
+
     LOG(DEBUG) << "Exiting " << FNAME;
 }
 
+Status ArtifactUploader::Impl::rejectOnDestruction(const UploadArtifactTask& task)
+{
+    LOG(WARNING) << "Uploader is being destroyed, artifact " << task.toString() << " isn't enqueued";
+    return makeError();
+}
+
+Status ArtifactUploader::Impl::flush(int timeoutMs, ArtifactUploader::Backlog& backlog)
+{
+    const char* FNAME = "ArtifactUploader::Impl::flush()";
+    LOG(DEBUG) << "Entered " << FNAME << ", timeout, ms: " << timeoutMs;
+
+    if (!queue_)
+    {
+        LOG(ERROR) << FNAME << ": uploader isn't initialized";
+        return makeError();
+    }
+
+    const boost::system_time deadline = boost::get_system_time()
+            + boost::posix_time::milliseconds(std::max(timeoutMs, 0));
+
+    // threads lingering for more counts or events upload what they have
+    queue_->beginFlush();
+
+    const bool isDrained = queue_->wait_drained(deadline);
+
+    queue_->endFlush();
+    backlog = getBacklog();
+
+    if (!isDrained)
+    {
+        LOG(WARNING) << "Upload queue isn't drained in " << timeoutMs << " ms, artifacts queued: "
+                     << backlog.numQueued << ", in progress: " << backlog.numInProgress;
+        return makeError(Status::TIMEOUT);
+    }
+
+    LOG(DEBUG) << "Exiting " << FNAME;
+    return makeSuccess();
+}
+
+void ArtifactUploader::Impl::abort()
+{
+    done_ = true;
+
+    if (queue_)
+        queue_->interrupt();
+
+    {
+        // threads waiting for session check done_ under lock
+        boost::lock_guard<boost::mutex> lock(sessionMutex_);
+        sessionCv_.notify_all();
+    }
+
+    for (size_t i = 0; i < sessions_.size(); ++i)
+        sessions_[i]->client.abortRequests();
+
+    resolverClient_.abortRequests();
+}
+
+ArtifactUploader::Backlog ArtifactUploader::Impl::abort(int timeoutMs)
+{
+    const char* FNAME = "ArtifactUploader::Impl::abort()";
+    LOG(DEBUG) << "Entered " << FNAME << ", timeout, ms: " << timeoutMs;
+
+    abort();
+
+    const boost::chrono::steady_clock::time_point deadline
+            = boost::chrono::steady_clock::now() + boost::chrono::milliseconds(std::max(timeoutMs, 0));
+
+    for (size_t i = 0; i < threads_.size(); ++i)
+    {
+        while (threads_[i]->joinable())
+        {
+            const boost::chrono::steady_clock::time_point now = boost::chrono::steady_clock::now();
+
+            if (now >= deadline)
+                break;
+
+            if (threads_[i]->try_join_until(std::min(deadline, now + ABORT_REPEAT_PERIOD)))
+                break;
+
+            for (size_t j = 0; j < sessions_.size(); ++j)
+                sessions_[j]->client.abortRequests();
+        }
+    }
+
+    const ArtifactUploader::Backlog backlog = getBacklog();
+
+    LOG(INFO) << "Uploads aborted, artifacts queued: " << backlog.numQueued
+              << ", in progress: " << backlog.numInProgress;
+
+    LOG(DEBUG) << "Exiting " << FNAME;
+    return backlog;
+}
+
+// Token itself isn't stored in session cache, only its FNV-1a hash to tell,
+// whether cache belongs to the same token
+static std::string hashToken(const std::string& token)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < token.size(); ++i)
+    {
+        hash ^= static_cast<unsigned char>(token[i]);
+        hash *= 1099511628211ULL;
+    }
+
+    std::ostringstream os;
+    os << std::hex << hash;
+
+    return os.str();
+}
+
+// Session cache holds API root, token hash, camera name, accounts URL,
+// account ID and camera ID, one per line. It's used only, if the first
+// three match.
+static bool loadSessionCache(const std::string& path, const std::string& apiRoot,
+                             const std::string& tokenHash, const std::string& cameraName,
+                             std::string& accountsUrl, id_t& accountId, id_t& cameraId)
+{
+    std::ifstream file(path.c_str());
+    std::string cachedApiRoot;
+    std::string cachedTokenHash;
+    std::string cachedCameraName;
+    std::string cachedAccountsUrl;
+    id_t cachedAccountId = -1;
+    id_t cachedCameraId = -1;
+
+    if (!std::getline(file, cachedApiRoot)  ||  !std::getline(file, cachedTokenHash)
+            ||  !std::getline(file, cachedCameraName)  ||  !std::getline(file, cachedAccountsUrl)
+            ||  !(file >> cachedAccountId >> cachedCameraId)  ||  cachedAccountsUrl.empty())
+    {
+        return false;
+    }
+
+    if (cachedApiRoot != apiRoot  ||  cachedTokenHash != tokenHash  ||  cachedCameraName != cameraName)
+    {
+        LOG(INFO) << "Session cache " << path << " is of different API root, token or camera, ignored";
+        return false;
+    }
+
+    accountsUrl = cachedAccountsUrl;
+    accountId = cachedAccountId;
+    cameraId = cachedCameraId;
+
+    return true;
+}
+
+// File is replaced by rename, so that it's never seen half-written
+static void saveSessionCache(const std::string& path, const std::string& apiRoot,
+                             const std::string& tokenHash, const std::string& cameraName,
+                             const std::string& accountsUrl, id_t accountId, id_t cameraId)
+{
+    const std::string tmpPath = path + ".tmp";
+
+    {
+        std::ofstream file(tmpPath.c_str(), std::ios::trunc);
+        file << apiRoot << '\n' << tokenHash << '\n' << cameraName << '\n' << accountsUrl << '\n'
+             << accountId << '\n' << cameraId << '\n';
+        file.flush();
+
+        if (!file)
+        {
+            LOG(WARNING) << "Unable to write session cache " << tmpPath;
+            return;
+        }
+    }
+
+    boost::system::error_code ec;
+    boost::filesystem::rename(tmpPath, path, ec);
+
+    if (ec)
+        LOG(WARNING) << "Unable to replace session cache " << path << ": " << ec.message();
+}
+
 Status ArtifactUploader::Impl::init(const ArtifactUploader::Configuration& cfg,
                                     ArtifactUploader::ClientConfigCallback* configCallback)
 {
@@ -148,28 +589,330 @@ Status ArtifactUploader::Impl::init(const ArtifactUploader::Configuration& cfg,
         return makeError();
     }
 
+    if (cfg.numUploadThreads == 0)
+    {
+        LOG(ERROR) << "Invalid numUploadThreads value " << cfg.numUploadThreads;
+        return makeError();
+    }
+
+    if (cfg.circuitBreakerThreshold < 0)
+    {
+        LOG(ERROR) << "Invalid circuitBreakerThreshold value " << cfg.circuitBreakerThreshold;
+        return makeError();
+    }
+
+    if (cfg.maxTimeSeriesBatchSize == 0  ||  cfg.timeSeriesLingerMs < 0)
+    {
+        LOG(ERROR) << "Invalid time-series batching parameters: maxTimeSeriesBatchSize "
+                   << cfg.maxTimeSeriesBatchSize << ", timeSeriesLingerMs " << cfg.timeSeriesLingerMs;
+        return makeError();
+    }
+
     // cfg.warnQueueSize is always >= 0, as type is size_t
-    if (cfg.queueType.compare(kStrSimple))
+    const bool isPersistent = !cfg.queueType.compare(kStrPersistent);
+    const bool isPriority = !cfg.queueType.compare(kStrPriority);
+
+    if (cfg.queueType.compare(kStrSimple)  &&  !isPersistent  &&  !isPriority)
     {
         LOG(ERROR) << "Unsupported queue type: " << cfg.queueType;
         return makeError();
     }
 
+    if (isPersistent  &&  (cfg.queueDir.empty()  ||  cfg.maxQueueDiskSize == 0))
+    {
+        LOG(ERROR) << "Persistent queue requires queueDir and non-zero maxQueueDiskSize";
+        return makeError();
+    }
+
+    queue_ = boost::make_shared<UploadQueue>(cfg.maxQueueSize, cfg.warnQueueSize, cfg.maxQueueFileSize);
+
+    if (isPriority)
+    {
+        UploadQueue::Priorities priorities;
+        priorities[UploadArtifactTask::EVENT] = cfg.priorities.event;
+        priorities[UploadArtifactTask::COUNT] = cfg.priorities.count;
+        priorities[UploadArtifactTask::OBJECT_STREAM] = cfg.priorities.objectStream;
+        priorities[UploadArtifactTask::BACKGROUND] = cfg.priorities.background;
+        priorities[UploadArtifactTask::FLIPBOOK] = cfg.priorities.flipbook;
+
+        queue_->setPriorities(priorities, boost::posix_time::seconds(cfg.maxPriorityWaitSec));
+    }
+
+    UploadQueue::Types supersedableTypes;
+
+    if (cfg.supersedable.background)
+        supersedableTypes.insert(UploadArtifactTask::BACKGROUND);
+
+    if (cfg.supersedable.objectStream)
+        supersedableTypes.insert(UploadArtifactTask::OBJECT_STREAM);
+
+    if (cfg.supersedable.flipbook)
+        supersedableTypes.insert(UploadArtifactTask::FLIPBOOK);
+
+    queue_->setSupersedableTypes(supersedableTypes);
+
+    if (isPersistent)
+    {
+        const Status status = queue_->openJournal(cfg.queueDir, cfg.maxQueueDiskSize);
+
+        if (status.isError())
+        {
+            LOG(ERROR) << "Unable to open upload queue journal in " << cfg.queueDir;
+            return status;
+        }
+
+        LOG(INFO) << "Tasks restored from upload queue journal: " << queue_->size();
+    }
+
+    maxTimeSeriesBatchSize_ = cfg.maxTimeSeriesBatchSize;
+    circuitBreakerThreshold_ = cfg.circuitBreakerThreshold;
+    retryPolicy_ = cfg.retryPolicy
+            ? cfg.retryPolicy
+            : boost::make_shared<ArtifactUploader::ExponentialBackoffRetryPolicy>();
+    timeSeriesLinger_ = boost::posix_time::milliseconds(cfg.timeSeriesLingerMs);
+
+    apiRoot_ = cfg.apiRoot;
+    tokenHash_ = hashToken(cfg.apiToken);
+    cameraName_ = cfg.cameraName;
+    sessionCacheFile_ = cfg.sessionCacheFile;
+
+    if (!sessionCacheFile_.empty()
+            &&  loadSessionCache(sessionCacheFile_, apiRoot_, tokenHash_, cameraName_,
+                                 accountsUrl_, accountId_, cameraId_))
+    {
+        LOG(INFO) << "Account ID: " << accountId_ << ", camera (instrument) ID: " << cameraId_
+                  << " are taken from " << sessionCacheFile_;
+        isSessionResolved_ = true;
+        isSessionCached_ = true;
+        sessionStatus_ = makeSuccess();
+    }
+
+    // Each thread has its own client, it gets accounts URL discovered by
+    // resolver thread, so that API root is queried once
+    while (sessions_.size() < cfg.numUploadThreads)
+    {
+        ClientSessionPtr session = boost::make_shared<ClientSession>();
+        Client threadClient(cfg.apiRoot, cfg.apiToken);
+
+        if (configCallback)
+            configCallback(threadClient);
+
+        session->client.swap(threadClient);
+        sessions_.push_back(session);
+    }
+
+    LOG(INFO) << "Upload threads: " << sessions_.size();
+
     Client client(cfg.apiRoot, cfg.apiToken);
 
     if (configCallback)
         configCallback(client);
 
-    Status status = client.init();
+    resolverClient_.swap(client);
+    resolverThread_ = boost::make_shared<boost::thread>(boost::bind(&Impl::resolverThreadFunc, this));
+
+    for (size_t i = 0; i < sessions_.size(); ++i)
+        threads_.push_back(boost::make_shared<boost::thread>(
+                               boost::bind(&Impl::threadFunc, this, boost::ref(*sessions_[i]))));
+
+    timeoutToCompleteUploadSec_ = cfg.timeoutToCompleteUploadSec;
+
+    return makeSuccess();
+}
+
+ArtifactUploader::ExponentialBackoffRetryPolicy::ExponentialBackoffRetryPolicy(
+        int baseDelayMs, int maxDelayMs, int maxAttempts, int maxAgeSec)
+    : baseDelayMs_(std::max(baseDelayMs, 1))
+    , maxDelayMs_(std::max(maxDelayMs, 0))
+    , maxAttempts_(maxAttempts)
+    , maxAgeSec_(maxAgeSec)
+{
+}
+
+bool ArtifactUploader::ExponentialBackoffRetryPolicy::isRetryable(const Status& status) const
+{
+    if (isNetworkError(status))
+        return true;
+
+    if (status.getFacility() != Status::FACILITY_HTTP)
+        return false;
+
+    switch (status.getCode())
+    {
+    case 408:
+    case 429:
+    case 500:
+    case 502:
+    case 503:
+    case 504:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+bool ArtifactUploader::ExponentialBackoffRetryPolicy::canRetry(int numFailures, int ageSec) const
+{
+    return (maxAttempts_ <= 0  ||  numFailures < maxAttempts_)
+            && (maxAgeSec_ <= 0  ||  ageSec < maxAgeSec_);
+}
+
+int ArtifactUploader::ExponentialBackoffRetryPolicy::getDelayMs(int numFailures) const
+{
+    if (numFailures <= 0)
+        return 0;
+
+    int64_t ceilingMs = baseDelayMs_;
+
+    for (int i = 1; i < numFailures  &&  ceilingMs < maxDelayMs_; ++i)
+        ceilingMs *= 2;
+
+    ceilingMs = std::min<int64_t>(ceilingMs, maxDelayMs_);
+
+    if (!jitterGenerator.get())
+    {
+        // devices started at the same time must not get the same sequence
+        const uint32_t seed = static_cast<uint32_t>(
+                    boost::chrono::high_resolution_clock::now().time_since_epoch().count())
+                ^ (static_cast<uint32_t>(getpid()) << 16);
+
+        jitterGenerator.reset(new boost::random::mt19937(seed));
+    }
+
+    boost::random::uniform_int_distribution<int> distribution(0, static_cast<int>(ceilingMs));
+
+    return distribution(*jitterGenerator);
+}
+
+void ArtifactUploader::Impl::postponeUploads(const Client& client)
+{
+    boost::lock_guard<boost::mutex> lock(retryMutex_);
+
+    ++numFailures_;
+
+    const int delayMs = std::max(retryPolicy_->getDelayMs(numFailures_),
+                                 client.getRetryAfterSec() * 1000);
+
+    retryAfter_ = std::max(retryAfter_,
+                           boost::get_system_time() + boost::posix_time::milliseconds(delayMs));
+
+    LOG(DEBUG) << "Uploads failed in a row: " << numFailures_ << ", next attempt in "
+               << delayMs << " ms";
+
+    if (circuitBreakerThreshold_  &&  numFailures_ >= circuitBreakerThreshold_  &&  !isCircuitOpen_)
+    {
+        LOG(WARNING) << "Uploads are paused after " << numFailures_ << " failures in a row";
+        isCircuitOpen_ = true;
+    }
+}
+
+void ArtifactUploader::Impl::resetFailures()
+{
+    boost::lock_guard<boost::mutex> lock(retryMutex_);
+    numFailures_ = 0;
+}
+
+void ArtifactUploader::Impl::waitUntilUploadsAllowed(ClientSession& session)
+{
+    while (!done_)
+    {
+        boost::system_time waitUntil;
+        bool shouldProbe = false;
+
+        {
+            boost::lock_guard<boost::mutex> lock(retryMutex_);
+            const boost::system_time now = boost::get_system_time();
+            waitUntil = retryAfter_;
+
+            if (now >= retryAfter_)
+            {
+                if (!isCircuitOpen_)
+                    break;
+
+                // other thread is probing, its result is checked periodically
+                shouldProbe = !isProbing_;
+                isProbing_ = true;
+                waitUntil = now + PROBE_WAIT_PERIOD;
+            }
+        }
+
+        if (shouldProbe)
+        {
+            probeServer(session);
+            continue;
+        }
+
+        // Don't try to upload right away, wait awhile.
+        // Loop is to handle spurious wake-ups and wake-ups due to adding
+        // new task to the queue.
+        queue_->timed_wait(waitUntil);
+    }
+}
+
+// Queries account, which is small request not consuming any artifact
+void ArtifactUploader::Impl::probeServer(ClientSession& session)
+{
+    Account account;
+    const Status status = session.client.queryAccount(session.accountId, account);
 
     if (status.isError())
     {
-        LOG(ERROR) << "Client::init() failed: " << status;
-        return status;
+        LOG(WARNING) << "Server is still unavailable: " << status;
+        postponeUploads(session.client);
     }
 
+    boost::lock_guard<boost::mutex> lock(retryMutex_);
+    isProbing_ = false;
+
+    // failures aren't reset, so that next failure pauses uploads again
+    if (status.isSuccess())
+    {
+        LOG(INFO) << "Server is available, uploads are resumed";
+        isCircuitOpen_ = false;
+    }
+}
+
+void ArtifactUploader::Impl::waitBeforeRetry(int numFailures, const Client& client)
+{
+    const int delayMs = std::max(retryPolicy_->getDelayMs(numFailures),
+                                 client.getRetryAfterSec() * 1000);
+
+    const boost::system_time waitUntil = boost::get_system_time()
+            + boost::posix_time::milliseconds(delayMs);
+
+    LOG(DEBUG) << "Attempts to reach server failed in a row: " << numFailures
+               << ", next attempt in " << delayMs << " ms";
+
+    boost::unique_lock<boost::mutex> lock(sessionMutex_);
+
+    while (!done_  &&  !isResolverStopped_  &&  boost::get_system_time() < waitUntil)
+        sessionCv_.timed_wait(lock, waitUntil);
+}
+
+bool ArtifactUploader::Impl::initClient(Client& client)
+{
+    for (int numFailures = 1; !done_  &&  !isResolverStopped_; ++numFailures)
+    {
+        const Status status = client.init();
+
+        if (status.isSuccess())
+            return true;
+
+        if (done_  ||  isResolverStopped_)
+            break;
+
+        LOG(WARNING) << "Client::init() failed: " << status;
+        waitBeforeRetry(numFailures, client);
+    }
+
+    return false;
+}
+
+Status ArtifactUploader::Impl::resolveSession(id_t& accountId, id_t& cameraId)
+{
     Accounts accounts;
-    status = client.queryAccountsList(accounts);
+    Status status = resolverClient_.queryAccountsList(accounts);
 
     if (status.isError())
     {
@@ -183,48 +926,214 @@ Status ArtifactUploader::Impl::init(const ArtifactUploader::Configuration& cfg,
         return makeError();
     }
 
-    id_t accountId = accounts[0].id;
-
-    LOG(INFO) << "Account ID: " << accountId;
+    accountId = accounts[0].id;
 
     Instrument camera;
-    status = findCameraByName(client, accountId, cfg.cameraName, camera);
+    status = findCameraByName(resolverClient_, accountId, cameraName_, camera);
 
     if (status.isError())
     {
         if (status.getCode() != Status::NOT_FOUND)
             return status;
 
-        status = registerNewCamera(client, accountId, cfg.cameraName, camera);
+        status = registerNewCamera(resolverClient_, accountId, cameraName_, camera);
 
         if (status.isError())
             return status;
     }
 
-    LOG(INFO) << "Camera (instrument) ID: " << camera.id;
+    cameraId = camera.id;
 
-    session_.client.swap(client);
-    session_.accountId = accountId;
-    session_.cameraId = camera.id;
+    return makeSuccess();
+}
 
-    queue_ = boost::make_shared<UploadQueue>(cfg.maxQueueSize, cfg.warnQueueSize);
+bool ArtifactUploader::Impl::waitUntilDiscoveryNeeded()
+{
+    boost::unique_lock<boost::mutex> lock(sessionMutex_);
 
-    boost::thread t(&Impl::threadFunc, this);
-    thread_.swap(t);
+    while (!done_  &&  !isResolverStopped_  &&  isSessionResolved_)
+        sessionCv_.wait(lock);
 
-    timeoutToCompleteUploadSec_ = cfg.timeoutToCompleteUploadSec;
+    return !done_  &&  !isResolverStopped_;
+}
 
-    return makeSuccess();
+void ArtifactUploader::Impl::discoverSession()
+{
+    // Client::init() has its own retries, they don't count here
+    for (int numFailures = 1; initClient(resolverClient_); ++numFailures)
+    {
+        id_t accountId = -1;
+        id_t cameraId = -1;
+        const Status status = resolveSession(accountId, cameraId);
+
+        if (status.isSuccess())
+        {
+            const std::string accountsUrl = resolverClient_.getAccountsUrl();
+
+            LOG(INFO) << "Account ID: " << accountId << ", camera (instrument) ID: " << cameraId;
+
+            {
+                boost::lock_guard<boost::mutex> lock(sessionMutex_);
+                accountsUrl_ = accountsUrl;
+                accountId_ = accountId;
+                cameraId_ = cameraId;
+                isSessionResolved_ = true;
+                isSessionCached_ = false;
+                sessionStatus_ = status;
+                sessionCv_.notify_all();
+            }
+
+            if (!sessionCacheFile_.empty())
+                saveSessionCache(sessionCacheFile_, apiRoot_, tokenHash_, cameraName_,
+                                 accountsUrl, accountId, cameraId);
+
+            return;
+        }
+
+        if (done_  ||  isResolverStopped_)
+            return;
+
+        {
+            boost::lock_guard<boost::mutex> lock(sessionMutex_);
+            sessionStatus_ = status;
+        }
+
+        LOG(WARNING) << "Unable to resolve account and camera, will retry: " << status;
+        waitBeforeRetry(numFailures, resolverClient_);
+    }
+}
+
+void ArtifactUploader::Impl::resolverThreadFunc()
+{
+    const char* FNAME = "ArtifactUploader::Impl::resolverThreadFunc()";
+    LOG(DEBUG) << "Entered " << FNAME;
+
+    try
+    {
+        while (waitUntilDiscoveryNeeded())
+            discoverSession();
+    }
+    catch (const std::exception& e)
+    {
+        LOG(ERROR) << FNAME << ": " << e.what();
+    }
+    catch (...)
+    {
+        LOG(ERROR) << FNAME << ": Unknown exception";
+    }
+
+    LOG(DEBUG) << "Exiting " << FNAME;
+}
+
+void ArtifactUploader::Impl::stopResolver()
+{
+    if (!resolverThread_)
+        return;
+
+    {
+        boost::lock_guard<boost::mutex> lock(sessionMutex_);
+        isResolverStopped_ = true;
+        sessionCv_.notify_all();
+    }
+
+    // request may start right after abort, so it's repeated
+    while (!resolverThread_->try_join_for(ABORT_REPEAT_PERIOD))
+        resolverClient_.abortRequests();
+}
+
+bool ArtifactUploader::Impl::waitUntilSessionResolved(ClientSession& session)
+{
+    boost::unique_lock<boost::mutex> lock(sessionMutex_);
+
+    while (!done_  &&  !isSessionResolved_)
+        sessionCv_.wait(lock);
+
+    if (session.client.getAccountsUrl() != accountsUrl_)
+        session.client.setAccountsUrl(accountsUrl_);
+
+    session.accountId = accountId_;
+    session.cameraId = cameraId_;
+
+    return !done_;
+}
+
+void ArtifactUploader::Impl::confirmCachedSession()
+{
+    boost::lock_guard<boost::mutex> lock(sessionMutex_);
+
+    if (isSessionCached_)
+    {
+        LOG(INFO) << "Cached account and camera are confirmed by upload";
+        isSessionCached_ = false;
+    }
+}
+
+bool ArtifactUploader::Impl::invalidateCachedSession(const ClientSession& session, const Status& status)
+{
+    if (status.getFacility() != Status::FACILITY_HTTP  ||  status.getCode() != 404)
+        return false;
+
+    boost::lock_guard<boost::mutex> lock(sessionMutex_);
+
+    // other thread may have invalidated it already
+    if (!isSessionResolved_  ||  session.accountId != accountId_  ||  session.cameraId != cameraId_)
+        return true;
+
+    if (!isSessionCached_)
+        return false;
+
+    LOG(WARNING) << "Cached account or camera doesn't exist any more, they are discovered again";
+
+    isSessionCached_ = false;
+    isSessionResolved_ = false;
+    sessionStatus_ = status;
+    sessionCv_.notify_all();
+
+    return true;
+}
+
+// Every task of batch is charged with the attempt, they share request
+static void addAttempt(const std::vector<UploadArtifactTaskPtr>& batch, int64_t transferMs)
+{
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+        if (batch[i]->getCompletion())
+            batch[i]->getCompletion()->addAttempt(transferMs);
+    }
+}
+
+static void reportCompletion(const UploadArtifactTask& task, const Status& status)
+{
+    if (task.getCompletion())
+        task.getCompletion()->complete(status);
 }
 
-static bool shouldRetryUpload(Status status)
+static bool isTimeSeriesTask(const UploadArtifactTask& task)
 {
-    return isNetworkError(status)
-            || (status.getFacility() == Status::FACILITY_HTTP && status.getCode() == 503)
-            || (status.getFacility() == Status::FACILITY_HTTP && status.getCode() == 500);
+    return task.getType() == UploadArtifactTask::COUNT
+            || task.getType() == UploadArtifactTask::EVENT;
 }
 
-void ArtifactUploader::Impl::threadFunc()
+void ArtifactUploader::Impl::collectTimeSeriesBatch(std::vector<UploadArtifactTaskPtr>& batch)
+{
+    // Linger time counts from enqueueing, so that task, which waited in
+    // queue already, isn't delayed any further
+    const boost::system_time lingerUntil = batch.front()->getQueueTime() + timeSeriesLinger_;
+
+    // Wake-up due to adding any task is fine, batch is refilled each time
+    while (queue_->pop_mergeable(batch, maxTimeSeriesBatchSize_) < maxTimeSeriesBatchSize_
+           && !done_
+           && !queue_->isFlushing()
+           && boost::get_system_time() < lingerUntil)
+    {
+        queue_->linger_wait(lingerUntil);
+    }
+
+    if (batch.size() > 1)
+        LOG(DEBUG) << "Merged " << batch.size() << " time-series artifacts into single upload";
+}
+
+void ArtifactUploader::Impl::threadFunc(ClientSession& session)
 {
     // defining const as __FUNCTIONS__ gives too little, __func__ gives too much
     const char* FNAME = "ArtifactUploader::Impl::threadFunc()";
@@ -234,36 +1143,146 @@ void ArtifactUploader::Impl::threadFunc()
     {
         while (!done_)
         {
+            // IDs may change, once cached ones are verified
+            if (!waitUntilSessionResolved(session))
+                break;
+
+            waitUntilUploadsAllowed(session);
+
             UploadArtifactTaskPtr task;
 
-            if (!queue_->pop_front(task))
+            if (done_  ||  !queue_->pop_front(task))
                 continue;
 
             if (!task) // upload complete
                 break;
 
-            const Status status = task->execute(session_);
+            // Tasks are merged for upload only, each of them stays in queue
+            // (and journal) on its own
+            std::vector<UploadArtifactTaskPtr> batch(1, task);
+            const bool isTimeSeries = isTimeSeriesTask(*task);
+
+            if (isTimeSeries  &&  maxTimeSeriesBatchSize_ > 1)
+            {
+                collectTimeSeriesBatch(batch);
+                task = mergeUploadArtifactTasks(batch);
+            }
+
+            // abort() may come, while batch is collected
+            Status status = makeNetworkError();
+            bool isAborted = done_;
+
+            if (!isAborted)
+            {
+                const boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+                status = task->execute(session);
+
+                addAttempt(batch, boost::chrono::duration_cast<boost::chrono::milliseconds>(
+                               boost::chrono::steady_clock::now() - start).count());
+
+                isAborted = status.isError()  &&  done_;
+            }
 
             if (status.isSuccess())
             {
                 LOG(INFO) << "Artifact " << task->toString() << " uploaded successfully";
+                resetFailures();
+                confirmCachedSession();
+
+                {
+                    boost::lock_guard<boost::mutex> lock(statisticsMutex_);
+                    statistics_.numArtifacts += batch.size();
+                    statistics_.numArtifactBytes += task->getArtifactSize();
+
+                    if (isTimeSeries)
+                    {
+                        statistics_.numTimeSeriesArtifacts += batch.size();
+                        ++statistics_.numTimeSeriesUploads;
+                    }
+                }
+
+                // completion is reported first, so that flush() returns
+                // after callbacks of artifacts it has waited for
+                for (size_t i = 0; i < batch.size(); ++i)
+                {
+                    reportCompletion(*batch[i], status);
+                    queue_->complete(batch[i]);
+                }
+
                 continue;
             }
 
-            LOG(ERROR) << "Unable to upload artifact " << task->toString() << ". Error: " << status;
+            // neither is failure of artifact, nor of server
+            const bool isStaleSession = !isAborted  &&  invalidateCachedSession(session, status);
+            const bool isFailure = !isAborted  &&  !isStaleSession;
+
+            if (isAborted)
+            {
+                LOG(INFO) << "Upload of artifact " << task->toString() << " is aborted";
+            }
+            else if (isStaleSession)
+            {
+                LOG(INFO) << "Artifact " << task->toString() << " waits for account and camera";
+            }
+            else
+            {
+                LOG(ERROR) << "Unable to upload artifact " << task->toString() << ". Error: " << status;
+
+                {
+                    boost::lock_guard<boost::mutex> lock(statisticsMutex_);
+                    ++statistics_.numFailedUploads;
+                }
+
+                if (!retryPolicy_->isRetryable(status))
+                {
+                    for (size_t i = 0; i < batch.size(); ++i)
+                    {
+                        reportCompletion(*batch[i], status);
+                        queue_->complete(batch[i]);
+                    }
+
+                    continue;
+                }
+
+                postponeUploads(session.client);
+            }
+
+            // put all back before releasing any to keep them ahead of tasks
+            // with the same keys
+            const boost::system_time now = boost::get_system_time();
+            std::vector<bool> isReturned(batch.size());
 
-            if (shouldRetryUpload(status))
+            for (size_t i = batch.size(); i > 0; --i)
             {
-                LOG(DEBUG) << "Returning artifact back to upload queue";
-                queue_->push_front(task);
+                UploadArtifactTask& t = *batch[i - 1];
+
+                if (isFailure)
+                    t.incrementNumFailures();
+
+                const int ageSec = (now - t.getQueueTime()).total_seconds();
 
-                boost::system_time waitUntil = boost::get_system_time() + NETWORK_ERROR_WAIT_PERIOD_SEC;
+                if (isFailure  &&  !retryPolicy_->canRetry(t.getNumFailures(), ageSec))
+                {
+                    LOG(WARNING) << "Dropping artifact " << t.toString() << " after "
+                                 << t.getNumFailures() << " failed attempts";
+                    continue;
+                }
 
-                // Don't try to upload the task right away, wait awhile.
-                // while is to handle spurious wake-ups and wake-ups due to adding
-                // new task to the queue.
-                while (!done_ && boost::get_system_time() < waitUntil)
-                    queue_->timed_wait(waitUntil);
+                LOG(DEBUG) << "Returning artifact " << t.toString() << " back to upload queue";
+                isReturned[i - 1] = queue_->push_front(batch[i - 1]).isSuccess();
+            }
+
+            for (size_t i = 0; i < batch.size(); ++i)
+            {
+                if (isReturned[i])
+                {
+                    queue_->release(batch[i]);
+                }
+                else
+                {
+                    reportCompletion(*batch[i], status);
+                    queue_->complete(batch[i]);
+                }
             }
         } // while
     } // try
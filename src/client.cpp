@@ -4,18 +4,106 @@
 #include "client.h"
 #include "private/const-strings.h"
 #include "private/curl-session.h"
+#include "private/PoolBasedCurlFactory.h"
+#include "private/CurlMultiEngine.h"
+#include "private/CaBundle.h"
+#include "private/HttpValidatorCache.h"
+#include "private/InstrumentCache.h"
+#include "private/JsonArrayReader.h"
 #include "private/util.h"
 #include "easylogging++.h"
 #include "rapidjson/document.h"
 #include "ConnectSDKConfig.h"
 #include <boost/format.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cctype>
+#include <sstream>
 
 namespace prism
 {
 namespace connect
 {
 
+namespace
+{
+    // Lookup by name expects single match, if server filters, otherwise it
+    // scans list in pages of this size
+    const int FIND_INSTRUMENT_PAGE_SIZE = 100;
+
+    const size_t DEFAULT_HTTP_CACHE_MAX_ENTRIES = 64;
+}
+
+typedef Client::CompletionCallback CompletionCallback;
+typedef boost::shared_ptr<CurlSession> CurlSessionSharedPtr;
+
+// Blocks caller until asynchronous operation passes its result to setter().
+// Setter may outlive SyncResult instance.
+template <typename T>
+class SyncResult
+{
+    struct State
+    {
+        explicit State(const T& value)
+            : value(value)
+            , isReady(false)
+        {
+        }
+
+        boost::mutex mutex;
+        boost::condition_variable cv;
+        T value;
+        bool isReady;
+    };
+
+    typedef boost::shared_ptr<State> StatePtr;
+
+public:
+    struct Setter
+    {
+        void operator()(const T& value) const
+        {
+            {
+                boost::lock_guard<boost::mutex> lock(state->mutex);
+                state->value = value;
+                state->isReady = true;
+            }
+
+            state->cv.notify_all();
+        }
+
+        StatePtr state;
+    };
+
+    explicit SyncResult(const T& initialValue)
+        : state_(boost::make_shared<State>(initialValue))
+    {
+    }
+
+    Setter setter() const
+    {
+        Setter rv;
+        rv.state = state_;
+        return rv;
+    }
+
+    T wait() const
+    {
+        boost::unique_lock<boost::mutex> lock(state_->mutex);
+
+        while (!state_->isReady)
+            state_->cv.wait(lock);
+
+        return state_->value;
+    }
+
+private:
+    StatePtr state_;
+};
 
 class Client::Impl
 {
@@ -28,6 +116,13 @@ public:
         , lowSpeedLimit_(0)
         , lowSpeedTime_(0)
         , sslVerifyPeer_(true)
+        , jsonEncoding_(Client::ENCODING_IDENTITY)
+        , jsonEncodingMinSize_(0)
+        , jsonEncodingLevel_(-1)
+        , abortGeneration_(0)
+        , instrumentCache_(boost::posix_time::seconds(0))
+        , httpCache_(DEFAULT_HTTP_CACHE_MAX_ENTRIES)
+        , curlFactory_(boost::make_shared<prism::PoolBasedCurlFactory>(0, CurlShare::getInstance()))
     {
     }
 
@@ -52,8 +147,18 @@ public:
     Status queryAccountsList(Accounts& accounts);
     Status queryAccount(id_t accountId, Account &account);
     Status queryInstrumentsList(id_t accountId, Instruments& instruments);
+    Status queryInstrumentsList(id_t accountId, const InstrumentQuery& query, const std::string& cursor,
+                                Instruments& instruments, std::string& nextCursor);
     Status registerInstrument(id_t accountId, const Instrument& instrument);
 
+    Status findInstrument(id_t accountId, const std::string& name, const std::string& type,
+                          Instrument& instrument);
+
+    void setInstrumentCacheTtlSec(int ttlSec)
+    {
+        instrumentCache_.setTtl(boost::posix_time::seconds(std::max(ttlSec, 0)));
+    }
+
     Status uploadBackground(id_t accountId, id_t instrumentId,
                               const timestamp_t& timestamp, const Payload& payload);
 
@@ -72,11 +177,42 @@ public:
     Status uploadTrack(id_t accountId, id_t instrumentId,
                        const timestamp_t& timestamp, const Tracks& data);
 
+    void uploadBackgroundAsync(id_t accountId, id_t instrumentId,
+                               const timestamp_t& timestamp, const Payload& payload,
+                               const CompletionCallback& callback);
+
+    void uploadFlipbookAsync(id_t accountId, id_t instrumentId,
+                             const Flipbook& flipbook, const Payload& payload,
+                             const CompletionCallback& callback);
+
+    void uploadCountAsync(id_t accountId, id_t instrumentId,
+                          const Counts& data, bool update,
+                          const CompletionCallback& callback);
+
+    void uploadEventAsync(id_t accountId, id_t instrumentId,
+                          const timestamp_t& timestamp, const Events& data,
+                          const CompletionCallback& callback);
+
+    void uploadObjectStreamAsync(id_t accountId, id_t instrumentId,
+                                 const ObjectStream& stream, const Payload& payload,
+                                 const CompletionCallback& callback);
+
+    void uploadTrackAsync(id_t accountId, id_t instrumentId,
+                          const timestamp_t& timestamp, const Tracks& data,
+                          const CompletionCallback& callback);
+
     void setLogFlags(int logFlags)
     {
         logFlags_ = logFlags;
     }
 
+    void setJsonEncoding(Client::ContentEncoding encoding, size_t minSize, int level)
+    {
+        jsonEncoding_ = encoding;
+        jsonEncodingMinSize_ = minSize;
+        jsonEncodingLevel_ = level;
+    }
+
     void setProxy(const std::string& proxy)
     {
         proxy_ = proxy;
@@ -85,10 +221,60 @@ public:
     void setCaBundlePath(const std::string& caBundlePath)
     {
         caBundlePath_ = caBundlePath;
+
+        // if it can't be read now, libCURL will report error on request
+        if (caBundlePath.empty())
+            caBundle_.reset();
+        else
+            caBundle_ = CaBundle::getInstance(caBundlePath);
+    }
+
+    int getRetryAfterSec() const;
+
+    std::string getAccountsUrl() const
+    {
+        return accountsUrl_;
+    }
+
+    RequestMetricsMap getMetrics() const
+    {
+        boost::lock_guard<boost::mutex> lock(metricsMutex_);
+        return metrics_;
+    }
+
+    void setHttpCacheMaxEntries(size_t maxEntries)
+    {
+        httpCache_.setMaxEntries(maxEntries);
+    }
+
+    Client::HttpCacheStatistics getHttpCacheStatistics() const
+    {
+        const HttpValidatorCache::Statistics cacheStatistics = httpCache_.getStatistics();
+
+        Client::HttpCacheStatistics statistics;
+        statistics.numHits = cacheStatistics.numHits;
+        statistics.numMisses = cacheStatistics.numMisses;
+
+        return statistics;
+    }
+
+    void setAccountsUrl(const std::string& accountsUrl)
+    {
+        accountsUrl_ = accountsUrl;
+
+        if (!accountsUrl_.empty()  &&  *accountsUrl_.rbegin() != '/')
+            accountsUrl_.push_back('/');
+    }
+
+    void abortRequests()
+    {
+        ++abortGeneration_;
+        engine_.wakeUp();
     }
 
 private:
     std::string getInstrumentsUrl(id_t accountId) const;
+    std::string getInstrumentsUrl(id_t accountId, const InstrumentQuery& query) const;
     std::string getAccountUrl(id_t accountId) const;
     std::string getInstrumentUrl(id_t accountId, id_t instrumentId) const;
     std::string getVideosUrl(id_t accountId, id_t instrumentId) const;
@@ -97,8 +283,62 @@ private:
 
     CurlSessionPtr createSession();
 
+    // Synchronous request, performed by engine_. Its metrics are recorded
+    // as of operation fname.
+    CURLcode perform(const char* fname, CurlSession& session);
+
+    void recordMetrics(const char* fname, const CurlSession& session, CURLcode res);
+
+    // Starts multipart POST of form prepared in session. Callback is called
+    // with status, once response is received. Response code 201 means success,
+    // as well as altSuccessCode, if non-zero. errorContext is appended to
+    // error message in log.
+    void submitUpload(const char* fname, CurlSessionPtr session,
+                      const std::string& url, const std::string& errorContext,
+                      long altSuccessCode, const CompletionCallback& callback);
+
+    void onUploadComplete(const char* fname, CurlSessionSharedPtr session,
+                          const std::string& url, const std::string& errorContext,
+                          long altSuccessCode, const CompletionCallback& callback,
+                          CURLcode res);
+
+    // Remembers delay, which server asked for by Retry-After header
+    void updateRetryAfter(const CurlSession& session);
+
+    // Makes GET of url conditional, if its result is cached. Call before
+    // prepareHttpGet().
+    void addConditionalHeaders(CurlSession& session, const std::string& url) const;
+
+    // Returns true, if server has replied 304 Not Modified to GET of url
+    // and cached result is taken
+    template <typename T>
+    bool getNotModified(const char* fname, const CurlSession& session, const std::string& url, T& result)
+    {
+        if (session.getResponseCode() != 304  ||  !httpCache_.get(url, result))
+            return false;
+
+        if (logFlags_ & Client::LOG_RESPONSE)
+            LOG(DEBUG) << fname << ": response: 304 Not Modified, cached result is used";
+
+        return true;
+    }
+
+    static HttpValidatorCache::Validators getValidators(const CurlSession& session);
+
+    static void failUpload(const char* fname, const CompletionCallback& callback);
+
+    // Adds JSON form part, compressed according to setJsonEncoding(). Takes
+    // json over.
+    void addJsonFormField(CurlSession& session, CString key, std::string& json) const;
+
     Status parseAccountJson(const rapidjson::Value& itemJson, Account& account);
 
+    Status addAccountJson(const rapidjson::Value& itemJson, Accounts& accounts)
+    {
+        accounts.push_back(Account());
+        return parseAccountJson(itemJson, accounts.back());
+    }
+
     std::string apiRoot_;
     std::string token_;
 
@@ -108,8 +348,38 @@ private:
     long lowSpeedLimit_;
     long lowSpeedTime_;
     bool sslVerifyPeer_;
+    Client::ContentEncoding jsonEncoding_;
+    size_t jsonEncodingMinSize_;
+    int jsonEncodingLevel_;
     std::string proxy_;
     std::string caBundlePath_;
+    // certificates of caBundlePath_ loaded once for all handles
+    CaBundlePtr caBundle_;
+
+    // incremented by abortRequests(), sessions created before that abort
+    boost::atomic<unsigned> abortGeneration_;
+
+    // filled by queryInstrumentsList(), used by findInstrument()
+    InstrumentCache instrumentCache_;
+
+    // results of GET requests, which server may reply 304 to
+    HttpValidatorCache httpCache_;
+
+    // Lives as long as client does. Keeps connections and TLS sessions open
+    // between calls, so that consecutive requests skip DNS lookup, TCP and
+    // TLS handshakes. Its handles share DNS cache and TLS sessions with
+    // other clients too.
+    CurlFactoryPtr curlFactory_;
+
+    mutable boost::mutex metricsMutex_;
+    RequestMetricsMap metrics_; // guarded by metricsMutex_
+
+    mutable boost::mutex retryAfterMutex_;
+    boost::system_time retryAfter_; // guarded by retryAfterMutex_
+
+    // Performs all requests of this client. Declared last to be destroyed
+    // first, as completion handlers may use other members.
+    CurlMultiEngine engine_;
 };
 
 Client::Client(const std::string& apiRoot, const std::string& token)
@@ -161,11 +431,28 @@ Status Client::queryInstrumentsList(id_t accountId, Instruments &instruments)
     return impl().queryInstrumentsList(accountId, instruments);
 }
 
+Status Client::queryInstrumentsList(id_t accountId, const InstrumentQuery& query, const std::string& cursor,
+                                    Instruments& instruments, std::string& nextCursor)
+{
+    return impl().queryInstrumentsList(accountId, query, cursor, instruments, nextCursor);
+}
+
 Status Client::registerInstrument(id_t accountId, const Instrument& instrument)
 {
     return impl().registerInstrument(accountId, instrument);
 }
 
+Status Client::findInstrument(id_t accountId, const std::string& name, const std::string& type,
+                              Instrument& instrument)
+{
+    return impl().findInstrument(accountId, name, type, instrument);
+}
+
+void Client::setInstrumentCacheTtlSec(int ttlSec)
+{
+    impl().setInstrumentCacheTtlSec(ttlSec);
+}
+
 Status Client::uploadBackground(id_t accountId, id_t instrumentId,
                                   const timestamp_t& timestamp, const Payload& payload)
 {
@@ -200,11 +487,58 @@ Status Client::uploadTrack(id_t accountId, id_t instrumentId, const timestamp_t&
     return impl().uploadTrack(accountId, instrumentId, timestamp, data);
 }
 
+void Client::uploadBackgroundAsync(id_t accountId, id_t instrumentId,
+                                   const timestamp_t& timestamp, const Payload& payload,
+                                   CompletionCallback callback)
+{
+    impl().uploadBackgroundAsync(accountId, instrumentId, timestamp, payload, callback);
+}
+
+void Client::uploadObjectStreamAsync(id_t accountId, id_t instrumentId,
+                                     const ObjectStream& stream, const Payload& payload,
+                                     CompletionCallback callback)
+{
+    impl().uploadObjectStreamAsync(accountId, instrumentId, stream, payload, callback);
+}
+
+void Client::uploadFlipbookAsync(id_t accountId, id_t instrumentId,
+                                 const Flipbook& flipbook, const Payload& payload,
+                                 CompletionCallback callback)
+{
+    impl().uploadFlipbookAsync(accountId, instrumentId, flipbook, payload, callback);
+}
+
+void Client::uploadCountAsync(id_t accountId, id_t instrumentId,
+                              const Counts& data, bool update,
+                              CompletionCallback callback)
+{
+    impl().uploadCountAsync(accountId, instrumentId, data, update, callback);
+}
+
+void Client::uploadEventAsync(id_t accountId, id_t instrumentId,
+                              const timestamp_t& timestamp, const Events& data,
+                              CompletionCallback callback)
+{
+    impl().uploadEventAsync(accountId, instrumentId, timestamp, data, callback);
+}
+
+void Client::uploadTrackAsync(id_t accountId, id_t instrumentId,
+                              const timestamp_t& timestamp, const Tracks& data,
+                              CompletionCallback callback)
+{
+    impl().uploadTrackAsync(accountId, instrumentId, timestamp, data, callback);
+}
+
 void Client::setLogFlags(int logFlags)
 {
     impl().setLogFlags(logFlags);
 }
 
+void Client::setJsonEncoding(ContentEncoding encoding, size_t minSize, int level)
+{
+    impl().setJsonEncoding(encoding, minSize, level);
+}
+
 void Client::setProxy(const std::string& proxy)
 {
     impl().setProxy(proxy);
@@ -215,6 +549,41 @@ void Client::setCaBundlePath(const std::string& caBundlePath)
     impl().setCaBundlePath(caBundlePath);
 }
 
+int Client::getRetryAfterSec() const
+{
+    return impl().getRetryAfterSec();
+}
+
+std::string Client::getAccountsUrl() const
+{
+    return impl().getAccountsUrl();
+}
+
+void Client::setAccountsUrl(const std::string& accountsUrl)
+{
+    impl().setAccountsUrl(accountsUrl);
+}
+
+RequestMetricsMap Client::getMetrics() const
+{
+    return impl().getMetrics();
+}
+
+void Client::setHttpCacheMaxEntries(size_t maxEntries)
+{
+    impl().setHttpCacheMaxEntries(maxEntries);
+}
+
+Client::HttpCacheStatistics Client::getHttpCacheStatistics() const
+{
+    return impl().getHttpCacheStatistics();
+}
+
+void Client::abortRequests()
+{
+    impl().abortRequests();
+}
+
 bool hasStringMember(const rapidjson::Value& value, const char* name)
 {
     return value.HasMember(name)  &&  value[name].IsString();
@@ -249,7 +618,9 @@ Status Client::Impl::init()
         CurlSession& session = *sessionPtr;
 
         const std::string& url = apiRoot_;
-        CURLcode res = session.httpGet(url);
+        addConditionalHeaders(session, url);
+        session.prepareHttpGet(url);
+        CURLcode res = perform(fname, session);
 
         if (res != CURLE_OK)
         {
@@ -259,6 +630,12 @@ Status Client::Impl::init()
             break;
         }
 
+        if (getNotModified(fname, session, url, accountsUrl_))
+        {
+            rv = makeSuccess();
+            break;
+        }
+
         long responseCode = session.getResponseCode();
         const std::string& responseBody = session.getResponseBodyAsString();
 
@@ -310,6 +687,7 @@ Status Client::Impl::init()
                          << ", using " << accountsUrl_ << " as accounts URL";
         }
 
+        httpCache_.put(url, getValidators(session), accountsUrl_);
         rv = makeSuccess();
     } while (false);
 
@@ -390,8 +768,19 @@ Status Client::Impl::queryAccountsList(Accounts& accounts)
 
         CurlSession& session = *sessionPtr;
 
+        // Response is parsed as it arrives, unless it's logged as a whole
+        const bool isStreamed = !(logFlags_ & Client::LOG_RESPONSE);
+        Accounts parsedAccounts;
+        JsonArrayReader reader(boost::bind(&Impl::addAccountJson, this, _1, boost::ref(parsedAccounts)));
+
         const std::string& url = accountsUrl_;
-        CURLcode res = session.httpGet(url);
+        addConditionalHeaders(session, url);
+        session.prepareHttpGet(url);
+
+        if (isStreamed)
+            session.setResponseBodySink(&reader);
+
+        CURLcode res = perform(fname, session);
 
         if (res != CURLE_OK)
         {
@@ -401,6 +790,12 @@ Status Client::Impl::queryAccountsList(Accounts& accounts)
             break;
         }
 
+        if (getNotModified(fname, session, url, accounts))
+        {
+            rv = makeSuccess();
+            break;
+        }
+
         long responseCode = session.getResponseCode();
         const std::string& responseBody = session.getResponseBodyAsString();
 
@@ -413,41 +808,23 @@ Status Client::Impl::queryAccountsList(Accounts& accounts)
             break;
         }
 
-        if (logFlags_ & Client::LOG_RESPONSE)
-            LOG(DEBUG) << fname << ": response: " << responseBody;
-
-        rapidjson::Document document;
-
-        if (document.Parse(responseBody.c_str()).HasParseError())
+        if (!isStreamed)
         {
-            LOG(ERROR) << fname << ": error parsing response: '" << responseBody
-                       << "' to GET " << url;
-            rv = makeError();
-            break;
+            LOG(DEBUG) << fname << ": response: " << responseBody;
+            reader.write(responseBody.data(), responseBody.size());
         }
 
-        if (!document.IsArray())
+        rv = reader.finish();
+
+        if (rv.isError())
         {
-            LOG(ERROR) << fname << ": accounts list must be JSON array: '"
-                       << responseBody << "' to GET " << url;
-            rv = makeError();
+            LOG(ERROR) << fname << ": error parsing accounts list in response to GET " << url
+                       << ": " << reader.getErrorMessage();
             break;
         }
 
-        accounts.clear();
-
-        for (rapidjson::SizeType i = 0; i < document.Size(); ++i)
-        {
-            accounts.push_back(Account());
-            rv = parseAccountJson(document[i], accounts.back());
-
-            if (rv.isError())
-            {
-                // parseAccountJson can't log response body, thus logging it here
-                LOG(ERROR) << fname << ": response body: " << responseBody;
-                break;
-            }
-        }
+        accounts.swap(parsedAccounts);
+        httpCache_.put(url, getValidators(session), accounts);
     } while(false);
 
     if (rv.isError())
@@ -480,7 +857,9 @@ Status Client::Impl::queryAccount(id_t accountId, Account& account)
         CurlSession& session = *sessionPtr;
 
         std::string url = getAccountUrl(accountId);
-        CURLcode res = session.httpGet(url);
+        addConditionalHeaders(session, url);
+        session.prepareHttpGet(url);
+        CURLcode res = perform(fname, session);
 
         if (res != CURLE_OK)
         {
@@ -490,6 +869,12 @@ Status Client::Impl::queryAccount(id_t accountId, Account& account)
             break;
         }
 
+        if (getNotModified(fname, session, url, account))
+        {
+            rv = makeSuccess();
+            break;
+        }
+
         long responseCode = session.getResponseCode();
         const std::string& responseBody = session.getResponseBodyAsString();
 
@@ -518,7 +903,12 @@ Status Client::Impl::queryAccount(id_t accountId, Account& account)
         rv = parseAccountJson(document, account);
 
         if (rv.isError())
+        {
             LOG(ERROR) << fname << ": response body " << responseBody;
+            break;
+        }
+
+        httpCache_.put(url, getValidators(session), account);
 
     } while (false);
 
@@ -556,100 +946,162 @@ Status parseInstrumentJson(const rapidjson::Value& itemJson, Instrument& instrum
     return makeSuccess();
 }
 
-Status Client::Impl::queryInstrumentsList(id_t accountId, Instruments& instruments)
+static bool isMatching(const Instrument& instrument, const InstrumentQuery& query)
 {
-    const char* fname = "Client::queryInstrumentsList()";
+    return (query.name.empty()  ||  instrument.name == query.name)
+            &&  (query.type.empty()  ||  instrument.type == query.type);
+}
 
-    if (logFlags_ & Client::LOG_INPUT)
-        LOG(DEBUG) << fname << ": accountId: " << accountId;
+static Status addMatchingInstrumentJson(const rapidjson::Value& itemJson, const InstrumentQuery& query,
+                                        Instruments& instruments)
+{
+    instruments.push_back(Instrument());
+    const Status status = parseInstrumentJson(itemJson, instruments.back());
 
-    Status rv = makeSuccess();
+    if (status.isSuccess()  &&  !isMatching(instruments.back(), query))
+        instruments.pop_back();
 
-    do
+    return status;
+}
+
+// Page of instruments, as it's cached for 304 responses
+struct InstrumentsPage
+{
+    Instruments instruments;
+    std::string nextCursor;
+};
+
+// Page of instruments is either object with "next" and "results" members or
+// plain array, if server doesn't paginate. The latter may be whole list of
+// large account, so it's passed to JsonArrayReader as it arrives. Page
+// object is bounded by page size, it's parsed once complete.
+class InstrumentsPageReader : public ResponseBodySink
+{
+public:
+    explicit InstrumentsPageReader(const JsonArrayReader::ElementCallback& callback)
+        : callback_(callback)
+        , arrayReader_(callback)
+        , isObject_(false)
+        , isFormatKnown_(false)
     {
-        CurlSessionPtr sessionPtr = createSession();
+    }
 
-        if (!sessionPtr)
+    void write(const char* data, size_t size)
+    {
+        if (!isFormatKnown_)
         {
-            LOG(ERROR) << fname << ": failed to create CURL session";
-            rv = makeError();
-            break;
-        }
-
-        CurlSession& session = *sessionPtr;
+            const char* p = data;
 
-        std::string url = getInstrumentsUrl(accountId);
+            while (p < data + size  &&  isspace(*p))
+                ++p;
 
-        CURLcode res = session.httpGet(url);
+            if (p == data + size)
+                return;
 
-        if (res != CURLE_OK)
-        {
-            LOG(ERROR) << fname << ": GET " << url << " failed. "
-                       << "CURLcode: " << res << ", " << curl_easy_strerror(res);
-            rv = makeNetworkError();
-            break;
+            isObject_ = *p == '{';
+            isFormatKnown_ = true;
         }
 
-        long responseCode = session.getResponseCode();
-
-        if (responseCode != 200)
-        {
-            LOG(ERROR) << fname << ": GET " << url << " failed."
-                       << " HTTP response code: " << responseCode;
-            rv = makeError(responseCode, Status::FACILITY_HTTP);
-            break;
-        }
+        if (isObject_)
+            body_.append(data, size);
+        else
+            arrayReader_.write(data, size);
+    }
 
-        const std::string& responseBody = session.getResponseBodyAsString();
+    // Call after the last chunk. Sets nextCursor to URL of the next page,
+    // it's left empty after the last one.
+    Status finish(std::string& nextCursor)
+    {
+        if (!isObject_)
+            return arrayReader_.finish();
 
         rapidjson::Document document;
 
-        if (document.Parse(responseBody.c_str()).HasParseError())
-        {
-            LOG(ERROR) << fname << ": error parsing response: '" << responseBody
-                       << "' to GET " << url;
-            rv = makeError();
-            break;
-        }
-
-        if (!document.IsArray())
+        if (document.Parse(body_.c_str()).HasParseError()  ||  !document.IsObject()
+                ||  !document.HasMember(kStrResults)  ||  !document[kStrResults].IsArray())
         {
-            LOG(ERROR) << fname << ": JSON array expected, got " << responseBody;
-            rv = makeError();
-            break;
+            errorMessage_ = "JSON object with results array expected";
+            return makeError();
         }
 
-        instruments.clear();
+        const rapidjson::Value& results = document[kStrResults];
 
-        for (rapidjson::SizeType i = 0; i < document.Size(); ++i)
+        for (rapidjson::SizeType i = 0; i < results.Size(); ++i)
         {
-            instruments.push_back(Instrument());
-            rv = parseInstrumentJson(document[i], instruments.back());
+            const Status status = callback_(results[i]);
 
-            if (rv.isError())
+            if (status.isError())
             {
-                LOG(ERROR) << fname << ": response body " << responseBody;
-                break;
+                std::ostringstream os;
+                os << "results element " << i << " is rejected";
+                errorMessage_ = os.str();
+
+                return status;
             }
         }
-    } while (false);
-
-    if (rv.isError())
-        LOG(ERROR) << fname << ": " << rv;
 
-    return rv;
-}
+        if (hasStringMember(document, kStrNext))
+            nextCursor = document[kStrNext].GetString();
 
-Status Client::Impl::registerInstrument(id_t accountId, const Instrument& instrument)
-{
-    const char* fname = "Client::registerInstrument()";
+        return makeSuccess();
+    }
 
-    if (logFlags_ & Client::LOG_INPUT)
+    const std::string& getErrorMessage() const
     {
-        LOG(DEBUG) << fname << ": accountId: " << accountId
-                   << ", instrument{id: " << instrument.id
-                   << ", name: " << instrument.name
-                   << ", type: " << instrument.type << "}";
+        return isObject_ ? errorMessage_ : arrayReader_.getErrorMessage();
+    }
+
+private:
+    JsonArrayReader::ElementCallback callback_;
+    JsonArrayReader arrayReader_;
+    bool isObject_;
+    bool isFormatKnown_;
+    std::string body_;
+    std::string errorMessage_;
+};
+
+Status Client::Impl::queryInstrumentsList(id_t accountId, Instruments& instruments)
+{
+    // Server may paginate, even if it isn't asked to, then whole list takes
+    // several requests
+    Instruments allInstruments;
+    std::string cursor;
+
+    do
+    {
+        Instruments page;
+        std::string nextCursor;
+        const Status rv = queryInstrumentsList(accountId, InstrumentQuery(), cursor, page, nextCursor);
+
+        if (rv.isError())
+            return rv;
+
+        if (allInstruments.empty())
+            allInstruments.swap(page);
+        else
+            allInstruments.insert(allInstruments.end(), page.begin(), page.end());
+
+        cursor.swap(nextCursor);
+    } while (!cursor.empty());
+
+    instruments.swap(allInstruments);
+    instrumentCache_.put(accountId, instruments);
+
+    return makeSuccess();
+}
+
+Status Client::Impl::queryInstrumentsList(id_t accountId, const InstrumentQuery& query, const std::string& cursor,
+                                          Instruments& instruments, std::string& nextCursor)
+{
+    const char* fname = "Client::queryInstrumentsList()";
+
+    if (logFlags_ & Client::LOG_INPUT)
+    {
+        LOG(DEBUG) << fname << ": accountId: " << accountId
+                   << ", query{name: " << query.name
+                   << ", type: " << query.type
+                   << ", pageSize: " << query.pageSize << "}"
+                   << ", cursor: " << cursor;
     }
 
     Status rv = makeSuccess();
@@ -666,36 +1118,85 @@ Status Client::Impl::registerInstrument(id_t accountId, const Instrument& instru
         }
 
         CurlSession& session = *sessionPtr;
-        std::string url = getInstrumentsUrl(accountId);
-        session.addHeader("Content-Type: application/json");
-        std::string json = toJsonString(instrument);
 
-        if (logFlags_ & Client::LOG_INPUT_JSON)
-        {
-            LOG(DEBUG) << fname << ": instrument JSON: " << json;
-        }
+        // Response is parsed as it arrives, unless it's logged as a whole.
+        // List of large account is megabytes, its DOM is several times more.
+        const bool isStreamed = !(logFlags_ & Client::LOG_RESPONSE);
+        Instruments parsedInstruments;
+        InstrumentsPageReader reader(boost::bind(addMatchingInstrumentJson, _1, boost::cref(query),
+                                                 boost::ref(parsedInstruments)));
 
-        CURLcode res = session.httpPost(url, json);
+        // cursor is URL of the next page, as server has returned it
+        std::string url = cursor.empty() ? getInstrumentsUrl(accountId, query) : cursor;
+
+        addConditionalHeaders(session, url);
+        session.prepareHttpGet(url);
+
+        if (isStreamed)
+            session.setResponseBodySink(&reader);
+
+        CURLcode res = perform(fname, session);
 
         if (res != CURLE_OK)
         {
-            LOG(ERROR) << fname << ": POST " << url << " failed. "
+            LOG(ERROR) << fname << ": GET " << url << " failed. "
                        << "CURLcode: " << res << ", " << curl_easy_strerror(res);
             rv = makeNetworkError();
             break;
         }
 
+        InstrumentsPage page;
+
+        if (getNotModified(fname, session, url, page))
+        {
+            instruments.swap(page.instruments);
+            nextCursor.swap(page.nextCursor);
+            rv = makeSuccess();
+            break;
+        }
+
         long responseCode = session.getResponseCode();
 
-        if (responseCode != 201)
+        if (responseCode != 200)
         {
-            LOG(ERROR) << fname << ": POST " << url << " failed."
+            LOG(ERROR) << fname << ": GET " << url << " failed."
                        << " HTTP response code: " << responseCode;
             rv = makeError(responseCode, Status::FACILITY_HTTP);
             break;
         }
 
-        rv = makeSuccess();
+        if (!isStreamed)
+        {
+            const std::string& responseBody = session.getResponseBodyAsString();
+
+            LOG(DEBUG) << fname << ": response: " << responseBody;
+            reader.write(responseBody.data(), responseBody.size());
+        }
+
+        std::string parsedNextCursor;
+        rv = reader.finish(parsedNextCursor);
+
+        if (rv.isError())
+        {
+            LOG(ERROR) << fname << ": error parsing instruments list in response to GET " << url
+                       << ": " << reader.getErrorMessage();
+            break;
+        }
+
+        // server, which ignores cursor, would be queried forever
+        if (parsedNextCursor == url)
+        {
+            LOG(ERROR) << fname << ": response to GET " << url << " refers to itself as the next page";
+            rv = makeError();
+            break;
+        }
+
+        page.instruments.swap(parsedInstruments);
+        page.nextCursor.swap(parsedNextCursor);
+        httpCache_.put(url, getValidators(session), page);
+
+        instruments.swap(page.instruments);
+        nextCursor.swap(page.nextCursor);
     } while (false);
 
     if (rv.isError())
@@ -704,54 +1205,43 @@ Status Client::Impl::registerInstrument(id_t accountId, const Instrument& instru
     return rv;
 }
 
-Status Client::Impl::uploadBackground(id_t accountId, id_t instrumentId,
-                                        const timestamp_t& timestamp, const Payload& payload)
+Status Client::Impl::registerInstrument(id_t accountId, const Instrument& instrument)
 {
-    const char* fname = "Client::uploadBackground()";
+    const char* fname = "Client::registerInstrument()";
 
     if (logFlags_ & Client::LOG_INPUT)
     {
         LOG(DEBUG) << fname << ": accountId: " << accountId
-                   << ", instrumentId: " << instrumentId
-                   << ", timestamp: " << toIsoTimeString(timestamp)
-                   << ", " << toString(payload);
+                   << ", instrument{id: " << instrument.id
+                   << ", name: " << instrument.name
+                   << ", type: " << instrument.type << "}";
     }
 
     Status rv = makeSuccess();
 
     do
     {
-        CurlSessionPtr session = createSession();
+        CurlSessionPtr sessionPtr = createSession();
 
-        if (!session)
+        if (!sessionPtr)
         {
             LOG(ERROR) << fname << ": failed to create CURL session";
             rv = makeError();
             break;
         }
 
-        CurlSession* cs = session.get();
-
-        // -F "key=BACKGROUND"
-        // -F "timestamp=2016-08-17T00:00:00"
-        // -F "data=@/path/to/image.png;type=image/png"
-        cs->addFormField(kStrKey, kStrBACKGROUND);
-        cs->addFormField(kStrTimestamp, toIsoTimeString(timestamp));
-
-        size_t payloadDataSize = payload.dataSize;
+        CurlSession& session = *sessionPtr;
+        std::string url = getInstrumentsUrl(accountId);
+        session.addHeader("Content-Type: application/json");
+        std::string json = toJsonString(instrument);
 
-        if (payload.data)
-            cs->addFormFile(kStrData, payload.data, payload.dataSize, payload.mimeType);
-        else
+        if (logFlags_ & Client::LOG_INPUT_JSON)
         {
-            std::string mimeType = mimeTypeFromFilePath(payload.fileName);
-            cs->addFormFile(kStrData, payload.fileName, mimeType);
-            payloadDataSize = boost::filesystem::file_size(payload.fileName);
+            LOG(DEBUG) << fname << ": instrument JSON: " << json;
         }
 
-        std::string url = getImagesUrl(accountId, instrumentId);
-
-        CURLcode res = cs->httpPostForm(url);
+        session.prepareHttpPost(url, json);
+        CURLcode res = perform(fname, session);
 
         if (res != CURLE_OK)
         {
@@ -761,112 +1251,196 @@ Status Client::Impl::uploadBackground(id_t accountId, id_t instrumentId,
             break;
         }
 
-        long responseCode = cs->getResponseCode();
+        long responseCode = session.getResponseCode();
 
         if (responseCode != 201)
         {
             LOG(ERROR) << fname << ": POST " << url << " failed."
-                       << " HTTP response code: " << responseCode
-                       << ", error message: " << cs->getErrorMessage()
-                       << ", payloadDataSize: " << payloadDataSize;
+                       << " HTTP response code: " << responseCode;
             rv = makeError(responseCode, Status::FACILITY_HTTP);
             break;
         }
 
+        // Cached list stays valid, if server has returned new instrument,
+        // otherwise it's fetched again by next lookup
+        rapidjson::Document document;
+        Instrument registered;
+
+        if (!document.Parse(session.getResponseBodyAsString().c_str()).HasParseError()
+                &&  document.IsObject()
+                &&  hasIntMember(document, kStrId)
+                &&  hasStringMember(document, kStrName))
+        {
+            parseInstrumentJson(document, registered);
+            instrumentCache_.add(accountId, registered);
+        }
+        else
+        {
+            instrumentCache_.invalidate(accountId);
+        }
+
         rv = makeSuccess();
     } while (false);
 
     if (rv.isError())
+    {
         LOG(ERROR) << fname << ": " << rv;
 
+        // instrument may be registered, even if response is lost
+        instrumentCache_.invalidate(accountId);
+    }
+
     return rv;
 }
 
-Status Client::Impl::uploadFlipbook(id_t accountId, id_t instrumentId,
-                                      const Flipbook& flipbook, const Payload& payload)
+Status Client::Impl::findInstrument(id_t accountId, const std::string& name, const std::string& type,
+                                    Instrument& instrument)
 {
-    const char* fname = "Client::uploadFlipbook()";
+    const char* fname = "Client::findInstrument()";
+
+    if (logFlags_ & Client::LOG_INPUT)
+        LOG(DEBUG) << fname << ": accountId: " << accountId << ", name: " << name << ", type: " << type;
+
+    if (instrumentCache_.find(accountId, name, type, instrument))
+        return makeSuccess();
+
+    bool isFound = false;
+    InstrumentQuery query;
+    query.name = name;
+    query.type = type;
+    query.pageSize = FIND_INSTRUMENT_PAGE_SIZE;
+
+    std::string cursor;
+
+    do
+    {
+        Instruments instruments;
+        std::string nextCursor;
+        const Status status = queryInstrumentsList(accountId, query, cursor, instruments, nextCursor);
+
+        if (status.isError())
+            return status;
+
+        // the first one wins, as in whole list
+        isFound = !instruments.empty();
+
+        if (isFound)
+            instrument = instruments.front();
+
+        cursor.swap(nextCursor);
+    } while (!isFound  &&  !cursor.empty());
+
+    if (!isFound)
+        return makeError(Status::NOT_FOUND);
+
+    instrumentCache_.add(accountId, instrument);
+
+    return makeSuccess();
+}
+
+void Client::Impl::uploadBackgroundAsync(id_t accountId, id_t instrumentId,
+                                         const timestamp_t& timestamp, const Payload& payload,
+                                         const CompletionCallback& callback)
+{
+    const char* fname = "Client::uploadBackground()";
 
     if (logFlags_ & Client::LOG_INPUT)
     {
         LOG(DEBUG) << fname << ": accountId: " << accountId
                    << ", instrumentId: " << instrumentId
-                   << ", " << toString(flipbook)
+                   << ", timestamp: " << toIsoTimeString(timestamp)
                    << ", " << toString(payload);
     }
 
-    Status rv = makeSuccess();
+    CurlSessionPtr session = createSession();
 
-    do
+    if (!session)
     {
-        CurlSessionPtr session = createSession();
+        failUpload(fname, callback);
+        return;
+    }
 
-        if (!session)
-        {
-            LOG(ERROR) << fname << ": failed to create CURL session";
-            rv = makeError();
-            break;
-        }
+    CurlSession* cs = session.get();
 
-        CurlSession* cs = session.get();
+    // -F "key=BACKGROUND"
+    // -F "timestamp=2016-08-17T00:00:00"
+    // -F "data=@/path/to/image.png;type=image/png"
+    cs->addFormField(kStrKey, kStrBACKGROUND);
+    cs->addFormField(kStrTimestamp, toIsoTimeString(timestamp));
 
-        cs->addFormField(kStrKey, kStrFLIPBOOK);
-        cs->addFormField(kStrStartTimestamp, toIsoTimeString(flipbook.startTimestamp));
-        cs->addFormField(kStrStopTimestamp, toIsoTimeString(flipbook.stopTimestamp));
+    size_t payloadDataSize = payload.dataSize;
 
-        std::string mimeType = payload.data
-                ? payload.mimeType
-                : mimeTypeFromFilePath(payload.fileName);
+    if (payload.data)
+        cs->addFormFile(kStrData, payload.data, payload.dataSize, payload.mimeType, payload.fileName);
+    else
+    {
+        std::string mimeType = mimeTypeFromFilePath(payload.fileName);
+        cs->addFormFile(kStrData, payload.fileName, mimeType);
+        payloadDataSize = boost::filesystem::file_size(payload.fileName);
+    }
 
-        size_t payloadDataSize = payload.dataSize;
+    std::string url = getImagesUrl(accountId, instrumentId);
 
-        if (payload.data)
-            cs->addFormFile(kStrData, payload.data, payload.dataSize, mimeType);
-        else
-        {
-            cs->addFormFile(kStrData, payload.fileName, mimeType);
-            payloadDataSize = boost::filesystem::file_size(payload.fileName);
-        }
+    submitUpload(fname, boost::move(session), url,
+                 (boost::format(", payloadDataSize: %d") % payloadDataSize).str(), 0, callback);
+}
 
-        cs->addFormField(kStrWidth, toString(flipbook.width));
-        cs->addFormField(kStrHeight, toString(flipbook.height));
-        cs->addFormField(kStrNumberOfFrames, toString(flipbook.numberOfFrames));
-        cs->addFormField(kStrContentType, mimeType);
+void Client::Impl::uploadFlipbookAsync(id_t accountId, id_t instrumentId,
+                                       const Flipbook& flipbook, const Payload& payload,
+                                       const CompletionCallback& callback)
+{
+    const char* fname = "Client::uploadFlipbook()";
+
+    if (logFlags_ & Client::LOG_INPUT)
+    {
+        LOG(DEBUG) << fname << ": accountId: " << accountId
+                   << ", instrumentId: " << instrumentId
+                   << ", " << toString(flipbook)
+                   << ", " << toString(payload);
+    }
 
-        std::string url = getVideosUrl(accountId, instrumentId);
+    CurlSessionPtr session = createSession();
 
-        CURLcode res = cs->httpPostForm(url);
+    if (!session)
+    {
+        failUpload(fname, callback);
+        return;
+    }
 
-        if (res != CURLE_OK)
-        {
-            LOG(ERROR) << fname << ": POST " << url << " failed. "
-                       << "CURLcode: " << res << ", " << curl_easy_strerror(res);
-            rv = makeNetworkError();
-            break;
-        }
+    CurlSession* cs = session.get();
 
-        long responseCode = cs->getResponseCode();
+    cs->addFormField(kStrKey, kStrFLIPBOOK);
+    cs->addFormField(kStrStartTimestamp, toIsoTimeString(flipbook.startTimestamp));
+    cs->addFormField(kStrStopTimestamp, toIsoTimeString(flipbook.stopTimestamp));
 
-        if (responseCode != 201)
-        {
-            LOG(ERROR) << fname << ": POST " << url << " failed. "
-                       << " HTTP response code: " << responseCode
-                       << ", error message: " << cs->getErrorMessage()
-                       << ", payloadDataSize: " << payloadDataSize;;
-            rv = makeError(responseCode, Status::FACILITY_HTTP);
-            break;
-        }
+    std::string mimeType = payload.data
+            ? payload.mimeType
+            : mimeTypeFromFilePath(payload.fileName);
 
-        rv = makeSuccess();
-    } while (false);
+    size_t payloadDataSize = payload.dataSize;
 
-    if (rv.isError())
-        LOG(ERROR) << fname << ": " << rv;
+    if (payload.data)
+        cs->addFormFile(kStrData, payload.data, payload.dataSize, mimeType, payload.fileName);
+    else
+    {
+        cs->addFormFile(kStrData, payload.fileName, mimeType);
+        payloadDataSize = boost::filesystem::file_size(payload.fileName);
+    }
 
-    return rv;
+    cs->addFormField(kStrWidth, toString(flipbook.width));
+    cs->addFormField(kStrHeight, toString(flipbook.height));
+    cs->addFormField(kStrNumberOfFrames, toString(flipbook.numberOfFrames));
+    cs->addFormField(kStrContentType, mimeType);
+
+    std::string url = getVideosUrl(accountId, instrumentId);
+
+    submitUpload(fname, boost::move(session), url,
+                 (boost::format(", payloadDataSize: %d") % payloadDataSize).str(), 0, callback);
 }
 
-Status Client::Impl::uploadCount(id_t accountId, id_t instrumentId, const Counts& data, bool update)
+void Client::Impl::uploadCountAsync(id_t accountId, id_t instrumentId,
+                                    const Counts& data, bool update,
+                                    const CompletionCallback& callback)
 {
     const char* fname = "Client::uploadCount()";
 
@@ -878,71 +1452,40 @@ Status Client::Impl::uploadCount(id_t accountId, id_t instrumentId, const Counts
                    << ", update = " << update;
     }
 
-    Status rv = makeSuccess();
+    CurlSessionPtr session = createSession();
 
-    do
+    if (!session)
     {
-        CurlSessionPtr session = createSession();
-
-        if (!session)
-        {
-            LOG(ERROR) << fname << ": failed to create CURL session";
-            rv = makeError();
-            break;
-        }
-
-        CurlSession* cs = session.get();
-
-        // -F "key=COUNT"
-        cs->addFormField(kStrKey, kStrCOUNT);
-
-        // -F "update=true|false"
-        cs->addFormField(kStrUpdate, update ? kStrTrue : kStrFalse);
-
-        // -F "data=<json_as_std::string>;type=application/json"
-        std::string json = toJsonString(data);
-
-        if (logFlags_ & Client::LOG_INPUT_JSON)
-        {
-            LOG(DEBUG) << fname << ": counts JSON: " << json;
-        }
-
-        cs->addFormField(kStrData, json, "application/json");
+        failUpload(fname, callback);
+        return;
+    }
 
-        std::string url = getTimeSeriesUrl(accountId, instrumentId);
+    CurlSession* cs = session.get();
 
-        CURLcode res = cs->httpPostForm(url);
+    // -F "key=COUNT"
+    cs->addFormField(kStrKey, kStrCOUNT);
 
-        if (res != CURLE_OK)
-        {
-            LOG(ERROR) << fname << ": POST " << url << " failed. "
-                       << "CURLcode: " << res << ", " << curl_easy_strerror(res);
-            rv = makeNetworkError();
-            break;
-        }
+    // -F "update=true|false"
+    cs->addFormField(kStrUpdate, update ? kStrTrue : kStrFalse);
 
-        long responseCode = cs->getResponseCode();
+    // -F "data=<json_as_std::string>;type=application/json"
+    std::string json = toJsonString(data);
 
-        if (responseCode != 201)
-        {
-            LOG(ERROR) << fname << ": POST " << url << " failed. "
-                       << " HTTP response code: " << responseCode
-                       << ", error message: " << cs->getErrorMessage();
-            rv = makeError(responseCode, Status::FACILITY_HTTP);
-            break;
-        }
+    if (logFlags_ & Client::LOG_INPUT_JSON)
+    {
+        LOG(DEBUG) << fname << ": counts JSON: " << json;
+    }
 
-        rv = makeSuccess();
-    } while (false);
+    addJsonFormField(*cs, kStrData, json);
 
-    if (rv.isError())
-        LOG(ERROR) << fname << ": " << rv;
+    std::string url = getTimeSeriesUrl(accountId, instrumentId);
 
-    return rv;
+    submitUpload(fname, boost::move(session), url, std::string(), 0, callback);
 }
 
-Status Client::Impl::uploadEvent(id_t accountId, id_t instrumentId,
-                                   const timestamp_t& timestamp, const Events& data)
+void Client::Impl::uploadEventAsync(id_t accountId, id_t instrumentId,
+                                    const timestamp_t& timestamp, const Events& data,
+                                    const CompletionCallback& callback)
 {
     const char* fname = "Client::uploadEvent()";
 
@@ -954,217 +1497,392 @@ Status Client::Impl::uploadEvent(id_t accountId, id_t instrumentId,
                    << ", " << toString(data);
     }
 
-    Status rv = makeSuccess();
+    CurlSessionPtr session = createSession();
 
-    do
+    if (!session)
     {
-        CurlSessionPtr session = createSession();
+        failUpload(fname, callback);
+        return;
+    }
 
-        if (!session)
-        {
-            LOG(ERROR) << fname << ": failed to create CURL session";
-            rv = makeError();
-            break;
-        }
+    CurlSession* cs = session.get();
 
-        CurlSession* cs = session.get();
+    // -F "key=EVENT"
+    cs->addFormField(kStrKey, kStrEVENT);
 
-        // -F "key=EVENT"
-        cs->addFormField(kStrKey, kStrEVENT);
+    // -F "timestamp=2016-08-17T00:00:00"
+    cs->addFormField(kStrTimestamp, toIsoTimeString(timestamp));
 
-        // -F "timestamp=2016-08-17T00:00:00"
-        cs->addFormField(kStrTimestamp, toIsoTimeString(timestamp));
+    // -F "data=<json_as_std::string>;type=application/json"
+    std::string json = toJsonString(data);
 
-        // -F "data=<json_as_std::string>;type=application/json"
-        std::string json = toJsonString(data);
+    if (logFlags_ & Client::LOG_INPUT_JSON)
+    {
+        LOG(DEBUG) << fname << ": events JSON: " << json;
+    }
 
-        if (logFlags_ & Client::LOG_INPUT_JSON)
-        {
-            LOG(DEBUG) << fname << ": events JSON: " << json;
-        }
+    addJsonFormField(*cs, kStrData, json);
+
+    std::string url = getTimeSeriesUrl(accountId, instrumentId);
+
+    submitUpload(fname, boost::move(session), url, std::string(), 0, callback);
+}
 
-        cs->addFormField(kStrData, json, "application/json");
+void Client::Impl::uploadObjectStreamAsync(id_t accountId, id_t instrumentId,
+                                           const ObjectStream& stream, const Payload& payload,
+                                           const CompletionCallback& callback)
+{
+    const char* fname = "Client::uploadObjectStream()";
 
-        std::string url = getTimeSeriesUrl(accountId, instrumentId);
+    if (logFlags_ & Client::LOG_INPUT)
+    {
+        LOG(DEBUG) << fname << ": accountId: " << accountId
+                   << ", instrumentId: " << instrumentId
+                   << ", " << toString(stream)
+                   << ", " << toString(payload);
+    }
 
-        CURLcode res = cs->httpPostForm(url);
+    CurlSessionPtr session = createSession();
 
-        if (res != CURLE_OK)
-        {
-            LOG(ERROR) << fname << ": POST " << url << " failed. "
-                       << "CURLcode: " << res << ", " << curl_easy_strerror(res);
-            rv = makeNetworkError();
-            break;
-        }
+    if (!session)
+    {
+        failUpload(fname, callback);
+        return;
+    }
 
-        long responseCode = cs->getResponseCode();
+    CurlSession* cs = session.get();
 
-        if (responseCode != 201)
-        {
-            LOG(ERROR) << fname << ": POST " << url << " failed. "
-                       << " HTTP response code: " << responseCode
-                       << ", error message: " << cs->getErrorMessage();
-            rv = makeError(cs->getResponseCode(), Status::FACILITY_HTTP);
-            break;
-        }
+    cs->addFormField(kStrKey, kStrOBJECT_STREAM);
 
-        rv = makeSuccess();
-    } while (false);
+    std::string json = toJsonString(stream);
 
-    if (rv.isError())
-        LOG(ERROR) << fname << ": " << rv;
+    if (logFlags_ & Client::LOG_INPUT_JSON)
+    {
+        LOG(DEBUG) << fname << ": obj stream JSON: " << json;
+    }
 
-    return rv;
+    cs->addFormField(kStrMeta, move_ref<std::string>(json), "application/json");
+
+    if (payload.data)
+        cs->addFormFile(kStrData, payload.data, payload.dataSize, payload.mimeType, payload.fileName);
+    else
+    {
+        std::string mimeType = mimeTypeFromFilePath(payload.fileName);
+        cs->addFormFile(kStrData, payload.fileName.c_str(), mimeType);
+    }
+
+    std::string url = getImagesUrl(accountId, instrumentId);
+
+    // object stream is also accepted with 200
+    submitUpload(fname, boost::move(session), url, std::string(), 200, callback);
 }
 
-Status Client::Impl::uploadObjectStream(id_t accountId, id_t instrumentId,
-                                          const ObjectStream& stream, const Payload& payload)
+void Client::Impl::uploadTrackAsync(id_t accountId, id_t instrumentId,
+                                    const timestamp_t& timestamp, const Tracks& data,
+                                    const CompletionCallback& callback)
 {
-    const char* fname = "Client::uploadObjectStream()";
+    const char* fname = "Client::uploadTrack()";
 
     if (logFlags_ & Client::LOG_INPUT)
     {
         LOG(DEBUG) << fname << ": accountId: " << accountId
                    << ", instrumentId: " << instrumentId
-                   << ", " << toString(stream)
-                   << ", " << toString(payload);
+                   << ", timestamp: " << toIsoTimeString(timestamp)
+                   << ", " << toString(data);
     }
 
-    Status rv = makeSuccess();
+    CurlSessionPtr session = createSession();
 
-    do
+    if (!session)
     {
-        CurlSessionPtr session = createSession();
+        failUpload(fname, callback);
+        return;
+    }
 
-        if (!session)
-        {
-            LOG(ERROR) << fname << ": failed to create CURL session";
-            rv = makeError();
-            break;
-        }
+    CurlSession* cs = session.get();
 
-        CurlSession* cs = session.get();
+    // -F "key=TRACK"
+    cs->addFormField(kStrKey, kStrTRACK);
 
-        cs->addFormField(kStrKey, kStrOBJECT_STREAM);
+    // -F "timestamp=2016-08-17T00:00:00"
+    cs->addFormField(kStrTimestamp, toIsoTimeString(timestamp));
 
-        std::string json = toJsonString(stream);
+    // -F "data=<json_as_std::string>;type=application/json"
+    std::string json = toJsonString(data);
 
-        if (logFlags_ & Client::LOG_INPUT_JSON)
-        {
-            LOG(DEBUG) << fname << ": obj stream JSON: " << json;
-        }
+    if (logFlags_ & Client::LOG_INPUT_JSON)
+        LOG(DEBUG) << fname << ": tracks JSON: " << json;
 
-        cs->addFormField(kStrMeta, json, "application/json");
+    addJsonFormField(*cs, kStrData, json);
 
-        if (payload.data)
-            cs->addFormFile(kStrData, payload.data, payload.dataSize, payload.mimeType);
-        else
-        {
-            std::string mimeType = mimeTypeFromFilePath(payload.fileName);
-            cs->addFormFile(kStrData, payload.fileName.c_str(), mimeType);
-        }
+    std::string url = getTimeSeriesUrl(accountId, instrumentId);
 
-        std::string url = getImagesUrl(accountId, instrumentId);
-
-        CURLcode res = cs->httpPostForm(url);
-
-        if (res != CURLE_OK)
-        {
-            LOG(ERROR) << fname << ": POST " << url << " failed. "
-                       << "CURLcode: " << res << ", " << curl_easy_strerror(res);
-            rv = makeNetworkError();
-            break;
-        }
+    submitUpload(fname, boost::move(session), url, std::string(), 0, callback);
+}
 
-        long responseCode = cs->getResponseCode();
+Status Client::Impl::uploadBackground(id_t accountId, id_t instrumentId,
+                                      const timestamp_t& timestamp, const Payload& payload)
+{
+    SyncResult<Status> result(makeSuccess());
+    uploadBackgroundAsync(accountId, instrumentId, timestamp, payload, result.setter());
+    return result.wait();
+}
 
-        if (responseCode != 201 && responseCode != 200)
-        {
-            LOG(ERROR) << fname << ": POST " << url << " failed. "
-                       << " HTTP response code: " << responseCode
-                       << ", error message: " << cs->getErrorMessage();
-            rv = makeError(responseCode, Status::FACILITY_HTTP);
-            break;
-        }
+Status Client::Impl::uploadFlipbook(id_t accountId, id_t instrumentId,
+                                    const Flipbook& flipbook, const Payload& payload)
+{
+    SyncResult<Status> result(makeSuccess());
+    uploadFlipbookAsync(accountId, instrumentId, flipbook, payload, result.setter());
+    return result.wait();
+}
 
-        rv = makeSuccess();
-    } while (false);
+Status Client::Impl::uploadCount(id_t accountId, id_t instrumentId, const Counts& data, bool update)
+{
+    SyncResult<Status> result(makeSuccess());
+    uploadCountAsync(accountId, instrumentId, data, update, result.setter());
+    return result.wait();
+}
 
-    if (rv.isError())
-        LOG(ERROR) << fname << ": " << rv;
+Status Client::Impl::uploadEvent(id_t accountId, id_t instrumentId,
+                                 const timestamp_t& timestamp, const Events& data)
+{
+    SyncResult<Status> result(makeSuccess());
+    uploadEventAsync(accountId, instrumentId, timestamp, data, result.setter());
+    return result.wait();
+}
 
-    return rv;
+Status Client::Impl::uploadObjectStream(id_t accountId, id_t instrumentId,
+                                        const ObjectStream& stream, const Payload& payload)
+{
+    SyncResult<Status> result(makeSuccess());
+    uploadObjectStreamAsync(accountId, instrumentId, stream, payload, result.setter());
+    return result.wait();
 }
 
 Status Client::Impl::uploadTrack(id_t accountId, id_t instrumentId,
                                  const timestamp_t& timestamp, const Tracks& data)
 {
-    const char* fname = "Client::uploadTrack()";
+    SyncResult<Status> result(makeSuccess());
+    uploadTrackAsync(accountId, instrumentId, timestamp, data, result.setter());
+    return result.wait();
+}
 
-    if (logFlags_ & Client::LOG_INPUT)
+CURLcode Client::Impl::perform(const char* fname, CurlSession& session)
+{
+    CURLcode res = CURLE_OK;
+
+    // called from completion callback, waiting for engine here would deadlock
+    if (engine_.isEngineThread())
     {
-        LOG(DEBUG) << fname << ": accountId: " << accountId
-                   << ", instrumentId: " << instrumentId
-                   << ", timestamp: " << toIsoTimeString(timestamp)
-                   << ", " << toString(data);
+        res = session.perform();
     }
+    else
+    {
+        SyncResult<CURLcode> result(CURLE_OK);
+        engine_.submit(session, result.setter());
+        res = result.wait();
+    }
+
+    recordMetrics(fname, session, res);
+
+    return res;
+}
+
+static uint64_t toMicroseconds(double seconds)
+{
+    return seconds > 0 ? uint64_t(seconds * 1e6 + 0.5) : 0;
+}
+
+void Client::Impl::recordMetrics(const char* fname, const CurlSession& session, CURLcode res)
+{
+    const RequestTimings& timings = session.getTimings();
+    const long responseCode = session.getResponseCode();
+
+    // phases are cumulative in timings, durations of their own are recorded
+    const double connectTime = std::max(timings.connectTime, timings.nameLookupTime);
+    const double tlsTime = timings.appConnectTime > 0 ? timings.appConnectTime - connectTime : 0;
+
+    boost::lock_guard<boost::mutex> lock(metricsMutex_);
+    RequestMetrics& metrics = metrics_[fname];
+
+    ++metrics.numRequests;
+
+    if (res != CURLE_OK  ||  responseCode >= 400)
+        ++metrics.numFailed;
+
+    if (timings.numConnects > 0)
+        ++metrics.numNewConnections;
+
+    metrics.numBytesUploaded += uint64_t(timings.sizeUpload);
+    metrics.numBytesDownloaded += uint64_t(timings.sizeDownload);
+
+    metrics.nameLookup.record(toMicroseconds(timings.nameLookupTime));
+    metrics.connect.record(toMicroseconds(connectTime - timings.nameLookupTime));
+    metrics.tlsHandshake.record(toMicroseconds(tlsTime));
+    metrics.timeToFirstByte.record(toMicroseconds(timings.startTransferTime));
+    metrics.total.record(toMicroseconds(timings.totalTime));
+}
+
+void Client::Impl::submitUpload(const char* fname, CurlSessionPtr sessionPtr,
+                                const std::string& url, const std::string& errorContext,
+                                long altSuccessCode, const CompletionCallback& callback)
+{
+    // shared, as it is owned by completion handler, which is copied around
+    CurlSessionSharedPtr session(sessionPtr.release());
+    session->prepareHttpPostForm(url);
+
+    CurlMultiEngine::CompletionHandler handler
+            = boost::bind(&Impl::onUploadComplete, this, fname, session, url, errorContext,
+                          altSuccessCode, callback, _1);
+
+    if (engine_.isEngineThread())
+    {
+        handler(session->perform());
+        return;
+    }
+
+    engine_.submit(*session, handler);
+}
+
+void Client::Impl::onUploadComplete(const char* fname, CurlSessionSharedPtr session,
+                                    const std::string& url, const std::string& errorContext,
+                                    long altSuccessCode, const CompletionCallback& callback,
+                                    CURLcode res)
+{
+    recordMetrics(fname, *session, res);
 
     Status rv = makeSuccess();
+    long responseCode = session->getResponseCode();
 
-    do
+    if (res != CURLE_OK)
+    {
+        LOG(ERROR) << fname << ": POST " << url << " failed. "
+                   << "CURLcode: " << res << ", " << curl_easy_strerror(res);
+        rv = makeNetworkError();
+    }
+    else if (responseCode != 201  &&  (altSuccessCode == 0  ||  responseCode != altSuccessCode))
+    {
+        LOG(ERROR) << fname << ": POST " << url << " failed. "
+                   << " HTTP response code: " << responseCode
+                   << ", error message: " << session->getErrorMessage()
+                   << errorContext;
+        rv = makeError(responseCode, Status::FACILITY_HTTP);
+
+        if (responseCode == 429  ||  responseCode == 503)
+            updateRetryAfter(*session);
+    }
+
+    if (rv.isError())
+        LOG(ERROR) << fname << ": " << rv;
+
+    if (callback)
+        callback(rv);
+}
+
+void Client::Impl::updateRetryAfter(const CurlSession& session)
+{
+    const std::string value = session.getResponseHeader(kStrRetryAfter);
+
+    if (value.empty())
+        return;
+
+    // Retry-After is either number of seconds or HTTP date
+    long delaySec = 0;
+
+    if (value.find_first_not_of("0123456789") == std::string::npos)
+        delaySec = atol(value.c_str());
+    else
     {
-        CurlSessionPtr session = createSession();
+        const time_t retryTime = curl_getdate(value.c_str(), NULL);
 
-        if (!session)
+        if (retryTime < 0)
         {
-            LOG(ERROR) << fname << ": failed to create CURL session";
-            rv = makeError();
-            break;
+            LOG(WARNING) << "Unable to parse Retry-After header: " << value;
+            return;
         }
 
-        CurlSession* cs = session.get();
+        delaySec = retryTime - time(NULL);
+    }
 
-        // -F "key=TRACK"
-        cs->addFormField(kStrKey, kStrTRACK);
+    if (delaySec <= 0)
+        return;
 
-        // -F "timestamp=2016-08-17T00:00:00"
-        cs->addFormField(kStrTimestamp, toIsoTimeString(timestamp));
+    boost::lock_guard<boost::mutex> lock(retryAfterMutex_);
+    retryAfter_ = boost::get_system_time() + boost::posix_time::seconds(delaySec);
+}
 
-        // -F "data=<json_as_std::string>;type=application/json"
-        std::string json = toJsonString(data);
+int Client::Impl::getRetryAfterSec() const
+{
+    boost::system_time retryAfter;
 
-        if (logFlags_ & Client::LOG_INPUT_JSON)
-            LOG(DEBUG) << fname << ": tracks JSON: " << json;
+    {
+        boost::lock_guard<boost::mutex> lock(retryAfterMutex_);
+        retryAfter = retryAfter_;
+    }
 
-        cs->addFormField(kStrData, json, "application/json");
+    const boost::system_time now = boost::get_system_time();
 
-        std::string url = getTimeSeriesUrl(accountId, instrumentId);
+    if (retryAfter.is_not_a_date_time()  ||  retryAfter <= now)
+        return 0;
 
-        CURLcode res = cs->httpPostForm(url);
+    // rounded up, so that caller doesn't come back too early
+    return ((retryAfter - now).total_milliseconds() + 999) / 1000;
+}
 
-        if (res != CURLE_OK)
-        {
-            LOG(ERROR) << fname << ": POST " << url << " failed. "
-                       << "CURLcode: " << res << ", " << curl_easy_strerror(res);
-            // no need to log POST parameters here
-            rv = makeNetworkError();
-            break;
-        }
+void Client::Impl::addConditionalHeaders(CurlSession& session, const std::string& url) const
+{
+    HttpValidatorCache::Validators validators;
 
-        if (cs->getResponseCode() != 201)
-        {
-            LOG(ERROR) << fname << ": POST " << url << " failed. "
-                       << cs->getResponseCode() << ", error message: "
-                       << cs->getErrorMessage();
-            rv = makeError(cs->getResponseCode(), Status::FACILITY_HTTP);
-            break;
-        }
-    } while (false);
+    if (!httpCache_.getValidators(url, validators))
+        return;
 
-    if (rv.isError())
-        LOG(ERROR) << fname << ": " << rv;
+    if (!validators.etag.empty())
+        session.addHeader("If-None-Match: " + validators.etag);
 
-    return rv;
+    if (!validators.lastModified.empty())
+        session.addHeader("If-Modified-Since: " + validators.lastModified);
+}
+
+HttpValidatorCache::Validators Client::Impl::getValidators(const CurlSession& session)
+{
+    HttpValidatorCache::Validators validators;
+    validators.etag = session.getResponseHeader(kStrETag);
+    validators.lastModified = session.getResponseHeader(kStrLastModified);
+
+    return validators;
+}
+
+void Client::Impl::failUpload(const char* fname, const CompletionCallback& callback)
+{
+    LOG(ERROR) << fname << ": failed to create CURL session";
+
+    Status rv = makeError();
+    LOG(ERROR) << fname << ": " << rv;
+
+    if (callback)
+        callback(rv);
+}
+
+void Client::Impl::addJsonFormField(CurlSession& session, CString key, std::string& json) const
+{
+    if (jsonEncoding_ == Client::ENCODING_IDENTITY  ||  json.size() < jsonEncodingMinSize_)
+    {
+        session.addFormField(key, move_ref<std::string>(json), "application/json");
+        return;
+    }
+
+    const bool isGzip = jsonEncoding_ == Client::ENCODING_GZIP;
+    std::string compressed;
+
+    if (!compressString(json, isGzip, jsonEncodingLevel_, compressed))
+    {
+        LOG(WARNING) << "Unable to compress JSON with level " << jsonEncodingLevel_ << ", sending it as is";
+        session.addFormField(key, move_ref<std::string>(json), "application/json");
+        return;
+    }
+
+    session.addFormField(key, move_ref<std::string>(compressed), "application/json",
+                         isGzip ? "gzip" : "deflate");
 }
 
 std::string Client::Impl::getInstrumentsUrl(id_t accountId) const
@@ -1172,6 +1890,54 @@ std::string Client::Impl::getInstrumentsUrl(id_t accountId) const
     return accountsUrl_ + toString(accountId) + "/instruments/";
 }
 
+// Query parameter value, as in application/x-www-form-urlencoded
+static std::string urlEncode(const std::string& value)
+{
+    static const char* const hexDigits = "0123456789ABCDEF";
+    std::string encoded;
+    encoded.reserve(value.size());
+
+    for (size_t i = 0; i < value.size(); ++i)
+    {
+        const unsigned char c = value[i];
+
+        if (isalnum(c)  ||  c == '-'  ||  c == '_'  ||  c == '.'  ||  c == '~')
+            encoded.push_back(c);
+        else
+        {
+            encoded.push_back('%');
+            encoded.push_back(hexDigits[c >> 4]);
+            encoded.push_back(hexDigits[c & 0x0F]);
+        }
+    }
+
+    return encoded;
+}
+
+static void addQueryParam(std::string& url, const char* name, const std::string& value)
+{
+    url += url.find('?') == std::string::npos ? '?' : '&';
+    url += name;
+    url += '=';
+    url += urlEncode(value);
+}
+
+std::string Client::Impl::getInstrumentsUrl(id_t accountId, const InstrumentQuery& query) const
+{
+    std::string url = getInstrumentsUrl(accountId);
+
+    if (!query.name.empty())
+        addQueryParam(url, kStrName, query.name);
+
+    if (!query.type.empty())
+        addQueryParam(url, kStrInstrumentType, query.type);
+
+    if (query.pageSize > 0)
+        addQueryParam(url, "page_size", toString(query.pageSize));
+
+    return url;
+}
+
 std::string Client::Impl::getAccountUrl(id_t accountId) const
 {
     return accountsUrl_ + toString(accountId) + '/';
@@ -1199,7 +1965,7 @@ std::string Client::Impl::getTimeSeriesUrl(id_t accountId, id_t instrumentId) co
 
 CurlSessionPtr Client::Impl::createSession()
 {
-    CurlSessionPtr sessionPtr = CurlSession::create(token_);
+    CurlSessionPtr sessionPtr = CurlSession::create(token_, curlFactory_);
 
     // apply stored options here, there is no reason to pass them all
     // to CurlSession::create()
@@ -1210,8 +1976,11 @@ CurlSessionPtr Client::Impl::createSession()
         session.setLowSpeed(lowSpeedTime_, lowSpeedLimit_);
         session.setSslVerifyPeer(sslVerifyPeer_);
         session.setProxy(proxy_);
-        if (!caBundlePath_.empty())
+        if (caBundle_)
+            session.setCaBundle(caBundle_);
+        else if (!caBundlePath_.empty())
             session.setCaBundlePath(caBundlePath_);
+        session.setAbortGeneration(abortGeneration_);
     }
 
     return boost::move(sessionPtr);
@@ -1227,24 +1996,46 @@ std::string SdkVersion::toString() const
     return boost::str(boost::format("%d.%d.%d") % int(major) % int(minor) % int(revision));
 }
 
-Status findCameraByName(Client& client, id_t accountId, const std::string& name,
-                        Instrument& cameraInfo)
+InstrumentCursor::InstrumentCursor(Client& client, id_t accountId, const InstrumentQuery& query)
+    : client_(client)
+    , accountId_(accountId)
+    , query_(query)
+    , pos_(0)
+    , numPages_(0)
+    , status_(makeSuccess())
 {
-    Instruments instruments;
-    Status status = client.queryInstrumentsList(accountId, instruments);
+}
 
-    if (status.isError())
-        return status;
+bool InstrumentCursor::next(Instrument& instrument)
+{
+    // page may be empty, if server doesn't filter, but paginates
+    while (pos_ == page_.size())
+    {
+        if (status_.isError()  ||  (numPages_ > 0  &&  nextCursor_.empty()))
+            return false;
 
-    for (size_t i = 0; i < instruments.size(); ++i)
-        if (instruments[i].name == name
-            && instruments[i].type == kStrCamera)
-        {
-            cameraInfo = instruments[i];
-            return makeSuccess();
-        }
+        Instruments page;
+        std::string nextCursor;
+        status_ = client_.queryInstrumentsList(accountId_, query_, nextCursor_, page, nextCursor);
+
+        if (status_.isError())
+            return false;
+
+        page_.swap(page);
+        pos_ = 0;
+        nextCursor_.swap(nextCursor);
+        ++numPages_;
+    }
+
+    instrument = page_[pos_++];
+
+    return true;
+}
 
-    return makeError(Status::NOT_FOUND);
+Status findCameraByName(Client& client, id_t accountId, const std::string& name,
+                        Instrument& cameraInfo)
+{
+    return client.findInstrument(accountId, name, kStrCamera, cameraInfo);
 }
 
 Status registerNewCamera(Client& client, id_t accountId, const std::string& name,
@@ -43,10 +43,17 @@ const char* kStrLabel   = "label";
 
 const char* kStrErrorMessages = "error_messages";
 const char* kStrSimple = "simple";
+const char* kStrPersistent = "persistent";
+const char* kStrPriority = "priority";
 const char* kStrCamera = "camera";
 const char* kStrTrue = "true";
 const char* kStrFalse = "false";
 const char* kStrUpdate = "update";
 const char* kStrPoints = "points";
+const char* kStrRetryAfter = "Retry-After";
+const char* kStrNext = "next";
+const char* kStrResults = "results";
+const char* kStrETag = "ETag";
+const char* kStrLastModified = "Last-Modified";
 }
 }
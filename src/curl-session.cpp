@@ -6,20 +6,18 @@
 #include "private/const-strings.h"
 #include "easylogging++.h"
 #include "boost/noncopyable.hpp"
-#include "boost/make_shared.hpp"
-#include "private/PoolBasedCurlFactory.h"
 
 namespace prism
 {
 namespace connect
 {
 
-CurlSessionPtr CurlSession::create(const std::string& token)
+CurlSessionPtr CurlSession::create(const std::string& token, CurlFactoryPtr curlFactory)
 {
     CurlSessionPtr rv(new CurlSession());
     CurlSession& ref = *rv;
 
-    if (ref.init(token))
+    if (ref.init(token, curlFactory))
         return boost::move(rv);
 
     return CurlSessionPtr();
@@ -29,9 +27,9 @@ CurlSession::~CurlSession()
 {
 }
 
-bool CurlSession::init(const std::string& token)
+bool CurlSession::init(const std::string& token, CurlFactoryPtr curlFactory)
 {
-    if ( !CurlWrapper::init(boost::make_shared<prism::PoolBasedCurlFactory>()) )
+    if ( !CurlWrapper::init(curlFactory) )
         return false;
 
     setHeader(std::string("Authorization: Token ").append(token));
@@ -39,17 +37,15 @@ bool CurlSession::init(const std::string& token)
     return true;
 }
 
-CURLcode CurlSession::performRequest(CString url)
+void CurlSession::completeRequest(CURLcode result)
 {
-    CURLcode rv = CurlWrapper::performRequest(url);
+    CurlWrapper::completeRequest(result);
 
     errorMessage_.clear();
     long responseCode = getResponseCode();
 
     if (responseCode >= 400  &&  responseCode < 500)
         parseResponseForMessage();
-
-    return rv;
 }
 
 void CurlSession::parseResponseForMessage()
@@ -4,6 +4,14 @@
 #include "private/curl-wrapper.h"
 #include "easylogging++.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 namespace prism
 {
 namespace connect
@@ -30,6 +38,14 @@ bool CurlWrapper::init(CurlFactoryPtr curlFactory)
     curl_easy_setopt(curl_, CURLOPT_FOLLOWLOCATION, 1);
     curl_easy_setopt(curl_, CURLOPT_MAXREDIRS, 10);
 
+    // handles are reused, keep idle connections alive between requests
+    curl_easy_setopt(curl_, CURLOPT_TCP_KEEPALIVE, 1L);
+
+#if LIBCURL_VERSION_NUM >= 0x073e00
+    // fewer, larger reads of file payloads, default is 64 KB
+    curl_easy_setopt(curl_, CURLOPT_UPLOAD_BUFFERSIZE, 512L * 1024);
+#endif
+
     curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, writeFunctionThunk);
     curl_easy_setopt(curl_, CURLOPT_WRITEDATA, (CurlCallbacks*)this);
     curl_easy_setopt(curl_, CURLOPT_HEADERFUNCTION, headerFunctionThunk);
@@ -40,6 +56,8 @@ bool CurlWrapper::init(CurlFactoryPtr curlFactory)
 
 CurlWrapper::~CurlWrapper()
 {
+    releaseForm();
+
     if (curl_)
     {
         curlFactory_->destroy(curl_);
@@ -53,35 +71,324 @@ CurlWrapper::~CurlWrapper()
     }
 }
 
-CURLcode CurlWrapper::httpPostForm(const std::string& url)
+#if CONNECT_CURL_HAS_MIME
+
+// Form part data read by libcurl straight from buffer it doesn't own
+struct FormBuffer
+{
+    FormBuffer(const void* data, size_t size)
+        : data(static_cast<const char*>(data))
+        , size(size)
+        , pos(0)
+    {
+    }
+
+    static size_t read(char* buffer, size_t size, size_t nitems, void* arg)
+    {
+        FormBuffer* self = static_cast<FormBuffer*>(arg);
+        const size_t len = std::min(size * nitems, self->size - self->pos);
+
+        memcpy(buffer, self->data + self->pos, len);
+        self->pos += len;
+
+        return len;
+    }
+
+    // called, when request is resent e.g. after redirect
+    static int seek(void* arg, curl_off_t offset, int origin)
+    {
+        FormBuffer* self = static_cast<FormBuffer*>(arg);
+
+        if (origin != SEEK_SET  ||  offset < 0  ||  (size_t)offset > self->size)
+            return CURL_SEEKFUNC_CANTSEEK;
+
+        self->pos = offset;
+        return CURL_SEEKFUNC_OK;
+    }
+
+    static void free(void* arg)
+    {
+        delete static_cast<FormBuffer*>(arg);
+    }
+
+    const char* data;
+    size_t size;
+    size_t pos;
+};
+
+// Form part data read by libcurl from file descriptor
+struct FormFile
+{
+    explicit FormFile(int fd)
+        : fd(fd)
+    {
+    }
+
+    static size_t read(char* buffer, size_t size, size_t nitems, void* arg)
+    {
+        const ssize_t len = ::read(static_cast<FormFile*>(arg)->fd, buffer, size * nitems);
+        return len < 0 ? CURL_READFUNC_ABORT : len;
+    }
+
+    static int seek(void* arg, curl_off_t offset, int origin)
+    {
+        return lseek(static_cast<FormFile*>(arg)->fd, offset, origin) == -1
+                ? CURL_SEEKFUNC_FAIL
+                : CURL_SEEKFUNC_OK;
+    }
+
+    static void free(void* arg)
+    {
+        FormFile* self = static_cast<FormFile*>(arg);
+        close(self->fd);
+        delete self;
+    }
+
+    int fd;
+};
+
+curl_mimepart* CurlWrapper::addFormPart(CString key, CString mimeType)
+{
+    if (!mime_)
+        mime_ = curl_mime_init(curl_);
+
+    curl_mimepart* part = curl_mime_addpart(mime_);
+    curl_mime_name(part, key);
+
+    if (mimeType.ptr())
+        curl_mime_type(part, mimeType);
+
+    return part;
+}
+
+void CurlWrapper::addFormField(CString key, CString value)
+{
+    curl_mime_data(addFormPart(key, NULL), value, CURL_ZERO_TERMINATED);
+}
+
+void CurlWrapper::addFormField(CString key, CString value, CString mimeType)
+{
+    curl_mime_data(addFormPart(key, mimeType), value, CURL_ZERO_TERMINATED);
+}
+
+void CurlWrapper::addFormField(CString key, move_ref<std::string> value, CString mimeType)
+{
+    formValues_.push_back(std::string());
+    formValues_.back().swap(value.ref);
+
+    const std::string& data = formValues_.back();
+    curl_mime_data_cb(addFormPart(key, mimeType), data.size(), FormBuffer::read,
+                      FormBuffer::seek, FormBuffer::free, new FormBuffer(data.data(), data.size()));
+}
+
+void CurlWrapper::addFormField(CString key, move_ref<std::string> value, CString mimeType,
+                               CString contentEncoding)
+{
+    formValues_.push_back(std::string());
+    formValues_.back().swap(value.ref);
+
+    const std::string& data = formValues_.back();
+    curl_mimepart* part = addFormPart(key, mimeType);
+    curl_mime_data_cb(part, data.size(), FormBuffer::read,
+                      FormBuffer::seek, FormBuffer::free, new FormBuffer(data.data(), data.size()));
+
+    const std::string header = std::string("Content-Encoding: ") + contentEncoding.ptr();
+    curl_mime_headers(part, curl_slist_append(NULL, header.c_str()), 1);
+}
+
+void CurlWrapper::addFormFile(CString key, CString filePath, CString mimeType)
+{
+    curl_mimepart* part = addFormPart(key, mimeType);
+    const char* fileName = strrchr(filePath, '/');
+    curl_mime_filename(part, fileName ? fileName + 1 : filePath.ptr());
+
+    const int fd = open(filePath, O_RDONLY);
+    struct stat st;
+
+    if (fd == -1  ||  fstat(fd, &st) == -1)
+    {
+        LOG(ERROR) << "CurlWrapper::addFormFile(): can't open " << filePath.ptr()
+                   << ": " << strerror(errno);
+
+        if (fd != -1)
+            close(fd);
+
+        // let libcurl fail request with CURLE_READ_ERROR
+        curl_mime_filedata(part, filePath);
+        return;
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    curl_mime_data_cb(part, st.st_size, FormFile::read, FormFile::seek, FormFile::free,
+                      new FormFile(fd));
+}
+
+void CurlWrapper::addFormFile(CString key, const void* data, size_t dataSize, CString mimeType,
+                              CString fileName)
+{
+    curl_mimepart* part = addFormPart(key, mimeType);
+    curl_mime_filename(part, *fileName.ptr() ? fileName.ptr() : "dummyname");
+    curl_mime_data_cb(part, dataSize, FormBuffer::read, FormBuffer::seek, FormBuffer::free,
+                      new FormBuffer(data, dataSize));
+}
+
+void CurlWrapper::prepareHttpPostForm(const std::string& url)
+{
+    curl_easy_setopt(curl_, CURLOPT_MIMEPOST, mime_);
+    prepareRequest(url);
+}
+
+void CurlWrapper::releaseForm()
+{
+    if (mime_)
+    {
+        // handle is reused, so it must not keep pointer to freed form
+        curl_easy_setopt(curl_, CURLOPT_MIMEPOST, NULL);
+        curl_mime_free(mime_);
+        mime_ = 0;
+    }
+
+    formValues_.clear();
+}
+
+#else // CONNECT_CURL_HAS_MIME
+
+void CurlWrapper::addFormField(CString key, CString value)
+{
+    curl_formadd(&post_, &last_,
+                 CURLFORM_COPYNAME, key.ptr(),
+                 CURLFORM_COPYCONTENTS, value.ptr(),
+                 CURLFORM_END);
+}
+
+void CurlWrapper::addFormField(CString key, CString value, CString mimeType)
+{
+    curl_formadd(&post_, &last_,
+                 CURLFORM_COPYNAME, key.ptr(),
+                 CURLFORM_COPYCONTENTS, value.ptr(),
+                 CURLFORM_CONTENTTYPE, mimeType.ptr(),
+                 CURLFORM_END);
+}
+
+void CurlWrapper::addFormField(CString key, move_ref<std::string> value, CString mimeType)
+{
+    formValues_.push_back(std::string());
+    formValues_.back().swap(value.ref);
+
+    const std::string& data = formValues_.back();
+    curl_formadd(&post_, &last_,
+                 CURLFORM_COPYNAME, key.ptr(),
+                 CURLFORM_PTRCONTENTS, data.data(),
+                 CURLFORM_CONTENTSLENGTH, (long)data.size(),
+                 CURLFORM_CONTENTTYPE, mimeType.ptr(),
+                 CURLFORM_END);
+}
+
+void CurlWrapper::addFormField(CString key, move_ref<std::string> value, CString mimeType,
+                               CString contentEncoding)
+{
+    formValues_.push_back(std::string());
+    formValues_.back().swap(value.ref);
+
+    const std::string header = std::string("Content-Encoding: ") + contentEncoding.ptr();
+    formHeaders_.push_back(curl_slist_append(NULL, header.c_str()));
+
+    const std::string& data = formValues_.back();
+    curl_formadd(&post_, &last_,
+                 CURLFORM_COPYNAME, key.ptr(),
+                 CURLFORM_PTRCONTENTS, data.data(),
+                 CURLFORM_CONTENTSLENGTH, (long)data.size(),
+                 CURLFORM_CONTENTTYPE, mimeType.ptr(),
+                 CURLFORM_CONTENTHEADER, formHeaders_.back(),
+                 CURLFORM_END);
+}
+
+void CurlWrapper::addFormFile(CString key, CString filePath, CString mimeType)
+{
+    curl_formadd(&post_, &last_,
+                 CURLFORM_COPYNAME, key.ptr(),
+                 CURLFORM_FILE, filePath.ptr(),
+                 CURLFORM_CONTENTTYPE, mimeType.ptr(),
+                 CURLFORM_END);
+}
+
+void CurlWrapper::addFormFile(CString key, const void* data, size_t dataSize, CString mimeType,
+                              CString fileName)
+{
+    curl_formadd(&post_, &last_,
+                 CURLFORM_COPYNAME, key.ptr(),
+                 CURLFORM_BUFFER, *fileName.ptr() ? fileName.ptr() : "dummyname",
+                 CURLFORM_BUFFERPTR, data,
+                 CURLFORM_BUFFERLENGTH, dataSize,
+                 CURLFORM_CONTENTTYPE, mimeType.ptr(),
+                 CURLFORM_END);
+}
+
+void CurlWrapper::prepareHttpPostForm(const std::string& url)
 {
     curl_easy_setopt(curl_, CURLOPT_HTTPPOST, post_);
-    CURLcode rv = performRequest(url);
-    curl_formfree(post_);
-    last_ = post_ = 0;
-    return rv;
+    prepareRequest(url);
+}
+
+void CurlWrapper::releaseForm()
+{
+    if (post_)
+    {
+        curl_formfree(post_);
+        last_ = post_ = 0;
+    }
+
+    for (std::list<curl_slist*>::iterator it = formHeaders_.begin(); it != formHeaders_.end(); ++it)
+        curl_slist_free_all(*it);
+
+    formHeaders_.clear();
+    formValues_.clear();
 }
 
+#endif // CONNECT_CURL_HAS_MIME
+
 struct CurlPerformance
 {
     CURLINFO info;
     const char* description;
+    double RequestTimings::* value;
 };
 
 CurlPerformance curlPerf[] =
 {
-    {CURLINFO_NAMELOOKUP_TIME, "Name lookup time, s: "},
-    {CURLINFO_CONNECT_TIME, "Connect time, s: "},
-    {CURLINFO_APPCONNECT_TIME, "App. connect time, s: "},
-    {CURLINFO_PRETRANSFER_TIME, "Start transfer time, s: "},
-    {CURLINFO_STARTTRANSFER_TIME, "Start transfer time, s: "},
-    {CURLINFO_TOTAL_TIME, "Total time, s: "},
-    {CURLINFO_REDIRECT_TIME, "Redirect time, s: "},
-    {CURLINFO_SPEED_DOWNLOAD, "Download speed, bytes/s: "},
-    {CURLINFO_SPEED_UPLOAD, "Upload speed, bytes/s: "}
+    {CURLINFO_NAMELOOKUP_TIME, "Name lookup time, s: ", &RequestTimings::nameLookupTime},
+    {CURLINFO_CONNECT_TIME, "Connect time, s: ", &RequestTimings::connectTime},
+    {CURLINFO_APPCONNECT_TIME, "App. connect time, s: ", &RequestTimings::appConnectTime},
+    {CURLINFO_PRETRANSFER_TIME, "Pretransfer time, s: ", &RequestTimings::preTransferTime},
+    {CURLINFO_STARTTRANSFER_TIME, "Start transfer time, s: ", &RequestTimings::startTransferTime},
+    {CURLINFO_TOTAL_TIME, "Total time, s: ", &RequestTimings::totalTime},
+    {CURLINFO_REDIRECT_TIME, "Redirect time, s: ", &RequestTimings::redirectTime},
+    {CURLINFO_SPEED_DOWNLOAD, "Download speed, bytes/s: ", &RequestTimings::downloadSpeed},
+    {CURLINFO_SPEED_UPLOAD, "Upload speed, bytes/s: ", &RequestTimings::uploadSpeed},
+    {CURLINFO_SIZE_UPLOAD, "Uploaded, bytes: ", &RequestTimings::sizeUpload},
+    {CURLINFO_SIZE_DOWNLOAD, "Downloaded, bytes: ", &RequestTimings::sizeDownload}
 };
 
-CURLcode CurlWrapper::performRequest(CString url)
+void CurlWrapper::setAbortGeneration(const boost::atomic<unsigned>& generation)
+{
+    abortGeneration_ = &generation;
+    startGeneration_ = generation.load(boost::memory_order_relaxed);
+
+    // libcurl calls it at least once per second during transfer
+#if CONNECT_CURL_HAS_XFERINFO
+    curl_easy_setopt(curl_, CURLOPT_XFERINFOFUNCTION, xferInfoThunk);
+    curl_easy_setopt(curl_, CURLOPT_XFERINFODATA, this);
+#else
+    curl_easy_setopt(curl_, CURLOPT_PROGRESSFUNCTION, progressThunk);
+    curl_easy_setopt(curl_, CURLOPT_PROGRESSDATA, this);
+#endif
+    curl_easy_setopt(curl_, CURLOPT_NOPROGRESS, 0L);
+}
+
+void CurlWrapper::prepareRequest(CString url)
 {
     if (httpHeader_)
         curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, httpHeader_);
@@ -90,29 +397,101 @@ CURLcode CurlWrapper::performRequest(CString url)
         curl_easy_setopt(curl_, CURLOPT_PROXY, proxy_.c_str());
 
     responseBody_.clear();
+    responseBodySink_ = 0;
     responseHeaders_.clear();
+    responseCode_ = 0;
     curl_easy_setopt(curl_, CURLOPT_URL, url.ptr());
+}
+
+size_t CurlWrapper::writeFunction(void* ptr, size_t size, size_t nmemb)
+{
+    long responseCode = 0;
+
+    // status line is received by now, also of the last redirect
+    if (responseBodySink_
+            &&  curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &responseCode) == CURLE_OK
+            &&  responseCode == 200)
+    {
+        responseBodySink_->write((const char*) ptr, size * nmemb);
+    }
+    else
+    {
+        responseBody_.append((char*) ptr, size * nmemb);
+    }
+
+    return size * nmemb;
+}
+
+std::string CurlWrapper::getResponseHeader(CString name) const
+{
+    const size_t nameLen = strlen(name);
+    std::string rv;
+    size_t pos = 0;
+
+    // headers of all responses are collected, if there were redirects, so
+    // the last one wins
+    while (pos < responseHeaders_.size())
+    {
+        size_t end = responseHeaders_.find('\n', pos);
+
+        if (end == std::string::npos)
+            end = responseHeaders_.size();
+
+        if (end - pos > nameLen
+                &&  responseHeaders_[pos + nameLen] == ':'
+                &&  !strncasecmp(responseHeaders_.c_str() + pos, name, nameLen))
+        {
+            const size_t first = responseHeaders_.find_first_not_of(" \t", pos + nameLen + 1);
+            const size_t last = responseHeaders_.find_last_not_of(" \t\r", end - 1);
+
+            rv = (first != std::string::npos  &&  first <= last  &&  last < end)
+                    ? responseHeaders_.substr(first, last - first + 1)
+                    : std::string();
+        }
+
+        pos = end + 1;
+    }
+
+    return rv;
+}
+
+CURLcode CurlWrapper::perform()
+{
     CURLcode rv = curl_easy_perform(curl_);
+    completeRequest(rv);
+    return rv;
+}
+
+void CurlWrapper::completeRequest(CURLcode /*result*/)
+{
+    releaseForm();
 
     responseCode_ = 0;
     curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &responseCode_);
 
-#if DUMP_CURL_PERF_DATA
-    size_t numEntries = sizeof(curlPerf)/sizeof(curlPerf[0]);
-    double value;
+    // timings are cheap to collect, so they are for every request, see
+    // Client::getMetrics()
+    timings_ = RequestTimings();
+    const size_t numEntries = sizeof(curlPerf)/sizeof(curlPerf[0]);
 
     for (size_t i = 0; i < numEntries; ++i)
+    {
+        double value = 0;
+
         if (curl_easy_getinfo(curl_, curlPerf[i].info, &value) == CURLE_OK)
         {
+            timings_.*curlPerf[i].value = value;
+
+#if DUMP_CURL_PERF_DATA
             LOG(DEBUG) << curlPerf[i].description << value;
-        }
 #endif
+        }
+    }
 
-    double value = 0;
-    if (curl_easy_getinfo(curl_, CURLINFO_SIZE_UPLOAD, &value) == CURLE_OK  &&  value > 0)
-        LOG(DEBUG) << "Uploaded, bytes: " << value;
+    curl_easy_getinfo(curl_, CURLINFO_NUM_CONNECTS, &timings_.numConnects);
 
-    return rv;
+    if (timings_.sizeUpload > 0)
+        LOG(DEBUG) << "Uploaded, bytes: " << timings_.sizeUpload;
 }
 
 }
@@ -2,6 +2,16 @@
  * Copyright (C) 2017 Prism Skylabs
  */
 #include "payload-holder.h"
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include "boost/filesystem.hpp"
+#include "boost/thread/locks.hpp"
+#include "boost/thread/mutex.hpp"
+#include "easylogging++.h"
+#include "private/util.h"
 
 namespace prism
 {
@@ -11,6 +21,14 @@ namespace connect
 class PayloadHolder::Impl
 {
 public:
+    Impl()
+        : fileSize_(0)
+        , isAutodelete_(false)
+        , mapping_(0)
+        , isMapFailed_(false)
+    {
+    }
+
     ~Impl();
 
     bool isFile() const
@@ -30,24 +48,75 @@ public:
 
     const uint8_t* getData() const
     {
-        return buf_.data();
+        return isFile() ? mapFile() : buf_.data();
     }
 
     size_t getDataSize() const
     {
-        return buf_.size();
+        return isFile() ? fileSize_ : buf_.size();
     }
 
 private:
     friend PayloadHolderPtr makePayloadHolderByMovingData(move_ref<ByteBuffer> data, const std::string& mimeType);
     friend PayloadHolderPtr makePayloadHolderByCopyingData(const void* data, size_t dataSize, const std::string& mimeType);
     friend PayloadHolderPtr makePayloadHolderByReferencingFileAutodelete(const std::string& filePath);
+    friend PayloadHolderPtr makePayloadHolderByReferencingFile(const std::string& filePath);
+
+    const uint8_t* mapFile() const;
 
     ByteBuffer buf_;
     std::string filePath_;
     std::string mimeType_;
+    size_t fileSize_;
+    bool isAutodelete_;
+
+    // file payload may be accessed by upload and journal threads at once
+    mutable boost::mutex mutex_;
+    mutable void* mapping_;
+    mutable bool isMapFailed_;
 };
 
+// Caller must not lock mutex_ before calling.
+const uint8_t* PayloadHolder::Impl::mapFile() const
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+
+    if (mapping_  ||  isMapFailed_)
+        return static_cast<const uint8_t*>(mapping_);
+
+    // file is mapped once, failure isn't retried
+    isMapFailed_ = true;
+
+    // mmap() refuses empty mapping
+    if (fileSize_ == 0)
+        return NULL;
+
+    const int fd = open(filePath_.c_str(), O_RDONLY);
+
+    if (fd == -1)
+    {
+        LOG(ERROR) << "Unable to open payload file " << filePath_ << ": " << strerror(errno);
+        return NULL;
+    }
+
+    void* mapping = mmap(NULL, fileSize_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        LOG(ERROR) << "Unable to map payload file " << filePath_ << ": " << strerror(errno);
+        return NULL;
+    }
+
+    // payload is read once from start to end
+    madvise(mapping, fileSize_, MADV_SEQUENTIAL);
+
+    mapping_ = mapping;
+    isMapFailed_ = false;
+
+    return static_cast<const uint8_t*>(mapping_);
+}
+
 PayloadHolder::PayloadHolder()
     : pImpl_(new Impl())
 {
@@ -75,9 +144,26 @@ PayloadHolderPtr makePayloadHolderByCopyingData(const void* data, size_t dataSiz
 }
 
 PayloadHolderPtr makePayloadHolderByReferencingFileAutodelete(const std::string& filePath)
+{
+    PayloadHolderPtr rv = makePayloadHolderByReferencingFile(filePath);
+    rv->impl().isAutodelete_ = true;
+
+    return rv;
+}
+
+PayloadHolderPtr makePayloadHolderByReferencingFile(const std::string& filePath)
 {
     PayloadHolderPtr rv(new PayloadHolder());
     rv->impl().filePath_ = filePath;
+    rv->impl().mimeType_ = mimeTypeFromFilePath(filePath);
+
+    boost::system::error_code ec;
+    const boost::uintmax_t fileSize = boost::filesystem::file_size(filePath, ec);
+
+    if (ec)
+        LOG(ERROR) << "Unable to get size of payload file " << filePath << ": " << ec.message();
+    else
+        rv->impl().fileSize_ = static_cast<size_t>(fileSize);
 
     return rv;
 }
@@ -109,7 +195,10 @@ size_t PayloadHolder::getDataSize() const
 
 PayloadHolder::Impl::~Impl()
 {
-    if (isFile())
+    if (mapping_)
+        munmap(mapping_, fileSize_);
+
+    if (isFile()  &&  isAutodelete_)
         removeFile(filePath_);
 }
 
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2018 Prism Skylabs
+ */
+#include "request-metrics.h"
+#include <algorithm>
+#include <cmath>
+
+namespace prism
+{
+namespace connect
+{
+
+DurationHistogram::DurationHistogram()
+    : count_(0)
+    , min_(0)
+    , max_(0)
+    , sum_(0)
+{
+    counts_.fill(0);
+}
+
+void DurationHistogram::record(uint64_t valueUs)
+{
+    const uint64_t maxValue = (uint64_t(1) << MAX_VALUE_BITS) - 1;
+    const uint64_t value = std::min(valueUs, maxValue);
+
+    ++counts_[getBucket(value)];
+    min_ = count_ ? std::min(min_, value) : value;
+    max_ = std::max(max_, value);
+    sum_ += value;
+    ++count_;
+}
+
+void DurationHistogram::merge(const DurationHistogram& other)
+{
+    if (!other.count_)
+        return;
+
+    for (size_t i = 0; i < counts_.size(); ++i)
+        counts_[i] += other.counts_[i];
+
+    min_ = count_ ? std::min(min_, other.min_) : other.min_;
+    max_ = std::max(max_, other.max_);
+    sum_ += other.sum_;
+    count_ += other.count_;
+}
+
+uint64_t DurationHistogram::getPercentileUs(double percent) const
+{
+    if (!count_)
+        return 0;
+
+    if (percent <= 0)
+        return min_;
+
+    // rank of value, 1-based
+    const uint64_t rank = std::max(uint64_t(1),
+            uint64_t(std::ceil(std::min(percent, 100.0) / 100 * count_)));
+    uint64_t numCounted = 0;
+
+    for (size_t i = 0; i < counts_.size(); ++i)
+    {
+        numCounted += counts_[i];
+
+        if (numCounted >= rank)
+            return std::max(min_, std::min(getBucketValue(i), max_));
+    }
+
+    return max_;
+}
+
+// Values below 2 * SUB_BUCKET_COUNT have bucket each. Larger ones are
+// counted by their SUB_BUCKET_BITS + 1 most significant bits, the highest
+// of which is 1, and by their shift.
+size_t DurationHistogram::getBucket(uint64_t value)
+{
+    if (value < 2 * SUB_BUCKET_COUNT)
+        return size_t(value);
+
+    int msb = 0;
+
+    for (uint64_t v = value; v > 1; v >>= 1)
+        ++msb;
+
+    const int shift = msb - SUB_BUCKET_BITS;
+
+    return size_t(shift) * SUB_BUCKET_COUNT + size_t(value >> shift);
+}
+
+uint64_t DurationHistogram::getBucketValue(size_t bucket)
+{
+    if (bucket < 2 * SUB_BUCKET_COUNT)
+        return bucket;
+
+    const size_t shift = bucket / SUB_BUCKET_COUNT - 1;
+    const uint64_t top = bucket - shift * SUB_BUCKET_COUNT;
+
+    return ((top + 1) << shift) - 1;
+}
+
+void RequestMetrics::merge(const RequestMetrics& other)
+{
+    numRequests += other.numRequests;
+    numFailed += other.numFailed;
+    numNewConnections += other.numNewConnections;
+    numBytesUploaded += other.numBytesUploaded;
+    numBytesDownloaded += other.numBytesDownloaded;
+
+    nameLookup.merge(other.nameLookup);
+    connect.merge(other.connect);
+    tlsHandshake.merge(other.tlsHandshake);
+    timeToFirstByte.merge(other.timeToFirstByte);
+    total.merge(other.total);
+}
+
+void mergeRequestMetrics(const RequestMetricsMap& from, RequestMetricsMap& to)
+{
+    for (RequestMetricsMap::const_iterator it = from.begin(); it != from.end(); ++it)
+        to[it->first].merge(it->second);
+}
+
+} // namespace connect
+} // namespace prism
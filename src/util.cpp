@@ -2,90 +2,22 @@
  * Copyright (C) 2016-2017 Prism Skylabs
  */
 #include "private/util.h"
+#include "private/IsoTimeFormatter.h"
 #include "domain-types.h"
 #include "private/const-strings.h"
 #include "rapidjson/document.h"
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/writer.h"
 #include "ctime"
+#include "cstring"
 #include "easylogging++.h"
+#include "zlib.h"
 
 namespace prism
 {
 namespace connect
 {
 
-class JsonValue
-{
-public:
-    JsonValue(rapidjson::Document::AllocatorType& allocator,
-              bool isArray = false)
-        : allocator_(allocator)
-    {
-        if (isArray)
-            value_.SetArray();
-        else
-            value_.SetObject();
-    }
-
-    operator rapidjson::Value& ()
-    {
-        return value_;
-    }
-
-    void addMember(const char* key, rapidjson::Value& objValue)
-    {
-        value_.AddMember(rapidjson::StringRef(key), objValue, allocator_);
-    }
-
-    void addMember(const char* key, const char* strValue)
-    {
-        rapidjson::Value value;
-        value.SetString(strValue, allocator_);
-        value_.AddMember(rapidjson::StringRef(key), value, allocator_);
-    }
-
-    void addMember(const char* key, const std::string& value)
-    {
-        addMember(key, value.c_str());
-    }
-
-    void addMember(const char* key, int intValue)
-    {
-        rapidjson::Value value;
-        value.SetInt(intValue);
-        value_.AddMember(rapidjson::StringRef(key), value, allocator_);
-    }
-
-    void pushBack(const char* strValue)
-    {
-        rapidjson::Value value;
-        value.SetString(strValue, allocator_);
-        value_.PushBack(value, allocator_);
-    }
-
-    void pushBack(const std::string& value)
-    {
-        pushBack(value.c_str());
-    }
-
-    void pushBack(int intValue)
-    {
-        rapidjson::Value value;
-        value.SetInt(intValue);
-        value_.PushBack(value, allocator_);
-    }
-
-    void pushBack(rapidjson::Value& objValue)
-    {
-        value_.PushBack(objValue, allocator_);
-    }
-
-private:
-    rapidjson::Value value_;
-    rapidjson::Document::AllocatorType& allocator_;
-};
-
 class JsonDoc
 {
 public:
@@ -171,6 +103,33 @@ private:
     rapidjson::Document::AllocatorType& allocator_;
 };
 
+// rapidjson output stream appending to caller's string, so that its
+// capacity is reused between calls
+class StringOutputStream
+{
+public:
+    typedef char Ch;
+
+    explicit StringOutputStream(std::string& str)
+        : str_(str)
+    {
+    }
+
+    void Put(char c)
+    {
+        str_ += c;
+    }
+
+    void Flush()
+    {
+    }
+
+private:
+    std::string& str_;
+};
+
+typedef rapidjson::Writer<StringOutputStream> JsonWriter;
+
 std::string toJsonString(const Instrument& instrument)
 {
     JsonDoc doc;
@@ -179,6 +138,34 @@ std::string toJsonString(const Instrument& instrument)
     return doc.toString();
 }
 
+bool compressString(const std::string& data, bool isGzip, int level, std::string& out)
+{
+    // windowBits beyond 15 select gzip wrapper
+    static const int kWindowBits = 15;
+    static const int kMemLevel = 8;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+
+    if (deflateInit2(&zs, level, Z_DEFLATED, isGzip ? kWindowBits + 16 : kWindowBits,
+                     kMemLevel, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+
+    // output fits into bound, so single deflate() call completes stream
+    out.resize(deflateBound(&zs, data.size()));
+
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    zs.avail_in = data.size();
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = out.size();
+
+    const int rv = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+
+    return rv == Z_STREAM_END;
+}
+
 std::string mimeTypeFromFilePath(const std::string& filePath)
 {
     typedef std::map<std::string, std::string> mapss_t;
@@ -210,19 +197,22 @@ static const size_t kFullTimeStrlen = 20; // Length of "2016-02-08T16:15:20\0"
 
 std::string toIsoTimeString(const timestamp_t& timestamp)
 {
-    using boost::chrono::system_clock;
-    static system_clock::time_point epochStart = system_clock::from_time_t(0);
-    system_clock::time_point now = epochStart + boost::chrono::seconds(timestamp/1000);
-    time_t time = system_clock::to_time_t(now);
-    tm* utcTime = gmtime(&time);
-    const size_t bufSize = 32;
-    char buffer[bufSize];
-    int numMs = timestamp % 1000;
-    snprintf(buffer, bufSize, "%04d-%02d-%02dT%02d:%02d:%02d.%03d",
-             utcTime->tm_year + 1900, utcTime->tm_mon + 1, utcTime->tm_mday,
-             utcTime->tm_hour, utcTime->tm_min, utcTime->tm_sec, numMs);
-
-    return buffer;
+    char buffer[IsoTimeFormatter::LENGTH];
+    IsoTimeFormatter().format(timestamp, buffer);
+
+    return std::string(buffer, IsoTimeFormatter::LENGTH);
+}
+
+static void writeIsoTime(JsonWriter& writer, IsoTimeFormatter& formatter, const timestamp_t& timestamp)
+{
+    char buffer[IsoTimeFormatter::LENGTH];
+    formatter.format(timestamp, buffer);
+    writer.String(buffer, IsoTimeFormatter::LENGTH);
+}
+
+static void writeKey(JsonWriter& writer, const char* key)
+{
+    writer.Key(key, strlen(key));
 }
 
 std::string toString(int value)
@@ -233,75 +223,124 @@ std::string toString(int value)
     return std::string(buf);
 }
 
-std::string toJsonString(const Counts& data)
+// Time-series data is written by rapidjson::Writer straight into output
+// string without building DOM, as batches may have thousands of items.
+
+void toJsonString(const Counts& data, std::string& out)
 {
-    JsonDoc doc(true);
-    rapidjson::Document::AllocatorType& allocator = doc.rawRef().GetAllocator();
+    out.clear();
+
+    std::vector<char> timestamps;
+    IsoTimeFormatter().format(data, timestamps);
 
-    doc.reserve(data.size());
+    StringOutputStream stream(out);
+    JsonWriter writer(stream);
+
+    writer.StartArray();
 
     for (size_t i = 0; i < data.size(); ++i)
     {
-        JsonValue obj(allocator);
-        obj.addMember(kStrTimestamp, toIsoTimeString(data[i].timestamp));
-        obj.addMember(kStrLabel, data[i].label);
-        obj.addMember(kStrValue, data[i].value);
-        doc.pushBack(obj);
+        const Count& count = data[i];
+
+        writer.StartObject();
+        writeKey(writer, kStrTimestamp);
+        writer.String(&timestamps[i * IsoTimeFormatter::LENGTH], IsoTimeFormatter::LENGTH);
+        writeKey(writer, kStrLabel);
+        writer.String(count.label.data(), count.label.size());
+        writeKey(writer, kStrValue);
+        writer.Int(count.value);
+        writer.EndObject();
     }
 
-    return doc.toString();
+    writer.EndArray();
 }
 
-std::string toJsonString(const Events& data)
+void toJsonString(const Events& data, std::string& out)
 {
-    JsonDoc doc(true);
-    rapidjson::Document::AllocatorType& allocator = doc.rawRef().GetAllocator();
+    out.clear();
+
+    IsoTimeFormatter formatter;
 
-    doc.reserve(data.size());
+    StringOutputStream stream(out);
+    JsonWriter writer(stream);
+
+    writer.StartArray();
 
     for (size_t i = 0; i < data.size(); ++i)
     {
-        JsonValue obj(allocator);
-        obj.addMember(kStrTimestamp, toIsoTimeString(data[i].timestamp));
-        doc.pushBack(obj);
+        writer.StartObject();
+        writeKey(writer, kStrTimestamp);
+        writeIsoTime(writer, formatter, data[i].timestamp);
+        writer.EndObject();
     }
 
-    return doc.toString();
+    writer.EndArray();
 }
 
-std::string toJsonString(const Tracks& tracks)
+void toJsonString(const Tracks& tracks, std::string& out)
 {
-    JsonDoc doc(true);
-    rapidjson::Document::AllocatorType& allocator = doc.rawRef().GetAllocator();
+    out.clear();
+
+    IsoTimeFormatter formatter;
 
-    doc.reserve(tracks.size());
+    StringOutputStream stream(out);
+    JsonWriter writer(stream);
+
+    writer.StartArray();
 
     for (size_t i = 0; i < tracks.size(); ++i)
     {
-        JsonValue jsonTrack(allocator);
-        const Track track = tracks[i];
-        jsonTrack.addMember(kStrObjectId, std::to_string(track.objectId));
-        jsonTrack.addMember(kStrTimestamp, toIsoTimeString(track.timestamp));
+        const Track& track = tracks[i];
+
+        // object ID is string, as it doesn't fit into JavaScript number
+        char objectId[24];
+        const int objectIdLen = snprintf(objectId, sizeof(objectId), "%lld", (long long)track.objectId);
 
-        JsonValue jsonPoints(allocator, true);
+        writer.StartObject();
+        writeKey(writer, kStrObjectId);
+        writer.String(objectId, objectIdLen);
+        writeKey(writer, kStrTimestamp);
+        writeIsoTime(writer, formatter, track.timestamp);
+        writeKey(writer, kStrPoints);
+        writer.StartArray();
 
         for (size_t j = 0; j < track.points.size(); ++j)
         {
-            JsonValue jsonPoint(allocator, true);
             const TrackPoint& tp = track.points[j];
 
-            jsonPoint.pushBack(tp.x);
-            jsonPoint.pushBack(tp.y);
-            jsonPoint.pushBack(tp.relativeTimeMs);
-
-            jsonPoints.pushBack(jsonPoint);
+            writer.StartArray();
+            writer.Int(tp.x);
+            writer.Int(tp.y);
+            writer.Int(tp.relativeTimeMs);
+            writer.EndArray();
         }
 
-        jsonTrack.addMember(kStrPoints, jsonPoints);
-        doc.pushBack(jsonTrack);
+        writer.EndArray();
+        writer.EndObject();
     }
 
-    return doc.toString();
+    writer.EndArray();
+}
+
+std::string toJsonString(const Counts& data)
+{
+    std::string rv;
+    toJsonString(data, rv);
+    return rv;
+}
+
+std::string toJsonString(const Events& data)
+{
+    std::string rv;
+    toJsonString(data, rv);
+    return rv;
+}
+
+std::string toJsonString(const Tracks& tracks)
+{
+    std::string rv;
+    toJsonString(tracks, rv);
+    return rv;
 }
 
 std::string toJsonString(const ObjectStream& os)